@@ -0,0 +1,523 @@
+/*
+ *  compress_stream.c: A stream compressing its input in independent
+ *  blocks on a pool of worker threads.
+ *
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ */
+
+#include <apr_thread_proc.h>
+#include <apr_thread_mutex.h>
+#include <apr_thread_cond.h>
+
+#include <zlib.h>
+#ifdef SVNRDUMP_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "svn_pools.h"
+#include "svn_io.h"
+
+#include "svn17_compat.h"
+#include "compress_stream.h"
+
+/* A block is cut in the middle of a revision once it gets this many
+   times larger than the block size. */
+#define MAX_BLOCK_FACTOR 8
+
+/* The states a block goes through. */
+enum block_state
+{
+  block_filling,
+  block_queued,
+  block_running,
+  block_done
+};
+
+/* One block of input and its compressed form. */
+struct compress_block
+{
+  enum block_state state;
+  svn_stringbuf_t *input;
+
+  /* Output buffer, sized by the producer before queueing. */
+  char *output;
+  apr_size_t output_size;
+  apr_size_t output_len;
+
+  /* Set by the worker if compression failed. */
+  svn_error_t *err;
+};
+
+/* Blocks live in a ring of NBLOCKS slots.  Block number N uses slot
+ * N % NBLOCKS; NEXT_FILL is the block being filled by the producer and
+ * NEXT_WRITE the oldest block not yet written to the target, so
+ * NEXT_FILL - NEXT_WRITE blocks are queued, running or done. */
+struct compress_stream
+{
+  svn_stream_t *target;
+  enum compress_format format;
+  int level;
+  apr_size_t block_size;
+
+  struct compress_block *blocks;
+  int nblocks;
+  apr_uint64_t next_fill;
+  apr_uint64_t next_write;
+
+  /* Worker threads; none means compressing in the producer. */
+  apr_thread_t **threads;
+  int nthreads;
+  svn_boolean_t shutdown;
+
+  /* Protects the block states and SHUTDOWN.  WORK is signalled when
+     a block is queued, DONE when one is compressed. */
+  apr_thread_mutex_t *mutex;
+  apr_thread_cond_t *work;
+  apr_thread_cond_t *done;
+
+  svn_boolean_t closed;
+  struct compress_stats stats;
+  apr_pool_t *pool;
+};
+
+svn_error_t *
+compress_parse_format(enum compress_format *format,
+                      const char *name)
+{
+  if (strcmp(name, "gzip") == 0)
+    *format = compress_gzip;
+  else if (strcmp(name, "zstd") == 0)
+    {
+#ifdef SVNRDUMP_HAVE_ZSTD
+      *format = compress_zstd;
+#else
+      return svn_error_create(SVN_ERR_UNSUPPORTED_FEATURE, NULL,
+                              _("This svnrdump was built without zstd "
+                                "support"));
+#endif
+    }
+  else
+    return svn_error_createf(SVN_ERR_CL_ARG_PARSING_ERROR, NULL,
+                             _("Unknown compression format '%s'"), name);
+  return SVN_NO_ERROR;
+}
+
+svn_error_t *
+compress_check_level(enum compress_format format,
+                     int level)
+{
+  int max_level = 9;
+
+#ifdef SVNRDUMP_HAVE_ZSTD
+  if (format == compress_zstd)
+    max_level = ZSTD_maxCLevel();
+#endif
+
+  if (level < -1 || level > max_level)
+    return svn_error_createf(SVN_ERR_CL_ARG_PARSING_ERROR, NULL,
+                             _("Invalid compression level %d; expected "
+                               "-1 to %d"),
+                             level, max_level);
+  return SVN_NO_ERROR;
+}
+
+/* Return an upper bound for the compressed size of LEN bytes in
+ * FORMAT. */
+static apr_size_t
+compress_bound(enum compress_format format,
+               apr_size_t len)
+{
+#ifdef SVNRDUMP_HAVE_ZSTD
+  if (format == compress_zstd)
+    return ZSTD_compressBound(len);
+#endif
+
+  /* compressBound() assumes the 6 bytes of zlib framing; gzip has 18. */
+  return compressBound(len) + 32;
+}
+
+/* Compress BLOCK in FORMAT at LEVEL.  This runs in a worker thread and
+ * must not allocate from any pool. */
+static svn_error_t *
+compress_block(struct compress_block *block,
+               enum compress_format format,
+               int level)
+{
+#ifdef SVNRDUMP_HAVE_ZSTD
+  if (format == compress_zstd)
+    {
+      size_t len = ZSTD_compress(block->output, block->output_size,
+                                 block->input->data, block->input->len,
+                                 level < 0 ? 3 : level);
+
+      if (ZSTD_isError(len))
+        return svn_error_createf(SVN_ERR_IO_WRITE_ERROR, NULL,
+                                 _("zstd compression failed: %s"),
+                                 ZSTD_getErrorName(len));
+      block->output_len = len;
+      return SVN_NO_ERROR;
+    }
+#endif
+
+  {
+    z_stream zs;
+    int zerr;
+
+    memset(&zs, 0, sizeof(zs));
+
+    /* A window of 15 + 16 asks for a gzip rather than a zlib wrapper. */
+    zerr = deflateInit2(&zs, level < 0 ? Z_DEFAULT_COMPRESSION : level,
+                        Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    if (zerr != Z_OK)
+      return svn_error_createf(SVN_ERR_IO_WRITE_ERROR, NULL,
+                               _("Can't initialize gzip compression: %s"),
+                               zs.msg ? zs.msg : "");
+
+    zs.next_in = (Bytef *)block->input->data;
+    zs.avail_in = (uInt)block->input->len;
+    zs.next_out = (Bytef *)block->output;
+    zs.avail_out = (uInt)block->output_size;
+
+    zerr = deflate(&zs, Z_FINISH);
+    block->output_len = zs.total_out;
+    deflateEnd(&zs);
+
+    if (zerr != Z_STREAM_END)
+      return svn_error_create(SVN_ERR_IO_WRITE_ERROR, NULL,
+                              _("gzip compression failed"));
+  }
+
+  return SVN_NO_ERROR;
+}
+
+#if APR_HAS_THREADS
+/* Thread body of a compression worker.  DATA is the compress_stream.
+ * Compress the oldest queued block until told to shut down. */
+static void * APR_THREAD_FUNC
+worker_thread(apr_thread_t *tid,
+              void *data)
+{
+  struct compress_stream *cs = data;
+
+  apr_thread_mutex_lock(cs->mutex);
+  while (1)
+    {
+      struct compress_block *block = NULL;
+      apr_uint64_t n;
+
+      for (n = cs->next_write; n < cs->next_fill; n++)
+        if (cs->blocks[n % cs->nblocks].state == block_queued)
+          {
+            block = &cs->blocks[n % cs->nblocks];
+            break;
+          }
+
+      if (! block)
+        {
+          if (cs->shutdown)
+            break;
+          apr_thread_cond_wait(cs->work, cs->mutex);
+          continue;
+        }
+
+      block->state = block_running;
+      apr_thread_mutex_unlock(cs->mutex);
+
+      block->err = compress_block(block, cs->format, cs->level);
+
+      apr_thread_mutex_lock(cs->mutex);
+      block->state = block_done;
+      apr_thread_cond_broadcast(cs->done);
+    }
+  apr_thread_mutex_unlock(cs->mutex);
+
+  apr_thread_exit(tid, APR_SUCCESS);
+  return NULL;
+}
+#endif
+
+/* Wait for the oldest block of CS to be compressed, and write it to
+ * the target stream. */
+static svn_error_t *
+write_oldest(struct compress_stream *cs)
+{
+  struct compress_block *block = &cs->blocks[cs->next_write % cs->nblocks];
+  svn_error_t *err;
+  apr_size_t len;
+
+  if (cs->nthreads)
+    {
+      apr_thread_mutex_lock(cs->mutex);
+      while (block->state != block_done)
+        apr_thread_cond_wait(cs->done, cs->mutex);
+      apr_thread_mutex_unlock(cs->mutex);
+    }
+
+  err = block->err;
+  block->err = SVN_NO_ERROR;
+  block->state = block_filling;
+  cs->next_write++;
+  SVN_ERR(err);
+
+  cs->stats.bytes_out += block->output_len;
+  len = block->output_len;
+  return svn_stream_write(cs->target, block->output, &len);
+}
+
+/* Write the blocks of CS which are already compressed, in order,
+ * without waiting for any others. */
+static svn_error_t *
+write_finished(struct compress_stream *cs)
+{
+  while (cs->next_write < cs->next_fill)
+    {
+      svn_boolean_t done;
+
+      apr_thread_mutex_lock(cs->mutex);
+      done = (cs->blocks[cs->next_write % cs->nblocks].state == block_done);
+      apr_thread_mutex_unlock(cs->mutex);
+
+      if (! done)
+        break;
+      SVN_ERR(write_oldest(cs));
+    }
+
+  return SVN_NO_ERROR;
+}
+
+/* Finish the block CS is filling, if it holds any data, and hand it
+ * to the workers (or compress and write it right away if there are
+ * none). */
+static svn_error_t *
+cut_block(struct compress_stream *cs)
+{
+  struct compress_block *block = &cs->blocks[cs->next_fill % cs->nblocks];
+  apr_size_t bound;
+
+  if (block->input->len == 0)
+    return SVN_NO_ERROR;
+
+  /* Workers must not allocate from our pool; size their output
+     buffer here. */
+  bound = compress_bound(cs->format, block->input->len);
+  if (bound > block->output_size)
+    {
+      block->output_size = bound;
+      block->output = apr_palloc(cs->pool, bound);
+    }
+
+  cs->stats.blocks++;
+  cs->stats.bytes_in += block->input->len;
+
+  if (! cs->nthreads)
+    {
+      block->err = compress_block(block, cs->format, cs->level);
+      block->state = block_done;
+      cs->next_fill++;
+      SVN_ERR(write_oldest(cs));
+    }
+  else
+    {
+      apr_thread_mutex_lock(cs->mutex);
+      block->state = block_queued;
+      cs->next_fill++;
+      apr_thread_cond_signal(cs->work);
+      apr_thread_mutex_unlock(cs->mutex);
+
+      SVN_ERR(write_finished(cs));
+    }
+
+  /* Make sure the next block's slot is free before filling it. */
+  if (cs->next_fill - cs->next_write == (apr_uint64_t)cs->nblocks)
+    SVN_ERR(write_oldest(cs));
+
+  svn_stringbuf_setempty(cs->blocks[cs->next_fill % cs->nblocks].input);
+  return SVN_NO_ERROR;
+}
+
+/* Implements svn_write_fn_t for compress_stream_get(). */
+static svn_error_t *
+write_handler(void *baton,
+              const char *data,
+              apr_size_t *len)
+{
+  struct compress_stream *cs = baton;
+  struct compress_block *block = &cs->blocks[cs->next_fill % cs->nblocks];
+
+  svn_stringbuf_appendbytes(block->input, data, *len);
+
+  /* Don't let a huge revision grow a block without bounds. */
+  if (block->input->len >= cs->block_size * MAX_BLOCK_FACTOR)
+    SVN_ERR(cut_block(cs));
+
+  return SVN_NO_ERROR;
+}
+
+svn_error_t *
+compress_stream_boundary(void *baton)
+{
+  struct compress_stream *cs = baton;
+
+  if (cs->blocks[cs->next_fill % cs->nblocks].input->len >= cs->block_size)
+    SVN_ERR(cut_block(cs));
+
+  return SVN_NO_ERROR;
+}
+
+svn_error_t *
+compress_stream_flush(struct compress_stream *cs)
+{
+  SVN_ERR(cut_block(cs));
+  while (cs->next_write < cs->next_fill)
+    SVN_ERR(write_oldest(cs));
+
+  return SVN_NO_ERROR;
+}
+
+/* Tell the workers of CS to exit once the queued blocks are done, and
+ * wait for them.  Blocks still queued are abandoned. */
+static void
+stop_workers(struct compress_stream *cs)
+{
+#if APR_HAS_THREADS
+  int i;
+
+  if (! cs->nthreads)
+    return;
+
+  apr_thread_mutex_lock(cs->mutex);
+  cs->shutdown = TRUE;
+  for (i = 0; i < cs->nblocks; i++)
+    if (cs->blocks[i].state == block_queued)
+      cs->blocks[i].state = block_done;
+  apr_thread_cond_broadcast(cs->work);
+  apr_thread_mutex_unlock(cs->mutex);
+
+  for (i = 0; i < cs->nthreads; i++)
+    {
+      apr_status_t retval;
+      apr_thread_join(&retval, cs->threads[i]);
+    }
+  cs->nthreads = 0;
+#endif
+}
+
+/* Implements svn_close_fn_t for compress_stream_get(). */
+static svn_error_t *
+close_handler(void *baton)
+{
+  struct compress_stream *cs = baton;
+  svn_error_t *err;
+  int i;
+
+  if (cs->closed)
+    return SVN_NO_ERROR;
+  cs->closed = TRUE;
+
+  err = cut_block(cs);
+  while (! err && cs->next_write < cs->next_fill)
+    err = write_oldest(cs);
+
+  stop_workers(cs);
+  for (i = 0; i < cs->nblocks; i++)
+    svn_error_clear(cs->blocks[i].err);
+
+  return svn_error_compose_create(err, svn_stream_close(cs->target));
+}
+
+svn_error_t *
+compress_stream_create(struct compress_stream **cs,
+                       svn_stream_t *target,
+                       enum compress_format format,
+                       int level,
+                       int threads,
+                       apr_size_t block_size,
+                       apr_pool_t *pool)
+{
+  struct compress_stream *new_cs = apr_pcalloc(pool, sizeof(*new_cs));
+  int i;
+
+#if ! APR_HAS_THREADS
+  threads = 0;
+#endif
+
+  new_cs->target = target;
+  new_cs->format = format;
+  new_cs->level = level;
+  new_cs->block_size = block_size;
+  new_cs->pool = pool;
+
+  /* Two blocks per worker keep them all busy while the oldest block
+     is being written; a single slot is enough without workers. */
+  new_cs->nblocks = threads ? threads * 2 + 1 : 1;
+  new_cs->blocks = apr_pcalloc(pool, new_cs->nblocks * sizeof(*new_cs->blocks));
+  for (i = 0; i < new_cs->nblocks; i++)
+    new_cs->blocks[i].input = svn_stringbuf_create_ensure(block_size, pool);
+
+#if APR_HAS_THREADS
+  if (threads)
+    {
+      apr_status_t status;
+
+      status = apr_thread_mutex_create(&new_cs->mutex,
+                                       APR_THREAD_MUTEX_DEFAULT, pool);
+      if (! status)
+        status = apr_thread_cond_create(&new_cs->work, pool);
+      if (! status)
+        status = apr_thread_cond_create(&new_cs->done, pool);
+      if (status)
+        return svn_error_wrap_apr(status, _("Can't create thread lock"));
+
+      new_cs->threads = apr_pcalloc(pool, threads * sizeof(*new_cs->threads));
+      for (i = 0; i < threads; i++)
+        {
+          status = apr_thread_create(&new_cs->threads[i], NULL,
+                                     worker_thread, new_cs, pool);
+          if (status)
+            {
+              stop_workers(new_cs);
+              return svn_error_wrap_apr(status,
+                                        _("Can't start compression thread"));
+            }
+          new_cs->nthreads++;
+        }
+    }
+#endif
+
+  *cs = new_cs;
+  return SVN_NO_ERROR;
+}
+
+svn_stream_t *
+compress_stream_get(struct compress_stream *cs,
+                    apr_pool_t *pool)
+{
+  svn_stream_t *stream = svn_stream_create(cs, pool);
+
+  svn_stream_set_write(stream, write_handler);
+  svn_stream_set_close(stream, close_handler);
+  return stream;
+}
+
+const struct compress_stats *
+compress_stream_get_stats(const struct compress_stream *cs)
+{
+  return &cs->stats;
+}
@@ -0,0 +1,127 @@
+/**
+ * @copyright
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ * @endcopyright
+ *
+ * @file compress_stream.h
+ * @brief A stream compressing its input in independent blocks on a
+ * pool of worker threads.
+ */
+
+#ifndef COMPRESS_STREAM_H_
+#define COMPRESS_STREAM_H_
+
+/** Blocks are cut at the first revision boundary after this many
+ * bytes: 1 MiB. */
+#define COMPRESS_DEFAULT_BLOCK_SIZE (1024 * 1024)
+
+/**
+ * Output compression formats.
+ */
+enum compress_format
+{
+  /* A multi-member gzip stream, one member per block. */
+  compress_gzip,
+
+  /* A sequence of zstd frames, one frame per block.  Only available
+     if built with SVNRDUMP_HAVE_ZSTD. */
+  compress_zstd
+};
+
+/**
+ * Counters describing the work of a compressing stream.
+ */
+struct compress_stats
+{
+  apr_uint64_t blocks;
+  apr_uint64_t bytes_in;
+  apr_uint64_t bytes_out;
+};
+
+/**
+ * An opaque compressing stream.
+ */
+struct compress_stream;
+
+/**
+ * Parse @a name ("gzip" or "zstd") into @a *format.
+ */
+svn_error_t *
+compress_parse_format(enum compress_format *format,
+                      const char *name);
+
+/**
+ * Return an error unless @a level is a compression level for @a format:
+ * -1 for the library default, 0 to 9 for gzip or 0 to the library
+ * maximum for zstd.
+ */
+svn_error_t *
+compress_check_level(enum compress_format format,
+                     int level);
+
+/**
+ * Create a compressing stream @a *cs writing @a format data to @a
+ * target, compressed at @a level (-1 for the library default) by @a
+ * threads worker threads.  Input is compressed in blocks of at least
+ * @a block_size bytes, which end at a revision boundary (see
+ * compress_stream_boundary()) unless a single revision grows much
+ * larger than that.  Compressed blocks are written to @a target in
+ * order, from the thread writing to the stream.  Allocate in @a pool.
+ */
+svn_error_t *
+compress_stream_create(struct compress_stream **cs,
+                       svn_stream_t *target,
+                       enum compress_format format,
+                       int level,
+                       int threads,
+                       apr_size_t block_size,
+                       apr_pool_t *pool);
+
+/**
+ * Return a writable stream, allocated in @a pool, feeding @a cs.
+ * Closing it compresses what is left, waits for the workers and
+ * closes the target stream.
+ */
+svn_stream_t *
+compress_stream_get(struct compress_stream *cs,
+                    apr_pool_t *pool);
+
+/**
+ * Tell @a baton, a struct compress_stream, that the input written so
+ * far ends at a revision boundary, where a block may be cut.
+ */
+svn_error_t *
+compress_stream_boundary(void *baton);
+
+/**
+ * Compress what has been written to @a cs so far and pass it on to
+ * the target stream, waiting for the workers if necessary.  This ends
+ * the current block early, so it costs some compression.
+ */
+svn_error_t *
+compress_stream_flush(struct compress_stream *cs);
+
+/**
+ * Return the counters of @a cs.
+ */
+const struct compress_stats *
+compress_stream_get_stats(const struct compress_stream *cs);
+
+#endif
@@ -22,6 +22,13 @@
  * ====================================================================
  */
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 #include "svn_hash.h"
 #include "svn_pools.h"
 #include "svn_repos.h"
@@ -29,8 +36,13 @@
 #include "svn_props.h"
 #include "svn_subst.h"
 #include "svn_dirent_uri.h"
+#include "svn_sorts.h"
 
 #include "svn17_compat.h"
+#include "spillbuf.h"
+#include "dump_record.h"
+#include "prop_list.h"
+#include "fulltext_cache.h"
 #include "dump_editor.h"
 
 #define ARE_VALID_COPY_ARGS(p,r) ((p) && SVN_IS_VALID_REVNUM(r))
@@ -46,26 +58,96 @@ struct dump_edit_baton {
   /* The output stream we write the dumpfile to */
   svn_stream_t *stream;
 
+  /* The record being assembled for the output stream.  Everything is
+     appended here and written out in one go once a record (or at
+     least its header and property blocks) is complete; see
+     flush_record().  Allocated in the per-edit-session pool */
+  svn_stringbuf_t *record;
+
   /* Pool for per-revision allocations */
   apr_pool_t *pool;
 
-  /* Properties which were modified during change_file_prop
+  /* Properties which were modified or deleted during change_file_prop
    * or change_dir_prop. */
-  apr_hash_t *props;
-
-  /* Properties which were deleted during change_file_prop
-   * or change_dir_prop. */
-  apr_hash_t *deleted_props;
+  struct prop_list *props;
 
   /* Temporary buffer to write property hashes to in human-readable
    * form. ### Is this really needed? */
   svn_stringbuf_t *propstring;
 
-  /* Temporary file used for textdelta application along with its
-     absolute path; these two variables should be allocated in the
-     per-edit-session pool */
-  const char *delta_abspath;
-  apr_file_t *delta_file;
+  /* Buffer used for textdelta application; kept in memory for small
+     deltas and spilled to an anonymous temporary file for large
+     ones.  Allocated in the per-edit-session pool */
+  struct spillbuf *delta_buf;
+
+  /* Counters to update as we go, or NULL */
+  struct dump_stats *stats;
+
+  /* The svndiff version and compression level of text deltas */
+  int svndiff_version;
+  int compression_level;
+
+  /* See struct dump_options */
+  svn_error_t *(*get_output_file)(apr_file_t **file, void *baton);
+  void *output_file_baton;
+
+  /* Path and property filters; see struct dump_options */
+  const apr_array_header_t *include_prefixes;
+  const apr_array_header_t *exclude_prefixes;
+  apr_hash_t *drop_props;
+  const char *root_path;
+
+  /* Revision hooks; see struct dump_options */
+  svn_error_t *(*start_node_func)(void *baton);
+  svn_error_t *(*map_revision_func)(svn_revnum_t *revision,
+                                    const char *path,
+                                    void *baton);
+  svn_error_t *(*add_tree_func)(const svn_delta_editor_t *editor,
+                                void *parent_baton,
+                                const char *path,
+                                const char *copyfrom_path,
+                                svn_revnum_t copyfrom_rev,
+                                void *baton,
+                                apr_pool_t *pool);
+  void *revision_baton;
+
+  /* This editor, without the cancellation wrapper, for ADD_TREE_FUNC */
+  const svn_delta_editor_t *editor;
+
+  /* Has a node record been written in this revision? */
+  svn_boolean_t node_dumped;
+
+  /* See struct dump_options; and whether the properties of the
+     current node changed, in that case. */
+  svn_boolean_t no_content;
+  svn_boolean_t props_changed;
+
+  /* See struct dump_options */
+  struct fulltext_cache *fulltext_cache;
+  svn_error_t *(*fetch_text_func)(svn_stream_t *stream,
+                                  const char *path,
+                                  svn_revnum_t revision,
+                                  void *baton,
+                                  apr_pool_t *pool);
+  svn_error_t *(*fetch_props_func)(apr_hash_t **props,
+                                   const char *path,
+                                   svn_node_kind_t kind,
+                                   svn_revnum_t revision,
+                                   void *baton,
+                                   apr_pool_t *pool);
+  void *fetch_text_baton;
+
+  /* The node of the record being assembled, and whether its property
+     changes are all of its properties, as for a node added without
+     history.  Allocated in the per-revision pool */
+  const char *node_path;
+  svn_node_kind_t node_kind;
+  svn_boolean_t node_props_complete;
+
+  /* The nodes, without a leading slash, whose property lists lost a
+     dropped property in this revision, so that the lists the dump has
+     are not theirs.  Allocated in the per-revision pool */
+  apr_hash_t *props_not_cached;
 
   /* The checksum of the file the delta is being applied to */
   const char *base_checksum;
@@ -76,36 +158,225 @@ struct dump_edit_baton {
   svn_boolean_t dump_newlines;
 };
 
+/* Return TRUE if the LEN bytes at DATA hold a CR, which
+ * normalize_prop() has to translate, or a NUL, at which it cuts the
+ * value.  Where AVX2 or SSE2 is available at compile time, look at 32
+ * or 16 bytes at a time.
+ */
+static svn_boolean_t
+needs_normalization(const char *data,
+                    apr_size_t len)
+{
+  apr_size_t i = 0;
+
+#ifdef __AVX2__
+  {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i nul = _mm256_setzero_si256();
+
+    for (; i + 32 <= len; i += 32)
+      {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(data + i));
+
+        if (_mm256_movemask_epi8(_mm256_or_si256(
+                                   _mm256_cmpeq_epi8(chunk, cr),
+                                   _mm256_cmpeq_epi8(chunk, nul))))
+          return TRUE;
+      }
+  }
+#endif
+
+#ifdef __SSE2__
+  {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i nul = _mm_setzero_si128();
+
+    for (; i + 16 <= len; i += 16)
+      {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, cr),
+                                           _mm_cmpeq_epi8(chunk, nul))))
+          return TRUE;
+      }
+  }
+#endif
+
+  for (; i < len; i++)
+    if (data[i] == '\r' || data[i] == '\0')
+      return TRUE;
+
+  return FALSE;
+}
+
+/* Normalize the line ending style of *VALUE, the value of the property
+ * NAME, if NAME "needs translation" (according to
+ * svn_prop_needs_translation(), currently all svn:* props) so that it
+ * contains only LF (\n) line endings.  Allocate a new value in POOL if
+ * anything changes; almost always, nothing does, and *VALUE is left
+ * alone.
+ */
+static svn_error_t *
+normalize_prop(const svn_string_t **value,
+               const char *name,
+               apr_pool_t *pool)
+{
+  const char *cstring;
+
+  if (! svn_prop_needs_translation(name)
+      || ! needs_normalization((*value)->data, (*value)->len))
+    return SVN_NO_ERROR;
+
+  SVN_ERR(svn_subst_translate_cstring2((*value)->data, &cstring,
+                                       "\n", TRUE,
+                                       NULL, FALSE,
+                                       pool));
+  *value = svn_string_create(cstring, pool);
+  return SVN_NO_ERROR;
+}
+
 /* Normalize the line ending style of the values of properties in PROPS
- * that "need translation" (according to svn_prop_needs_translation(),
- * currently all svn:* props) so that they contain only LF (\n) line endings.
+ * that "need translation"; see normalize_prop().
  */
 svn_error_t *
 normalize_props(apr_hash_t *props,
                 apr_pool_t *pool)
 {
   apr_hash_index_t *hi;
-  const char *key, *cstring;
-  const svn_string_t *value;
 
   for (hi = apr_hash_first(pool, props); hi; hi = apr_hash_next(hi))
     {
-      key = svn__apr_hash_index_key(hi);
-      value = svn__apr_hash_index_val(hi);
+      const char *key = svn__apr_hash_index_key(hi);
+      const svn_string_t *value = svn__apr_hash_index_val(hi);
+      const svn_string_t *normalized = value;
 
-      if (svn_prop_needs_translation(key))
-        {
-          SVN_ERR(svn_subst_translate_cstring2(value->data, &cstring,
-                                               "\n", TRUE,
-                                               NULL, FALSE,
-                                               pool));
-          value = svn_string_create(cstring, pool);
-          apr_hash_set(props, key, APR_HASH_KEY_STRING, value);
-        }
+      SVN_ERR(normalize_prop(&normalized, key, pool));
+      if (normalized != value)
+        apr_hash_set(props, key, APR_HASH_KEY_STRING, normalized);
     }
   return SVN_NO_ERROR;
 }
 
+/* Return TRUE if PATH is one of the path prefixes in PREFIXES or lies
+ * below one of them. */
+static svn_boolean_t
+under_prefix(const char *path,
+             const apr_array_header_t *prefixes)
+{
+  int i;
+
+  for (i = 0; i < prefixes->nelts; i++)
+    {
+      const char *prefix = APR_ARRAY_IDX(prefixes, i, const char *);
+      apr_size_t len = strlen(prefix);
+
+      if (strncmp(path, prefix, len) == 0
+          && (len == 0 || path[len] == '\0' || path[len] == '/'))
+        return TRUE;
+    }
+  return FALSE;
+}
+
+/* Return TRUE if the filters of EB leave the node at PATH (with or
+ * without a leading slash) out of the dump. */
+static svn_boolean_t
+path_excluded(const struct dump_edit_baton *eb,
+              const char *path)
+{
+  if (*path == '/')
+    path++;
+
+  if (eb->include_prefixes && ! under_prefix(path, eb->include_prefixes))
+    return TRUE;
+  return eb->exclude_prefixes && under_prefix(path, eb->exclude_prefixes);
+}
+
+/* Return TRUE if PATH (with or without a leading slash) is the root
+ * path EB dumps relative to. */
+static svn_boolean_t
+is_root_path(const struct dump_edit_baton *eb,
+             const char *path)
+{
+  if (! eb->root_path)
+    return FALSE;
+  if (*path == '/')
+    path++;
+  return strcmp(path, eb->root_path) == 0;
+}
+
+/* Return PATH, without a leading slash, relative to the root path of
+ * EB. */
+static const char *
+relative_path(const struct dump_edit_baton *eb,
+              const char *path)
+{
+  apr_size_t len;
+
+  if (*path == '/')
+    path++;
+  if (! eb->root_path || ! *eb->root_path)
+    return path;
+
+  len = strlen(eb->root_path);
+  if (strncmp(path, eb->root_path, len) == 0)
+    {
+      if (path[len] == '\0')
+        return "";
+      if (path[len] == '/')
+        return path + len + 1;
+    }
+  return path;
+}
+
+/* Return TRUE if the node property NAME is not to be dumped, either
+ * because it is not a regular property or because EB drops it. */
+static svn_boolean_t
+prop_excluded(const struct dump_edit_baton *eb,
+              const char *name)
+{
+  if (svn_property_kind(NULL, name) != svn_prop_regular_kind)
+    return TRUE;
+  return eb->drop_props
+         && apr_hash_get(eb->drop_props, name, APR_HASH_KEY_STRING);
+}
+
+/* Return an error if COPYFROM_PATH, the copy source of a node that is
+ * dumped, is left out of the dump by the filters of EB: the copy could
+ * not be loaded.  This is what svndumpfilter does, too. */
+static svn_error_t *
+check_copy_source(const struct dump_edit_baton *eb,
+                  const char *copyfrom_path)
+{
+  if (path_excluded(eb, copyfrom_path))
+    return svn_error_createf(SVN_ERR_INCOMPLETE_DATA, NULL,
+                             _("Invalid copy source path '%s'"),
+                             copyfrom_path);
+  return SVN_NO_ERROR;
+}
+
+/* Map *COPYFROM_REV, the revision COPYFROM_PATH is copied from, to the
+ * revision number it has in the output of EB.  Set it to
+ * SVN_INVALID_REVNUM if the output has no copy of the source, so that
+ * the copy has to be added as a tree. */
+static svn_error_t *
+map_copy_source(const struct dump_edit_baton *eb,
+                const char *copyfrom_path,
+                svn_revnum_t *copyfrom_rev)
+{
+  svn_revnum_t revision = *copyfrom_rev;
+
+  if (! eb->map_revision_func)
+    return SVN_NO_ERROR;
+
+  SVN_ERR(eb->map_revision_func(copyfrom_rev, copyfrom_path,
+                                eb->revision_baton));
+  if (! SVN_IS_VALID_REVNUM(*copyfrom_rev) && ! eb->add_tree_func)
+    return svn_error_createf(SVN_ERR_INCOMPLETE_DATA, NULL,
+                             _("Copy source '%s@%ld' is not in the dump"),
+                             copyfrom_path, revision);
+  return SVN_NO_ERROR;
+}
+
 /* Make a directory baton to represent the directory at path (relative
  * to the edit_baton).
  *
@@ -151,11 +422,102 @@ make_dir_baton(const char *path,
   new_db->copyfrom_rev = copyfrom_rev;
   new_db->added = added;
   new_db->written_out = FALSE;
+  new_db->excluded = path_excluded(eb, abspath);
   new_db->deleted_entries = apr_hash_make(pool);
 
   return new_db;
 }
 
+/* Write the record EB has assembled so far to EB->stream. */
+static svn_error_t *
+flush_record(struct dump_edit_baton *eb)
+{
+  return dump_record_write(eb->record, eb->stream);
+}
+
+/* Return PATH without a leading slash. */
+static const char *
+strip_slash(const char *path)
+{
+  return (*path == '/') ? path + 1 : path;
+}
+
+/* Replace the property changes collected in EB with the complete
+ * property list of the current node, as it is in the revision being
+ * dumped, for a full text dump.  Apply the changes to the list the
+ * fulltext cache has of the node, and fetch the list only if the cache
+ * has none; either way, keep the new list in the cache. */
+static svn_error_t *
+get_full_props(struct dump_edit_baton *eb)
+{
+  svn_revnum_t revision = fulltext_cache_revision(eb->fulltext_cache);
+  const struct fulltext_info *info;
+  apr_hash_t *props = NULL;
+  apr_hash_index_t *hi;
+  int i;
+
+  if (eb->node_props_complete)
+    props = apr_hash_make(eb->pool);
+  else
+    {
+      info = fulltext_cache_find_node_props(eb->fulltext_cache,
+                                            eb->node_path, revision,
+                                            eb->pool);
+      if (info)
+        SVN_ERR(fulltext_cache_read_props(&props, eb->fulltext_cache, info,
+                                          eb->pool));
+    }
+
+  if (props)
+    for (i = 0; i < prop_list_count(eb->props); i++)
+      {
+        const char *name;
+        const svn_string_t *value;
+
+        prop_list_get(&name, &value, eb->props, i);
+        apr_hash_set(props, name, APR_HASH_KEY_STRING, value);
+      }
+  else if (eb->fetch_props_func)
+    SVN_ERR(eb->fetch_props_func(&props, eb->node_path, eb->node_kind,
+                                 revision, eb->fetch_text_baton, eb->pool));
+  else
+    return svn_error_createf(SVN_ERR_INCOMPLETE_DATA, NULL,
+                             _("Can't get the properties of '%s'"),
+                             eb->node_path);
+
+  /* The repository has more than the regular properties to give. */
+  for (hi = apr_hash_first(eb->pool, props); hi; hi = apr_hash_next(hi))
+    {
+      const char *name = svn__apr_hash_index_key(hi);
+
+      if (svn_property_kind(NULL, name) != svn_prop_regular_kind)
+        apr_hash_set(props, name, APR_HASH_KEY_STRING, NULL);
+    }
+
+  if (! apr_hash_get(eb->props_not_cached, strip_slash(eb->node_path),
+                     APR_HASH_KEY_STRING))
+    {
+      SVN_ERR(fulltext_cache_write_props(&info, eb->fulltext_cache, props,
+                                         eb->pool));
+      fulltext_cache_set_node_props(eb->fulltext_cache, eb->node_path, info,
+                                    eb->pool);
+    }
+
+  prop_list_clear(eb->props);
+  for (hi = apr_hash_first(eb->pool, props); hi; hi = apr_hash_next(hi))
+    {
+      const char *name = svn__apr_hash_index_key(hi);
+      const svn_string_t *value = svn__apr_hash_index_val(hi);
+
+      if (prop_excluded(eb, name))
+        continue;
+      SVN_ERR(normalize_prop(&value, name, eb->pool));
+      prop_list_set(eb->props, name, value);
+    }
+
+  return SVN_NO_ERROR;
+}
+
 /* Extract and dump properties stored in edit baton EB, using POOL for
  * any temporary allocations. If TRIGGER_VAR is not NULL, it is set to FALSE.
  * Unless DUMP_DATA_TOO is set, only property headers are dumped.
@@ -166,47 +528,62 @@ dump_props(struct dump_edit_baton *eb,
            svn_boolean_t dump_data_too,
            apr_pool_t *pool)
 {
-  svn_stream_t *propstream;
-
   if (trigger_var && !*trigger_var)
     return SVN_NO_ERROR;
 
-  SVN_ERR(normalize_props(eb->props, eb->pool));
+  /* Without content, the node record ends right after its headers;
+     close_file() does that for files. */
+  if (eb->no_content)
+    {
+      if (dump_data_too)
+        {
+          if (eb->props_changed)
+            dump_record_header(eb->record, dump_header_props_changed,
+                               "true");
+          svn_stringbuf_appendbytes(eb->record, "\n\n", 2);
+          SVN_ERR(flush_record(eb));
+          eb->props_changed = FALSE;
+          if (trigger_var)
+            *trigger_var = FALSE;
+        }
+      return SVN_NO_ERROR;
+    }
+
+  /* Full texts go with full property lists, as in svnadmin dump. */
+  if (eb->fulltext_cache)
+    SVN_ERR(get_full_props(eb));
+
+  /* The properties go out sorted by name, so that the same changes
+     always make the same bytes. */
   svn_stringbuf_setempty(eb->propstring);
-  propstream = svn_stream_from_stringbuf(eb->propstring, eb->pool);
-  SVN_ERR(svn_hash_write_incremental(eb->props, eb->deleted_props,
-                                     propstream, "PROPS-END", pool));
-  SVN_ERR(svn_stream_close(propstream));
+  prop_list_write(eb->propstring, eb->props);
   
   /* Prop-delta: true */
-  SVN_ERR(svn_stream_printf(eb->stream, pool,
-                            SVN_REPOS_DUMPFILE_PROP_DELTA
-                            ": true\n"));
+  if (! eb->fulltext_cache)
+    dump_record_header(eb->record, dump_header_prop_delta, "true");
 
   /* Prop-content-length: 193 */
-  SVN_ERR(svn_stream_printf(eb->stream, pool,
-                            SVN_REPOS_DUMPFILE_PROP_CONTENT_LENGTH
-                            ": %" APR_SIZE_T_FMT "\n", eb->propstring->len));
+  dump_record_header_num(eb->record, dump_header_prop_content_length,
+                         eb->propstring->len);
 
   if (dump_data_too)
     {
       /* Content-length: 14 */
-      SVN_ERR(svn_stream_printf(eb->stream, pool,
-                                SVN_REPOS_DUMPFILE_CONTENT_LENGTH
-                                ": %" APR_SIZE_T_FMT "\n\n",
-                                eb->propstring->len));
+      dump_record_header_num(eb->record, dump_header_content_length,
+                             eb->propstring->len);
+      svn_stringbuf_appendbytes(eb->record, "\n", 1);
 
       /* The properties. */
-      SVN_ERR(svn_stream_write(eb->stream, eb->propstring->data,
-                               &(eb->propstring->len)));
+      svn_stringbuf_appendbytes(eb->record, eb->propstring->data,
+                                eb->propstring->len);
 
       /* No text is going to be dumped. Write a couple of newlines and
          wait for the next node/ revision. */
-      SVN_ERR(svn_stream_printf(eb->stream, pool, "\n\n"));
+      svn_stringbuf_appendbytes(eb->record, "\n\n", 2);
+      SVN_ERR(flush_record(eb));
 
       /* Cleanup so that data is never dumped twice. */
-      apr_hash_clear(eb->props);
-      apr_hash_clear(eb->deleted_props);
+      prop_list_clear(eb->props);
       if (trigger_var)
         *trigger_var = FALSE;
     }
@@ -221,12 +598,42 @@ dump_newlines(struct dump_edit_baton *eb,
 {
   if (trigger_var && *trigger_var)
     {
-      SVN_ERR(svn_stream_printf(eb->stream, pool, "\n\n"));
+      svn_stringbuf_appendbytes(eb->record, "\n\n", 2);
+      SVN_ERR(flush_record(eb));
       *trigger_var = FALSE;
     }
   return SVN_NO_ERROR;
 }
 
+/* Record in the fulltext cache of EB, if any, that PATH was added, as a
+ * copy of COPYFROM_PATH@COPYFROM_REV if those are valid.  This is done
+ * for nodes that are not dumped, too, so that the cache can tell the
+ * texts and properties of the nodes below copies. */
+static void
+note_added_node(struct dump_edit_baton *eb,
+                const char *path,
+                const char *copyfrom_path,
+                svn_revnum_t copyfrom_rev)
+{
+  if (! eb->fulltext_cache)
+    return;
+  if (! ARE_VALID_COPY_ARGS(copyfrom_path, copyfrom_rev))
+    copyfrom_path = NULL;
+  fulltext_cache_add_node(eb->fulltext_cache, path, copyfrom_path,
+                          copyfrom_rev);
+}
+
+/* Record in the fulltext cache of EB, if any, that the properties of
+ * PATH changed to something it doesn't know, for a change that isn't
+ * dumped. */
+static void
+note_unknown_props(struct dump_edit_baton *eb,
+                   const char *path)
+{
+  if (eb->fulltext_cache)
+    fulltext_cache_set_node_props(eb->fulltext_cache, path, NULL, eb->pool);
+}
+
 /*
  * Write out a node record for PATH of type KIND under EB->FS_ROOT.
  * ACTION describes what is happening to the node (see enum
@@ -248,25 +655,41 @@ dump_node(struct dump_edit_baton *eb,
           svn_revnum_t copyfrom_rev,
           apr_pool_t *pool)
 {
-  /* Remove leading slashes from path and copyfrom_path */
+  /* The node as given, for the add record of a replacement */
+  const char *orig_path = path;
+  const char *orig_copyfrom_path = copyfrom_path;
+  svn_revnum_t orig_copyfrom_rev = copyfrom_rev;
+
+  /* Let the caller write the revision record, if it defers that */
+  if (! eb->node_dumped)
+    {
+      if (eb->start_node_func)
+        SVN_ERR(eb->start_node_func(eb->revision_baton));
+      eb->node_dumped = TRUE;
+    }
+
+  eb->node_path = apr_pstrdup(eb->pool, orig_path);
+  eb->node_kind = kind;
+  eb->node_props_complete = ! is_copy
+                            && (action == svn_node_action_add
+                                || action == svn_node_action_replace);
+
+  /* Remove leading slashes from path and copyfrom_path, and make them
+     relative to the root path */
   if (path)
-    path = ((*path == '/') ? path + 1 : path);
+    path = relative_path(eb, path);
   
   if (copyfrom_path)
-    copyfrom_path = ((*copyfrom_path == '/') ?
-                     copyfrom_path + 1 : copyfrom_path);
+    copyfrom_path = relative_path(eb, copyfrom_path);
 
   /* Node-path: commons/STATUS */
-  SVN_ERR(svn_stream_printf(eb->stream, pool,
-                            SVN_REPOS_DUMPFILE_NODE_PATH ": %s\n", path));
+  dump_record_header(eb->record, dump_header_node_path, path);
 
   /* Node-kind: file */
   if (kind == svn_node_file)
-    SVN_ERR(svn_stream_printf(eb->stream, pool,
-                              SVN_REPOS_DUMPFILE_NODE_KIND ": file\n"));
+    dump_record_header(eb->record, dump_header_node_kind, "file");
   else if (kind == svn_node_dir)
-    SVN_ERR(svn_stream_printf(eb->stream, pool,
-                              SVN_REPOS_DUMPFILE_NODE_KIND ": dir\n"));
+    dump_record_header(eb->record, dump_header_node_kind, "dir");
 
 
   /* Write the appropriate Node-action header */
@@ -276,18 +699,15 @@ dump_node(struct dump_edit_baton *eb,
       /* We are here after a change_file_prop or change_dir_prop. They
          set up whatever dump_props they needed to- nothing to
          do here but print node action information */
-      SVN_ERR(svn_stream_printf(eb->stream, pool,
-                                SVN_REPOS_DUMPFILE_NODE_ACTION
-                                ": change\n"));
+      dump_record_header(eb->record, dump_header_node_action, "change");
       break;
 
     case svn_node_action_replace:
       if (!is_copy)
         {
           /* Node-action: replace */
-          SVN_ERR(svn_stream_printf(eb->stream, pool,
-                                    SVN_REPOS_DUMPFILE_NODE_ACTION
-                                    ": replace\n"));
+          dump_record_header(eb->record, dump_header_node_action,
+                             "replace");
 
           /* Wait for a change_*_prop to be called before dumping
              anything */          
@@ -298,32 +718,30 @@ dump_node(struct dump_edit_baton *eb,
          copyfrom_rev are present: delete the original, and then re-add
          it */
 
-      SVN_ERR(svn_stream_printf(eb->stream, pool,
-                                SVN_REPOS_DUMPFILE_NODE_ACTION
-                                ": delete\n\n"));
+      dump_record_header(eb->record, dump_header_node_action, "delete");
+      svn_stringbuf_appendbytes(eb->record, "\n", 1);
 
       /* Recurse: Print an additional add-with-history record. */
-      SVN_ERR(dump_node(eb, path, kind, svn_node_action_add,
-                        is_copy, copyfrom_path, copyfrom_rev, pool));
+      SVN_ERR(dump_node(eb, orig_path, kind, svn_node_action_add,
+                        is_copy, orig_copyfrom_path, orig_copyfrom_rev,
+                        pool));
 
       /* We can leave this routine quietly now, don't need to dump any
          content; that was already done in the second record. */
       break;
 
     case svn_node_action_delete:
-      SVN_ERR(svn_stream_printf(eb->stream, pool,
-                                SVN_REPOS_DUMPFILE_NODE_ACTION
-                                ": delete\n"));
+      dump_record_header(eb->record, dump_header_node_action, "delete");
 
       /* We can leave this routine quietly now. Nothing more to do-
          print a couple of newlines because we're not dumping props or
          text. */      
-      SVN_ERR(svn_stream_printf(eb->stream, pool, "\n\n"));
+      svn_stringbuf_appendbytes(eb->record, "\n\n", 2);
+      SVN_ERR(flush_record(eb));
       break;
 
     case svn_node_action_add:
-      SVN_ERR(svn_stream_printf(eb->stream, pool,
-                                SVN_REPOS_DUMPFILE_NODE_ACTION ": add\n"));
+      dump_record_header(eb->record, dump_header_node_action, "add");
 
       if (!is_copy)
         {
@@ -341,12 +759,10 @@ dump_node(struct dump_edit_baton *eb,
           break;
         }
 
-      SVN_ERR(svn_stream_printf(eb->stream, pool,
-                                SVN_REPOS_DUMPFILE_NODE_COPYFROM_REV
-                                ": %ld\n"
-                                SVN_REPOS_DUMPFILE_NODE_COPYFROM_PATH
-                                ": %s\n",
-                                copyfrom_rev, copyfrom_path));
+      dump_record_header_num(eb->record, dump_header_node_copyfrom_rev,
+                             copyfrom_rev);
+      dump_record_header(eb->record, dump_header_node_copyfrom_path,
+                         copyfrom_path);
 
       /* Ugly hack: If a directory was copied from a previous
          revision, nothing like close_file will be called to write two
@@ -374,9 +790,10 @@ open_root(void *edit_baton,
   /* Clear the per-revision pool after each revision */
   svn_pool_clear(eb->pool);
 
-  eb->props = apr_hash_make(eb->pool);
-  eb->deleted_props = apr_hash_make(eb->pool);
+  eb->props = prop_list_create(eb->pool);
   eb->propstring = svn_stringbuf_create("", eb->pool);
+  eb->props_not_cached = apr_hash_make(eb->pool);
+  eb->node_dumped = FALSE;
 
   *root_baton = make_dir_baton(NULL, NULL, SVN_INVALID_REVNUM,
                                edit_baton, NULL, FALSE, eb->pool);
@@ -401,6 +818,13 @@ delete_entry(const char *path,
   /* Some pending newlines to dump? */
   SVN_ERR(dump_newlines(pb->eb, &(pb->eb->dump_newlines), pool));
 
+  if (pb->eb->fulltext_cache)
+    fulltext_cache_delete_node(pb->eb->fulltext_cache, path);
+
+  /* The root path can't be deleted in the output */
+  if (path_excluded(pb->eb, path) || is_root_path(pb->eb, path))
+    return SVN_NO_ERROR;
+
   /* Add this path to the deleted_entries of the parent directory
      baton. */
   apr_hash_set(pb->deleted_entries, apr_pstrdup(pb->eb->pool, path),
@@ -421,6 +845,7 @@ add_directory(const char *path,
   void *val;
   struct dir_baton *new_db;
   svn_boolean_t is_copy;
+  svn_revnum_t output_rev = copyfrom_rev;
 
   LDR_DBG(("add_directory %s\n", path));
 
@@ -433,11 +858,34 @@ add_directory(const char *path,
   /* Some pending newlines to dump? */
   SVN_ERR(dump_newlines(pb->eb, &(pb->eb->dump_newlines), pool));
 
+  note_added_node(pb->eb, path, copyfrom_path, copyfrom_rev);
+
+  *child_baton = new_db;
+  if (new_db->excluded)
+    return SVN_NO_ERROR;
+
   /* This might be a replacement -- is the path already deleted? */
   val = apr_hash_get(pb->deleted_entries, path, APR_HASH_KEY_STRING);
 
   /* Detect an add-with-history */
   is_copy = ARE_VALID_COPY_ARGS(copyfrom_path, copyfrom_rev);
+  if (is_copy)
+    SVN_ERR(check_copy_source(pb->eb, copyfrom_path));
+
+  /* The root path exists in the output already; its properties are
+     dumped as a change by change_dir_prop */
+  if (is_root_path(pb->eb, path))
+    return SVN_NO_ERROR;
+
+  /* Without its source in the output, the copy is added as a tree; the
+     changes to it follow as changes to a directory that is already
+     there. */
+  if (is_copy)
+    SVN_ERR(map_copy_source(pb->eb, copyfrom_path, &output_rev));
+  if (is_copy && ! SVN_IS_VALID_REVNUM(output_rev))
+    return pb->eb->add_tree_func(pb->eb->editor, pb, path, copyfrom_path,
+                                 copyfrom_rev, pb->eb->revision_baton,
+                                 pool);
 
   /* Dump the node */
   SVN_ERR(dump_node(pb->eb, path,
@@ -445,7 +893,7 @@ add_directory(const char *path,
                     val ? svn_node_action_replace : svn_node_action_add,
                     is_copy,
                     is_copy ? copyfrom_path : NULL,
-                    is_copy ? copyfrom_rev : SVN_INVALID_REVNUM,
+                    is_copy ? output_rev : SVN_INVALID_REVNUM,
                     pool));
 
   if (val)
@@ -454,7 +902,6 @@ add_directory(const char *path,
 
   new_db->written_out = TRUE;
 
-  *child_baton = new_db;
   return SVN_NO_ERROR;
 }
 
@@ -500,7 +947,9 @@ close_directory(void *dir_baton,
 {
   struct dir_baton *db = dir_baton;
   struct dump_edit_baton *eb = db->eb;
+  apr_array_header_t *deleted;
   apr_hash_index_t *hi;
+  int i;
 
   LDR_DBG(("close_directory %p\n", dir_baton));
 
@@ -510,14 +959,19 @@ close_directory(void *dir_baton,
   /* Some pending newlines to dump? */
   SVN_ERR(dump_newlines(eb, &(eb->dump_newlines), pool));
 
-  /* Dump the deleted directory entries */
+  /* Dump the deleted directory entries, sorted so that they come out
+     in the same order every time. */
+  deleted = apr_array_make(pool, apr_hash_count(db->deleted_entries),
+                           sizeof(const char *));
   for (hi = apr_hash_first(pool, db->deleted_entries); hi;
        hi = apr_hash_next(hi))
+    APR_ARRAY_PUSH(deleted, const char *) = svn__apr_hash_index_key(hi);
+  qsort(deleted->elts, deleted->nelts, deleted->elt_size,
+        svn_sort_compare_paths);
+
+  for (i = 0; i < deleted->nelts; i++)
     {
-      const void *key;
-      const char *path;
-      apr_hash_this(hi, &key, NULL, NULL);
-      path = key;
+      const char *path = APR_ARRAY_IDX(deleted, i, const char *);
 
       SVN_ERR(dump_node(db->eb, path, svn_node_unknown, svn_node_action_delete,
                         FALSE, NULL, SVN_INVALID_REVNUM, pool));
@@ -536,8 +990,10 @@ add_file(const char *path,
          void **file_baton)
 {
   struct dir_baton *pb = parent_baton;
+  struct file_baton *fb;
   void *val;
   svn_boolean_t is_copy;
+  svn_revnum_t output_rev = copyfrom_rev;
 
   LDR_DBG(("add_file %s\n", path));
 
@@ -547,11 +1003,45 @@ add_file(const char *path,
   /* Some pending newlines to dump? */
   SVN_ERR(dump_newlines(pb->eb, &(pb->eb->dump_newlines), pool));
 
+  note_added_node(pb->eb, path, copyfrom_path, copyfrom_rev);
+
+  /* Build a nice file baton to pass to change_file_prop and
+     apply_textdelta */
+  fb = apr_pcalloc(pb->eb->pool, sizeof(*fb));
+  fb->eb = pb->eb;
+  fb->path = apr_pstrdup(pb->eb->pool, path);
+  fb->excluded = path_excluded(pb->eb, path);
+  *file_baton = fb;
+  if (fb->excluded)
+    return SVN_NO_ERROR;
+
   /* This might be a replacement -- is the path already deleted? */
   val = apr_hash_get(pb->deleted_entries, path, APR_HASH_KEY_STRING);
 
   /* Detect add-with-history. */
   is_copy = ARE_VALID_COPY_ARGS(copyfrom_path, copyfrom_rev);
+  if (is_copy)
+    SVN_ERR(check_copy_source(pb->eb, copyfrom_path));
+
+  if (is_copy)
+    {
+      fb->base_path = apr_pstrdup(pb->eb->pool, copyfrom_path);
+      fb->base_rev = copyfrom_rev;
+      fb->is_copy = TRUE;
+      SVN_ERR(map_copy_source(pb->eb, copyfrom_path, &output_rev));
+    }
+
+  /* Without its source in the output, the copy is added as a new file;
+     the changes to it follow in a change record. */
+  if (is_copy && ! SVN_IS_VALID_REVNUM(output_rev))
+    {
+      SVN_ERR(pb->eb->add_tree_func(pb->eb->editor, pb, path,
+                                    copyfrom_path, copyfrom_rev,
+                                    pb->eb->revision_baton, pool));
+      fb->is_copy = FALSE;
+      return dump_node(pb->eb, path, svn_node_file, svn_node_action_change,
+                       FALSE, copyfrom_path, copyfrom_rev, pool);
+    }
 
   /* Dump the node. */
   SVN_ERR(dump_node(pb->eb, path,
@@ -559,17 +1049,13 @@ add_file(const char *path,
                     val ? svn_node_action_replace : svn_node_action_add,
                     is_copy,
                     is_copy ? copyfrom_path : NULL,
-                    is_copy ? copyfrom_rev : SVN_INVALID_REVNUM,
+                    is_copy ? output_rev : SVN_INVALID_REVNUM,
                     pool));
 
   if (val)
     /* delete the path, it's now been dumped. */
     apr_hash_set(pb->deleted_entries, path, APR_HASH_KEY_STRING, NULL);
 
-  /* Build a nice file baton to pass to change_file_prop and
-     apply_textdelta */
-  *file_baton = pb->eb;
-
   return SVN_NO_ERROR;
 }
 
@@ -581,6 +1067,7 @@ open_file(const char *path,
           void **file_baton)
 {
   struct dir_baton *pb = parent_baton;
+  struct file_baton *fb;
   const char *copyfrom_path = NULL;
   svn_revnum_t copyfrom_rev = SVN_INVALID_REVNUM;
 
@@ -592,6 +1079,16 @@ open_file(const char *path,
   /* Some pending newlines to dump? */
   SVN_ERR(dump_newlines(pb->eb, &(pb->eb->dump_newlines), pool));
 
+  /* Build a nice file baton to pass to change_file_prop and
+     apply_textdelta */
+  fb = apr_pcalloc(pb->eb->pool, sizeof(*fb));
+  fb->eb = pb->eb;
+  fb->path = apr_pstrdup(pb->eb->pool, path);
+  fb->excluded = path_excluded(pb->eb, path);
+  *file_baton = fb;
+  if (fb->excluded)
+    return SVN_NO_ERROR;
+
   /* If the parent directory has explicit copyfrom path and rev,
      record the same for this one. */
   if (pb && ARE_VALID_COPY_ARGS(pb->copyfrom_path, pb->copyfrom_rev))
@@ -602,13 +1099,38 @@ open_file(const char *path,
       copyfrom_rev = pb->copyfrom_rev;
     }
 
+  /* The text changes relative to the copy source, or else to the
+     previous revision of the file. */
+  if (pb->eb->fulltext_cache)
+    {
+      fb->base_path = copyfrom_path ? copyfrom_path : fb->path;
+      fb->base_rev = copyfrom_path
+                     ? copyfrom_rev
+                     : fulltext_cache_revision(pb->eb->fulltext_cache) - 1;
+    }
+
   SVN_ERR(dump_node(pb->eb, path, svn_node_file, svn_node_action_change,
                     FALSE, copyfrom_path, copyfrom_rev, pool));
 
-  /* Build a nice file baton to pass to change_file_prop and
-     apply_textdelta */
-  *file_baton = pb->eb;
+  return SVN_NO_ERROR;
+}
 
+/* Note a change to the property NAME of PATH that is not dumped, in
+ * EB: the property lists the dump has of PATH no longer say what the
+ * fulltext cache should have. */
+static svn_error_t *
+note_dropped_prop(struct dump_edit_baton *eb,
+                  const char *path,
+                  const char *name)
+{
+  if (eb->fulltext_cache
+      && svn_property_kind(NULL, name) == svn_prop_regular_kind)
+    {
+      note_unknown_props(eb, path);
+      apr_hash_set(eb->props_not_cached,
+                   apr_pstrdup(eb->pool, strip_slash(path)),
+                   APR_HASH_KEY_STRING, eb);
+    }
   return SVN_NO_ERROR;
 }
 
@@ -622,33 +1144,44 @@ change_dir_prop(void *parent_baton,
 
   LDR_DBG(("change_dir_prop %p\n", parent_baton));
 
-  if (svn_property_kind(NULL, name) != svn_prop_regular_kind)
-    return SVN_NO_ERROR;
+  if (db->excluded)
+    {
+      note_unknown_props(db->eb, db->abspath);
+      return SVN_NO_ERROR;
+    }
 
-  if (value)
-    apr_hash_set(db->eb->props, apr_pstrdup(db->eb->pool, name),
-                 APR_HASH_KEY_STRING, svn_string_dup(value, db->eb->pool));
+  /* A replay without deltas only sends a dummy change, if any. */
+  if (db->eb->no_content)
+    db->eb->props_changed = TRUE;
+  else if (prop_excluded(db->eb, name))
+    return note_dropped_prop(db->eb, db->abspath, name);
   else
-    apr_hash_set(db->eb->deleted_props, apr_pstrdup(db->eb->pool, name),
-                 APR_HASH_KEY_STRING, "");
-
-  if (! db->written_out)
     {
-      /* If db->written_out is set, it means that the node information
-         corresponding to this directory has already been written: don't
-         do anything; dump_props will take care of dumping the
-         props. If it not, dump the node itself before dumping the
-         props. */
+      if (value)
+        {
+          value = svn_string_dup(value, db->eb->pool);
+          SVN_ERR(normalize_prop(&value, name, db->eb->pool));
+        }
+      prop_list_set(db->eb->props, apr_pstrdup(db->eb->pool, name), value);
+    }
 
+  /* Unless the node record of this directory is still open, waiting
+     for its properties or for the newlines ending it, start a new
+     one. */
+  if (! db->written_out
+      || ! (db->eb->dump_props || db->eb->dump_newlines))
+    {
       SVN_ERR(dump_node(db->eb, db->abspath, svn_node_dir,
                         svn_node_action_change, FALSE, db->copyfrom_path,
                         db->copyfrom_rev, pool));
       db->written_out = TRUE;
     }
 
-  /* Dump props whether or not the directory has been written
-     out. Then disable printing a couple of extra newlines */
-  SVN_ERR(dump_props(db->eb, NULL, TRUE, pool));
+  /* Collect all property changes of the directory in one block.  It
+     is dumped by the next operation on a child or sibling, or by
+     close_directory, which also takes the place of the extra
+     newlines. */
+  db->eb->dump_props = TRUE;
   db->eb->dump_newlines = FALSE;
 
   return SVN_NO_ERROR;
@@ -660,19 +1193,30 @@ change_file_prop(void *file_baton,
                  const svn_string_t *value,
                  apr_pool_t *pool)
 {
-  struct dump_edit_baton *eb = file_baton;
+  struct file_baton *fb = file_baton;
+  struct dump_edit_baton *eb = fb->eb;
 
   LDR_DBG(("change_file_prop %p\n", file_baton));
 
-  if (svn_property_kind(NULL, name) != svn_prop_regular_kind)
-    return SVN_NO_ERROR;
+  if (fb->excluded)
+    {
+      note_unknown_props(eb, fb->path);
+      return SVN_NO_ERROR;
+    }
 
-  if (value)
-    apr_hash_set(eb->props, apr_pstrdup(eb->pool, name),
-                 APR_HASH_KEY_STRING, svn_string_dup(value, eb->pool));
+  if (eb->no_content)
+    eb->props_changed = TRUE;
+  else if (prop_excluded(eb, name))
+    return note_dropped_prop(eb, fb->path, name);
   else
-    apr_hash_set(eb->deleted_props, apr_pstrdup(eb->pool, name),
-                 APR_HASH_KEY_STRING, "");
+    {
+      if (value)
+        {
+          value = svn_string_dup(value, eb->pool);
+          SVN_ERR(normalize_prop(&value, name, eb->pool));
+        }
+      prop_list_set(eb->props, apr_pstrdup(eb->pool, name), value);
+    }
 
   /* Dump the property headers and wait; close_file might need
      to write text headers too depending on whether
@@ -686,15 +1230,92 @@ static svn_error_t *
 window_handler(svn_txdelta_window_t *window, void *baton)
 {
   struct handler_baton *hb = baton;
-  static svn_error_t *err;
 
-  err = hb->apply_handler(window, hb->apply_baton);
-  if (window != NULL && !err)
+  return hb->apply_handler(window, hb->apply_baton);
+}
+
+/* Set *INFO to the text of the file PATH@REVISION in the fulltext cache
+ * of EB, looked up by its hex MD5 checksum MD5 if that is not NULL, or
+ * else by what the cache knows of the node.  Fetch the text into the
+ * cache if it isn't there.  If CONTENTS is not
+ * NULL, open the text for reading in *CONTENTS, too.  Allocate in POOL.
+ */
+static svn_error_t *
+get_cached_text(const struct fulltext_info **info,
+                svn_stream_t **contents,
+                struct dump_edit_baton *eb,
+                const char *path,
+                svn_revnum_t revision,
+                const char *md5,
+                apr_pool_t *pool)
+{
+  svn_stream_t *stream;
+
+  *info = md5 ? fulltext_cache_find(eb->fulltext_cache, md5)
+              : fulltext_cache_find_node_text(eb->fulltext_cache, path,
+                                              revision, pool);
+  if (*info && contents)
+    SVN_ERR(fulltext_cache_read(contents, eb->fulltext_cache, *info, pool));
+  if (*info && (! contents || *contents))
     return SVN_NO_ERROR;
 
-  if (err)
-    SVN_ERR(err);
+  if (! eb->fetch_text_func)
+    return svn_error_createf(SVN_ERR_INCOMPLETE_DATA, NULL,
+                             _("The text of '%s@%ld' is not in the "
+                               "fulltext cache"),
+                             path, revision);
+
+  SVN_ERR(fulltext_cache_write(&stream, info, eb->fulltext_cache, pool));
+  SVN_ERR(eb->fetch_text_func(stream, path, revision, eb->fetch_text_baton,
+                              pool));
+  SVN_ERR(svn_stream_close(stream));
+
+  if (md5 && strcmp((*info)->md5, md5) != 0)
+    return svn_error_createf(SVN_ERR_CHECKSUM_MISMATCH, NULL,
+                             _("Checksum mismatch for '%s@%ld':\n"
+                               "   expected:  %s\n"
+                               "     actual:  %s\n"),
+                             path, revision, md5, (*info)->md5);
+
+  if (contents)
+    SVN_ERR(fulltext_cache_read(contents, eb->fulltext_cache, *info, pool));
+  return SVN_NO_ERROR;
+}
+
+/* Prepare to apply a text delta against BASE_CHECKSUM for the file FB,
+ * keeping the result in the fulltext cache.  Set *HANDLER and
+ * *HANDLER_BATON to receive the windows. */
+static svn_error_t *
+apply_textdelta_fulltext(struct file_baton *fb,
+                         const char *base_checksum,
+                         svn_txdelta_window_handler_t *handler,
+                         void **handler_baton)
+{
+  struct dump_edit_baton *eb = fb->eb;
+  struct handler_baton *hb = apr_pcalloc(eb->pool, sizeof(*hb));
+  const struct fulltext_info *base;
+  svn_stream_t *source, *target;
 
+  if (fb->base_path)
+    {
+      SVN_ERR(get_cached_text(&base, &source, eb, fb->base_path,
+                              fb->base_rev, base_checksum, eb->pool));
+      if (fb->is_copy)
+        fb->copy_source = base;
+    }
+  else
+    source = svn_stream_empty(eb->pool);
+
+  /* The delta application closes the target once done; only then is
+     FB->text set. */
+  SVN_ERR(fulltext_cache_write(&target, &fb->text, eb->fulltext_cache,
+                               eb->pool));
+  svn_txdelta_apply(source, target, NULL, fb->path, eb->pool,
+                    &(hb->apply_handler), &(hb->apply_baton));
+
+  eb->dump_text = TRUE;
+  *handler = window_handler;
+  *handler_baton = hb;
   return SVN_NO_ERROR;
 }
 
@@ -704,26 +1325,44 @@ apply_textdelta(void *file_baton, const char *base_checksum,
                 svn_txdelta_window_handler_t *handler,
                 void **handler_baton)
 {
-  struct dump_edit_baton *eb = file_baton;
+  struct file_baton *fb = file_baton;
+  struct dump_edit_baton *eb = fb->eb;
 
   /* Custom handler_baton allocated in a separate pool */
   struct handler_baton *hb;
-  svn_stream_t *delta_filestream;
-
-  hb = apr_pcalloc(eb->pool, sizeof(*hb));
+  svn_stream_t *delta_stream;
 
   LDR_DBG(("apply_textdelta %p\n", file_baton));
 
-  /* Use a temporary file to measure the text-content-length */
-  delta_filestream = svn_stream_from_aprfile2(eb->delta_file, TRUE, pool);
+  /* Don't bother encoding or buffering deltas that are not dumped.
+     Without content, there is only an empty delta anyway. */
+  if (eb->no_content && ! fb->excluded)
+    eb->dump_text = TRUE;
+  if (fb->excluded && eb->fulltext_cache)
+    fulltext_cache_set_node_text(eb->fulltext_cache, fb->path, NULL, pool);
+  if (fb->excluded || eb->no_content)
+    {
+      *handler = svn_delta_noop_window_handler;
+      *handler_baton = NULL;
+      return SVN_NO_ERROR;
+    }
+
+  if (eb->fulltext_cache)
+    return apply_textdelta_fulltext(fb, base_checksum, handler,
+                                    handler_baton);
 
-  /* Prepare to write the delta to the delta_filestream */
-  svn_txdelta_to_svndiff2(&(hb->apply_handler), &(hb->apply_baton),
-                          delta_filestream, 0, pool);
+  hb = apr_pcalloc(eb->pool, sizeof(*hb));
+
+  /* Use the delta buffer to measure the text-content-length */
+  delta_stream = spillbuf_stream(eb->delta_buf, pool);
+
+  /* Prepare to write the delta to the delta_stream */
+  svn_txdelta_to_svndiff3(&(hb->apply_handler), &(hb->apply_baton),
+                          delta_stream, eb->svndiff_version,
+                          eb->compression_level, pool);
 
   eb->dump_text = TRUE;
   eb->base_checksum = apr_pstrdup(eb->pool, base_checksum);
-  svn_stream_close(delta_filestream);
 
   /* The actual writing takes place when this function has
      finished. Set handler and handler_baton now so for
@@ -734,116 +1373,204 @@ apply_textdelta(void *file_baton, const char *base_checksum,
   return SVN_NO_ERROR;
 }
 
+/* Copy the buffered text delta of EB to the output, straight to the
+ * output file if the delta is on disk and the output allows it. */
+static svn_error_t *
+write_delta(struct dump_edit_baton *eb,
+            apr_pool_t *pool)
+{
+  apr_file_t *file = NULL;
+  svn_filesize_t kernel_copied;
+
+  if (spillbuf_spilled(eb->delta_buf) && eb->get_output_file)
+    SVN_ERR(eb->get_output_file(&file, eb->output_file_baton));
+
+  if (! file)
+    return spillbuf_write_to(eb->delta_buf, eb->stream, pool);
+
+  SVN_ERR(spillbuf_write_to_file(eb->delta_buf, file, &kernel_copied,
+                                 pool));
+  if (eb->stats)
+    eb->stats->delta_kernel_copy_bytes += kernel_copied;
+  return SVN_NO_ERROR;
+}
+
 static svn_error_t *
 close_file(void *file_baton,
            const char *text_checksum,
            apr_pool_t *pool)
 {
-  struct dump_edit_baton *eb = file_baton;
-  svn_stream_t *delta_filestream;
-  apr_finfo_t *info = apr_pcalloc(pool, sizeof(apr_finfo_t));
-  apr_off_t offset;
-  apr_status_t err;
+  struct file_baton *fb = file_baton;
+  struct dump_edit_baton *eb = fb->eb;
+  svn_filesize_t text_len = 0;
 
   LDR_DBG(("close_file %p\n", file_baton));
 
+  if (fb->excluded)
+    return SVN_NO_ERROR;
+
+  if (eb->no_content)
+    {
+      if (eb->props_changed)
+        dump_record_header(eb->record, dump_header_props_changed, "true");
+      if (eb->dump_text)
+        dump_record_header(eb->record, dump_header_text_changed, "true");
+      eb->props_changed = FALSE;
+      eb->dump_props = FALSE;
+      eb->dump_text = FALSE;
+
+      svn_stringbuf_appendbytes(eb->record, "\n\n", 2);
+      return flush_record(eb);
+    }
+
+  /* Text-copy-source-md5: and -sha1:, for full texts */
+  if (eb->fulltext_cache && fb->is_copy)
+    {
+      /* An unchanged copy has the text of its source. */
+      if (! fb->copy_source)
+        SVN_ERR(get_cached_text(&fb->copy_source, NULL, eb, fb->base_path,
+                                fb->base_rev,
+                                eb->dump_text ? NULL : text_checksum,
+                                pool));
+      dump_record_header(eb->record, dump_header_text_copy_source_md5,
+                         fb->copy_source->md5);
+      dump_record_header(eb->record, dump_header_text_copy_source_sha1,
+                         fb->copy_source->sha1);
+    }
+
   /* Some pending properties to dump? Dump just the headers- dump the
      props only after dumping the text headers too (if present) */
   SVN_ERR(dump_props(eb, &(eb->dump_props), FALSE, pool));
 
   /* Dump the text headers */
-  if (eb->dump_text)
+  if (eb->dump_text && eb->fulltext_cache)
+    {
+      if (text_checksum && strcmp(text_checksum, fb->text->md5) != 0)
+        return svn_error_createf(SVN_ERR_CHECKSUM_MISMATCH, NULL,
+                                 _("Checksum mismatch for '%s':\n"
+                                   "   expected:  %s\n"
+                                   "     actual:  %s\n"),
+                                 fb->path, text_checksum, fb->text->md5);
+      text_len = fb->text->size;
+      fulltext_cache_set_node_text(eb->fulltext_cache, fb->path, fb->text,
+                                   pool);
+
+      /* Text-content-length: 39 */
+      dump_record_header_num(eb->record, dump_header_text_content_length,
+                             text_len);
+
+      /* Text-content-md5: and Text-content-sha1: */
+      dump_record_header(eb->record, dump_header_text_content_md5,
+                         fb->text->md5);
+      dump_record_header(eb->record, dump_header_text_content_sha1,
+                         fb->text->sha1);
+    }
+  else if (eb->dump_text)
     {
       /* Text-delta: true */
-      SVN_ERR(svn_stream_printf(eb->stream, pool,
-                                SVN_REPOS_DUMPFILE_TEXT_DELTA
-                                ": true\n"));
+      dump_record_header(eb->record, dump_header_text_delta, "true");
 
-      err = apr_file_info_get(info, APR_FINFO_SIZE, eb->delta_file);
-      if (err)
-        SVN_ERR(svn_error_wrap_apr(err, NULL));
+      text_len = spillbuf_size(eb->delta_buf);
 
       if (eb->base_checksum)
         /* Text-delta-base-md5: */
-        SVN_ERR(svn_stream_printf(eb->stream, pool,
-                                  SVN_REPOS_DUMPFILE_TEXT_DELTA_BASE_MD5
-                                  ": %s\n",
-                                  eb->base_checksum));
+        dump_record_header(eb->record, dump_header_text_delta_base_md5,
+                           eb->base_checksum);
 
       /* Text-content-length: 39 */
-      SVN_ERR(svn_stream_printf(eb->stream, pool,
-                                SVN_REPOS_DUMPFILE_TEXT_CONTENT_LENGTH
-                                ": %lu\n",
-                                (unsigned long)info->size));
+      dump_record_header_num(eb->record, dump_header_text_content_length,
+                             text_len);
 
       /* Text-content-md5: 82705804337e04dcd0e586bfa2389a7f */      
-      SVN_ERR(svn_stream_printf(eb->stream, pool,
-                                SVN_REPOS_DUMPFILE_TEXT_CONTENT_MD5
-                                ": %s\n",
-                                text_checksum));
+      dump_record_header(eb->record, dump_header_text_content_md5,
+                         text_checksum);
     }
 
   /* Content-length: 1549 */
   /* If both text and props are absent, skip this header */
   if (eb->dump_props)
-    SVN_ERR(svn_stream_printf(eb->stream, pool,
-                              SVN_REPOS_DUMPFILE_CONTENT_LENGTH
-                              ": %ld\n\n",
-                              (unsigned long)info->size + eb->propstring->len));
+    dump_record_header_num(eb->record, dump_header_content_length,
+                           text_len + eb->propstring->len);
   else if (eb->dump_text)
-    SVN_ERR(svn_stream_printf(eb->stream, pool,
-                              SVN_REPOS_DUMPFILE_CONTENT_LENGTH
-                              ": %ld\n\n",
-                              (unsigned long)info->size));
+    dump_record_header_num(eb->record, dump_header_content_length,
+                           text_len);
+  if (eb->dump_props || eb->dump_text)
+    svn_stringbuf_appendbytes(eb->record, "\n", 1);
 
   /* Dump the props now */
   if (eb->dump_props)
     {
-      SVN_ERR(svn_stream_write(eb->stream, eb->propstring->data,
-                               &(eb->propstring->len)));
+      svn_stringbuf_appendbytes(eb->record, eb->propstring->data,
+                                eb->propstring->len);
 
       /* Cleanup */
       eb->dump_props = FALSE;
-      apr_hash_clear(eb->props);
-      apr_hash_clear(eb->deleted_props);
+      prop_list_clear(eb->props);
+    }
+
+  /* Dump the full text, from the cache */
+  if (eb->dump_text && eb->fulltext_cache)
+    {
+      svn_stream_t *contents;
+
+      SVN_ERR(flush_record(eb));
+      SVN_ERR(fulltext_cache_read(&contents, eb->fulltext_cache, fb->text,
+                                  pool));
+      if (! contents)
+        return svn_error_createf(SVN_ERR_INCOMPLETE_DATA, NULL,
+                                 _("The text of '%s' vanished from the "
+                                   "fulltext cache"),
+                                 fb->path);
+      SVN_ERR(svn_stream_copy3(contents, svn_stream_disown(eb->stream, pool),
+                               NULL, NULL, pool));
+      eb->dump_text = FALSE;
     }
 
   /* Dump the text */
   if (eb->dump_text)
     {
-      /* Seek to the beginning of the delta file, map it to a stream,
-         and copy the stream to eb->stream. Then close the stream and
-         truncate the file so we can reuse it for the next textdelta
-         application. Note that the file isn't created, opened or
-         closed here */
-      offset = 0;
-      SVN_ERR(svn_io_file_seek(eb->delta_file, APR_SET, &offset, pool));
-      delta_filestream = svn_stream_from_aprfile2(eb->delta_file, TRUE, pool);
-      SVN_ERR(svn_stream_copy3(delta_filestream, eb->stream, NULL, NULL, pool));
+      /* Send the headers and props ahead of the delta, then copy the
+         buffered delta to eb->stream and empty the buffer so we can
+         reuse it for the next textdelta application. */
+      SVN_ERR(flush_record(eb));
+      SVN_ERR(write_delta(eb, pool));
+
+      if (eb->stats)
+        {
+          eb->stats->text_deltas++;
+          if (spillbuf_spilled(eb->delta_buf))
+            {
+              eb->stats->delta_spills++;
+              eb->stats->delta_spill_bytes += text_len;
+            }
+        }
 
       /* Cleanup */
-      SVN_ERR(svn_stream_close(delta_filestream));
-      SVN_ERR(svn_io_file_trunc(eb->delta_file, 0, pool));
+      SVN_ERR(spillbuf_reset(eb->delta_buf, pool));
       eb->dump_text = FALSE;
     }
 
   /* Write a couple of blank lines for matching output with `svnadmin
      dump` */
-  SVN_ERR(svn_stream_printf(eb->stream, pool, "\n\n"));
+  svn_stringbuf_appendbytes(eb->record, "\n\n", 2);
 
-  return SVN_NO_ERROR;
+  return flush_record(eb);
 }
 
 static svn_error_t *
 close_edit(void *edit_baton, apr_pool_t *pool)
 {
-  return SVN_NO_ERROR;
+  struct dump_edit_baton *eb = edit_baton;
+
+  /* The next revision header is written by someone else. */
+  return flush_record(eb);
 }
 
 svn_error_t *
 get_dump_editor(const svn_delta_editor_t **editor,
                 void **edit_baton,
                 svn_stream_t *stream,
+                const struct dump_options *options,
                 svn_cancel_func_t cancel_func,
                 void *cancel_baton,
                 apr_pool_t *pool)
@@ -853,15 +1580,41 @@ get_dump_editor(const svn_delta_editor_t **editor,
 
   eb = apr_pcalloc(pool, sizeof(struct dump_edit_baton));
   eb->stream = stream;
+  eb->record = svn_stringbuf_create_ensure(1024, pool);
+  eb->stats = options ? options->stats : NULL;
+  eb->svndiff_version = options ? options->svndiff_version : 0;
+  if (options)
+    {
+      eb->get_output_file = options->get_output_file;
+      eb->output_file_baton = options->output_file_baton;
+      eb->include_prefixes = options->include_prefixes;
+      eb->exclude_prefixes = options->exclude_prefixes;
+      eb->drop_props = options->drop_props;
+      eb->root_path = options->root_path;
+      eb->start_node_func = options->start_node_func;
+      eb->map_revision_func = options->map_revision_func;
+      eb->add_tree_func = options->add_tree_func;
+      eb->revision_baton = options->revision_baton;
+      eb->no_content = options->no_content;
+      eb->fulltext_cache = options->fulltext_cache;
+      eb->fetch_text_func = options->fetch_text_func;
+      eb->fetch_props_func = options->fetch_props_func;
+      eb->fetch_text_baton = options->fetch_text_baton;
+    }
+  eb->compression_level = (options && options->compression_level >= 0)
+                          ? options->compression_level
+                          : SVN_DELTA_COMPRESSION_LEVEL_DEFAULT;
 
   /* Create a special per-revision pool */
   eb->pool = svn_pool_create(pool);
 
-  /* Open a unique temporary file for all textdelta applications in
-     this edit session. The file is automatically closed and cleaned
-     up when the edit session is done. */
-  SVN_ERR(svn_io_open_unique_file3(&(eb->delta_file), &(eb->delta_abspath),
-                                   NULL, svn_io_file_del_on_close, pool, pool));
+  /* One delta buffer serves all textdelta applications in this edit
+     session. Its temporary file, if it ever needs one, is cleaned up
+     when the edit session is done. */
+  SVN_ERR(spillbuf_create(&(eb->delta_buf),
+                          options ? options->spill_threshold
+                                  : SPILLBUF_DEFAULT_THRESHOLD,
+                          pool));
 
   de = svn_delta_default_editor(pool);
   de->open_root = open_root;
@@ -876,6 +1629,7 @@ get_dump_editor(const svn_delta_editor_t **editor,
   de->open_file = open_file;
   de->close_file = close_file;
   de->close_edit = close_edit;
+  eb->editor = de;
 
   /* Set the edit_baton and editor. */
   *edit_baton = eb;
@@ -43,6 +43,9 @@ struct dir_baton
   /* has this directory been written to the output stream? */
   svn_boolean_t written_out;
 
+  /* is this directory filtered out of the dump? */
+  svn_boolean_t excluded;
+
   /* the absolute path to this directory */
   const char *abspath;
 
@@ -57,6 +60,31 @@ struct dir_baton
   apr_hash_t *deleted_entries;
 };
 
+/**
+ * A file baton used by all file-related callback functions in the
+ * dump editor.
+ */
+struct file_baton
+{
+  struct dump_edit_baton *eb;
+
+  /* is this file filtered out of the dump? */
+  svn_boolean_t excluded;
+
+  /* For full texts: the path of the file, and where the text a delta
+     applies to comes from, if anywhere: its copy source, or the file
+     itself in the previous revision.  IS_COPY tells which. */
+  const char *path;
+  const char *base_path;
+  svn_revnum_t base_rev;
+  svn_boolean_t is_copy;
+
+  /* For full texts: the copy source text, once known, and the new
+     text, once the delta is applied. */
+  const struct fulltext_info *copy_source;
+  const struct fulltext_info *text;
+};
+
 /**
  * A handler baton to be used in window_handler().
  */
@@ -66,16 +94,155 @@ struct handler_baton
   void *apply_baton;
 };
 
+/**
+ * Counters maintained by the dump editor.
+ */
+struct dump_stats
+{
+  /* number of text deltas dumped */
+  apr_uint64_t text_deltas;
+
+  /* how many of those did not fit in memory and were spilled to disk,
+     and how many bytes they amounted to */
+  apr_uint64_t delta_spills;
+  apr_uint64_t delta_spill_bytes;
+
+  /* how many bytes of spilled deltas the kernel moved to the output
+     file, without passing them through user space */
+  apr_uint64_t delta_kernel_copy_bytes;
+};
+
+/**
+ * The highest svndiff version the dump editor can produce: svndiff1,
+ * which zlib-compresses the delta data.
+ */
+#define DUMP_MAX_SVNDIFF_VERSION 1
+
+/**
+ * Options controlling the behaviour of the dump editor.
+ */
+struct dump_options
+{
+  /* Text deltas up to this many bytes are buffered in memory; larger
+     ones are spilled to an anonymous temporary file. */
+  apr_size_t spill_threshold;
+
+  /* If not NULL, counters to update during the edit. */
+  struct dump_stats *stats;
+
+  /* The svndiff version of text deltas (0 to DUMP_MAX_SVNDIFF_VERSION)
+     and, for compressed versions, the compression level
+     (SVN_DELTA_COMPRESSION_LEVEL_NONE to _MAX, or -1 for the
+     default). */
+  int svndiff_version;
+  int compression_level;
+
+  /* If not NULL, called before a text delta that was spilled to disk
+     is copied to the output stream, to get at the file the stream
+     writes to.  It sets *FILE to that file, flushed so that it holds
+     everything written to the stream so far, or to NULL if the output
+     has to go through the stream.  The delta is then moved to the file
+     by the kernel.  OUTPUT_FILE_BATON is passed to it. */
+  svn_error_t *(*get_output_file)(apr_file_t **file, void *baton);
+  void *output_file_baton;
+
+  /* If not NULL, arrays of const char * path prefixes (relative to
+     the root of the edit, without leading or trailing slashes)
+     selecting the nodes to dump.  A node is dumped if it lies under
+     one of INCLUDE_PREFIXES (or INCLUDE_PREFIXES is NULL) and under
+     none of EXCLUDE_PREFIXES.  As with svndumpfilter, copying a node
+     from a path that is left out is an error. */
+  const apr_array_header_t *include_prefixes;
+  const apr_array_header_t *exclude_prefixes;
+
+  /* If not NULL, the names of node properties to leave out of the
+     dump, as keys mapping to anything. */
+  apr_hash_t *drop_props;
+
+  /* If not NULL, a path (relative to the root of the edit, without
+     leading or trailing slashes) to dump as if it were the root of
+     the repository: node paths and copy sources are made relative to
+     it.  Only the nodes below it should be selected by the filters.
+     The node at ROOT_PATH itself is only dumped when its properties
+     change. */
+  const char *root_path;
+
+  /* If not NULL, called with REVISION_BATON before the first node
+     record of each revision is written, so that the caller can write
+     the revision record then (or leave out revisions without nodes). */
+  svn_error_t *(*start_node_func)(void *baton);
+
+  /* If not NULL, called with REVISION_BATON to map *REVISION, the
+     revision a node is copied from, to the revision number it has in
+     the output.  PATH is the copy source, relative to the root of the
+     edit.  An error stops the dump.  SVN_INVALID_REVNUM means that the
+     output has no copy of the source.
+
+     ADD_TREE_FUNC, if not NULL, is then called with REVISION_BATON to
+     drive EDITOR to add the tree COPYFROM_PATH@COPYFROM_REV as PATH
+     below the directory PARENT_BATON, without history.  The copy is
+     dumped as that tree of adds followed by the changes made to it;
+     without ADD_TREE_FUNC, it is an error. */
+  svn_error_t *(*map_revision_func)(svn_revnum_t *revision,
+                                    const char *path,
+                                    void *baton);
+  svn_error_t *(*add_tree_func)(const svn_delta_editor_t *editor,
+                                void *parent_baton,
+                                const char *path,
+                                const char *copyfrom_path,
+                                svn_revnum_t copyfrom_rev,
+                                void *baton,
+                                apr_pool_t *pool);
+
+  void *revision_baton;
+
+  /* If set, the edit comes from a replay without deltas, which only
+     tells which texts and properties changed.  Node records then get
+     DUMP_SKELETON_TEXT_CHANGED and DUMP_SKELETON_PROPS_CHANGED headers
+     instead of any content; see dump_record.h. */
+  svn_boolean_t no_content;
+
+  /* If not NULL, file contents are dumped as full texts with SHA-1
+     checksums, and changed properties as the complete property list
+     of the node, as by svnadmin dump without --deltas; copied files
+     get Text-copy-source-* headers.  Text deltas are applied to texts
+     from this cache, where the new texts are kept as well.  The
+     revision of the cache must be the one being dumped.
+
+     FETCH_TEXT_FUNC, if not NULL, is called with FETCH_TEXT_BATON to
+     write the text of the file PATH@REVISION (relative to the root of
+     the edit) to STREAM when the cache doesn't have it; otherwise
+     that is an error.  FETCH_PROPS_FUNC, likewise, sets *PROPS to the
+     properties of the node PATH@REVISION of KIND, whose property
+     changes don't make up its complete list; without it, that is an
+     error. */
+  struct fulltext_cache *fulltext_cache;
+  svn_error_t *(*fetch_text_func)(svn_stream_t *stream,
+                                  const char *path,
+                                  svn_revnum_t revision,
+                                  void *baton,
+                                  apr_pool_t *pool);
+  svn_error_t *(*fetch_props_func)(apr_hash_t **props,
+                                   const char *path,
+                                   svn_node_kind_t kind,
+                                   svn_revnum_t revision,
+                                   void *baton,
+                                   apr_pool_t *pool);
+  void *fetch_text_baton;
+};
+
 /**
  * Get a dump editor @a editor along with a @a edit_baton allocated in
- * @a pool.  The editor will write output to @a stream.  Use @a
- * cancel_func and @a cancel_baton to check for user cancellation of
- * the operation (for timely-but-safe termination).
+ * @a pool.  The editor will write output to @a stream, tuned by @a
+ * options (which may be NULL for the defaults).  Use @a cancel_func
+ * and @a cancel_baton to check for user cancellation of the operation
+ * (for timely-but-safe termination).
  */
 svn_error_t *
 get_dump_editor(const svn_delta_editor_t **editor,
                 void **edit_baton,
                 svn_stream_t *stream,
+                const struct dump_options *options,
                 svn_cancel_func_t cancel_func,
                 void *cancel_baton,
                 apr_pool_t *pool);
@@ -0,0 +1,160 @@
+/*
+ *  dump_record.c: Assembling dumpfile records in a single buffer.
+ *
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ */
+
+#include "svn_hash.h"
+#include "svn_io.h"
+#include "svn_repos.h"
+
+#include "svn17_compat.h"
+#include "prop_list.h"
+#include "dump_record.h"
+
+/* A header name followed by ": ", and the length of that. */
+struct header_name
+{
+  const char *name;
+  apr_size_t len;
+};
+
+#define HEADER_NAME(name) { name ": ", sizeof(name ": ") - 1 }
+
+/* Indexed by enum dump_header. */
+static const struct header_name header_names[] =
+  {
+    HEADER_NAME(SVN_REPOS_DUMPFILE_REVISION_NUMBER),
+    HEADER_NAME(SVN_REPOS_DUMPFILE_NODE_PATH),
+    HEADER_NAME(SVN_REPOS_DUMPFILE_NODE_KIND),
+    HEADER_NAME(SVN_REPOS_DUMPFILE_NODE_ACTION),
+    HEADER_NAME(SVN_REPOS_DUMPFILE_NODE_COPYFROM_REV),
+    HEADER_NAME(SVN_REPOS_DUMPFILE_NODE_COPYFROM_PATH),
+    HEADER_NAME(SVN_REPOS_DUMPFILE_PROP_DELTA),
+    HEADER_NAME(SVN_REPOS_DUMPFILE_PROP_CONTENT_LENGTH),
+    HEADER_NAME(SVN_REPOS_DUMPFILE_TEXT_DELTA),
+    HEADER_NAME(SVN_REPOS_DUMPFILE_TEXT_DELTA_BASE_MD5),
+    HEADER_NAME(SVN_REPOS_DUMPFILE_TEXT_CONTENT_LENGTH),
+    HEADER_NAME(SVN_REPOS_DUMPFILE_TEXT_CONTENT_MD5),
+    HEADER_NAME(SVN_REPOS_DUMPFILE_TEXT_CONTENT_SHA1),
+    HEADER_NAME(SVN_REPOS_DUMPFILE_TEXT_COPY_SOURCE_MD5),
+    HEADER_NAME(SVN_REPOS_DUMPFILE_TEXT_COPY_SOURCE_SHA1),
+    HEADER_NAME(SVN_REPOS_DUMPFILE_CONTENT_LENGTH),
+    HEADER_NAME(DUMP_SKELETON_TEXT_CHANGED),
+    HEADER_NAME(DUMP_SKELETON_PROPS_CHANGED),
+    HEADER_NAME(DUMP_REVISION_NODES_LENGTH)
+  };
+
+/* Append the name of HEADER, and the ": " separator, to RECORD. */
+static void
+append_name(svn_stringbuf_t *record,
+            enum dump_header header)
+{
+  svn_stringbuf_appendbytes(record, header_names[header].name,
+                            header_names[header].len);
+}
+
+void
+dump_record_header(svn_stringbuf_t *record,
+                   enum dump_header header,
+                   const char *value)
+{
+  append_name(record, header);
+  svn_stringbuf_appendcstr(record, value);
+  svn_stringbuf_appendbytes(record, "\n", 1);
+}
+
+void
+dump_record_header_num(svn_stringbuf_t *record,
+                       enum dump_header header,
+                       apr_int64_t value)
+{
+  /* Digits are produced from the end; 20 digits, a sign and the
+     newline cover any 64-bit value. */
+  char buf[22];
+  char *p = buf + sizeof(buf);
+  apr_uint64_t magnitude = (value < 0) ? -(apr_uint64_t)value : value;
+
+  *--p = '\n';
+  do
+    {
+      *--p = (char)('0' + magnitude % 10);
+      magnitude /= 10;
+    }
+  while (magnitude);
+  if (value < 0)
+    *--p = '-';
+
+  append_name(record, header);
+  svn_stringbuf_appendbytes(record, p, buf + sizeof(buf) - p);
+}
+
+svn_error_t *
+dump_record_write(svn_stringbuf_t *record,
+                  svn_stream_t *stream)
+{
+  apr_size_t len = record->len;
+
+  if (len)
+    SVN_ERR(svn_stream_write(stream, record->data, &len));
+  svn_stringbuf_setempty(record);
+  return SVN_NO_ERROR;
+}
+
+svn_error_t *
+dump_record_revision(svn_stringbuf_t *record,
+                     svn_revnum_t revision,
+                     apr_hash_t *rev_props,
+                     svn_filesize_t nodes_length,
+                     apr_pool_t *pool)
+{
+  struct prop_list *props = prop_list_create(pool);
+  svn_stringbuf_t *propstring = svn_stringbuf_create_ensure(256, pool);
+  apr_hash_index_t *hi;
+
+  /* Sort the properties, so that the record comes out the same every
+     time. */
+  for (hi = apr_hash_first(pool, rev_props); hi; hi = apr_hash_next(hi))
+    prop_list_set(props, svn__apr_hash_index_key(hi),
+                  svn__apr_hash_index_val(hi));
+  prop_list_write(propstring, props);
+
+  /* Revision-number: 19 */
+  dump_record_header_num(record, dump_header_revision_number, revision);
+
+  /* Prop-content-length: 13 */
+  dump_record_header_num(record, dump_header_prop_content_length,
+                         propstring->len);
+
+  /* SVN-rdump-Nodes-length: 1074 */
+  if (nodes_length >= 0)
+    dump_record_header_num(record, dump_header_nodes_length, nodes_length);
+
+  /* Content-length: 29 */
+  dump_record_header_num(record, dump_header_content_length,
+                         propstring->len);
+  svn_stringbuf_appendbytes(record, "\n", 1);
+
+  /* Property data. */
+  svn_stringbuf_appendbytes(record, propstring->data, propstring->len);
+  svn_stringbuf_appendbytes(record, "\n", 1);
+
+  return SVN_NO_ERROR;
+}
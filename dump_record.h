@@ -0,0 +1,119 @@
+/**
+ * @copyright
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ * @endcopyright
+ *
+ * @file dump_record.h
+ * @brief Assembling dumpfile records in a single buffer.
+ */
+
+#ifndef DUMP_RECORD_H_
+#define DUMP_RECORD_H_
+
+/**
+ * The magic header line of a skeleton dump, which has the records of a
+ * dumpfile without any text or property content.  It stands in for
+ * SVN_REPOS_DUMPFILE_MAGIC_HEADER, so that loaders reject the dump.
+ */
+#define DUMP_SKELETON_MAGIC_HEADER "SVN-rdump-skeleton-version"
+#define DUMP_SKELETON_VERSION 1
+
+/**
+ * Headers of skeleton dump node records, telling that the text or the
+ * properties of the node changed.
+ */
+#define DUMP_SKELETON_TEXT_CHANGED "Text-changed"
+#define DUMP_SKELETON_PROPS_CHANGED "Props-changed"
+
+/**
+ * Header of revision records giving the number of bytes of node
+ * records that follow, up to the next revision record, so that
+ * readers can skip the revision in one go.  Loaders ignore it.
+ */
+#define DUMP_REVISION_NODES_LENGTH "SVN-rdump-Nodes-length"
+
+/**
+ * The headers of a dumpfile record, one per SVN_REPOS_DUMPFILE_*
+ * constant, and those of skeleton dumps.
+ */
+enum dump_header
+{
+  dump_header_revision_number,
+  dump_header_node_path,
+  dump_header_node_kind,
+  dump_header_node_action,
+  dump_header_node_copyfrom_rev,
+  dump_header_node_copyfrom_path,
+  dump_header_prop_delta,
+  dump_header_prop_content_length,
+  dump_header_text_delta,
+  dump_header_text_delta_base_md5,
+  dump_header_text_content_length,
+  dump_header_text_content_md5,
+  dump_header_text_content_sha1,
+  dump_header_text_copy_source_md5,
+  dump_header_text_copy_source_sha1,
+  dump_header_content_length,
+  dump_header_text_changed,
+  dump_header_props_changed,
+  dump_header_nodes_length
+};
+
+/**
+ * Append the line "HEADER: @a value" for @a header to @a record.
+ */
+void
+dump_record_header(svn_stringbuf_t *record,
+                   enum dump_header header,
+                   const char *value);
+
+/**
+ * Append the line "HEADER: @a value" for @a header to @a record,
+ * formatting the decimal number @a value without going through
+ * printf.
+ */
+void
+dump_record_header_num(svn_stringbuf_t *record,
+                       enum dump_header header,
+                       apr_int64_t value);
+
+/**
+ * Write all of @a record to @a stream in a single write, and empty
+ * @a record for the next one.
+ */
+svn_error_t *
+dump_record_write(svn_stringbuf_t *record,
+                  svn_stream_t *stream);
+
+/**
+ * Append a revision record for @a revision with the revision
+ * properties @a rev_props, sorted by name, to @a record.  Unless @a
+ * nodes_length is negative, give it as the length of the node records
+ * of the revision in a DUMP_REVISION_NODES_LENGTH header.  Use @a pool
+ * for temporary allocations.
+ */
+svn_error_t *
+dump_record_revision(svn_stringbuf_t *record,
+                     svn_revnum_t revision,
+                     apr_hash_t *rev_props,
+                     svn_filesize_t nodes_length,
+                     apr_pool_t *pool);
+
+#endif
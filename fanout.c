@@ -0,0 +1,603 @@
+/*
+ *  fanout.c: Writing one dumpstream to several outputs, each drained
+ *  by its own writer thread.
+ *
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ */
+
+#include <apr_thread_proc.h>
+#include <apr_thread_mutex.h>
+#include <apr_thread_cond.h>
+#include <apr_time.h>
+
+#include "svn_pools.h"
+#include "svn_io.h"
+
+#include "svn17_compat.h"
+#include "fanout.h"
+
+/* The boundary of a block without a revision boundary. */
+#define NO_BOUNDARY ((apr_size_t)-1)
+
+/* A buffer shared by all outputs. */
+struct block
+{
+  char *data;
+  apr_size_t len;
+
+  /* The offset in DATA of the last revision boundary, or NO_BOUNDARY */
+  apr_size_t boundary;
+
+  /* The number of outputs that still have to write this block */
+  int refs;
+};
+
+enum output_state
+{
+  output_active,
+  output_dropped,
+  output_failed
+};
+
+/* One output of a fanout. */
+struct output
+{
+  struct fanout *fanout;
+
+  svn_stream_t *target;
+  svn_error_t *(*boundary_func)(void *baton);
+  void *boundary_baton;
+
+  /* The blocks waiting to be written, a ring of FANOUT->depth entries
+     of which LEN are used, starting at START */
+  struct block **queue;
+  int start;
+  int len;
+
+  enum output_state state;
+
+  /* The error the output failed with, until it is handed over */
+  svn_error_t *err;
+
+  apr_thread_t *thread;
+  struct fanout_output_stats stats;
+};
+
+/* Unlike a write queue, a fanout has several consumers, each of them
+ * holding its own references to the blocks it has yet to write.  All
+ * bookkeeping is done under one mutex, which is taken about once per
+ * block and output; that is cheap next to writing the block.  The
+ * data itself is only touched by the producer while it fills a block
+ * that no output has a reference to, and read by the outputs after
+ * that. */
+struct fanout
+{
+  enum fanout_policy policy;
+  apr_interval_time_t stall_limit;
+  apr_size_t buffer_size;
+  int depth;
+  svn_boolean_t flush_at_boundary;
+
+  /* The blocks not used by anyone, as a stack of NFREE entries */
+  struct block **free_blocks;
+  int nfree;
+
+  /* The block the producer is filling, or NULL, and whether the next
+     block starts at a revision boundary.  Only used by the producer */
+  struct block *current;
+  svn_boolean_t pending_boundary;
+
+  /* The outputs, as struct output *; fixed once writing started */
+  apr_array_header_t *outputs;
+  svn_boolean_t started;
+
+  /* Protects all of the above that is shared, and signals any change
+     to the free blocks or the queues */
+  apr_thread_mutex_t *mutex;
+  apr_thread_cond_t *cond;
+
+  svn_boolean_t closing;
+  svn_boolean_t closed;
+
+  struct fanout_stats stats;
+  apr_pool_t *pool;
+};
+
+/* Give up OUTPUT's reference to BLOCK.  Call with the mutex held. */
+static void
+release_block(struct fanout *fanout,
+              struct block *block)
+{
+  if (--block->refs == 0)
+    fanout->free_blocks[fanout->nfree++] = block;
+}
+
+/* Release the blocks queued for OUTPUT and put it into STATE.  Call
+ * with the mutex held. */
+static void
+stop_output(struct output *output,
+            enum output_state state)
+{
+  struct fanout *fanout = output->fanout;
+
+  for (; output->len; output->len--)
+    {
+      release_block(fanout, output->queue[output->start]);
+      output->start = (output->start + 1) % fanout->depth;
+    }
+
+  output->state = state;
+  if (state == output_dropped)
+    output->stats.dropped = TRUE;
+  apr_thread_cond_broadcast(fanout->cond);
+}
+
+/* Return the active output of FANOUT with the most blocks left to
+ * write, or NULL if there is none.  Call with the mutex held. */
+static struct output *
+slowest_output(struct fanout *fanout)
+{
+  struct output *slowest = NULL;
+  int i;
+
+  for (i = 0; i < fanout->outputs->nelts; i++)
+    {
+      struct output *output = APR_ARRAY_IDX(fanout->outputs, i,
+                                            struct output *);
+
+      if (output->state == output_active
+          && (! slowest || output->len > slowest->len))
+        slowest = output;
+    }
+  return slowest;
+}
+
+/* Return the error of an output of FANOUT that failed, if any.  The
+ * original error is handed over once, a generic one after.  Call with
+ * the mutex held. */
+static svn_error_t *
+output_error(struct fanout *fanout)
+{
+  int i;
+
+  for (i = 0; i < fanout->outputs->nelts; i++)
+    {
+      struct output *output = APR_ARRAY_IDX(fanout->outputs, i,
+                                            struct output *);
+      svn_error_t *err = output->err;
+
+      if (output->state != output_failed)
+        continue;
+      if (err)
+        {
+          output->err = SVN_NO_ERROR;
+          return err;
+        }
+      return svn_error_createf(SVN_ERR_IO_WRITE_ERROR, NULL,
+                               _("Output '%s' failed"), output->stats.name);
+    }
+  return SVN_NO_ERROR;
+}
+
+/* Make a free block of FANOUT the current one, applying the policy if
+ * the outputs don't free one in time. */
+static svn_error_t *
+claim_block(struct fanout *fanout)
+{
+  svn_error_t *err = SVN_NO_ERROR;
+  apr_time_t start = 0;
+
+  apr_thread_mutex_lock(fanout->mutex);
+  while (1)
+    {
+      err = output_error(fanout);
+      if (err || fanout->nfree)
+        break;
+
+      if (! start)
+        start = apr_time_now();
+      else if (fanout->policy != fanout_block
+               && apr_time_now() - start > fanout->stall_limit)
+        {
+          struct output *slowest = slowest_output(fanout);
+
+          if (slowest && fanout->policy == fanout_fail)
+            {
+              err = svn_error_createf(SVN_ERR_IO_WRITE_ERROR, NULL,
+                                      _("Output '%s' fell behind"),
+                                      slowest->stats.name);
+              break;
+            }
+          if (slowest)
+            {
+              stop_output(slowest, output_dropped);
+              continue;
+            }
+        }
+
+      /* Every change to the free blocks or the outputs is signalled;
+         only the stall limit of a policy that gives up on outputs
+         needs a timeout. */
+      if (fanout->policy == fanout_block)
+        apr_thread_cond_wait(fanout->cond, fanout->mutex);
+      else
+        apr_thread_cond_timedwait(fanout->cond, fanout->mutex,
+                                  start + fanout->stall_limit + 1
+                                  - apr_time_now());
+    }
+
+  if (! err)
+    fanout->current = fanout->free_blocks[--fanout->nfree];
+  apr_thread_mutex_unlock(fanout->mutex);
+
+  if (start)
+    fanout->stats.producer_stall += apr_time_now() - start;
+  SVN_ERR(err);
+
+  fanout->current->len = 0;
+  fanout->current->boundary = fanout->pending_boundary ? 0 : NO_BOUNDARY;
+  fanout->pending_boundary = FALSE;
+  return SVN_NO_ERROR;
+}
+
+/* Hand the current block of FANOUT to all active outputs. */
+static svn_error_t *
+publish(struct fanout *fanout)
+{
+  struct block *block = fanout->current;
+  int i;
+
+  fanout->current = NULL;
+  fanout->stats.buffers++;
+  fanout->stats.bytes += block->len;
+
+  apr_thread_mutex_lock(fanout->mutex);
+  block->refs = 0;
+  for (i = 0; i < fanout->outputs->nelts; i++)
+    {
+      struct output *output = APR_ARRAY_IDX(fanout->outputs, i,
+                                            struct output *);
+
+      if (output->state != output_active)
+        continue;
+
+      output->queue[(output->start + output->len) % fanout->depth] = block;
+      output->len++;
+      block->refs++;
+    }
+  if (! block->refs)
+    fanout->free_blocks[fanout->nfree++] = block;
+  apr_thread_cond_broadcast(fanout->cond);
+  apr_thread_mutex_unlock(fanout->mutex);
+
+  if (! block->refs)
+    return svn_error_create(SVN_ERR_IO_WRITE_ERROR, NULL,
+                            _("All outputs were dropped"));
+  return SVN_NO_ERROR;
+}
+
+/* Implements svn_write_fn_t for fanout_stream(). */
+static svn_error_t *
+write_handler(void *baton,
+              const char *data,
+              apr_size_t *len)
+{
+  struct fanout *fanout = baton;
+  apr_size_t remaining = *len;
+
+  if (fanout->closed)
+    return svn_error_create(SVN_ERR_IO_WRITE_ERROR, NULL,
+                            _("Write to a closed fanout"));
+  fanout->started = TRUE;
+
+  while (remaining)
+    {
+      struct block *block;
+      apr_size_t chunk;
+
+      if (! fanout->current)
+        SVN_ERR(claim_block(fanout));
+
+      block = fanout->current;
+      chunk = fanout->buffer_size - block->len;
+      if (chunk > remaining)
+        chunk = remaining;
+
+      memcpy(block->data + block->len, data, chunk);
+      block->len += chunk;
+      data += chunk;
+      remaining -= chunk;
+
+      if (block->len == fanout->buffer_size)
+        SVN_ERR(publish(fanout));
+    }
+
+  return SVN_NO_ERROR;
+}
+
+/* Implements svn_close_fn_t for fanout_stream(). */
+static svn_error_t *
+close_handler(void *baton)
+{
+  return fanout_close(baton);
+}
+
+#if APR_HAS_THREADS
+/* Write BLOCK to OUTPUT, telling it about the revision boundary in it,
+ * if any. */
+static svn_error_t *
+write_block(struct output *output,
+            struct block *block)
+{
+  apr_size_t len;
+
+  if (block->boundary != NO_BOUNDARY)
+    {
+      len = block->boundary;
+      if (len)
+        SVN_ERR(svn_stream_write(output->target, block->data, &len));
+      if (output->boundary_func)
+        SVN_ERR(output->boundary_func(output->boundary_baton));
+
+      len = block->len - block->boundary;
+      if (len)
+        SVN_ERR(svn_stream_write(output->target,
+                                 block->data + block->boundary, &len));
+    }
+  else
+    {
+      len = block->len;
+      SVN_ERR(svn_stream_write(output->target, block->data, &len));
+    }
+
+  output->stats.bytes += block->len;
+  return SVN_NO_ERROR;
+}
+
+/* Thread body of an output.  DATA is the struct output. */
+static void * APR_THREAD_FUNC
+output_thread(apr_thread_t *tid,
+              void *data)
+{
+  struct output *output = data;
+  struct fanout *fanout = output->fanout;
+  svn_error_t *err = SVN_NO_ERROR;
+
+  apr_thread_mutex_lock(fanout->mutex);
+  while (output->state == output_active)
+    {
+      struct block *block;
+
+      if (! output->len)
+        {
+          apr_time_t start;
+
+          if (fanout->closing)
+            break;
+
+          start = apr_time_now();
+          apr_thread_cond_wait(fanout->cond, fanout->mutex);
+          output->stats.stall += apr_time_now() - start;
+          continue;
+        }
+
+      block = output->queue[output->start];
+      output->start = (output->start + 1) % fanout->depth;
+      output->len--;
+      apr_thread_mutex_unlock(fanout->mutex);
+
+      err = write_block(output, block);
+
+      apr_thread_mutex_lock(fanout->mutex);
+      release_block(fanout, block);
+      apr_thread_cond_broadcast(fanout->cond);
+      if (err)
+        break;
+    }
+  apr_thread_mutex_unlock(fanout->mutex);
+
+  /* Close the target even if the output was dropped, so that what it
+     got so far is written out. */
+  if (! err)
+    err = svn_stream_close(output->target);
+
+  apr_thread_mutex_lock(fanout->mutex);
+  if (err && fanout->policy == fanout_drop)
+    {
+      svn_error_clear(err);
+      stop_output(output, output_dropped);
+    }
+  else if (err)
+    {
+      output->err = err;
+      stop_output(output, output_failed);
+    }
+  apr_thread_mutex_unlock(fanout->mutex);
+
+  apr_thread_exit(tid, APR_SUCCESS);
+  return NULL;
+}
+#endif
+
+svn_error_t *
+fanout_create(struct fanout **fanout,
+              enum fanout_policy policy,
+              apr_interval_time_t stall_limit,
+              apr_size_t buffer_size,
+              int depth,
+              svn_boolean_t flush_at_boundary,
+              apr_pool_t *pool)
+{
+#if APR_HAS_THREADS
+  struct fanout *new_fanout = apr_pcalloc(pool, sizeof(*new_fanout));
+  apr_status_t status;
+  int i;
+
+  SVN_ERR_ASSERT(buffer_size > 0 && depth > 0);
+
+  new_fanout->policy = policy;
+  new_fanout->stall_limit = stall_limit;
+  new_fanout->buffer_size = buffer_size;
+  new_fanout->depth = depth;
+  new_fanout->flush_at_boundary = flush_at_boundary;
+  new_fanout->outputs = apr_array_make(pool, 4, sizeof(struct output *));
+  new_fanout->pool = pool;
+
+  new_fanout->free_blocks = apr_palloc(pool, depth * sizeof(struct block *));
+  for (i = 0; i < depth; i++)
+    {
+      struct block *block = apr_pcalloc(pool, sizeof(*block));
+
+      block->data = apr_palloc(pool, buffer_size);
+      new_fanout->free_blocks[new_fanout->nfree++] = block;
+    }
+
+  status = apr_thread_mutex_create(&new_fanout->mutex,
+                                   APR_THREAD_MUTEX_DEFAULT, pool);
+  if (! status)
+    status = apr_thread_cond_create(&new_fanout->cond, pool);
+  if (status)
+    return svn_error_wrap_apr(status, _("Can't create fanout"));
+
+  *fanout = new_fanout;
+  return SVN_NO_ERROR;
+#else
+  return svn_error_create(SVN_ERR_UNSUPPORTED_FEATURE, NULL,
+                          _("Writing to several outputs requires thread "
+                            "support"));
+#endif
+}
+
+svn_error_t *
+fanout_add_output(struct fanout *fanout,
+                  const char *name,
+                  svn_stream_t *target,
+                  svn_error_t *(*boundary_func)(void *baton),
+                  void *boundary_baton)
+{
+#if APR_HAS_THREADS
+  struct output *output = apr_pcalloc(fanout->pool, sizeof(*output));
+  apr_status_t status;
+
+  SVN_ERR_ASSERT(! fanout->started);
+
+  output->fanout = fanout;
+  output->target = target;
+  output->boundary_func = boundary_func;
+  output->boundary_baton = boundary_baton;
+  output->queue = apr_pcalloc(fanout->pool,
+                              fanout->depth * sizeof(struct block *));
+  output->state = output_active;
+  output->stats.name = apr_pstrdup(fanout->pool, name);
+
+  status = apr_thread_create(&output->thread, NULL, output_thread, output,
+                             fanout->pool);
+  if (status)
+    return svn_error_wrap_apr(status, _("Can't start output writer thread"));
+
+  APR_ARRAY_PUSH(fanout->outputs, struct output *) = output;
+  return SVN_NO_ERROR;
+#else
+  return svn_error_create(SVN_ERR_UNSUPPORTED_FEATURE, NULL,
+                          _("Writing to several outputs requires thread "
+                            "support"));
+#endif
+}
+
+svn_stream_t *
+fanout_stream(struct fanout *fanout,
+              apr_pool_t *pool)
+{
+  svn_stream_t *stream = svn_stream_create(fanout, pool);
+
+  svn_stream_set_write(stream, write_handler);
+  svn_stream_set_close(stream, close_handler);
+  return stream;
+}
+
+svn_error_t *
+fanout_boundary(void *baton)
+{
+  struct fanout *fanout = baton;
+
+  if (! fanout->current)
+    {
+      fanout->pending_boundary = TRUE;
+      return SVN_NO_ERROR;
+    }
+
+  fanout->current->boundary = fanout->current->len;
+  if (fanout->flush_at_boundary)
+    return publish(fanout);
+  return SVN_NO_ERROR;
+}
+
+svn_error_t *
+fanout_close(struct fanout *fanout)
+{
+  svn_error_t *err = SVN_NO_ERROR;
+  int i;
+
+  if (fanout->closed)
+    return SVN_NO_ERROR;
+  fanout->closed = TRUE;
+
+  if (fanout->current)
+    err = publish(fanout);
+
+  apr_thread_mutex_lock(fanout->mutex);
+  fanout->closing = TRUE;
+  apr_thread_cond_broadcast(fanout->cond);
+  apr_thread_mutex_unlock(fanout->mutex);
+
+  for (i = 0; i < fanout->outputs->nelts; i++)
+    {
+      struct output *output = APR_ARRAY_IDX(fanout->outputs, i,
+                                            struct output *);
+#if APR_HAS_THREADS
+      apr_status_t retval;
+
+      apr_thread_join(&retval, output->thread);
+#endif
+      err = svn_error_compose_create(err, output->err);
+      output->err = SVN_NO_ERROR;
+    }
+
+  return err;
+}
+
+const struct fanout_stats *
+fanout_get_stats(const struct fanout *fanout)
+{
+  return &fanout->stats;
+}
+
+int
+fanout_output_count(const struct fanout *fanout)
+{
+  return fanout->outputs->nelts;
+}
+
+const struct fanout_output_stats *
+fanout_get_output_stats(const struct fanout *fanout,
+                        int i)
+{
+  return &(APR_ARRAY_IDX(fanout->outputs, i, struct output *)->stats);
+}
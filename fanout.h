@@ -0,0 +1,173 @@
+/**
+ * @copyright
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ * @endcopyright
+ *
+ * @file fanout.h
+ * @brief Writing one dumpstream to several outputs, each drained by
+ * its own writer thread.
+ */
+
+#ifndef FANOUT_H_
+#define FANOUT_H_
+
+/** The default size of the buffers shared by the outputs: 256 KiB. */
+#define FANOUT_DEFAULT_BUFFER_SIZE (256 * 1024)
+
+/** The default number of shared buffers. */
+#define FANOUT_DEFAULT_DEPTH 8
+
+/** How long, by default, the producer waits for a slow output before
+ * the policy applies: one second. */
+#define FANOUT_DEFAULT_STALL_LIMIT apr_time_from_sec(1)
+
+/**
+ * What to do when an output falls behind so far that no buffer is
+ * left for the producer to fill.
+ */
+enum fanout_policy
+{
+  /* Wait for it, however long it takes. */
+  fanout_block,
+
+  /* After the stall limit, stop writing to the slowest output and go
+     on without it.  An output that fails is dropped as well. */
+  fanout_drop,
+
+  /* After the stall limit, fail the dump. */
+  fanout_fail
+};
+
+/**
+ * Counters describing a fanout.  Times are in microseconds.
+ */
+struct fanout_stats
+{
+  /* buffers and bytes handed to the outputs */
+  apr_uint64_t buffers;
+  apr_uint64_t bytes;
+
+  /* time the producer spent waiting for a free buffer */
+  apr_time_t producer_stall;
+};
+
+/**
+ * Counters describing one output of a fanout.
+ */
+struct fanout_output_stats
+{
+  /* the name the output was added with */
+  const char *name;
+
+  /* bytes written to it, and time spent waiting for the producer */
+  apr_uint64_t bytes;
+  apr_time_t stall;
+
+  /* set if it fell behind or failed and was dropped, so that it is
+     incomplete */
+  svn_boolean_t dropped;
+};
+
+/**
+ * An opaque fanout.
+ */
+struct fanout;
+
+/**
+ * Create a fanout @a *fanout with @a depth buffers of @a buffer_size
+ * bytes each, shared by all of its outputs.  A buffer is filled once
+ * and then written to every output from the same memory; it is
+ * reused when the last output is done with it.  If no buffer is free
+ * for more than @a stall_limit, @a policy decides what happens.  If
+ * @a flush_at_boundary is set, the buffer being filled is handed to
+ * the outputs at every revision boundary (see fanout_boundary()).
+ * Allocate in @a pool.
+ */
+svn_error_t *
+fanout_create(struct fanout **fanout,
+              enum fanout_policy policy,
+              apr_interval_time_t stall_limit,
+              apr_size_t buffer_size,
+              int depth,
+              svn_boolean_t flush_at_boundary,
+              apr_pool_t *pool);
+
+/**
+ * Add an output called @a name to @a fanout and start its writer
+ * thread, which is the only one to ever write to and close @a target.
+ * @a boundary_func, if not NULL, is called with @a boundary_baton from
+ * that thread whenever the data written to @a target ends at a
+ * revision boundary.  Outputs must be added before anything is
+ * written to the fanout.
+ */
+svn_error_t *
+fanout_add_output(struct fanout *fanout,
+                  const char *name,
+                  svn_stream_t *target,
+                  svn_error_t *(*boundary_func)(void *baton),
+                  void *boundary_baton);
+
+/**
+ * Return a writable stream, allocated in @a pool, feeding @a fanout.
+ * Closing the stream is equivalent to calling fanout_close().  The
+ * stream must only be used by one thread.
+ */
+svn_stream_t *
+fanout_stream(struct fanout *fanout,
+              apr_pool_t *pool);
+
+/**
+ * Tell @a baton, a struct fanout, that the data written so far ends
+ * at a revision boundary.
+ */
+svn_error_t *
+fanout_boundary(void *baton);
+
+/**
+ * Hand what is left to the outputs, wait for all of them to write it
+ * out and close their targets.  Return the first error of an output
+ * that was not dropped, if any.  A dropped output is closed as well,
+ * once it returns from the write it was in.  Calling this more than
+ * once is harmless.
+ */
+svn_error_t *
+fanout_close(struct fanout *fanout);
+
+/**
+ * Return the counters of @a fanout.
+ */
+const struct fanout_stats *
+fanout_get_stats(const struct fanout *fanout);
+
+/**
+ * Return the number of outputs of @a fanout.
+ */
+int
+fanout_output_count(const struct fanout *fanout);
+
+/**
+ * Return the counters of output number @a i (counting from 0, in the
+ * order they were added) of @a fanout.
+ */
+const struct fanout_output_stats *
+fanout_get_output_stats(const struct fanout *fanout,
+                        int i);
+
+#endif
@@ -0,0 +1,1084 @@
+/*
+ *  fulltext_cache.c: A persistent on-disk cache of file texts, addressed
+ *  by their checksums.
+ *
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "svn_pools.h"
+#include "svn_io.h"
+#include "svn_hash.h"
+#include "svn_checksum.h"
+#include "svn_dirent_uri.h"
+
+#include "svn17_compat.h"
+#include "fulltext_cache.h"
+
+/* The name of the index file in the cache directory, and its first
+   line. */
+#define INDEX_NAME "index"
+#define INDEX_HEADER "SVNRDUMP-FULLTEXT-CACHE 2"
+
+/* An oversized cache is cut down to this much of its size limit, so
+   that it doesn't need to evict again at the next revision. */
+#define EVICT_TARGET(max_size) ((max_size) / 10 * 9)
+
+/* How many copies a lookup of a node follows at most. */
+#define MAX_COPY_HOPS 16
+
+/* A text or property list in the cache. */
+struct cache_entry
+{
+  struct fulltext_info info;
+
+  /* The clock of the cache when the text was last used. */
+  apr_uint64_t used;
+};
+
+/* Stands for the text or property list of the copy source of a node
+   that it is unchanged from. */
+static struct cache_entry as_copy_source;
+#define AS_COPY_SOURCE (&as_copy_source)
+
+/* What the index knows of a node. */
+struct node_entry
+{
+  /* The path of the node, without a leading slash. */
+  const char *path;
+
+  /* The last revision the node was recorded in, and the last revision
+     it was added, replaced or deleted in, or SVN_INVALID_REVNUM if
+     that isn't known.  The entries of nodes below it from before that
+     are out of date. */
+  svn_revnum_t revision;
+  svn_revnum_t reset_rev;
+
+  /* Whether the node was deleted in REVISION. */
+  svn_boolean_t deleted;
+
+  /* Whether entries of nodes below it have been evicted, so that the
+     nodes it has no entry for can't be taken to be unchanged from
+     below its copy source. */
+  svn_boolean_t partial;
+
+  /* Where the node was copied from in RESET_REV, or NULL. */
+  const char *copyfrom_path;
+  svn_revnum_t copyfrom_rev;
+
+  /* The text and the property list of the node as of REVISION: NULL
+     if unknown, or AS_COPY_SOURCE. */
+  struct cache_entry *text;
+  struct cache_entry *props;
+
+  /* The clock of the cache when the entry was last used. */
+  apr_uint64_t used;
+};
+
+struct fulltext_cache
+{
+  /* The cache directory, and the URL of the repository the nodes are
+     those of. */
+  const char *dir;
+  const char *url;
+
+  /* The size limit, and the size of all texts and node entries. */
+  apr_uint64_t max_size;
+  apr_uint64_t size;
+
+  /* Maps hex MD5 checksums to struct cache_entry *. */
+  apr_hash_t *texts;
+
+  /* Maps node paths, without a leading slash, to struct node_entry *. */
+  apr_hash_t *nodes;
+
+  /* Counts uses of texts and nodes. */
+  apr_uint64_t clock;
+
+  /* See fulltext_cache_start_revision(). */
+  svn_revnum_t revision;
+
+  struct fulltext_cache_stats stats;
+
+  /* Everything above is allocated here. */
+  apr_pool_t *pool;
+};
+
+/* Baton for a stream adding a text to the cache. */
+struct text_writer
+{
+  struct fulltext_cache *cache;
+
+  /* The temporary file in the cache directory the text goes to, and
+     the checksums and size of what was written to it so far. */
+  apr_file_t *file;
+  const char *tmp_path;
+  svn_checksum_ctx_t *md5_ctx;
+  svn_checksum_ctx_t *sha1_ctx;
+  svn_filesize_t size;
+
+  /* Where to point to the text. */
+  const struct fulltext_info **info;
+
+  apr_pool_t *pool;
+};
+
+/* Return PATH without a leading slash. */
+static const char *
+node_key(const char *path)
+{
+  return (*path == '/') ? path + 1 : path;
+}
+
+/* Return the length of the path of the parent of the node whose path
+ * is the first LEN bytes of PATH, which must not be the root. */
+static apr_size_t
+parent_length(const char *path,
+              apr_size_t len)
+{
+  while (len > 0 && path[len - 1] != '/')
+    len--;
+  return (len > 0) ? len - 1 : 0;
+}
+
+/* Return the file holding the text INFO of CACHE, allocated in POOL. */
+static const char *
+text_file(const struct fulltext_cache *cache,
+          const struct fulltext_info *info,
+          apr_pool_t *pool)
+{
+  return svn_dirent_join(cache->dir, info->sha1, pool);
+}
+
+/* Return the text in CACHE with the hex checksums MD5 and SHA1 and
+ * SIZE, adding it if it isn't there. */
+static struct cache_entry *
+add_text(struct fulltext_cache *cache,
+         const char *md5,
+         const char *sha1,
+         svn_filesize_t size)
+{
+  struct cache_entry *entry = apr_hash_get(cache->texts, md5,
+                                           APR_HASH_KEY_STRING);
+
+  if (! entry)
+    {
+      entry = apr_pcalloc(cache->pool, sizeof(*entry));
+      entry->info.md5 = apr_pstrdup(cache->pool, md5);
+      entry->info.sha1 = apr_pstrdup(cache->pool, sha1);
+      entry->info.size = size;
+      apr_hash_set(cache->texts, entry->info.md5, APR_HASH_KEY_STRING, entry);
+      cache->size += size;
+    }
+  entry->used = ++cache->clock;
+  return entry;
+}
+
+/* Remove ENTRY from CACHE, though not its file. */
+static void
+remove_text(struct fulltext_cache *cache,
+            struct cache_entry *entry)
+{
+  apr_hash_set(cache->texts, entry->info.md5, APR_HASH_KEY_STRING, NULL);
+  cache->size -= entry->info.size;
+}
+
+/* Return how much NODE counts against the size limit of its cache: the
+ * memory it takes, near enough. */
+static apr_uint64_t
+node_size(const struct node_entry *node)
+{
+  return sizeof(*node) + strlen(node->path) + 1
+         + (node->copyfrom_path ? strlen(node->copyfrom_path) + 1 : 0);
+}
+
+/* Return the entry of the node PATH, without a leading slash, in
+ * CACHE, adding an empty one if there is none. */
+static struct node_entry *
+get_node(struct fulltext_cache *cache,
+         const char *path)
+{
+  struct node_entry *node = apr_hash_get(cache->nodes, path,
+                                         APR_HASH_KEY_STRING);
+
+  if (! node)
+    {
+      node = apr_pcalloc(cache->pool, sizeof(*node));
+      node->path = apr_pstrdup(cache->pool, path);
+      node->revision = SVN_INVALID_REVNUM;
+      node->reset_rev = SVN_INVALID_REVNUM;
+      node->copyfrom_rev = SVN_INVALID_REVNUM;
+      apr_hash_set(cache->nodes, node->path, APR_HASH_KEY_STRING, node);
+      cache->size += node_size(node);
+    }
+  node->used = ++cache->clock;
+  return node;
+}
+
+/* Set the copy source of NODE in CACHE to COPYFROM_PATH@COPYFROM_REV,
+ * or to none if COPYFROM_PATH is NULL. */
+static void
+set_copyfrom(struct fulltext_cache *cache,
+             struct node_entry *node,
+             const char *copyfrom_path,
+             svn_revnum_t copyfrom_rev)
+{
+  cache->size -= node_size(node);
+  node->copyfrom_path = copyfrom_path
+                        ? apr_pstrdup(cache->pool, node_key(copyfrom_path))
+                        : NULL;
+  node->copyfrom_rev = copyfrom_path ? copyfrom_rev : SVN_INVALID_REVNUM;
+  cache->size += node_size(node);
+}
+
+/* Remove NODE from CACHE. */
+static void
+remove_node(struct fulltext_cache *cache,
+            struct node_entry *node)
+{
+  apr_hash_set(cache->nodes, node->path, APR_HASH_KEY_STRING, NULL);
+  cache->size -= node_size(node);
+}
+
+/* Forget all nodes of CACHE.  Use POOL for temporary allocations. */
+static void
+clear_nodes(struct fulltext_cache *cache,
+            apr_pool_t *pool)
+{
+  apr_hash_index_t *hi;
+
+  for (hi = apr_hash_first(pool, cache->nodes); hi; hi = apr_hash_next(hi))
+    remove_node(cache, svn__apr_hash_index_val(hi));
+}
+
+/* Return the parent of the node PATH in CACHE that was added, replaced
+ * or deleted last, or NULL if none is known to have been. */
+static struct node_entry *
+last_reset_parent(struct fulltext_cache *cache,
+                  const char *path)
+{
+  struct node_entry *parent = NULL;
+  apr_size_t len = strlen(path);
+
+  while (len > 0)
+    {
+      struct node_entry *node;
+
+      len = parent_length(path, len);
+      node = apr_hash_get(cache->nodes, path, len);
+      if (node && SVN_IS_VALID_REVNUM(node->reset_rev)
+          && (! parent || node->reset_rev > parent->reset_rev))
+        parent = node;
+    }
+
+  return parent;
+}
+
+/* Return TRUE if NODE, whose last reset parent in its cache is PARENT,
+ * is not out of date. */
+static svn_boolean_t
+node_is_current(const struct node_entry *node,
+                const struct node_entry *parent)
+{
+  return ! parent || node->revision >= parent->reset_rev;
+}
+
+/* Return the text, if TEXT is set, or else the property list of the
+ * node PATH@REVISION according to CACHE, or NULL if unknown.  Follow at
+ * most HOPS copies.  Use POOL for temporary allocations. */
+static struct cache_entry *
+resolve_node(struct fulltext_cache *cache,
+             const char *path,
+             svn_revnum_t revision,
+             svn_boolean_t text,
+             int hops,
+             apr_pool_t *pool)
+{
+  struct node_entry *node = apr_hash_get(cache->nodes, path,
+                                         APR_HASH_KEY_STRING);
+  struct node_entry *parent = last_reset_parent(cache, path);
+  struct cache_entry *entry;
+  const char *below;
+
+  if (node && node_is_current(node, parent))
+    {
+      /* Nothing is known of the node before its last change. */
+      if (node->deleted || node->revision > revision)
+        return NULL;
+
+      node->used = ++cache->clock;
+      entry = text ? node->text : node->props;
+      if (entry != AS_COPY_SOURCE)
+        return entry;
+      if (hops == 0)
+        return NULL;
+      return resolve_node(cache, node->copyfrom_path, node->copyfrom_rev,
+                          text, hops - 1, pool);
+    }
+
+  /* The node hasn't changed since its parent was added, so it is as it
+     was below the copy source of the parent, if there was one. */
+  if (! parent || ! parent->copyfrom_path || parent->partial
+      || parent->reset_rev > revision || hops == 0)
+    return NULL;
+
+  parent->used = ++cache->clock;
+  below = path + strlen(parent->path);
+  if (*below == '/')
+    below++;
+  return resolve_node(cache,
+                      svn_relpath_join(parent->copyfrom_path, below, pool),
+                      parent->copyfrom_rev, text, hops - 1, pool);
+}
+
+/* Return the entry of the node PATH, without a leading slash, in
+ * CACHE, brought up to the current revision for a change to it.  Keep
+ * whatever is still known of it.  Use POOL for temporary
+ * allocations. */
+static struct node_entry *
+touch_node(struct fulltext_cache *cache,
+           const char *path,
+           apr_pool_t *pool)
+{
+  struct node_entry *node = apr_hash_get(cache->nodes, path,
+                                         APR_HASH_KEY_STRING);
+  struct cache_entry *text, *props;
+
+  if (node && ! node->deleted
+      && (node->revision == cache->revision
+          || node_is_current(node, last_reset_parent(cache, path))))
+    {
+      node->revision = cache->revision;
+      node->used = ++cache->clock;
+      return node;
+    }
+
+  /* Start over with what the node was copied with, if anything. */
+  text = resolve_node(cache, path, cache->revision, TRUE, MAX_COPY_HOPS,
+                      pool);
+  props = resolve_node(cache, path, cache->revision, FALSE, MAX_COPY_HOPS,
+                       pool);
+  node = get_node(cache, path);
+  set_copyfrom(cache, node, NULL, SVN_INVALID_REVNUM);
+  node->revision = cache->revision;
+  node->reset_rev = SVN_INVALID_REVNUM;
+  node->deleted = FALSE;
+  node->partial = FALSE;
+  node->text = text;
+  node->props = props;
+  return node;
+}
+
+/* Forget the texts of the nodes of CACHE that have been removed, and
+ * the nodes below those in the hash EVICTED, if not NULL, which maps
+ * the paths of removed nodes to their entries.  Use POOL for temporary
+ * allocations. */
+static void
+prune_nodes(struct fulltext_cache *cache,
+            apr_hash_t *evicted,
+            apr_pool_t *pool)
+{
+  apr_hash_index_t *hi;
+
+  for (hi = apr_hash_first(pool, cache->nodes); hi; hi = apr_hash_next(hi))
+    {
+      struct node_entry *node = svn__apr_hash_index_val(hi);
+      apr_size_t len = strlen(node->path);
+
+      if (node->text && node->text != AS_COPY_SOURCE
+          && apr_hash_get(cache->texts, node->text->info.md5,
+                          APR_HASH_KEY_STRING) != node->text)
+        node->text = NULL;
+      if (node->props && node->props != AS_COPY_SOURCE
+          && apr_hash_get(cache->texts, node->props->info.md5,
+                          APR_HASH_KEY_STRING) != node->props)
+        node->props = NULL;
+
+      /* Without the parent that was added or deleted, the node might
+         look current when it isn't. */
+      while (evicted && len > 0)
+        {
+          len = parent_length(node->path, len);
+          if (apr_hash_get(evicted, node->path, len))
+            {
+              remove_node(cache, node);
+              break;
+            }
+        }
+    }
+}
+
+/* A text or a node, as a candidate for eviction. */
+struct lru_item
+{
+  apr_uint64_t used;
+  struct cache_entry *text;
+  struct node_entry *node;
+};
+
+/* Order struct lru_item from the least recently used. */
+static int
+compare_used(const void *a,
+             const void *b)
+{
+  const struct lru_item *item_a = a;
+  const struct lru_item *item_b = b;
+
+  if (item_a->used == item_b->used)
+    return 0;
+  return (item_a->used < item_b->used) ? -1 : 1;
+}
+
+/* If CACHE is larger than its limit, remove the least recently used
+ * texts and nodes.  Use POOL for temporary allocations. */
+static svn_error_t *
+evict(struct fulltext_cache *cache,
+      apr_pool_t *pool)
+{
+  apr_array_header_t *items;
+  apr_hash_t *evicted;
+  apr_hash_index_t *hi;
+  apr_pool_t *iterpool;
+  int i;
+
+  if (cache->size <= cache->max_size)
+    return SVN_NO_ERROR;
+
+  items = apr_array_make(pool, apr_hash_count(cache->texts)
+                               + apr_hash_count(cache->nodes),
+                         sizeof(struct lru_item));
+  for (hi = apr_hash_first(pool, cache->texts); hi; hi = apr_hash_next(hi))
+    {
+      struct lru_item *item = apr_array_push(items);
+
+      item->text = svn__apr_hash_index_val(hi);
+      item->node = NULL;
+      item->used = item->text->used;
+    }
+  for (hi = apr_hash_first(pool, cache->nodes); hi; hi = apr_hash_next(hi))
+    {
+      struct lru_item *item = apr_array_push(items);
+
+      item->text = NULL;
+      item->node = svn__apr_hash_index_val(hi);
+      item->used = item->node->used;
+    }
+  qsort(items->elts, items->nelts, items->elt_size, compare_used);
+
+  evicted = apr_hash_make(pool);
+  iterpool = svn_pool_create(pool);
+  for (i = 0;
+       i < items->nelts && cache->size > EVICT_TARGET(cache->max_size);
+       i++)
+    {
+      const struct lru_item *item = &APR_ARRAY_IDX(items, i,
+                                                   struct lru_item);
+
+      svn_pool_clear(iterpool);
+      if (item->text)
+        {
+          SVN_ERR(svn_io_remove_file2(text_file(cache, &item->text->info,
+                                                iterpool),
+                                      TRUE, iterpool));
+          remove_text(cache, item->text);
+          cache->stats.evictions++;
+        }
+      else
+        {
+          struct node_entry *parent = last_reset_parent(cache,
+                                                        item->node->path);
+
+          /* Lookups of the node, and of those below it if it was
+             added, now end at that parent. */
+          if (parent)
+            parent->partial = TRUE;
+          remove_node(cache, item->node);
+          if (SVN_IS_VALID_REVNUM(item->node->reset_rev))
+            apr_hash_set(evicted, item->node->path, APR_HASH_KEY_STRING,
+                         item->node);
+        }
+    }
+  svn_pool_destroy(iterpool);
+
+  prune_nodes(cache, apr_hash_count(evicted) ? evicted : NULL, pool);
+  return SVN_NO_ERROR;
+}
+
+/* Return an error for the malformed index file INDEX_PATH. */
+static svn_error_t *
+malformed_index(const char *index_path)
+{
+  return svn_error_createf(SVN_ERR_BAD_VERSION_FILE_FORMAT, NULL,
+                           _("'%s' is not a valid fulltext cache index"),
+                           index_path);
+}
+
+/* Split the first N space-separated fields of LINE off into FIELDS, in
+ * place, and return the rest of the line, or NULL if LINE has fewer
+ * fields. */
+static char *
+split_fields(char **fields,
+             int n,
+             char *line)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    {
+      char *end = strchr(line, ' ');
+
+      if (! end)
+        return NULL;
+      *end = '\0';
+      fields[i] = line;
+      line = end + 1;
+    }
+  return line;
+}
+
+/* Set *ENTRY to the text NAME stands for in a node line of the index of
+ * CACHE, as written by entry_name().  Return FALSE if there is no such
+ * text. */
+static svn_boolean_t
+parse_entry_name(struct cache_entry **entry,
+                 struct fulltext_cache *cache,
+                 const char *name)
+{
+  if (strcmp(name, "-") == 0)
+    *entry = NULL;
+  else if (strcmp(name, "=") == 0)
+    *entry = AS_COPY_SOURCE;
+  else
+    *entry = apr_hash_get(cache->texts, name, APR_HASH_KEY_STRING);
+  return *entry != NULL || strcmp(name, "-") == 0;
+}
+
+/* Return how ENTRY, the text or property list of a node, is written in
+ * the index. */
+static const char *
+entry_name(const struct cache_entry *entry)
+{
+  if (! entry)
+    return "-";
+  if (entry == AS_COPY_SOURCE)
+    return "=";
+  return entry->info.md5;
+}
+
+/* Read the index of CACHE, if there is one.  It has INDEX_HEADER on the
+ * first line, then these lines, with USED being the clock of the cache
+ * when the text or node was last used:
+ *
+ *   "U URL"  the URL the nodes are those of
+ *   "R REV"  the revision last started
+ *   "T USED MD5 SHA1 SIZE"  for each text, before the nodes
+ *   "N USED REV RESET DELETED PARTIAL TEXT PROPS PATH"  for each
+ *            node, with the flags as 0 or 1, and TEXT and PROPS as
+ *            written by entry_name()
+ *   "C REV PATH"  for the copy source of the node before it, if any
+ *
+ * Use POOL for temporary allocations. */
+static svn_error_t *
+read_index(struct fulltext_cache *cache,
+           apr_pool_t *pool)
+{
+  const char *index_path = svn_dirent_join(cache->dir, INDEX_NAME, pool);
+  struct node_entry *node = NULL;
+  apr_pool_t *iterpool;
+  svn_stream_t *stream;
+  svn_stringbuf_t *line;
+  svn_boolean_t eof;
+  svn_error_t *err;
+
+  err = svn_stream_open_readonly(&stream, index_path, pool, pool);
+  if (err && APR_STATUS_IS_ENOENT(err->apr_err))
+    {
+      svn_error_clear(err);
+      return SVN_NO_ERROR;
+    }
+  SVN_ERR(err);
+
+  SVN_ERR(svn_stream_readline(stream, &line, "\n", &eof, pool));
+  if (strcmp(line->data, INDEX_HEADER) != 0)
+    return malformed_index(index_path);
+
+  iterpool = svn_pool_create(pool);
+  while (1)
+    {
+      char *fields[8];
+      char *rest;
+      apr_uint64_t used;
+
+      svn_pool_clear(iterpool);
+      SVN_ERR(svn_stream_readline(stream, &line, "\n", &eof, iterpool));
+      if (eof)
+        break;
+
+      switch (line->data[0])
+        {
+        case 'U':
+          if (! (rest = split_fields(fields, 1, line->data)))
+            return malformed_index(index_path);
+          cache->url = apr_pstrdup(cache->pool, rest);
+          break;
+
+        case 'R':
+          if (! (rest = split_fields(fields, 1, line->data)))
+            return malformed_index(index_path);
+          cache->revision = (svn_revnum_t)apr_strtoi64(rest, NULL, 10);
+          break;
+
+        case 'T':
+          {
+            struct cache_entry *entry;
+
+            if (! (rest = split_fields(fields, 4, line->data)))
+              return malformed_index(index_path);
+            entry = add_text(cache, fields[2], fields[3],
+                             apr_strtoi64(rest, NULL, 10));
+            used = apr_strtoi64(fields[1], NULL, 10);
+            entry->used = used;
+            if (used > cache->clock)
+              cache->clock = used;
+          }
+          break;
+
+        case 'N':
+          /* The path may contain spaces; it runs to the end of the
+             line. */
+          if (! (rest = split_fields(fields, 8, line->data)))
+            return malformed_index(index_path);
+          node = get_node(cache, rest);
+          if (! parse_entry_name(&node->text, cache, fields[6])
+              || ! parse_entry_name(&node->props, cache, fields[7]))
+            return malformed_index(index_path);
+          node->revision = (svn_revnum_t)apr_strtoi64(fields[2], NULL, 10);
+          node->reset_rev = (svn_revnum_t)apr_strtoi64(fields[3], NULL, 10);
+          node->deleted = (strcmp(fields[4], "1") == 0);
+          node->partial = (strcmp(fields[5], "1") == 0);
+          used = apr_strtoi64(fields[1], NULL, 10);
+          node->used = used;
+          if (used > cache->clock)
+            cache->clock = used;
+          break;
+
+        case 'C':
+          if (! node || ! (rest = split_fields(fields, 2, line->data)))
+            return malformed_index(index_path);
+          set_copyfrom(cache, node, rest,
+                       (svn_revnum_t)apr_strtoi64(fields[1], NULL, 10));
+          break;
+
+        default:
+          return malformed_index(index_path);
+        }
+    }
+  svn_pool_destroy(iterpool);
+
+  return svn_stream_close(stream);
+}
+
+/* Write the index of CACHE, in the format read_index() reads, and put
+ * it in place in one go.  Use POOL for temporary allocations. */
+static svn_error_t *
+write_index(const struct fulltext_cache *cache,
+            apr_pool_t *pool)
+{
+  apr_pool_t *iterpool = svn_pool_create(pool);
+  apr_hash_index_t *hi;
+  apr_file_t *file;
+  const char *tmp_path;
+  svn_stream_t *stream;
+
+  SVN_ERR(svn_io_open_unique_file3(&file, &tmp_path, cache->dir,
+                                   svn_io_file_del_none, pool, pool));
+  stream = svn_stream_from_aprfile2(file, FALSE, pool);
+
+  SVN_ERR(svn_stream_printf(stream, pool, "%s\n", INDEX_HEADER));
+  if (cache->url)
+    SVN_ERR(svn_stream_printf(stream, pool, "U %s\n", cache->url));
+  if (SVN_IS_VALID_REVNUM(cache->revision))
+    SVN_ERR(svn_stream_printf(stream, pool, "R %ld\n", cache->revision));
+
+  for (hi = apr_hash_first(pool, cache->texts); hi; hi = apr_hash_next(hi))
+    {
+      const struct cache_entry *entry = svn__apr_hash_index_val(hi);
+
+      svn_pool_clear(iterpool);
+      SVN_ERR(svn_stream_printf(stream, iterpool,
+                                "T %" APR_UINT64_T_FMT " %s %s %"
+                                SVN_FILESIZE_T_FMT "\n",
+                                entry->used, entry->info.md5,
+                                entry->info.sha1, entry->info.size));
+    }
+  for (hi = apr_hash_first(pool, cache->nodes); hi; hi = apr_hash_next(hi))
+    {
+      const struct node_entry *node = svn__apr_hash_index_val(hi);
+
+      svn_pool_clear(iterpool);
+      SVN_ERR(svn_stream_printf(stream, iterpool,
+                                "N %" APR_UINT64_T_FMT " %ld %ld %d %d %s "
+                                "%s %s\n",
+                                node->used, node->revision, node->reset_rev,
+                                node->deleted ? 1 : 0, node->partial ? 1 : 0,
+                                entry_name(node->text),
+                                entry_name(node->props), node->path));
+      if (node->copyfrom_path)
+        SVN_ERR(svn_stream_printf(stream, iterpool, "C %ld %s\n",
+                                  node->copyfrom_rev, node->copyfrom_path));
+    }
+  svn_pool_destroy(iterpool);
+  SVN_ERR(svn_stream_close(stream));
+
+  return svn_io_file_rename(tmp_path,
+                            svn_dirent_join(cache->dir, INDEX_NAME, pool),
+                            pool);
+}
+
+svn_error_t *
+fulltext_cache_open(struct fulltext_cache **cache,
+                    const char *dir,
+                    const char *url,
+                    apr_uint64_t max_size,
+                    apr_pool_t *pool)
+{
+  struct fulltext_cache *fc = apr_pcalloc(pool, sizeof(*fc));
+  apr_pool_t *scratch_pool = svn_pool_create(pool);
+  apr_hash_t *known, *dirents;
+  apr_hash_index_t *hi;
+
+  fc->dir = apr_pstrdup(pool, dir);
+  fc->max_size = max_size;
+  fc->texts = apr_hash_make(pool);
+  fc->nodes = apr_hash_make(pool);
+  fc->revision = SVN_INVALID_REVNUM;
+  fc->pool = pool;
+
+  SVN_ERR(svn_io_make_dir_recursively(dir, scratch_pool));
+  SVN_ERR(read_index(fc, scratch_pool));
+
+  /* The paths of the nodes are those of another dump. */
+  if (! fc->url || strcmp(fc->url, url) != 0)
+    {
+      clear_nodes(fc, scratch_pool);
+      fc->revision = SVN_INVALID_REVNUM;
+      fc->url = apr_pstrdup(pool, url);
+    }
+
+  /* Remove the files an interrupted run left behind: texts that never
+     made it into the index, and temporary files. */
+  known = apr_hash_make(scratch_pool);
+  for (hi = apr_hash_first(scratch_pool, fc->texts); hi;
+       hi = apr_hash_next(hi))
+    {
+      const struct cache_entry *entry = svn__apr_hash_index_val(hi);
+
+      apr_hash_set(known, entry->info.sha1, APR_HASH_KEY_STRING, entry);
+    }
+  SVN_ERR(svn_io_get_dirents2(&dirents, dir, scratch_pool));
+  for (hi = apr_hash_first(scratch_pool, dirents); hi;
+       hi = apr_hash_next(hi))
+    {
+      const char *name = svn__apr_hash_index_key(hi);
+
+      if (strcmp(name, INDEX_NAME) != 0
+          && ! apr_hash_get(known, name, APR_HASH_KEY_STRING))
+        SVN_ERR(svn_io_remove_file2(svn_dirent_join(dir, name, scratch_pool),
+                                    TRUE, scratch_pool));
+    }
+
+  svn_pool_destroy(scratch_pool);
+  *cache = fc;
+  return SVN_NO_ERROR;
+}
+
+svn_error_t *
+fulltext_cache_start_revision(struct fulltext_cache *cache,
+                              svn_revnum_t revision,
+                              apr_pool_t *pool)
+{
+  /* After a gap, the nodes may have changed in revisions that weren't
+     recorded.  The same revision again is a retry. */
+  if (SVN_IS_VALID_REVNUM(cache->revision)
+      && revision != cache->revision && revision != cache->revision + 1)
+    clear_nodes(cache, pool);
+
+  cache->revision = revision;
+  return evict(cache, pool);
+}
+
+svn_revnum_t
+fulltext_cache_revision(const struct fulltext_cache *cache)
+{
+  return cache->revision;
+}
+
+/* Count a lookup of ENTRY, which is NULL if it failed, in CACHE, and
+ * return the text of ENTRY. */
+static const struct fulltext_info *
+use_text(struct fulltext_cache *cache,
+         struct cache_entry *entry)
+{
+  if (! entry)
+    {
+      cache->stats.misses++;
+      return NULL;
+    }
+
+  cache->stats.hits++;
+  entry->used = ++cache->clock;
+  return &entry->info;
+}
+
+const struct fulltext_info *
+fulltext_cache_find(struct fulltext_cache *cache,
+                    const char *md5)
+{
+  return use_text(cache, apr_hash_get(cache->texts, md5,
+                                      APR_HASH_KEY_STRING));
+}
+
+svn_error_t *
+fulltext_cache_read(svn_stream_t **contents,
+                    struct fulltext_cache *cache,
+                    const struct fulltext_info *info,
+                    apr_pool_t *pool)
+{
+  svn_error_t *err = svn_stream_open_readonly(contents,
+                                              text_file(cache, info, pool),
+                                              pool, pool);
+  struct cache_entry *entry;
+
+  if (! err || ! APR_STATUS_IS_ENOENT(err->apr_err))
+    return err;
+
+  /* Someone removed the file; forget about the text. */
+  svn_error_clear(err);
+  entry = apr_hash_get(cache->texts, info->md5, APR_HASH_KEY_STRING);
+  if (entry && &entry->info == info)
+    {
+      remove_text(cache, entry);
+      prune_nodes(cache, NULL, pool);
+    }
+  *contents = NULL;
+  return SVN_NO_ERROR;
+}
+
+/* Add data to a text.  Implements svn_write_fn_t. */
+static svn_error_t *
+write_text(void *baton,
+           const char *data,
+           apr_size_t *len)
+{
+  struct text_writer *tw = baton;
+
+  SVN_ERR(svn_checksum_update(tw->md5_ctx, data, *len));
+  SVN_ERR(svn_checksum_update(tw->sha1_ctx, data, *len));
+  tw->size += *len;
+  return svn_io_file_write_full(tw->file, data, *len, NULL, tw->pool);
+}
+
+/* Put a complete text in place.  Implements svn_close_fn_t. */
+static svn_error_t *
+close_text(void *baton)
+{
+  struct text_writer *tw = baton;
+  struct fulltext_cache *cache = tw->cache;
+  svn_checksum_t *md5, *sha1;
+  const char *md5_hex;
+  struct cache_entry *entry;
+
+  SVN_ERR(svn_io_file_close(tw->file, tw->pool));
+  SVN_ERR(svn_checksum_final(&md5, tw->md5_ctx, tw->pool));
+  SVN_ERR(svn_checksum_final(&sha1, tw->sha1_ctx, tw->pool));
+  md5_hex = svn_checksum_to_cstring_display(md5, tw->pool);
+
+  entry = apr_hash_get(cache->texts, md5_hex, APR_HASH_KEY_STRING);
+  if (entry)
+    {
+      SVN_ERR(svn_io_remove_file2(tw->tmp_path, FALSE, tw->pool));
+      entry->used = ++cache->clock;
+    }
+  else
+    {
+      entry = add_text(cache, md5_hex,
+                       svn_checksum_to_cstring_display(sha1, tw->pool),
+                       tw->size);
+      SVN_ERR(svn_io_file_rename(tw->tmp_path,
+                                 text_file(cache, &entry->info, tw->pool),
+                                 tw->pool));
+      cache->stats.stores++;
+    }
+
+  *tw->info = &entry->info;
+  return SVN_NO_ERROR;
+}
+
+svn_error_t *
+fulltext_cache_write(svn_stream_t **stream,
+                     const struct fulltext_info **info,
+                     struct fulltext_cache *cache,
+                     apr_pool_t *pool)
+{
+  struct text_writer *tw = apr_pcalloc(pool, sizeof(*tw));
+
+  SVN_ERR(svn_io_open_unique_file3(&tw->file, &tw->tmp_path, cache->dir,
+                                   svn_io_file_del_none, pool, pool));
+  tw->cache = cache;
+  tw->md5_ctx = svn_checksum_ctx_create(svn_checksum_md5, pool);
+  tw->sha1_ctx = svn_checksum_ctx_create(svn_checksum_sha1, pool);
+  tw->info = info;
+  tw->pool = pool;
+
+  *stream = svn_stream_create(tw, pool);
+  svn_stream_set_write(*stream, write_text);
+  svn_stream_set_close(*stream, close_text);
+  return SVN_NO_ERROR;
+}
+
+svn_error_t *
+fulltext_cache_read_props(apr_hash_t **props,
+                          struct fulltext_cache *cache,
+                          const struct fulltext_info *info,
+                          apr_pool_t *pool)
+{
+  svn_stream_t *contents;
+
+  SVN_ERR(fulltext_cache_read(&contents, cache, info, pool));
+  if (! contents)
+    {
+      *props = NULL;
+      return SVN_NO_ERROR;
+    }
+
+  *props = apr_hash_make(pool);
+  SVN_ERR(svn_hash_read2(*props, contents, SVN_HASH_TERMINATOR, pool));
+  return svn_stream_close(contents);
+}
+
+svn_error_t *
+fulltext_cache_write_props(const struct fulltext_info **info,
+                           struct fulltext_cache *cache,
+                           apr_hash_t *props,
+                           apr_pool_t *pool)
+{
+  svn_stream_t *stream;
+
+  /* The properties are written sorted by name, so that the same list
+     is always the same text. */
+  SVN_ERR(fulltext_cache_write(&stream, info, cache, pool));
+  SVN_ERR(svn_hash_write2(props, stream, SVN_HASH_TERMINATOR, pool));
+  return svn_stream_close(stream);
+}
+
+void
+fulltext_cache_add_node(struct fulltext_cache *cache,
+                        const char *path,
+                        const char *copyfrom_path,
+                        svn_revnum_t copyfrom_rev)
+{
+  struct node_entry *node = get_node(cache, node_key(path));
+
+  set_copyfrom(cache, node, copyfrom_path, copyfrom_rev);
+  node->revision = cache->revision;
+  node->reset_rev = cache->revision;
+  node->deleted = FALSE;
+  node->partial = FALSE;
+  node->text = copyfrom_path ? AS_COPY_SOURCE : NULL;
+  node->props = copyfrom_path ? AS_COPY_SOURCE : NULL;
+}
+
+void
+fulltext_cache_delete_node(struct fulltext_cache *cache,
+                           const char *path)
+{
+  struct node_entry *node = get_node(cache, node_key(path));
+
+  set_copyfrom(cache, node, NULL, SVN_INVALID_REVNUM);
+  node->revision = cache->revision;
+  node->reset_rev = cache->revision;
+  node->deleted = TRUE;
+  node->partial = FALSE;
+  node->text = NULL;
+  node->props = NULL;
+}
+
+void
+fulltext_cache_set_node_text(struct fulltext_cache *cache,
+                             const char *path,
+                             const struct fulltext_info *info,
+                             apr_pool_t *pool)
+{
+  struct node_entry *node = touch_node(cache, node_key(path), pool);
+
+  node->text = info ? apr_hash_get(cache->texts, info->md5,
+                                   APR_HASH_KEY_STRING)
+                    : NULL;
+}
+
+void
+fulltext_cache_set_node_props(struct fulltext_cache *cache,
+                              const char *path,
+                              const struct fulltext_info *info,
+                              apr_pool_t *pool)
+{
+  struct node_entry *node = touch_node(cache, node_key(path), pool);
+
+  node->props = info ? apr_hash_get(cache->texts, info->md5,
+                                    APR_HASH_KEY_STRING)
+                     : NULL;
+}
+
+const struct fulltext_info *
+fulltext_cache_find_node_text(struct fulltext_cache *cache,
+                              const char *path,
+                              svn_revnum_t revision,
+                              apr_pool_t *pool)
+{
+  return use_text(cache, resolve_node(cache, node_key(path), revision,
+                                      TRUE, MAX_COPY_HOPS, pool));
+}
+
+const struct fulltext_info *
+fulltext_cache_find_node_props(struct fulltext_cache *cache,
+                               const char *path,
+                               svn_revnum_t revision,
+                               apr_pool_t *pool)
+{
+  return use_text(cache, resolve_node(cache, node_key(path), revision,
+                                      FALSE, MAX_COPY_HOPS, pool));
+}
+
+const struct fulltext_cache_stats *
+fulltext_cache_get_stats(const struct fulltext_cache *cache)
+{
+  return &cache->stats;
+}
+
+svn_error_t *
+fulltext_cache_close(struct fulltext_cache *cache,
+                     apr_pool_t *pool)
+{
+  SVN_ERR(evict(cache, pool));
+  return write_index(cache, pool);
+}
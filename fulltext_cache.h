@@ -0,0 +1,246 @@
+/**
+ * @copyright
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ * @endcopyright
+ *
+ *
+ *
+ *
+ * @file fulltext_cache.h
+ * @brief A persistent on-disk cache of file texts, addressed by their
+ * checksums.
+ */
+
+#ifndef FULLTEXT_CACHE_H_
+#define FULLTEXT_CACHE_H_
+
+/** The default size limit of a fulltext cache: 1 GiB. */
+#define FULLTEXT_DEFAULT_CACHE_SIZE (1024 * 1024 * 1024)
+
+/**
+ * A text or a property list in a fulltext cache.
+ */
+struct fulltext_info
+{
+  /* The hex MD5 and SHA-1 checksums of the text, and its length. */
+  const char *md5;
+  const char *sha1;
+  svn_filesize_t size;
+};
+
+/**
+ * Counters describing the work of a fulltext cache.
+ */
+struct fulltext_cache_stats
+{
+  apr_uint64_t hits;
+  apr_uint64_t misses;
+  apr_uint64_t stores;
+  apr_uint64_t evictions;
+};
+
+/**
+ * An opaque fulltext cache.
+ *
+ * The cache is a directory holding one file per text, named after its
+ * SHA-1 checksum, and an index.  Property lists are kept as texts, too,
+ * in the hash dump format.  Texts are looked up by MD5 checksum, since
+ * that is what text deltas name their base by.
+ *
+ * The index also knows, for each node the dump has recorded, its text
+ * and property list as of the last revision it changed in, and where
+ * it was copied from.  It only counts on this for revisions it has
+ * seen every change of: starting a revision that doesn't follow the
+ * last one, or a dump of another URL, drops what it knew of the
+ * nodes.  The text or property list of a node is found even in later
+ * revisions, and below directories copied since, as long as the node
+ * didn't change in ways that weren't recorded.
+ *
+ * Once the texts and the nodes add up to more than the size limit, the
+ * least recently used ones are removed, though only between revisions,
+ * so that those of the current revision stay around.  The index is
+ * written back when the cache is closed; files it doesn't know of,
+ * left behind by an interrupted run, are removed when it is opened.
+ *
+ * A cache is not thread-safe, and only one process should use a cache
+ * directory at a time.
+ */
+struct fulltext_cache;
+
+/**
+ * Open the fulltext cache @a *cache in the directory @a dir, creating
+ * the directory if needed, with a size limit of @a max_size bytes, to
+ * dump the repository at @a url.  Allocate in @a pool, which must live
+ * until fulltext_cache_close().
+ */
+svn_error_t *
+fulltext_cache_open(struct fulltext_cache **cache,
+                    const char *dir,
+                    const char *url,
+                    apr_uint64_t max_size,
+                    apr_pool_t *pool);
+
+/**
+ * Tell @a cache that the changes recorded from now on are those of @a
+ * revision, evicting texts and nodes if the cache has grown too large.
+ * Use @a pool for temporary allocations.
+ */
+svn_error_t *
+fulltext_cache_start_revision(struct fulltext_cache *cache,
+                              svn_revnum_t revision,
+                              apr_pool_t *pool);
+
+/**
+ * Return the revision last passed to fulltext_cache_start_revision(),
+ * in this run or the last one, or SVN_INVALID_REVNUM.
+ */
+svn_revnum_t
+fulltext_cache_revision(const struct fulltext_cache *cache);
+
+/**
+ * Return the text with the hex MD5 checksum @a md5 in @a cache, or
+ * NULL if there is none.
+ */
+const struct fulltext_info *
+fulltext_cache_find(struct fulltext_cache *cache,
+                    const char *md5);
+
+/**
+ * Set @a *contents to a readable stream of the text @a info in @a
+ * cache, or to NULL if its file has gone missing.  Allocate in @a pool.
+ */
+svn_error_t *
+fulltext_cache_read(svn_stream_t **contents,
+                    struct fulltext_cache *cache,
+                    const struct fulltext_info *info,
+                    apr_pool_t *pool);
+
+/**
+ * Set @a *stream to a writable stream, allocated in @a pool, that adds
+ * a text to @a cache.  Once @a *stream is closed, @a *info points to
+ * the text.
+ */
+svn_error_t *
+fulltext_cache_write(svn_stream_t **stream,
+                     const struct fulltext_info **info,
+                     struct fulltext_cache *cache,
+                     apr_pool_t *pool);
+
+/**
+ * Set @a *props to the property list @a info in @a cache, as a hash of
+ * names to svn_string_t *, or to NULL if its file has gone missing.
+ * Allocate in @a pool.
+ */
+svn_error_t *
+fulltext_cache_read_props(apr_hash_t **props,
+                          struct fulltext_cache *cache,
+                          const struct fulltext_info *info,
+                          apr_pool_t *pool);
+
+/**
+ * Add the property list @a props, a hash of names to svn_string_t *,
+ * to @a cache, and set @a *info to it.  Use @a pool for temporary
+ * allocations.
+ */
+svn_error_t *
+fulltext_cache_write_props(const struct fulltext_info **info,
+                           struct fulltext_cache *cache,
+                           apr_hash_t *props,
+                           apr_pool_t *pool);
+
+/**
+ * Record in @a cache that the node @a path (with or without a leading
+ * slash, like all paths here) was added in the current revision, as a
+ * copy of @a copyfrom_path at @a copyfrom_rev if @a copyfrom_path is
+ * not NULL.  Its text and property list are those of the copy source,
+ * or else unknown, until set.
+ */
+void
+fulltext_cache_add_node(struct fulltext_cache *cache,
+                        const char *path,
+                        const char *copyfrom_path,
+                        svn_revnum_t copyfrom_rev);
+
+/**
+ * Record in @a cache that the node @a path was deleted in the current
+ * revision, along with everything below it.
+ */
+void
+fulltext_cache_delete_node(struct fulltext_cache *cache,
+                           const char *path);
+
+/**
+ * Record in @a cache that the text of the file @a path changed in the
+ * current revision, to @a info, or to an unknown text if @a info is
+ * NULL.  Use @a pool for temporary allocations.
+ */
+void
+fulltext_cache_set_node_text(struct fulltext_cache *cache,
+                             const char *path,
+                             const struct fulltext_info *info,
+                             apr_pool_t *pool);
+
+/**
+ * Record in @a cache that the property list of the node @a path
+ * changed in the current revision, to @a info, or to an unknown list
+ * if @a info is NULL.  Use @a pool for temporary allocations.
+ */
+void
+fulltext_cache_set_node_props(struct fulltext_cache *cache,
+                              const char *path,
+                              const struct fulltext_info *info,
+                              apr_pool_t *pool);
+
+/**
+ * Return the text the file @a path had at @a revision according to @a
+ * cache, or NULL if unknown.  Use @a pool for temporary allocations.
+ */
+const struct fulltext_info *
+fulltext_cache_find_node_text(struct fulltext_cache *cache,
+                              const char *path,
+                              svn_revnum_t revision,
+                              apr_pool_t *pool);
+
+/**
+ * Return the property list the node @a path had at @a revision
+ * according to @a cache, or NULL if unknown.  Use @a pool for temporary
+ * allocations.
+ */
+const struct fulltext_info *
+fulltext_cache_find_node_props(struct fulltext_cache *cache,
+                               const char *path,
+                               svn_revnum_t revision,
+                               apr_pool_t *pool);
+
+/**
+ * Return the counters of @a cache.
+ */
+const struct fulltext_cache_stats *
+fulltext_cache_get_stats(const struct fulltext_cache *cache);
+
+/**
+ * Evict texts and nodes from @a cache if it has grown too large and
+ * write its index back to disk.  Use @a pool for temporary allocations.
+ */
+svn_error_t *
+fulltext_cache_close(struct fulltext_cache *cache,
+                     apr_pool_t *pool);
+
+#endif
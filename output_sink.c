@@ -0,0 +1,142 @@
+/*
+ *  output_sink.c: A large output buffer in front of the dump's
+ *  destination.
+ *
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ */
+
+#include "svn_pools.h"
+#include "svn_io.h"
+
+#include "svn17_compat.h"
+#include "output_sink.h"
+
+/* The buffer collects small writes and hands them to TARGET in
+   chunks of up to SIZE bytes. */
+struct output_sink
+{
+  svn_stream_t *target;
+
+  /* The buffer, its size and how much of it is in use. */
+  char *buffer;
+  apr_size_t size;
+  apr_size_t len;
+
+  svn_boolean_t closed;
+  struct output_sink_stats stats;
+};
+
+/* Write LEN bytes of DATA to the target of SINK. */
+static svn_error_t *
+write_target(struct output_sink *sink,
+             const char *data,
+             apr_size_t len)
+{
+  sink->stats.writes++;
+  sink->stats.bytes += len;
+  return svn_stream_write(sink->target, data, &len);
+}
+
+/* Implements svn_write_fn_t for output_sink_stream(). */
+static svn_error_t *
+write_handler(void *baton,
+              const char *data,
+              apr_size_t *len)
+{
+  struct output_sink *sink = baton;
+
+  if (sink->len + *len <= sink->size)
+    {
+      memcpy(sink->buffer + sink->len, data, *len);
+      sink->len += *len;
+      return SVN_NO_ERROR;
+    }
+
+  SVN_ERR(output_sink_flush(sink));
+
+  /* Large writes gain nothing from a detour through the buffer. */
+  if (*len >= sink->size)
+    return write_target(sink, data, *len);
+
+  memcpy(sink->buffer, data, *len);
+  sink->len = *len;
+  return SVN_NO_ERROR;
+}
+
+/* Implements svn_close_fn_t for output_sink_stream(). */
+static svn_error_t *
+close_handler(void *baton)
+{
+  struct output_sink *sink = baton;
+
+  if (sink->closed)
+    return SVN_NO_ERROR;
+  sink->closed = TRUE;
+
+  return svn_error_compose_create(output_sink_flush(sink),
+                                  svn_stream_close(sink->target));
+}
+
+svn_error_t *
+output_sink_create(struct output_sink **sink,
+                   svn_stream_t *target,
+                   apr_size_t buffer_size,
+                   apr_pool_t *pool)
+{
+  struct output_sink *new_sink = apr_pcalloc(pool, sizeof(*new_sink));
+
+  SVN_ERR_ASSERT(buffer_size > 0);
+
+  new_sink->target = target;
+  new_sink->size = buffer_size;
+  new_sink->buffer = apr_palloc(pool, buffer_size);
+
+  *sink = new_sink;
+  return SVN_NO_ERROR;
+}
+
+svn_stream_t *
+output_sink_stream(struct output_sink *sink,
+                   apr_pool_t *pool)
+{
+  svn_stream_t *stream = svn_stream_create(sink, pool);
+
+  svn_stream_set_write(stream, write_handler);
+  svn_stream_set_close(stream, close_handler);
+  return stream;
+}
+
+svn_error_t *
+output_sink_flush(struct output_sink *sink)
+{
+  apr_size_t len = sink->len;
+
+  if (len == 0)
+    return SVN_NO_ERROR;
+
+  sink->len = 0;
+  return write_target(sink, sink->buffer, len);
+}
+
+const struct output_sink_stats *
+output_sink_get_stats(const struct output_sink *sink)
+{
+  return &sink->stats;
+}
@@ -0,0 +1,94 @@
+/**
+ * @copyright
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ * @endcopyright
+ *
+ * @file output_sink.h
+ * @brief A large output buffer in front of the dump's destination.
+ */
+
+#ifndef OUTPUT_SINK_H_
+#define OUTPUT_SINK_H_
+
+/** The default size of the output buffer: 1 MiB. */
+#define OUTPUT_SINK_DEFAULT_BUFFER_SIZE (1024 * 1024)
+
+/**
+ * When buffered output is passed on to the destination.
+ */
+enum output_flush_policy
+{
+  /* Only when the buffer is full, and at the end of the dump. */
+  output_flush_when_full,
+
+  /* In addition, at the end of every revision, so that the
+     destination always holds whole revisions. */
+  output_flush_at_revision
+};
+
+/**
+ * Counters describing how an output sink was used.
+ */
+struct output_sink_stats
+{
+  /* writes made to the destination, and the bytes they carried */
+  apr_uint64_t writes;
+  apr_uint64_t bytes;
+};
+
+/**
+ * An opaque output sink.
+ */
+struct output_sink;
+
+/**
+ * Create an output sink @a *sink collecting output for @a target in a
+ * buffer of @a buffer_size bytes, allocated in @a pool.  Writes at
+ * least as large as the buffer bypass it.
+ */
+svn_error_t *
+output_sink_create(struct output_sink **sink,
+                   svn_stream_t *target,
+                   apr_size_t buffer_size,
+                   apr_pool_t *pool);
+
+/**
+ * Return a writable stream, allocated in @a pool, feeding @a sink.
+ * All writers of the dump share this one stream, so their output
+ * reaches @a target in the order it was written.  Closing the stream
+ * flushes @a sink and closes the target.
+ */
+svn_stream_t *
+output_sink_stream(struct output_sink *sink,
+                   apr_pool_t *pool);
+
+/**
+ * Pass whatever @a sink has buffered on to its target.
+ */
+svn_error_t *
+output_sink_flush(struct output_sink *sink);
+
+/**
+ * Return the counters of @a sink.
+ */
+const struct output_sink_stats *
+output_sink_get_stats(const struct output_sink *sink);
+
+#endif
@@ -0,0 +1,271 @@
+/*
+ *  plan.c: Cutting a revision range into parts of similar dump
+ *  size.
+ *
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ */
+
+#include "svn_pools.h"
+#include "svn_ra.h"
+#include "svn_path.h"
+#include "svn_props.h"
+
+#include "svn17_compat.h"
+#include "plan.h"
+
+/* The estimated cost, in bytes of dumpstream, of a revision record
+   without its properties, of one property in it, and of the headers
+   of a node record. */
+#define REVISION_COST 128
+#define REVPROP_COST 24
+#define NODE_COST 160
+
+/* The text delta of a modified file is guessed to be this fraction of
+   its full size. */
+#define MODIFIED_TEXT_DIVISOR 4
+
+/* A file whose size is to be looked up. */
+struct probe
+{
+  svn_revnum_t revision;
+  const char *path;
+  svn_boolean_t modified;
+};
+
+/* Baton for log_receiver(). */
+struct plan_baton
+{
+  /* The estimated cost of each revision, from START_REVISION on. */
+  apr_uint64_t *costs;
+  svn_revnum_t start_revision;
+
+  /* The repository path the session is open to, "/" for the root. */
+  const char *session_path;
+
+  /* If not NULL, the files to look up, allocated in POOL. */
+  apr_array_header_t *probes;
+  apr_pool_t *pool;
+
+  svn_cancel_func_t cancel_func;
+  void *cancel_baton;
+};
+
+/* Return the path of the repository path PATH relative to the session
+ * path of PB, or NULL if it is outside of it.  Allocate in POOL. */
+static const char *
+session_relpath(struct plan_baton *pb,
+                const char *path,
+                apr_pool_t *pool)
+{
+  if (strcmp(pb->session_path, "/") == 0)
+    return path + 1;
+  if (strcmp(pb->session_path, path) == 0)
+    return "";
+  return svn_path_is_child(pb->session_path, path, pool);
+}
+
+/* Implements svn_log_entry_receiver_t, adding up the estimated cost
+ * of LOG_ENTRY in the plan_baton BATON. */
+static svn_error_t *
+log_receiver(void *baton,
+             svn_log_entry_t *log_entry,
+             apr_pool_t *pool)
+{
+  struct plan_baton *pb = baton;
+  apr_uint64_t *cost;
+  apr_hash_index_t *hi;
+
+  if (pb->cancel_func)
+    SVN_ERR(pb->cancel_func(pb->cancel_baton));
+
+  if (! SVN_IS_VALID_REVNUM(log_entry->revision))
+    return SVN_NO_ERROR;
+  cost = &pb->costs[log_entry->revision - pb->start_revision];
+
+  if (log_entry->revprops)
+    for (hi = apr_hash_first(pool, log_entry->revprops); hi;
+         hi = apr_hash_next(hi))
+      {
+        const void *key;
+        apr_ssize_t klen;
+        void *val;
+
+        apr_hash_this(hi, &key, &klen, &val);
+        *cost += REVPROP_COST + klen + ((svn_string_t *)val)->len;
+      }
+
+  if (! log_entry->changed_paths2)
+    return SVN_NO_ERROR;
+
+  for (hi = apr_hash_first(pool, log_entry->changed_paths2); hi;
+       hi = apr_hash_next(hi))
+    {
+      const void *key;
+      void *val;
+      const svn_log_changed_path2_t *change;
+      const char *relpath;
+
+      apr_hash_this(hi, &key, NULL, &val);
+      change = val;
+
+      /* The replay leaves out whatever is outside of the session. */
+      relpath = session_relpath(pb, key, pool);
+      if (! relpath)
+        continue;
+      *cost += NODE_COST;
+
+      /* Copies are dumped without their text, unless modified, which
+         the log doesn't tell. */
+      if (! pb->probes || change->node_kind == svn_node_dir
+          || change->action == 'D'
+          || (change->action != 'M' && change->copyfrom_path))
+        continue;
+
+      {
+        struct probe *probe = apr_array_push(pb->probes);
+
+        probe->revision = log_entry->revision;
+        probe->path = apr_pstrdup(pb->pool, relpath);
+        probe->modified = (change->action == 'M');
+      }
+    }
+
+  return SVN_NO_ERROR;
+}
+
+/* Cut the NREVS revisions from START_REVISION on, whose estimated
+ * costs are COSTS and add up to TOTAL, into NPARTS parts of roughly
+ * equal cost.  Return them as an array of struct plan_part allocated
+ * in POOL. */
+static apr_array_header_t *
+cut_parts(const apr_uint64_t *costs,
+          svn_revnum_t start_revision,
+          svn_revnum_t nrevs,
+          int nparts,
+          apr_uint64_t total,
+          apr_pool_t *pool)
+{
+  apr_array_header_t *parts = apr_array_make(pool, nparts,
+                                             sizeof(struct plan_part));
+  apr_uint64_t done = 0;
+  svn_revnum_t i = 0;
+  int k;
+
+  for (k = 0; k < nparts; k++)
+    {
+      struct plan_part *part = apr_array_push(parts);
+      apr_uint64_t target = total / nparts * (k + 1)
+                            + total % nparts * (k + 1) / nparts;
+      int later_parts = nparts - k - 1;
+
+      part->start_revision = start_revision + i;
+      part->estimated_size = 0;
+
+      /* Take at least one revision and leave one for each later part;
+         otherwise stop where the total comes closest to the target. */
+      do
+        {
+          part->estimated_size += costs[i];
+          done += costs[i];
+          i++;
+        }
+      while (i < nrevs - later_parts
+             && (later_parts == 0 || done + costs[i] / 2 < target));
+
+      part->end_revision = start_revision + i - 1;
+    }
+
+  return parts;
+}
+
+svn_error_t *
+plan_dump(apr_array_header_t **parts,
+          apr_uint64_t *total,
+          svn_ra_session_t *session,
+          svn_revnum_t start_revision,
+          svn_revnum_t end_revision,
+          int nparts,
+          svn_boolean_t probe_sizes,
+          svn_cancel_func_t cancel_func,
+          void *cancel_baton,
+          apr_pool_t *pool)
+{
+  struct plan_baton pb = { 0 };
+  svn_revnum_t nrevs = end_revision - start_revision + 1;
+  apr_array_header_t *paths = apr_array_make(pool, 1, sizeof(const char *));
+  const char *root_url;
+  const char *session_url;
+  apr_pool_t *iterpool;
+  svn_revnum_t i;
+
+  pb.costs = apr_palloc(pool, nrevs * sizeof(*pb.costs));
+  for (i = 0; i < nrevs; i++)
+    pb.costs[i] = REVISION_COST;
+  pb.start_revision = start_revision;
+  pb.pool = pool;
+  pb.cancel_func = cancel_func;
+  pb.cancel_baton = cancel_baton;
+  if (probe_sizes)
+    pb.probes = apr_array_make(pool, 64, sizeof(struct probe));
+
+  SVN_ERR(svn_ra_get_repos_root2(session, &root_url, pool));
+  SVN_ERR(svn_ra_get_session_url(session, &session_url, pool));
+  pb.session_path = svn_path_uri_decode(session_url + strlen(root_url),
+                                        pool);
+  if (*pb.session_path == '\0')
+    pb.session_path = "/";
+
+  /* Revisions not touching the session path still get a revision
+     record, at the baseline cost. */
+  APR_ARRAY_PUSH(paths, const char *) = "";
+  SVN_ERR(svn_ra_get_log2(session, paths, start_revision, end_revision, 0,
+                          TRUE, TRUE, FALSE, NULL, log_receiver, &pb,
+                          pool));
+
+  /* The session is free again; look up the file sizes. */
+  iterpool = svn_pool_create(pool);
+  for (i = 0; probe_sizes && i < pb.probes->nelts; i++)
+    {
+      const struct probe *probe = &APR_ARRAY_IDX(pb.probes, i, struct probe);
+      svn_dirent_t *dirent;
+
+      svn_pool_clear(iterpool);
+      if (cancel_func)
+        SVN_ERR(cancel_func(cancel_baton));
+
+      SVN_ERR(svn_ra_stat(session, probe->path, probe->revision, &dirent,
+                          iterpool));
+      if (dirent && dirent->kind == svn_node_file)
+        pb.costs[probe->revision - start_revision] +=
+          probe->modified ? dirent->size / MODIFIED_TEXT_DIVISOR
+                          : dirent->size;
+    }
+  svn_pool_destroy(iterpool);
+
+  *total = 0;
+  for (i = 0; i < nrevs; i++)
+    *total += pb.costs[i];
+
+  if (nparts > nrevs)
+    nparts = (int)nrevs;
+  *parts = cut_parts(pb.costs, start_revision, nrevs, nparts, *total, pool);
+
+  return SVN_NO_ERROR;
+}
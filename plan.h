@@ -0,0 +1,74 @@
+/**
+ * @copyright
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ * @endcopyright
+ *
+ *
+ *
+ * @file plan.h
+ * @brief Cutting a revision range into parts of similar dump size.
+ */
+
+#ifndef PLAN_H_
+#define PLAN_H_
+
+/**
+ * One part of a planned dump: a contiguous range of revisions and the
+ * estimated size of its dumpstream.
+ */
+struct plan_part
+{
+  svn_revnum_t start_revision;
+  svn_revnum_t end_revision;
+  apr_uint64_t estimated_size;
+};
+
+/**
+ * Estimate the dump size of each revision from @a start_revision to
+ * @a end_revision of the repository @a session is open to, and cut
+ * the range into at most @a nparts contiguous parts of roughly equal
+ * estimated size.  Set @a *parts to an array of struct plan_part in
+ * revision order, and @a *total to the estimated size of the whole
+ * range.
+ *
+ * The estimate comes from a single svn_ra_get_log2() call: each
+ * revision costs a fixed overhead, the size of its revision
+ * properties and a fixed amount per changed path below the session
+ * URL.  If @a probe_sizes is set, the size of each file added or
+ * modified is also looked up with svn_ra_stat(), at one round trip
+ * per file.  A single revision is never split, so one huge revision
+ * still makes for an uneven plan.
+ *
+ * Call @a cancel_func with @a cancel_baton now and then, if not NULL.
+ * Allocate in @a pool.
+ */
+svn_error_t *
+plan_dump(apr_array_header_t **parts,
+          apr_uint64_t *total,
+          svn_ra_session_t *session,
+          svn_revnum_t start_revision,
+          svn_revnum_t end_revision,
+          int nparts,
+          svn_boolean_t probe_sizes,
+          svn_cancel_func_t cancel_func,
+          void *cancel_baton,
+          apr_pool_t *pool);
+
+#endif
@@ -0,0 +1,206 @@
+/*
+ *  prop_list.c: A small set of property changes, kept sorted by name.
+ *
+ *
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ */
+
+#include <string.h>
+
+#include <apr_strings.h>
+
+#include "svn_string.h"
+
+#include "svn17_compat.h"
+#include "prop_list.h"
+
+/* Lists start out with room for this many properties. */
+#define INITIAL_SIZE 8
+
+/* One property change; VALUE is NULL for a deletion. */
+struct prop_entry
+{
+  const char *name;
+  const svn_string_t *value;
+};
+
+struct prop_list
+{
+  /* NELTS changes sorted by name, in an array of NALLOC allocated in
+     POOL. */
+  struct prop_entry *entries;
+  int nelts;
+  int nalloc;
+  apr_pool_t *pool;
+};
+
+struct prop_list *
+prop_list_create(apr_pool_t *pool)
+{
+  struct prop_list *list = apr_palloc(pool, sizeof(*list));
+
+  list->entries = apr_palloc(pool, INITIAL_SIZE * sizeof(*list->entries));
+  list->nelts = 0;
+  list->nalloc = INITIAL_SIZE;
+  list->pool = pool;
+  return list;
+}
+
+/* Return the index of NAME in LIST, or if it is not there, the index
+ * it would be inserted at, and set *FOUND accordingly. */
+static int
+find(const struct prop_list *list,
+     const char *name,
+     svn_boolean_t *found)
+{
+  int low = 0, high = list->nelts;
+
+  while (low < high)
+    {
+      int mid = low + (high - low) / 2;
+      int cmp = strcmp(list->entries[mid].name, name);
+
+      if (cmp == 0)
+        {
+          *found = TRUE;
+          return mid;
+        }
+      if (cmp < 0)
+        low = mid + 1;
+      else
+        high = mid;
+    }
+
+  *found = FALSE;
+  return low;
+}
+
+void
+prop_list_set(struct prop_list *list,
+              const char *name,
+              const svn_string_t *value)
+{
+  svn_boolean_t found;
+  int i = find(list, name, &found);
+
+  if (found)
+    {
+      list->entries[i].value = value;
+      return;
+    }
+
+  if (list->nelts == list->nalloc)
+    {
+      struct prop_entry *entries;
+
+      entries = apr_palloc(list->pool,
+                           2 * list->nalloc * sizeof(*entries));
+      memcpy(entries, list->entries, list->nelts * sizeof(*entries));
+      list->entries = entries;
+      list->nalloc *= 2;
+    }
+
+  memmove(&list->entries[i + 1], &list->entries[i],
+          (list->nelts - i) * sizeof(*list->entries));
+  list->entries[i].name = name;
+  list->entries[i].value = value;
+  list->nelts++;
+}
+
+int
+prop_list_count(const struct prop_list *list)
+{
+  return list->nelts;
+}
+
+void
+prop_list_get(const char **name,
+              const svn_string_t **value,
+              const struct prop_list *list,
+              int index)
+{
+  *name = list->entries[index].name;
+  *value = list->entries[index].value;
+}
+
+void
+prop_list_clear(struct prop_list *list)
+{
+  list->nelts = 0;
+}
+
+/* Append the line "TAG LEN" to OUT. */
+static void
+append_length(svn_stringbuf_t *out,
+              char tag,
+              apr_size_t len)
+{
+  char buf[32];
+  int n = apr_snprintf(buf, sizeof(buf), "%c %" APR_SIZE_T_FMT "\n", tag,
+                       len);
+
+  svn_stringbuf_appendbytes(out, buf, n);
+}
+
+void
+prop_list_write(svn_stringbuf_t *out,
+                const struct prop_list *list)
+{
+  int i;
+
+  for (i = 0; i < list->nelts; i++)
+    {
+      const struct prop_entry *entry = &list->entries[i];
+      apr_size_t name_len;
+
+      if (! entry->value)
+        continue;
+
+      /* K 10
+         svn:author
+         V 5
+         jrandom */
+      name_len = strlen(entry->name);
+      append_length(out, 'K', name_len);
+      svn_stringbuf_appendbytes(out, entry->name, name_len);
+      svn_stringbuf_appendbytes(out, "\n", 1);
+      append_length(out, 'V', entry->value->len);
+      svn_stringbuf_appendbytes(out, entry->value->data, entry->value->len);
+      svn_stringbuf_appendbytes(out, "\n", 1);
+    }
+
+  for (i = 0; i < list->nelts; i++)
+    {
+      const struct prop_entry *entry = &list->entries[i];
+      apr_size_t name_len;
+
+      if (entry->value)
+        continue;
+
+      /* D 13
+         svn:mime-type */
+      name_len = strlen(entry->name);
+      append_length(out, 'D', name_len);
+      svn_stringbuf_appendbytes(out, entry->name, name_len);
+      svn_stringbuf_appendbytes(out, "\n", 1);
+    }
+
+  svn_stringbuf_appendcstr(out, "PROPS-END\n");
+}
@@ -0,0 +1,88 @@
+/**
+ * @copyright
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ * @endcopyright
+ *
+ * @file prop_list.h
+ * @brief A small set of property changes, kept sorted by name.
+ */
+
+#ifndef PROP_LIST_H_
+#define PROP_LIST_H_
+
+/**
+ * An opaque list of property changes: each property is either set to
+ * a value or deleted.  The changes are kept in a vector sorted by
+ * name, which is cheaper than a hash for the handful of properties a
+ * node or revision usually has, and lets them be written out in the
+ * same order every time.
+ */
+struct prop_list;
+
+/**
+ * Return a new, empty property list allocated in @a pool.
+ */
+struct prop_list *
+prop_list_create(apr_pool_t *pool);
+
+/**
+ * Set the property @a name in @a list to @a value, or record its
+ * deletion if @a value is NULL, replacing any earlier change to it.
+ * Neither @a name nor @a value is copied; they must live as long as
+ * @a list is used.
+ */
+void
+prop_list_set(struct prop_list *list,
+              const char *name,
+              const svn_string_t *value);
+
+/**
+ * Return the number of properties in @a list.
+ */
+int
+prop_list_count(const struct prop_list *list);
+
+/**
+ * Set @a *name and @a *value to the property at @a index in @a list,
+ * counting from 0 in order of their names; @a *value is NULL for a
+ * deletion.
+ */
+void
+prop_list_get(const char **name,
+              const svn_string_t **value,
+              const struct prop_list *list,
+              int index);
+
+/**
+ * Remove all properties from @a list, keeping its memory for reuse.
+ */
+void
+prop_list_clear(struct prop_list *list);
+
+/**
+ * Append @a list to @a out in the hash dump format, as done by
+ * svn_hash_write_incremental(): the properties that are set in order
+ * of their names, then the deleted ones, then "PROPS-END".
+ */
+void
+prop_list_write(svn_stringbuf_t *out,
+                const struct prop_list *list);
+
+#endif
@@ -0,0 +1,286 @@
+/*
+ *  resume.c: Locating the point at which an interrupted dump can be
+ *  continued.
+ *
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ */
+
+#include "svn_pools.h"
+#include "svn_io.h"
+#include "svn_repos.h"
+
+#include "svn17_compat.h"
+#include "dump_record.h"
+#include "resume.h"
+
+/* A minimal buffered reader over an apr_file_t that knows its logical
+   position and can skip forward cheaply. */
+struct scanner
+{
+  apr_file_t *file;
+
+  /* Size of the file and logical offset of the next unread byte. */
+  apr_off_t size;
+  apr_off_t pos;
+
+  char buf[16384];
+  apr_size_t buf_len;
+  apr_size_t buf_pos;
+};
+
+/* Refill the buffer of SC.  Set *EOF if there is nothing left. */
+static svn_error_t *
+fill(struct scanner *sc,
+     svn_boolean_t *eof)
+{
+  apr_size_t len = sizeof(sc->buf);
+  apr_status_t status = apr_file_read(sc->file, sc->buf, &len);
+
+  if (status && ! APR_STATUS_IS_EOF(status))
+    return svn_error_wrap_apr(status, _("Can't read dumpfile"));
+
+  sc->buf_len = len;
+  sc->buf_pos = 0;
+  *eof = (len == 0);
+  return SVN_NO_ERROR;
+}
+
+/* Read the next line of SC into LINE, without its newline.  Set
+ * *COMPLETE to FALSE if the file ends before the newline, and *EOF if
+ * it ends before the first byte. */
+static svn_error_t *
+read_line(struct scanner *sc,
+          svn_stringbuf_t *line,
+          svn_boolean_t *complete,
+          svn_boolean_t *eof)
+{
+  svn_stringbuf_setempty(line);
+  *complete = FALSE;
+  *eof = FALSE;
+
+  while (1)
+    {
+      const char *start, *nl;
+
+      if (sc->buf_pos == sc->buf_len)
+        {
+          svn_boolean_t at_end;
+
+          SVN_ERR(fill(sc, &at_end));
+          if (at_end)
+            {
+              *eof = (line->len == 0);
+              return SVN_NO_ERROR;
+            }
+        }
+
+      start = sc->buf + sc->buf_pos;
+      nl = memchr(start, '\n', sc->buf_len - sc->buf_pos);
+      if (nl)
+        {
+          svn_stringbuf_appendbytes(line, start, nl - start);
+          sc->buf_pos += nl - start + 1;
+          sc->pos += nl - start + 1;
+          *complete = TRUE;
+          return SVN_NO_ERROR;
+        }
+
+      svn_stringbuf_appendbytes(line, start, sc->buf_len - sc->buf_pos);
+      sc->pos += sc->buf_len - sc->buf_pos;
+      sc->buf_pos = sc->buf_len;
+    }
+}
+
+/* Skip LEN bytes of SC.  Set *COMPLETE to FALSE if the file is too
+ * short for that. */
+static svn_error_t *
+skip(struct scanner *sc,
+     apr_off_t len,
+     svn_boolean_t *complete,
+     apr_pool_t *pool)
+{
+  apr_off_t offset;
+
+  *complete = (sc->pos + len <= sc->size);
+  if (! *complete)
+    return SVN_NO_ERROR;
+
+  if (len <= (apr_off_t)(sc->buf_len - sc->buf_pos))
+    {
+      sc->buf_pos += (apr_size_t)len;
+      sc->pos += len;
+      return SVN_NO_ERROR;
+    }
+
+  sc->pos += len;
+  sc->buf_pos = sc->buf_len = 0;
+  offset = sc->pos;
+  return svn_io_file_seek(sc->file, APR_SET, &offset, pool);
+}
+
+/* Read the header block of the next record of SC into HEADERS, a
+ * hash mapping header names to values allocated in POOL.  Blank lines
+ * before the record are skipped; set *START to the offset of its
+ * first header.  Set *COMPLETE to FALSE if the file ends before the
+ * blank line terminating the block, and *EOF if there is no further
+ * record at all. */
+static svn_error_t *
+read_headers(struct scanner *sc,
+             apr_hash_t *headers,
+             apr_off_t *start,
+             svn_boolean_t *complete,
+             svn_boolean_t *eof,
+             apr_pool_t *pool)
+{
+  svn_stringbuf_t *line = svn_stringbuf_create_ensure(256, pool);
+  svn_boolean_t seen_header = FALSE;
+
+  apr_hash_clear(headers);
+  *eof = FALSE;
+
+  while (1)
+    {
+      apr_off_t line_start = sc->pos;
+      svn_boolean_t line_complete, line_eof;
+      char *colon;
+
+      SVN_ERR(read_line(sc, line, &line_complete, &line_eof));
+      if (! line_complete)
+        {
+          *complete = FALSE;
+          *eof = ! seen_header && line_eof;
+          return SVN_NO_ERROR;
+        }
+
+      if (line->len == 0)
+        {
+          if (seen_header)
+            {
+              *complete = TRUE;
+              return SVN_NO_ERROR;
+            }
+          continue;
+        }
+
+      if (! seen_header)
+        *start = line_start;
+      seen_header = TRUE;
+
+      colon = strstr(line->data, ": ");
+      if (! colon)
+        return svn_error_createf(SVN_ERR_STREAM_MALFORMED_DATA, NULL,
+                                 _("Malformed dumpfile header at offset "
+                                   "%" APR_OFF_T_FMT), line_start);
+      *colon = '\0';
+      apr_hash_set(headers, apr_pstrdup(pool, line->data),
+                   APR_HASH_KEY_STRING, apr_pstrdup(pool, colon + 2));
+    }
+}
+
+svn_error_t *
+find_resume_point(struct resume_point **point,
+                  apr_file_t *file,
+                  apr_pool_t *pool)
+{
+  struct resume_point *rp = apr_pcalloc(pool, sizeof(*rp));
+  struct scanner *sc = apr_pcalloc(pool, sizeof(*sc));
+  apr_pool_t *iterpool = svn_pool_create(pool);
+  apr_hash_t *headers = apr_hash_make(pool);
+  apr_finfo_t finfo;
+  apr_status_t status;
+  apr_off_t start = 0;
+  svn_boolean_t complete, eof;
+  const char *value;
+
+  rp->revision = SVN_INVALID_REVNUM;
+  rp->offset = 0;
+  *point = rp;
+
+  status = apr_file_info_get(&finfo, APR_FINFO_SIZE, file);
+  if (status)
+    return svn_error_wrap_apr(status, _("Can't stat dumpfile"));
+  sc->file = file;
+  sc->size = finfo.size;
+  SVN_ERR(svn_io_file_seek(file, APR_SET, &start, pool));
+
+  /* The magic header record, then the UUID record.  If either is
+     torn, start over from an empty file. */
+  SVN_ERR(read_headers(sc, headers, &start, &complete, &eof, pool));
+  if (! complete)
+    return SVN_NO_ERROR;
+  if (! apr_hash_get(headers, SVN_REPOS_DUMPFILE_MAGIC_HEADER,
+                     APR_HASH_KEY_STRING))
+    return svn_error_create(SVN_ERR_STREAM_MALFORMED_DATA, NULL,
+                            _("The file to resume is not a dumpfile"));
+
+  SVN_ERR(read_headers(sc, headers, &start, &complete, &eof, pool));
+  if (! complete)
+    return SVN_NO_ERROR;
+  rp->uuid = apr_hash_get(headers, SVN_REPOS_DUMPFILE_UUID,
+                          APR_HASH_KEY_STRING);
+  if (! rp->uuid)
+    return svn_error_create(SVN_ERR_STREAM_MALFORMED_DATA, NULL,
+                            _("The file to resume has no UUID record"));
+  rp->has_header = TRUE;
+  rp->offset = sc->pos;
+
+  /* Walk the records, remembering where the last revision began. */
+  while (1)
+    {
+      svn_pool_clear(iterpool);
+
+      SVN_ERR(read_headers(sc, headers, &start, &complete, &eof, iterpool));
+      if (! complete)
+        break;
+
+      value = apr_hash_get(headers, SVN_REPOS_DUMPFILE_REVISION_NUMBER,
+                           APR_HASH_KEY_STRING);
+      if (value)
+        {
+          rp->revision = (svn_revnum_t)apr_strtoi64(value, NULL, 10);
+          rp->offset = start;
+        }
+
+      value = apr_hash_get(headers, SVN_REPOS_DUMPFILE_CONTENT_LENGTH,
+                           APR_HASH_KEY_STRING);
+      if (value)
+        {
+          SVN_ERR(skip(sc, apr_strtoi64(value, NULL, 10), &complete,
+                       iterpool));
+          if (! complete)
+            break;
+        }
+
+      /* Step over the node records of the revision without reading
+         their headers, if the revision record tells their length. */
+      value = apr_hash_get(headers, DUMP_REVISION_NODES_LENGTH,
+                           APR_HASH_KEY_STRING);
+      if (value)
+        {
+          SVN_ERR(skip(sc, apr_strtoi64(value, NULL, 10), &complete,
+                       iterpool));
+          if (! complete)
+            break;
+        }
+    }
+
+  svn_pool_destroy(iterpool);
+  return SVN_NO_ERROR;
+}
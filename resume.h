@@ -0,0 +1,70 @@
+/**
+ * @copyright
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ * @endcopyright
+ *
+ * @file resume.h
+ * @brief Locating the point at which an interrupted dump can be
+ * continued.
+ */
+
+#ifndef RESUME_H_
+#define RESUME_H_
+
+/**
+ * Where to pick up an interrupted dump.
+ */
+struct resume_point
+{
+  /* Whether the dumpfile starts with a complete magic header and
+     UUID record, and the UUID found there. */
+  svn_boolean_t has_header;
+  const char *uuid;
+
+  /* The first revision that is not known to be completely written,
+     or SVN_INVALID_REVNUM if the file holds no revision records. */
+  svn_revnum_t revision;
+
+  /* The length to truncate the file to before appending. */
+  apr_off_t offset;
+};
+
+/**
+ * Scan the partial dumpfile @a file from the start and fill in @a
+ * *point, allocated in @a pool.
+ *
+ * Only record headers are parsed; record contents are skipped by
+ * seeking past them, so the cost is proportional to the number of
+ * records rather than to the size of the file.  The node records of
+ * revisions dumped with their length (DUMP_REVISION_NODES_LENGTH) are
+ * skipped along with the revision record.
+ *
+ * A revision is considered complete once the next revision record
+ * has started, so the last revision in the file is always dumped
+ * again: there is no way to tell whether all of its node records made
+ * it to disk.  Any torn record at the end of the file is discarded
+ * along with it.
+ */
+svn_error_t *
+find_resume_point(struct resume_point **point,
+                  apr_file_t *file,
+                  apr_pool_t *pool);
+
+#endif
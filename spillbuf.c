@@ -0,0 +1,411 @@
+/*
+ *  spillbuf.c: A write buffer that spills from memory to an anonymous
+ *  temporary file once it grows past a threshold.
+ *
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ */
+
+#include <apr_portable.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/sendfile.h>
+#endif
+
+#include "svn_pools.h"
+#include "svn_io.h"
+
+#include "svn17_compat.h"
+#include "spillbuf.h"
+
+struct spillbuf
+{
+  /* Pool the buffer, its memory block and its file live in. */
+  apr_pool_t *pool;
+
+  /* Bytes kept in memory before spilling. */
+  apr_size_t threshold;
+
+  /* In-memory contents, valid while SPILLED is FALSE. */
+  svn_stringbuf_t *mem;
+
+  /* Temporary file, created on the first spill and then reused. */
+  apr_file_t *file;
+
+  /* Whether the current contents live in FILE rather than MEM. */
+  svn_boolean_t spilled;
+
+  /* Total number of bytes currently held. */
+  svn_filesize_t size;
+};
+
+/* Spilled data is copied through user space this many bytes at a
+   time. */
+#define COPY_BUFFER_SIZE (64 * 1024)
+
+#if defined(__linux__) && defined(O_TMPFILE)
+/* Pool cleanup closing the file descriptor wrapped in BATON, an
+ * apr_file_t created by apr_os_file_put(). */
+static apr_status_t
+close_tmpfile(void *baton)
+{
+  return apr_file_close(baton);
+}
+#endif
+
+/* Open an anonymous temporary file for BUF.  On Linux, try O_TMPFILE
+ * first so that the file never has a name on disk; otherwise fall
+ * back to an ordinary unique file deleted on close. */
+static svn_error_t *
+open_spill_file(struct spillbuf *buf)
+{
+#if defined(__linux__) && defined(O_TMPFILE)
+  const char *temp_dir;
+  int fd;
+
+  SVN_ERR(svn_io_temp_dir(&temp_dir, buf->pool));
+  fd = open(temp_dir, O_TMPFILE | O_RDWR, 0600);
+  if (fd >= 0)
+    {
+      apr_os_file_t os_file = fd;
+      apr_status_t status;
+
+      status = apr_os_file_put(&buf->file, &os_file,
+                               APR_READ | APR_WRITE | APR_BINARY,
+                               buf->pool);
+      if (status)
+        {
+          close(fd);
+          return svn_error_wrap_apr(status, NULL);
+        }
+      apr_pool_cleanup_register(buf->pool, buf->file, close_tmpfile,
+                                apr_pool_cleanup_null);
+      return SVN_NO_ERROR;
+    }
+  /* Filesystems without O_TMPFILE support return EOPNOTSUPP or
+     EISDIR; just use a named file then. */
+#endif
+
+  return svn_io_open_unique_file3(&buf->file, NULL, NULL,
+                                  svn_io_file_del_on_pool_cleanup,
+                                  buf->pool, buf->pool);
+}
+
+/* Move the in-memory contents of BUF to its temporary file. */
+static svn_error_t *
+spill(struct spillbuf *buf)
+{
+  if (! buf->file)
+    SVN_ERR(open_spill_file(buf));
+
+  if (buf->mem->len)
+    SVN_ERR(svn_io_file_write_full(buf->file, buf->mem->data, buf->mem->len,
+                                   NULL, buf->pool));
+  svn_stringbuf_setempty(buf->mem);
+  buf->spilled = TRUE;
+
+  return SVN_NO_ERROR;
+}
+
+svn_error_t *
+spillbuf_create(struct spillbuf **buf,
+                apr_size_t threshold,
+                apr_pool_t *pool)
+{
+  struct spillbuf *new_buf = apr_pcalloc(pool, sizeof(*new_buf));
+
+  new_buf->pool = pool;
+  new_buf->threshold = threshold;
+  new_buf->mem = svn_stringbuf_create_ensure(0, pool);
+
+  *buf = new_buf;
+  return SVN_NO_ERROR;
+}
+
+svn_error_t *
+spillbuf_write(struct spillbuf *buf,
+               const char *data,
+               apr_size_t len)
+{
+  if (! buf->spilled && buf->mem->len + len > buf->threshold)
+    SVN_ERR(spill(buf));
+
+  if (buf->spilled)
+    SVN_ERR(svn_io_file_write_full(buf->file, data, len, NULL, buf->pool));
+  else
+    svn_stringbuf_appendbytes(buf->mem, data, len);
+
+  buf->size += len;
+  return SVN_NO_ERROR;
+}
+
+/* Implements svn_write_fn_t for spillbuf_stream(). */
+static svn_error_t *
+write_handler(void *baton,
+              const char *data,
+              apr_size_t *len)
+{
+  return spillbuf_write(baton, data, *len);
+}
+
+svn_stream_t *
+spillbuf_stream(struct spillbuf *buf,
+                apr_pool_t *pool)
+{
+  svn_stream_t *stream = svn_stream_create(buf, pool);
+
+  svn_stream_set_write(stream, write_handler);
+  return stream;
+}
+
+svn_filesize_t
+spillbuf_size(const struct spillbuf *buf)
+{
+  return buf->size;
+}
+
+svn_boolean_t
+spillbuf_spilled(const struct spillbuf *buf)
+{
+  return buf->spilled;
+}
+
+/* Copy LEN bytes from OFFSET of FILE to STREAM, through a buffer
+ * allocated in POOL. */
+static svn_error_t *
+copy_range_to_stream(apr_file_t *file,
+                     apr_off_t offset,
+                     svn_filesize_t len,
+                     svn_stream_t *stream,
+                     apr_pool_t *pool)
+{
+  char *data = apr_palloc(pool, COPY_BUFFER_SIZE);
+
+  SVN_ERR(svn_io_file_seek(file, APR_SET, &offset, pool));
+  while (len > 0)
+    {
+      apr_size_t n = (len > COPY_BUFFER_SIZE) ? COPY_BUFFER_SIZE
+                                              : (apr_size_t)len;
+
+      SVN_ERR(svn_io_file_read_full(file, data, n, NULL, pool));
+      SVN_ERR(svn_stream_write(stream, data, &n));
+      len -= n;
+    }
+
+  return SVN_NO_ERROR;
+}
+
+svn_error_t *
+spillbuf_write_to(struct spillbuf *buf,
+                  svn_stream_t *stream,
+                  apr_pool_t *pool)
+{
+  return spillbuf_write_range_to(buf, 0, buf->size, stream, pool);
+}
+
+svn_error_t *
+spillbuf_write_range_to(struct spillbuf *buf,
+                        svn_filesize_t offset,
+                        svn_filesize_t len,
+                        svn_stream_t *stream,
+                        apr_pool_t *pool)
+{
+  if (! buf->spilled)
+    {
+      apr_size_t n = (apr_size_t)len;
+
+      if (n)
+        SVN_ERR(svn_stream_write(stream, buf->mem->data + offset, &n));
+      return SVN_NO_ERROR;
+    }
+
+  return copy_range_to_stream(buf->file, (apr_off_t)offset, len, stream,
+                              pool);
+}
+
+#ifdef __linux__
+/* The ways of having the kernel move file data, in order of
+   preference.  copy_file_range() can share extents between files on
+   the same filesystem; sendfile() works with any output; splice()
+   needs the output to be a pipe. */
+enum kernel_copy_method
+{
+  copy_with_copy_file_range,
+  copy_with_sendfile,
+  copy_with_splice,
+  copy_in_user_space
+};
+
+/* Return TRUE if ERRNO_VAL says that a kernel copy method is not
+   available for the pair of files at hand, rather than that the
+   copy failed. */
+static svn_boolean_t
+method_unsupported(int errno_val)
+{
+  return errno_val == EINVAL || errno_val == ENOSYS || errno_val == EXDEV
+         || errno_val == EOPNOTSUPP || errno_val == EBADF;
+}
+
+/* Copy LEN bytes from offset *IN_OFFSET of IN_FD to the current offset
+ * of OUT_FD with METHOD, and advance *IN_OFFSET and *LEN past the data
+ * copied.  Set *UNSUPPORTED and stop if METHOD turns out not to work
+ * for these files. */
+static svn_error_t *
+kernel_copy(int in_fd,
+            apr_off_t *in_offset,
+            int out_fd,
+            apr_off_t *len,
+            enum kernel_copy_method method,
+            svn_boolean_t *unsupported)
+{
+  *unsupported = FALSE;
+
+  while (*len > 0)
+    {
+      size_t chunk = (*len > 0x40000000) ? 0x40000000 : (size_t)*len;
+      loff_t offset = *in_offset;
+      ssize_t copied;
+
+      if (method == copy_with_copy_file_range)
+        copied = copy_file_range(in_fd, &offset, out_fd, NULL, chunk, 0);
+      else if (method == copy_with_sendfile)
+        copied = sendfile(out_fd, in_fd, &offset, chunk);
+      else
+        copied = splice(in_fd, &offset, out_fd, NULL, chunk, 0);
+
+      if (copied < 0 && errno == EINTR)
+        continue;
+      if (copied < 0 && method_unsupported(errno))
+        {
+          *unsupported = TRUE;
+          return SVN_NO_ERROR;
+        }
+      if (copied < 0)
+        return svn_error_wrap_apr(apr_get_os_error(),
+                                  _("Can't copy spooled data to the "
+                                    "output"));
+
+      /* A short source means someone truncated it under us. */
+      if (copied == 0)
+        return svn_error_create(SVN_ERR_STREAM_UNEXPECTED_EOF, NULL,
+                                _("Unexpected end of spooled data"));
+
+      *in_offset += copied;
+      *len -= copied;
+    }
+
+  return SVN_NO_ERROR;
+}
+#endif
+
+svn_error_t *
+spillbuf_write_to_file(struct spillbuf *buf,
+                       apr_file_t *file,
+                       svn_filesize_t *kernel_copied,
+                       apr_pool_t *pool)
+{
+  return spillbuf_write_range_to_file(buf, 0, buf->size, file,
+                                      kernel_copied, pool);
+}
+
+svn_error_t *
+spillbuf_write_range_to_file(struct spillbuf *buf,
+                             svn_filesize_t start,
+                             svn_filesize_t len,
+                             apr_file_t *file,
+                             svn_filesize_t *kernel_copied,
+                             apr_pool_t *pool)
+{
+  apr_off_t offset = (apr_off_t)start;
+  apr_off_t remaining = (apr_off_t)len;
+  apr_status_t status;
+
+  if (kernel_copied)
+    *kernel_copied = 0;
+
+  if (! buf->spilled)
+    {
+      if (len)
+        SVN_ERR(svn_io_file_write_full(file, buf->mem->data + start,
+                                       (apr_size_t)len, NULL, pool));
+      return SVN_NO_ERROR;
+    }
+
+  /* Both descriptors must be up to date with what was written through
+     APR, which may buffer. */
+  status = apr_file_flush(buf->file);
+  if (! status)
+    status = apr_file_flush(file);
+  if (status)
+    return svn_error_wrap_apr(status, _("Can't flush file"));
+
+#ifdef __linux__
+  {
+    apr_os_file_t in_fd, out_fd;
+    enum kernel_copy_method method;
+
+    apr_os_file_get(&in_fd, buf->file);
+    apr_os_file_get(&out_fd, file);
+
+    for (method = copy_with_copy_file_range;
+         remaining > 0 && method != copy_in_user_space;
+         method++)
+      {
+        svn_boolean_t unsupported;
+
+        SVN_ERR(kernel_copy(in_fd, &offset, out_fd, &remaining, method,
+                            &unsupported));
+        if (! unsupported)
+          break;
+      }
+
+    if (kernel_copied)
+      *kernel_copied = offset - (apr_off_t)start;
+
+    if (remaining == 0)
+      return SVN_NO_ERROR;
+  }
+#endif
+
+  /* Copy whatever the kernel didn't through user space. */
+  return copy_range_to_stream(buf->file, offset, remaining,
+                              svn_stream_from_aprfile2(file, TRUE, pool),
+                              pool);
+}
+
+svn_error_t *
+spillbuf_reset(struct spillbuf *buf,
+               apr_pool_t *pool)
+{
+  if (buf->spilled)
+    {
+      apr_off_t offset = 0;
+
+      SVN_ERR(svn_io_file_trunc(buf->file, 0, pool));
+      SVN_ERR(svn_io_file_seek(buf->file, APR_SET, &offset, pool));
+      buf->spilled = FALSE;
+    }
+
+  svn_stringbuf_setempty(buf->mem);
+  buf->size = 0;
+  return SVN_NO_ERROR;
+}
@@ -0,0 +1,140 @@
+/**
+ * @copyright
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ * @endcopyright
+ *
+ * @file spillbuf.h
+ * @brief A write buffer that lives in memory until it grows past a
+ * threshold, and spills to an anonymous temporary file after that.
+ */
+
+#ifndef SPILLBUF_H_
+#define SPILLBUF_H_
+
+/** The default spill threshold: 1 MiB. */
+#define SPILLBUF_DEFAULT_THRESHOLD (1024 * 1024)
+
+/**
+ * An opaque spill buffer.  A spill buffer is filled through the
+ * stream returned by spillbuf_stream(), read back in one go with
+ * spillbuf_write_to() and then emptied with spillbuf_reset() for
+ * reuse.  The memory block and the temporary file (once created)
+ * are retained across resets.
+ */
+struct spillbuf;
+
+/**
+ * Create a spill buffer @a *buf in @a pool that keeps up to @a
+ * threshold bytes in memory.  A @a threshold of zero sends
+ * everything straight to the temporary file.  The temporary file is
+ * only created on the first spill and is removed when @a pool is
+ * cleared or destroyed.
+ */
+svn_error_t *
+spillbuf_create(struct spillbuf **buf,
+                apr_size_t threshold,
+                apr_pool_t *pool);
+
+/**
+ * Return a writable stream, allocated in @a pool, that appends to
+ * @a buf.  Closing the stream does not affect @a buf.
+ */
+svn_stream_t *
+spillbuf_stream(struct spillbuf *buf,
+                apr_pool_t *pool);
+
+/**
+ * Append @a len bytes of @a data to @a buf.
+ */
+svn_error_t *
+spillbuf_write(struct spillbuf *buf,
+               const char *data,
+               apr_size_t len);
+
+/**
+ * Return the number of bytes currently held by @a buf.
+ */
+svn_filesize_t
+spillbuf_size(const struct spillbuf *buf);
+
+/**
+ * Return TRUE if the contents of @a buf no longer fit in memory and
+ * have been moved to the temporary file.
+ */
+svn_boolean_t
+spillbuf_spilled(const struct spillbuf *buf);
+
+/**
+ * Write the whole contents of @a buf to @a stream, using @a pool for
+ * temporary allocations.  @a stream is not closed.
+ */
+svn_error_t *
+spillbuf_write_to(struct spillbuf *buf,
+                  svn_stream_t *stream,
+                  apr_pool_t *pool);
+
+/**
+ * Like spillbuf_write_to(), but write only the @a len bytes of @a buf
+ * starting at @a offset, which must lie within its contents.
+ */
+svn_error_t *
+spillbuf_write_range_to(struct spillbuf *buf,
+                        svn_filesize_t offset,
+                        svn_filesize_t len,
+                        svn_stream_t *stream,
+                        apr_pool_t *pool);
+
+/**
+ * Write the whole contents of @a buf to the current position of @a
+ * file, using @a pool for temporary allocations.  If @a buf has been
+ * spilled, the data is moved by the kernel (copy_file_range(),
+ * sendfile() or splice(), whichever works for @a file) where
+ * available, without passing through user space; otherwise, or if
+ * none of these works, it is copied as by spillbuf_write_to().  If
+ * @a kernel_copied is not NULL, set @a *kernel_copied to the number of
+ * bytes the kernel moved.
+ */
+svn_error_t *
+spillbuf_write_to_file(struct spillbuf *buf,
+                       apr_file_t *file,
+                       svn_filesize_t *kernel_copied,
+                       apr_pool_t *pool);
+
+/**
+ * Like spillbuf_write_to_file(), but write only the @a len bytes of
+ * @a buf starting at @a offset, which must lie within its contents.
+ */
+svn_error_t *
+spillbuf_write_range_to_file(struct spillbuf *buf,
+                             svn_filesize_t offset,
+                             svn_filesize_t len,
+                             apr_file_t *file,
+                             svn_filesize_t *kernel_copied,
+                             apr_pool_t *pool);
+
+/**
+ * Empty @a buf so it can be filled again, using @a pool for
+ * temporary allocations.
+ */
+svn_error_t *
+spillbuf_reset(struct spillbuf *buf,
+               apr_pool_t *pool);
+
+#endif
@@ -0,0 +1,268 @@
+/*
+ *  split_dump.c: Dumping the subtrees of one replay to separate
+ *  dumpfiles.
+ *
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ */
+
+#include "svn_pools.h"
+#include "svn_delta.h"
+#include "svn_repos.h"
+
+#include "svn17_compat.h"
+#include "spillbuf.h"
+#include "dump_record.h"
+#include "dump_editor.h"
+#include "split_dump.h"
+
+/* One output of a split dump. */
+struct split_output
+{
+  struct split_dump *split;
+
+  /* The stream the output is written to, and the dump editor writing
+     its nodes there. */
+  svn_stream_t *stream;
+  const svn_delta_editor_t *editor;
+  void *edit_baton;
+
+  /* Set while the record of the current revision is still to be
+     written to this output. */
+  svn_boolean_t revision_pending;
+
+  /* The revisions written to this output, in ascending order, if
+     empty revisions are dropped. */
+  apr_array_header_t *revisions;
+};
+
+struct split_dump
+{
+  /* The outputs, as struct split_output * */
+  apr_array_header_t *outputs;
+
+  svn_boolean_t drop_empty_revs;
+
+  /* The current revision and its revision record */
+  svn_revnum_t revision;
+  svn_stringbuf_t *revision_record;
+
+  apr_pool_t *pool;
+};
+
+/* Write the pending revision record of the output BATON.  Implements
+ * the start_node_func of struct dump_options. */
+static svn_error_t *
+start_node(void *baton)
+{
+  struct split_output *output = baton;
+  struct split_dump *split = output->split;
+  apr_size_t len = split->revision_record->len;
+
+  if (! output->revision_pending)
+    return SVN_NO_ERROR;
+
+  SVN_ERR(svn_stream_write(output->stream, split->revision_record->data,
+                           &len));
+  if (output->revisions)
+    APR_ARRAY_PUSH(output->revisions, svn_revnum_t) = split->revision;
+  output->revision_pending = FALSE;
+  return SVN_NO_ERROR;
+}
+
+/* Set *REVISION to the last revision written to the output BATON that
+ * is not younger than it: the contents of the output did not change
+ * after that.  Leave *REVISION alone if there is none.  Implements the
+ * map_revision_func of struct dump_options. */
+static svn_error_t *
+map_revision(svn_revnum_t *revision,
+             const char *path,
+             void *baton)
+{
+  struct split_output *output = baton;
+  int low = 0, high = output->revisions->nelts;
+
+  /* Find the first revision younger than *REVISION. */
+  while (low < high)
+    {
+      int mid = low + (high - low) / 2;
+
+      if (APR_ARRAY_IDX(output->revisions, mid, svn_revnum_t) <= *revision)
+        low = mid + 1;
+      else
+        high = mid;
+    }
+
+  if (low)
+    *revision = APR_ARRAY_IDX(output->revisions, low - 1, svn_revnum_t);
+  return SVN_NO_ERROR;
+}
+
+svn_error_t *
+split_dump_create(struct split_dump **split,
+                  svn_boolean_t drop_empty_revs,
+                  apr_pool_t *pool)
+{
+  struct split_dump *sd = apr_pcalloc(pool, sizeof(*sd));
+
+  sd->outputs = apr_array_make(pool, 4, sizeof(struct split_output *));
+  sd->drop_empty_revs = drop_empty_revs;
+  sd->revision = SVN_INVALID_REVNUM;
+  sd->revision_record = svn_stringbuf_create_ensure(256, pool);
+  sd->pool = pool;
+
+  *split = sd;
+  return SVN_NO_ERROR;
+}
+
+svn_error_t *
+split_dump_add_output(struct split_dump *split,
+                      const char *prefix,
+                      svn_stream_t *stream,
+                      const struct dump_options *options,
+                      apr_pool_t *pool)
+{
+  struct split_output *output = apr_pcalloc(pool, sizeof(*output));
+  struct dump_options output_options = { 0 };
+  apr_array_header_t *include_prefixes;
+
+  if (options)
+    output_options = *options;
+  else
+    output_options.spill_threshold = SPILLBUF_DEFAULT_THRESHOLD;
+
+  /* Select the subtree, and dump it as the root of the output. */
+  include_prefixes = apr_array_make(pool, 1, sizeof(const char *));
+  APR_ARRAY_PUSH(include_prefixes, const char *) = prefix;
+  output_options.include_prefixes = include_prefixes;
+  output_options.root_path = prefix;
+
+  output_options.start_node_func = start_node;
+  output_options.revision_baton = output;
+  if (split->drop_empty_revs)
+    {
+      output_options.map_revision_func = map_revision;
+      output->revisions = apr_array_make(pool, 64, sizeof(svn_revnum_t));
+    }
+
+  output->split = split;
+  output->stream = stream;
+  SVN_ERR(get_dump_editor(&output->editor, &output->edit_baton, stream,
+                          &output_options, NULL, NULL, pool));
+
+  APR_ARRAY_PUSH(split->outputs, struct split_output *) = output;
+  return SVN_NO_ERROR;
+}
+
+svn_error_t *
+split_dump_get_editor(const svn_delta_editor_t **editor,
+                      void **edit_baton,
+                      struct split_dump *split,
+                      svn_cancel_func_t cancel_func,
+                      void *cancel_baton,
+                      apr_pool_t *pool)
+{
+  const svn_delta_editor_t *tee_editor;
+  void *tee_baton;
+  int i;
+
+  SVN_ERR_ASSERT(split->outputs->nelts > 0);
+
+  /* Chain the dump editors together with tee editors; each of them
+     ignores the nodes outside its subtree. */
+  tee_editor = APR_ARRAY_IDX(split->outputs, 0, struct split_output *)->editor;
+  tee_baton =
+    APR_ARRAY_IDX(split->outputs, 0, struct split_output *)->edit_baton;
+  for (i = 1; i < split->outputs->nelts; i++)
+    {
+      struct split_output *output =
+        APR_ARRAY_IDX(split->outputs, i, struct split_output *);
+
+      SVN_ERR(svn_delta_tee_editor(&tee_editor, &tee_baton,
+                                   tee_editor, tee_baton,
+                                   output->editor, output->edit_baton,
+                                   pool));
+    }
+
+  return svn_delta_get_cancellation_editor(cancel_func, cancel_baton,
+                                           tee_editor, tee_baton,
+                                           editor, edit_baton, pool);
+}
+
+svn_error_t *
+split_dump_write_header(struct split_dump *split,
+                        const char *uuid,
+                        apr_pool_t *pool)
+{
+  int i;
+
+  for (i = 0; i < split->outputs->nelts; i++)
+    {
+      struct split_output *output =
+        APR_ARRAY_IDX(split->outputs, i, struct split_output *);
+
+      SVN_ERR(svn_stream_printf(output->stream, pool,
+                                SVN_REPOS_DUMPFILE_MAGIC_HEADER ": %d\n\n"
+                                SVN_REPOS_DUMPFILE_UUID ": %s\n\n",
+                                SVN_REPOS_DUMPFILE_FORMAT_VERSION, uuid));
+    }
+  return SVN_NO_ERROR;
+}
+
+svn_error_t *
+split_dump_start_revision(struct split_dump *split,
+                          svn_revnum_t revision,
+                          apr_hash_t *rev_props,
+                          apr_pool_t *pool)
+{
+  int i;
+
+  split->revision = revision;
+  svn_stringbuf_setempty(split->revision_record);
+  SVN_ERR(dump_record_revision(split->revision_record, revision, rev_props,
+                               -1, pool));
+
+  for (i = 0; i < split->outputs->nelts; i++)
+    {
+      struct split_output *output =
+        APR_ARRAY_IDX(split->outputs, i, struct split_output *);
+
+      output->revision_pending = TRUE;
+      if (! split->drop_empty_revs)
+        SVN_ERR(start_node(output));
+    }
+  return SVN_NO_ERROR;
+}
+
+svn_error_t *
+split_dump_close(struct split_dump *split)
+{
+  svn_error_t *err = SVN_NO_ERROR;
+  int i;
+
+  /* Close every stream, even if one of them fails. */
+  for (i = 0; i < split->outputs->nelts; i++)
+    {
+      struct split_output *output =
+        APR_ARRAY_IDX(split->outputs, i, struct split_output *);
+
+      err = svn_error_compose_create(err, svn_stream_close(output->stream));
+    }
+  return err;
+}
@@ -0,0 +1,102 @@
+/**
+ * @copyright
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ * @endcopyright
+ *
+ *
+ * @file split_dump.h
+ * @brief Dumping the subtrees of one replay to separate dumpfiles.
+ */
+
+#ifndef SPLIT_DUMP_H_
+#define SPLIT_DUMP_H_
+
+/**
+ * An opaque set of outputs, each receiving the part of the dump below
+ * one path prefix as a standalone dumpfile.
+ */
+struct split_dump;
+
+/**
+ * Create an empty set of outputs @a *split in @a pool.  If @a
+ * drop_empty_revs is set, revisions without any node in an output
+ * are left out of that output, and copy sources are renumbered to
+ * the revisions written instead.
+ */
+svn_error_t *
+split_dump_create(struct split_dump **split,
+                  svn_boolean_t drop_empty_revs,
+                  apr_pool_t *pool);
+
+/**
+ * Add an output to @a split, dumping the nodes below @a prefix (a path
+ * relative to the root of the replay, without leading or trailing
+ * slashes) to @a stream, with paths relative to @a prefix.  Its dump
+ * editor is tuned by @a options, which may be NULL.  Allocate in @a
+ * pool.
+ */
+svn_error_t *
+split_dump_add_output(struct split_dump *split,
+                      const char *prefix,
+                      svn_stream_t *stream,
+                      const struct dump_options *options,
+                      apr_pool_t *pool);
+
+/**
+ * Set @a *editor and @a *edit_baton to an editor, allocated in @a
+ * pool, driving the dump editors of all outputs of @a split.  Use @a
+ * cancel_func and @a cancel_baton to check for cancellation.
+ */
+svn_error_t *
+split_dump_get_editor(const svn_delta_editor_t **editor,
+                      void **edit_baton,
+                      struct split_dump *split,
+                      svn_cancel_func_t cancel_func,
+                      void *cancel_baton,
+                      apr_pool_t *pool);
+
+/**
+ * Write the dumpfile header for a repository with @a uuid to every
+ * output of @a split.  Use @a pool for temporary allocations.
+ */
+svn_error_t *
+split_dump_write_header(struct split_dump *split,
+                        const char *uuid,
+                        apr_pool_t *pool);
+
+/**
+ * Start @a revision, with the revision properties @a rev_props, in
+ * every output of @a split.  Its revision record is written at once,
+ * or with the first node of an output if empty revisions are dropped.
+ * Use @a pool for temporary allocations.
+ */
+svn_error_t *
+split_dump_start_revision(struct split_dump *split,
+                          svn_revnum_t revision,
+                          apr_hash_t *rev_props,
+                          apr_pool_t *pool);
+
+/**
+ * Close the streams of all outputs of @a split.
+ */
+svn_error_t *
+split_dump_close(struct split_dump *split);
+
+#endif
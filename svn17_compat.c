@@ -28,6 +28,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <assert.h>
 
 #include <apr.h>
@@ -980,6 +981,18 @@ svn_io_remove_file2(const char *path,
   return err;
 }
 
+void
+svn_txdelta_to_svndiff3(svn_txdelta_window_handler_t *handler,
+                        void **handler_baton,
+                        svn_stream_t *output,
+                        int svndiff_version,
+                        int compression_level,
+                        apr_pool_t *pool)
+{
+  svn_txdelta_to_svndiff2(handler, handler_baton, output, svndiff_version,
+                          pool);
+}
+
 /* Note about the type casts:  apr_hash_this() does not expect a const hash
  * index pointer even though it does not modify the hash index.  In
  * Subversion we're trying to be const-correct, so these functions all take
@@ -1004,6 +1017,45 @@ void *svn__apr_hash_index_val(const apr_hash_index_t *hi)
   return val;
 }
 
+/* From libsvn_subr/string.c. */
+svn_error_t *
+svn_cstring_strtoi64(apr_int64_t *n, const char *str,
+                     apr_int64_t minval, apr_int64_t maxval,
+                     int base)
+{
+  apr_int64_t val;
+  char *endptr;
+
+  /* We assume errno is thread-safe. */
+  errno = 0; /* APR-0.9 doesn't always set errno */
+
+  val = apr_strtoi64(str, &endptr, base);
+  if (errno == EINVAL || endptr == str || str[0] == '\0' || *endptr != '\0')
+    return svn_error_createf(SVN_ERR_INCORRECT_PARAMS, NULL,
+                             _("Could not convert '%s' into a number"),
+                             str);
+  if ((errno == ERANGE && (val == APR_INT64_MIN || val == APR_INT64_MAX)) ||
+      val < minval || val > maxval)
+    return svn_error_createf(SVN_ERR_INCORRECT_PARAMS, NULL,
+                             _("Number '%s' is out of range "
+                               "'[%" APR_INT64_T_FMT ", %" APR_INT64_T_FMT
+                               "]'"),
+                             str, minval, maxval);
+  *n = val;
+  return SVN_NO_ERROR;
+}
+
+/* From libsvn_subr/string.c. */
+svn_error_t *
+svn_cstring_atoi(int *n, const char *str)
+{
+  apr_int64_t val;
+
+  SVN_ERR(svn_cstring_strtoi64(&val, str, APR_INT32_MIN, APR_INT32_MAX, 10));
+  *n = (int)val;
+  return SVN_NO_ERROR;
+}
+
 
 /* From libsvn_subr/cmdline.c. */
 svn_error_t *
@@ -36,6 +36,7 @@
 #include <apr_pools.h>
 
 #include <svn_types.h>
+#include <svn_delta.h>
 
 /** Join a valid base uri (@a base) with a relative path or uri
  * (@a component), allocating the result in @a pool. @a component need
@@ -195,6 +196,36 @@ svn_io_remove_file2(const char *path,
                    svn_boolean_t ignore_enoent,
                    apr_pool_t *scratch_pool);
 
+/** Compression levels for svn_txdelta_to_svndiff3().
+ *
+ * From svn_delta.h.
+ */
+#define SVN_DELTA_COMPRESSION_LEVEL_NONE 0
+#define SVN_DELTA_COMPRESSION_LEVEL_MAX 9
+#define SVN_DELTA_COMPRESSION_LEVEL_DEFAULT 5
+
+/** Prepare to produce an svndiff-format diff from text delta windows.
+ * @a output is a writable generic stream to write the svndiff data to.
+ * Allocation takes place in a sub-pool of @a pool.  On return, @a
+ * *handler is set to a window handler function and @a *handler_baton
+ * to a value to pass to that function.  @a svndiff_version selects
+ * the version of svndiff to produce; the compression of svndiff1 data
+ * is controlled by @a compression_level.
+ *
+ * The 1.6 library behind this wrapper always compresses at
+ * SVN_DELTA_COMPRESSION_LEVEL_DEFAULT, so @a compression_level is
+ * ignored.
+ *
+ * From svn_delta.h.
+ */
+void
+svn_txdelta_to_svndiff3(svn_txdelta_window_handler_t *handler,
+                        void **handler_baton,
+                        svn_stream_t *output,
+                        int svndiff_version,
+                        int compression_level,
+                        apr_pool_t *pool);
+
 
 /** @defgroup apr_hash_utilities APR Hash Table Helpers
  * These functions enable the caller to dereference an APR hash table index
@@ -216,6 +247,29 @@ svn__apr_hash_index_val(const apr_hash_index_t *hi);
 
 /** @} */
 
+/**
+ * Parse the C string @a str into a 64 bit number, and return it in @a *n.
+ * Assume that the number is represented in base @a base.
+ * Raise an error if conversion fails (e.g. due to overflow), or if the
+ * converted number is smaller than @a minval or larger than @a maxval.
+ *
+ * From svn_string.h.
+ */
+svn_error_t *
+svn_cstring_strtoi64(apr_int64_t *n, const char *str,
+                     apr_int64_t minval, apr_int64_t maxval,
+                     int base);
+
+/**
+ * Parse the C string @a str into a 32 bit number, and return it in @a *n.
+ * Assume that the number is represented in base 10.
+ * Raise an error if conversion fails (e.g. due to overflow).
+ *
+ * From svn_string.h.
+ */
+svn_error_t *
+svn_cstring_atoi(int *n, const char *str);
+
 /* From svn_private_config.h.
  */
 #define PACKAGE_NAME "subversion"
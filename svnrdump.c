@@ -23,6 +23,9 @@
  */
 
 #include <apr_signal.h>
+#include <apr_thread_proc.h>
+#include <apr_thread_mutex.h>
+#include <apr_thread_cond.h>
 
 #include "svn_pools.h"
 #include "svn_cmdline.h"
@@ -37,7 +40,18 @@
 #include "svn_dirent_uri.h"
 
 #include "svn17_compat.h"
+#include "spillbuf.h"
+#include "write_queue.h"
+#include "resume.h"
+#include "compress_stream.h"
+#include "output_sink.h"
+#include "uring_writer.h"
+#include "fanout.h"
+#include "dump_record.h"
+#include "fulltext_cache.h"
 #include "dump_editor.h"
+#include "split_dump.h"
+#include "plan.h"
 #include "load_editor.h"
 
 
@@ -47,10 +61,23 @@
 /* A flag to see if we've been cancelled by the client or not. */
 static volatile sig_atomic_t cancelled = FALSE;
 
+/* Set if the first signal should only stop the dump at the end of the
+   current revision (see check_revision_boundary()), and a flag to see
+   if such a stop has been requested. */
+static svn_boolean_t stop_at_revision_boundary = FALSE;
+static volatile sig_atomic_t stop_requested = FALSE;
+
 /* A signal handler to support cancellation. */
 static void
 signal_handler(int signum)
 {
+  if (stop_at_revision_boundary && ! stop_requested)
+    {
+      /* Keep the handler; a second signal cancels right away. */
+      stop_requested = TRUE;
+      return;
+    }
+
   apr_signal(signum, SIG_IGN);
   cancelled = TRUE;
 }
@@ -65,10 +92,22 @@ check_cancel(void *baton)
     return SVN_NO_ERROR;
 }
 
+/* Our cancellation callback for revision boundaries, where the output
+   is consistent and a pending stop request can be honoured. */
+static svn_error_t *
+check_revision_boundary(void *baton)
+{
+  if (stop_requested)
+    return svn_error_create(SVN_ERR_CANCELLED, NULL,
+                            _("Caught signal; stopped after the last "
+                              "complete revision"));
+  return check_cancel(baton);
+}
+
 
 
 
-static svn_opt_subcommand_t dump_cmd, load_cmd;
+static svn_opt_subcommand_t dump_cmd, dump_many_cmd, plan_cmd, load_cmd;
 
 enum svn_svnrdump__longopt_t
   {
@@ -79,21 +118,116 @@ enum svn_svnrdump__longopt_t
     opt_auth_nocache,
     opt_version,
     opt_config_option,
+    opt_spill_threshold,
+    opt_stats,
+    opt_jobs,
+    opt_output_queue,
+    opt_resume,
+    opt_compress,
+    opt_compress_level,
+    opt_compress_threads,
+    opt_svndiff_version,
+    opt_svndiff_level,
+    opt_output_buffer,
+    opt_flush,
+    opt_output,
+    opt_io_uring,
+    opt_direct,
+    opt_preallocate,
+    opt_include,
+    opt_exclude,
+    opt_drop_prop,
+    opt_split_by,
+    opt_drop_empty_revs,
+    opt_tee,
+    opt_tee_policy,
+    opt_tee_stall_limit,
+    opt_retries,
+    opt_follow,
+    opt_poll_interval,
+    opt_parts,
+    opt_probe_sizes,
+    opt_no_content,
+    opt_revprops_only,
+    opt_base_snapshot,
+    opt_fulltext,
+    opt_fulltext_cache_size,
+    opt_revision_length,
   };
 
 static const svn_opt_subcommand_desc2_t svnrdump__cmd_table[] =
   {
     { "dump", dump_cmd, { 0 },
-      N_("usage: svnrdump dump URL [-r LOWER[:UPPER]]\n\n"
+      N_("usage: svnrdump dump URL [-r LOWER[:UPPER]]\n"
+         "                        [--output FILE | --resume FILE]\n\n"
          "Dump revisions LOWER to UPPER of repository at remote URL "
-         "to stdout in a 'dumpfile' portable format.\n"
-         "If only LOWER is given, dump that one revision.\n"),
-      { 0 } },
+         "to stdout (or to\nFILE) in a 'dumpfile' portable format.\n"
+         "If only LOWER is given, dump that one revision.\n"
+         "With --resume, write to FILE instead, continuing after the "
+         "last complete\nrevision if FILE holds an interrupted dump.\n"
+         "--include, --exclude and --drop-prop leave nodes and node "
+         "properties out\nof the dump, like svndumpfilter.\n"
+         "With --split-by, write the nodes below each PREFIX to a "
+         "separate FILE\ninstead, as a dumpfile of its own rooted at "
+         "PREFIX.\n"
+         "With --tee, write a copy of the dump to each FILE as well.  "
+         "Options after\nFILE give it its own compression (compress=gzip "
+         "or zstd, level=N) and\nbuffer (buffer=SIZE).\n"
+         "With --follow, keep dumping new revisions as they are "
+         "committed, until\ninterrupted.\n"
+         "With --no-content, only dump the structure of the history, "
+         "without file\ncontents or property values; such a dump "
+         "can't be loaded.\n"
+         "With --revprops-only, only dump the revision records, with "
+         "their revision\nproperties.\n"
+         "With --base-snapshot, dump LOWER as a complete tree of added "
+         "nodes, so that\nthe dump can be loaded into an empty "
+         "repository.\n"
+         "With --fulltext, dump file contents as full texts and "
+         "changed properties as\ncomplete lists, like 'svnadmin dump', "
+         "applying the deltas to texts kept in\nthe cache directory "
+         "DIR.\n"
+         "With --revision-length, give the length of the node records "
+         "of each\nrevision in its revision record, so that readers "
+         "can skip it.\n"),
+      { 'r', 'q', opt_base_snapshot, opt_fulltext, opt_fulltext_cache_size,
+        opt_revision_length, opt_no_content, opt_revprops_only,
+        opt_follow, opt_poll_interval, opt_include, opt_exclude,
+        opt_drop_prop, opt_split_by, opt_drop_empty_revs, opt_output,
+        opt_tee, opt_tee_policy, opt_tee_stall_limit, opt_io_uring,
+        opt_direct, opt_preallocate, opt_resume, opt_retries, opt_jobs,
+        opt_output_buffer, opt_flush, opt_output_queue, opt_compress,
+        opt_compress_level, opt_compress_threads, opt_svndiff_version,
+        opt_svndiff_level, opt_spill_threshold, opt_stats } },
+    { "dump-many", dump_many_cmd, { 0 },
+      N_("usage: svnrdump dump-many LISTFILE\n\n"
+         "Dump every repository listed in LISTFILE.  Each line of "
+         "LISTFILE gives the\nURL of a repository and the FILE to dump "
+         "it to, separated by whitespace;\nempty lines and lines "
+         "starting with '#' are ignored.\n"
+         "With --jobs, dump that many repositories at a time, without "
+         "prompting for\ncredentials.  A failed dump doesn't stop the "
+         "others; a summary is printed\nat the end.\n"),
+      { 'q', opt_jobs, opt_retries, opt_include, opt_exclude, opt_drop_prop,
+        opt_io_uring, opt_direct, opt_preallocate, opt_output_buffer,
+        opt_flush, opt_output_queue, opt_compress, opt_compress_level,
+        opt_compress_threads, opt_svndiff_version, opt_svndiff_level,
+        opt_spill_threshold } },
+    { "plan", plan_cmd, { 0 },
+      N_("usage: svnrdump plan URL --parts N [-r LOWER[:UPPER]]\n\n"
+         "Cut revisions LOWER to UPPER of the repository at remote URL "
+         "into N\ncontiguous ranges which should take about the same "
+         "amount of dump output\neach, judging by the log.  Print one "
+         "range per line to stdout, as\n'LOWER:UPPER ESTIMATED-BYTES'.\n"
+         "With --probe-sizes, also look up the size of each added or "
+         "modified file\nfor a better estimate, at one request per "
+         "file.\n"),
+      { 'r', 'q', opt_parts, opt_probe_sizes } },
     { "load", load_cmd, { 0 },
       N_("usage: svnrdump load URL\n\n"
          "Load a 'dumpfile' given on stdin to a repository "
          "at remote URL.\n"),
-      { 0 } },
+      { 'q' } },
     { "help", 0, { "?", "h" },
       N_("usage: svnrdump help [SUBCOMMAND...]\n\n"
          "Describe the usage of this program or its subcommands.\n"),
@@ -121,6 +255,154 @@ static const apr_getopt_option_t svnrdump__options[] =
                       N_("display this help")},
     {"version",       opt_version, 0,
                       N_("show program version information")},
+    {"base-snapshot", opt_base_snapshot, 0,
+                      N_("dump the first revision as a complete tree\n"
+                         "                             "
+                         "of added nodes")},
+    {"fulltext",      opt_fulltext, 1,
+                      N_("dump full texts instead of text deltas,\n"
+                         "                             "
+                         "keeping them in the cache directory ARG for\n"
+                         "                             "
+                         "this and later dumps")},
+    {"fulltext-cache-size", opt_fulltext_cache_size, 1,
+                      N_("let the --fulltext cache grow to ARG bytes\n"
+                         "                             "
+                         "(with an optional K, M or G suffix) before\n"
+                         "                             "
+                         "evicting the least recently used texts\n"
+                         "                             "
+                         "[default: 1G]")},
+    {"revision-length", opt_revision_length, 0,
+                      N_("give the length of the node records of each\n"
+                         "                             "
+                         "revision in a header of its revision record")},
+    {"no-content",    opt_no_content, 0,
+                      N_("dump nodes without text or property values,\n"
+                         "                             "
+                         "only noting which changed; the result is not\n"
+                         "                             "
+                         "a loadable dumpfile")},
+    {"revprops-only", opt_revprops_only, 0,
+                      N_("dump revision properties only, without any\n"
+                         "                             "
+                         "nodes")},
+    {"include",       opt_include, 1,
+                      N_("dump only nodes at or below path ARG; may be\n"
+                         "                             "
+                         "given more than once")},
+    {"exclude",       opt_exclude, 1,
+                      N_("leave out nodes at or below path ARG; may be\n"
+                         "                             "
+                         "given more than once")},
+    {"drop-prop",     opt_drop_prop, 1,
+                      N_("leave out node property ARG; may be given\n"
+                         "                             "
+                         "more than once")},
+    {"split-by",      opt_split_by, 1,
+                      N_("dump the nodes below PREFIX to FILE, given ARG\n"
+                         "                             "
+                         "as PREFIX=FILE; may be given more than once")},
+    {"drop-empty-revs", opt_drop_empty_revs, 0,
+                      N_("with --split-by, leave revisions that don't\n"
+                         "                             "
+                         "change a FILE out of it")},
+    {"output",        opt_output, 1,
+                      N_("write the dump to file ARG instead of stdout")},
+    {"io-uring",      opt_io_uring, 0,
+                      N_("write the --output file asynchronously through\n"
+                         "                             "
+                         "io_uring (Linux)")},
+    {"direct",        opt_direct, 0,
+                      N_("with --io-uring, bypass the page cache\n"
+                         "                             "
+                         "(O_DIRECT) where the filesystem allows")},
+    {"preallocate",   opt_preallocate, 1,
+                      N_("with --io-uring, reserve ARG bytes (with an\n"
+                         "                             "
+                         "optional K, M or G suffix) for the file")},
+    {"tee",           opt_tee, 1,
+                      N_("also write the dump to a file, given ARG as\n"
+                         "                             "
+                         "FILE[,compress=FORMAT][,level=N][,buffer=SIZE];\n"
+                         "                             "
+                         "may be given more than once")},
+    {"tee-policy",    opt_tee_policy, 1,
+                      N_("when an output falls behind the others: 'block'\n"
+                         "                             "
+                         "waits for it, 'drop' goes on without it, 'fail'\n"
+                         "                             "
+                         "stops the dump [default: block]")},
+    {"tee-stall-limit", opt_tee_stall_limit, 1,
+                      N_("apply --tee-policy after waiting ARG ms for an\n"
+                         "                             "
+                         "output [default: 1000]")},
+    {"resume",        opt_resume, 1,
+                      N_("dump to file ARG, continuing an interrupted dump")},
+    {"follow",        opt_follow, 0,
+                      N_("after the last revision, wait for new ones and\n"
+                         "                             "
+                         "dump them too; a signal stops at the end of a\n"
+                         "                             "
+                         "revision")},
+    {"poll-interval", opt_poll_interval, 1,
+                      N_("with --follow, look for new revisions every ARG\n"
+                         "                             "
+                         "seconds [default: 2]")},
+    {"parts",         opt_parts, 1,
+                      N_("cut the range into ARG parts")},
+    {"probe-sizes",   opt_probe_sizes, 0,
+                      N_("look up file sizes to estimate the dump size")},
+    {"retries",       opt_retries, 1,
+                      N_("reconnect and dump a revision again up to ARG\n"
+                         "                             "
+                         "times after a connection failure [default: 3;\n"
+                         "                             "
+                         "0 writes each revision as it is replayed]")},
+    {"jobs",          opt_jobs, 1,
+                      N_("dump using ARG concurrent connections; the\n"
+                         "                             "
+                         "output is the same as with a single one")},
+    {"output-buffer", opt_output_buffer, 1,
+                      N_("collect the output in a buffer of ARG bytes\n"
+                         "                             "
+                         "(with an optional K, M or G suffix), or in\n"
+                         "                             "
+                         "queue buffers of that size with --output-queue\n"
+                         "                             "
+                         "[default: 1M; 0 writes unbuffered]")},
+    {"flush",         opt_flush, 1,
+                      N_("pass buffered output on when the buffer is\n"
+                         "                             "
+                         "'full' or at the end of every 'revision'\n"
+                         "                             "
+                         "[default: full]")},
+    {"output-queue",  opt_output_queue, 1,
+                      N_("write the output from a separate thread, through\n"
+                         "                             "
+                         "a queue of ARG buffers [default: 0 (off)]")},
+    {"compress",      opt_compress, 1,
+                      N_("compress the output with ARG ('gzip' or 'zstd')")},
+    {"compress-level", opt_compress_level, 1,
+                      N_("compress at level ARG [default: the library's]")},
+    {"compress-threads", opt_compress_threads, 1,
+                      N_("compress blocks of revisions on ARG threads\n"
+                         "                             "
+                         "[default: 1; 0 compresses inline]")},
+    {"svndiff-version", opt_svndiff_version, 1,
+                      N_("write text deltas as svndiff version ARG; 1\n"
+                         "                             "
+                         "compresses them [default: 0]")},
+    {"svndiff-level", opt_svndiff_level, 1,
+                      N_("compress svndiff1 deltas at level ARG (0-9)")},
+    {"spill-threshold", opt_spill_threshold, 1,
+                      N_("keep text deltas of up to ARG bytes (with an\n"
+                         "                             "
+                         "optional K, M or G suffix) in memory; larger\n"
+                         "                             "
+                         "ones go to a temporary file [default: 1M]")},
+    {"stats",         opt_stats, 0,
+                      N_("print buffering statistics to stderr when done")},
     {"config-option", opt_config_option, 1,
                       N_("set user configuration option in the format:\n"
                          "                             "
@@ -132,8 +414,16 @@ static const apr_getopt_option_t svnrdump__options[] =
     {0, 0, 0, 0}
   };
 
+/* Options that every subcommand accepts. */
+static const int svnrdump__global_options[] =
+  { opt_config_dir, opt_auth_username, opt_auth_password,
+    opt_non_interactive, opt_auth_nocache, opt_config_option, 0 };
+
 /* Baton for the RA replay session. */
 struct replay_baton {
+  /* The stream revision headers are written to. */
+  svn_stream_t *stream;
+
   /* The editor producing diffs. */
   const svn_delta_editor_t *editor;
 
@@ -142,8 +432,62 @@ struct replay_baton {
 
   /* Whether to be quiet. */
   svn_boolean_t quiet;
+
+  /* If not NULL, the outputs the revisions are split into; revision
+     records go there rather than to STREAM. */
+  struct split_dump *split;
+
+  /* Called after each revision, if not NULL. */
+  svn_error_t *(*boundary_func)(void *baton);
+  void *boundary_baton;
+
+  /* If not NULL, STREAM appends to this buffer, which collects the
+     current revision until it is complete and then goes to OUTPUT,
+     so that a failed revision can be dumped again.  OUTPUT_OPTIONS
+     tell where the output file is, if any. */
+  struct spillbuf *revision_buffer;
+  svn_stream_t *output;
+  const struct dump_options *output_options;
+
+  /* Whether to give the length of the node records in REVISION_BUFFER
+     in the revision record, which then waits in REV_PROPS for the end
+     of the revision. */
+  svn_boolean_t nodes_length;
+  apr_hash_t *rev_props;
+
+  /* The revision after the last one written out. */
+  svn_revnum_t next_revision;
+
+  /* Set when writing to OUTPUT failed.  Part of the revision may have
+     got out then, so it must not be dumped again. */
+  svn_boolean_t output_failed;
+
+  /* Set for the workers of a parallel dump, which leave stopping at a
+     revision boundary to the thread writing out their output. */
+  svn_boolean_t defer_stop;
+
+  /* The cache the dump editor keeps full texts in, or NULL. */
+  struct fulltext_cache *fulltext_cache;
 };
 
+/* Revision properties are fetched with the log of this many revisions
+   at a time. */
+#define REVPROPS_BATCH_SIZE 1000
+
+/* Revision buffers keep this many bytes in memory before spilling to
+   disk. */
+#define REVISION_SPILL_THRESHOLD (16 * 1024 * 1024)
+
+/* The first retry after a connection failure waits this long; each
+   further retry of the same revision waits twice as long as the one
+   before, up to RETRY_MAX_DELAY. */
+#define RETRY_INITIAL_DELAY apr_time_from_sec(1)
+#define RETRY_MAX_DELAY apr_time_from_sec(30)
+
+/* With --follow, the wait for new revisions is cut into naps of this
+   length, so that a signal ends it soon. */
+#define FOLLOW_NAP apr_time_from_msec(100)
+
 /* Option set */
 typedef struct opt_baton_t {
   svn_ra_session_t *session;
@@ -151,8 +495,149 @@ typedef struct opt_baton_t {
   svn_revnum_t start_revision;
   svn_revnum_t end_revision;
   svn_boolean_t quiet;
+  apr_size_t spill_threshold;
+  svn_boolean_t stats;
+  int jobs;
+  int output_queue;
+  apr_size_t output_buffer;
+  enum output_flush_policy flush_policy;
+  const char *resume_file;
+  const char *output_file;
+  svn_boolean_t io_uring;
+  svn_boolean_t direct;
+  apr_size_t preallocate;
+  const char *compress;
+  int compress_level;
+  int compress_threads;
+  int svndiff_version;
+  int svndiff_level;
+
+  /* Whether to leave file contents and property values out, and
+     whether to leave out nodes altogether. */
+  svn_boolean_t no_content;
+  svn_boolean_t revprops_only;
+
+  /* Whether to dump the first revision as a tree of adds. */
+  svn_boolean_t base_snapshot;
+
+  /* Whether to give the length of the node records of each revision
+     in its revision record. */
+  svn_boolean_t revision_length;
+
+  /* The directory and size limit of the cache for --fulltext, or
+     NULL, and the cache once open. */
+  const char *fulltext_dir;
+  apr_size_t fulltext_cache_size;
+  struct fulltext_cache *fulltext_cache;
+
+  /* Path prefixes to include and exclude and node properties to drop,
+     or NULL. */
+  apr_array_header_t *include_prefixes;
+  apr_array_header_t *exclude_prefixes;
+  apr_hash_t *drop_props;
+
+  /* How many times a revision may be dumped again after a connection
+     failure, and how many retries there have been. */
+  int retries;
+  int retry_count;
+
+  /* Whether to go on dumping revisions committed after the last one,
+     and how often to look for them. */
+  svn_boolean_t follow;
+  apr_interval_time_t poll_interval;
+
+  /* For "plan", the number of ranges to cut the revisions into, and
+     whether to look up file sizes. */
+  int parts;
+  svn_boolean_t probe_sizes;
+
+  /* The PREFIX=FILE arguments of --split-by, or NULL, and the outputs
+     opened for them. */
+  apr_array_header_t *split_by;
+  svn_boolean_t drop_empty_revs;
+  struct split_dump *split;
+
+  /* The FILE[,OPTION...] arguments of --tee, or NULL, and what to do
+     about an output that falls behind. */
+  apr_array_header_t *tees;
+  enum fanout_policy tee_policy;
+  apr_interval_time_t tee_stall_limit;
+
+  /* Called whenever the output ends at a revision boundary, if not
+     NULL. */
+  svn_error_t *(*boundary_func)(void *baton);
+  void *boundary_baton;
+
+  /* Set when the output continues an existing dumpfile. */
+  svn_boolean_t append;
+
+  /* Connection parameters, kept for opening additional sessions. */
+  svn_boolean_t non_interactive;
+  const char *username;
+  const char *password;
+  const char *config_dir;
+  svn_boolean_t no_auth_cache;
+  apr_array_header_t *config_options;
+
+  /* For a dump-many job, the context of the worker running it, which
+     additional sessions are opened with instead; else NULL. */
+  svn_client_ctx_t *ctx;
 } opt_baton_t;
 
+/* Write a revision record for REVISION with the revision properties
+ * REV_PROPS to STREAM, in a single write.  Unless NODES_LENGTH is
+ * negative, give it as the length of the node records to follow.  Use
+ * POOL for allocations.
+ */
+static svn_error_t *
+write_revision_record(svn_stream_t *stream,
+                      svn_revnum_t revision,
+                      apr_hash_t *rev_props,
+                      svn_filesize_t nodes_length,
+                      apr_pool_t *pool)
+{
+  svn_stringbuf_t *record = svn_stringbuf_create_ensure(256, pool);
+
+  SVN_ERR(dump_record_revision(record, revision, rev_props, nodes_length,
+                               pool));
+  return dump_record_write(record, stream);
+}
+
+/* Write the LEN bytes of BUF at OFFSET to STREAM, or straight to the
+ * file behind it if DUMP_OPTIONS (which may be NULL) allows and BUF has
+ * spilled to disk.  Use POOL for temporary allocations.
+ */
+static svn_error_t *
+write_buffer_range(struct spillbuf *buf,
+                   svn_filesize_t offset,
+                   svn_filesize_t len,
+                   const struct dump_options *dump_options,
+                   svn_stream_t *stream,
+                   apr_pool_t *pool)
+{
+  apr_file_t *file = NULL;
+
+  if (spillbuf_spilled(buf) && dump_options && dump_options->get_output_file)
+    SVN_ERR(dump_options->get_output_file(&file,
+                                          dump_options->output_file_baton));
+
+  if (file)
+    return spillbuf_write_range_to_file(buf, offset, len, file, NULL,
+                                        pool);
+  return spillbuf_write_range_to(buf, offset, len, stream, pool);
+}
+
+/* Write the contents of BUF to STREAM as by write_buffer_range(). */
+static svn_error_t *
+write_buffer(struct spillbuf *buf,
+             const struct dump_options *dump_options,
+             svn_stream_t *stream,
+             apr_pool_t *pool)
+{
+  return write_buffer_range(buf, 0, spillbuf_size(buf), dump_options,
+                            stream, pool);
+}
+
 /* Print dumpstream-formatted information about REVISION.
  * Implements the `svn_ra_replay_revstart_callback_t' interface.
  */
@@ -165,38 +650,21 @@ replay_revstart(svn_revnum_t revision,
                 apr_pool_t *pool)
 {
   struct replay_baton *rb = replay_baton;
-  svn_stringbuf_t *propstring;
-  svn_stream_t *stdout_stream;
-  svn_stream_t *revprop_stream;
 
-  svn_stream_for_stdout(&stdout_stream, pool);
+  /* Drop whatever a failed attempt at this revision left behind. */
+  if (rb->revision_buffer)
+    SVN_ERR(spillbuf_reset(rb->revision_buffer, pool));
+  if (rb->fulltext_cache)
+    SVN_ERR(fulltext_cache_start_revision(rb->fulltext_cache, revision,
+                                          pool));
 
-  /* Revision-number: 19 */
-  SVN_ERR(svn_stream_printf(stdout_stream, pool,
-                            SVN_REPOS_DUMPFILE_REVISION_NUMBER
-                            ": %ld\n", revision));
   SVN_ERR(normalize_props(rev_props, pool));
-  propstring = svn_stringbuf_create_ensure(0, pool);
-  revprop_stream = svn_stream_from_stringbuf(propstring, pool);
-  SVN_ERR(svn_hash_write2(rev_props, revprop_stream, "PROPS-END", pool));
-  SVN_ERR(svn_stream_close(revprop_stream));
-
-  /* Prop-content-length: 13 */
-  SVN_ERR(svn_stream_printf(stdout_stream, pool,
-                            SVN_REPOS_DUMPFILE_PROP_CONTENT_LENGTH
-                            ": %" APR_SIZE_T_FMT "\n", propstring->len));
-
-  /* Content-length: 29 */
-  SVN_ERR(svn_stream_printf(stdout_stream, pool,
-                            SVN_REPOS_DUMPFILE_CONTENT_LENGTH
-                            ": %" APR_SIZE_T_FMT "\n\n", propstring->len));
-
-  /* Property data. */
-  SVN_ERR(svn_stream_write(stdout_stream, propstring->data,
-                           &(propstring->len)));
-
-  SVN_ERR(svn_stream_printf(stdout_stream, pool, "\n"));
-  SVN_ERR(svn_stream_close(stdout_stream));
+  if (rb->split)
+    SVN_ERR(split_dump_start_revision(rb->split, revision, rev_props, pool));
+  else if (rb->nodes_length)
+    rb->rev_props = rev_props;
+  else
+    SVN_ERR(write_revision_record(rb->stream, revision, rev_props, -1, pool));
 
   /* Extract editor and editor_baton from the replay_baton and
      set them so that the editor callbacks can use them. */
@@ -216,10 +684,96 @@ replay_revend(svn_revnum_t revision,
               apr_hash_t *rev_props,
               apr_pool_t *pool)
 {
-  /* No resources left to free. */
   struct replay_baton *rb = replay_baton;
+  svn_error_t *err = SVN_NO_ERROR;
+
+  /* The replay doesn't close the edit; do it so that the editor
+     writes out whatever it still holds before the next revision. */
+  SVN_ERR(editor->close_edit(edit_baton, pool));
+
+  if (rb->revision_buffer)
+    {
+      if (rb->nodes_length)
+        err = write_revision_record(rb->output, revision, rb->rev_props,
+                                    spillbuf_size(rb->revision_buffer),
+                                    pool);
+      if (! err)
+        err = write_buffer(rb->revision_buffer, rb->output_options,
+                           rb->output, pool);
+      if (err)
+        {
+          rb->output_failed = TRUE;
+          return err;
+        }
+      SVN_ERR(spillbuf_reset(rb->revision_buffer, pool));
+    }
+  rb->next_revision = revision + 1;
+
   if (! rb->quiet)
     svn_cmdline_fprintf(stderr, pool, "* Dumped revision %lu.\n", revision);
+  if (rb->boundary_func)
+    {
+      err = rb->boundary_func(rb->boundary_baton);
+      if (err)
+        {
+          rb->output_failed = TRUE;
+          return err;
+        }
+    }
+  return rb->defer_stop ? check_cancel(NULL) : check_revision_boundary(NULL);
+}
+
+/* Set *CONFIG to the user configuration read from CONFIG_DIR, with
+ * the overrides in CONFIG_OPTIONS (if not NULL) applied.  Allocate
+ * *CONFIG in POOL.
+ */
+static svn_error_t *
+load_config(apr_hash_t **config,
+            const char *config_dir,
+            apr_array_header_t *config_options,
+            apr_pool_t *pool)
+{
+  SVN_ERR(svn_config_ensure(config_dir, pool));
+  SVN_ERR(svn_config_get_config(config, config_dir, pool));
+
+  if (config_options)
+    SVN_ERR(svn_cmdline__apply_config_options(*config, config_options,
+                                              "svnrdump: ", "--config-option"));
+  return SVN_NO_ERROR;
+}
+
+/* Set *CTX to a new client context for opening RA sessions, using
+ * the user configuration CONFIG.  Pass USERNAME, PASSWORD, CONFIG_DIR
+ * and NO_AUTH_CACHE to initialize the authorization baton.  Allocate
+ * *CTX in POOL.
+ */
+static svn_error_t *
+create_client_context(svn_client_ctx_t **ctx,
+                      apr_hash_t *config,
+                      svn_boolean_t non_interactive,
+                      const char *username,
+                      const char *password,
+                      const char *config_dir,
+                      svn_boolean_t no_auth_cache,
+                      apr_pool_t *pool)
+{
+  svn_config_t *cfg_config;
+
+  SVN_ERR(svn_client_create_context(ctx, pool));
+  (*ctx)->config = config;
+
+  cfg_config = apr_hash_get(config, SVN_CONFIG_CATEGORY_CONFIG,
+                            APR_HASH_KEY_STRING);
+
+  /* Set up our cancellation support. */
+  (*ctx)->cancel_func = check_cancel;
+
+  /* Default authentication providers for non-interactive use */
+  SVN_ERR(svn_cmdline_create_auth_baton(&((*ctx)->auth_baton),
+                                        non_interactive, username, password,
+                                        config_dir, no_auth_cache, FALSE,
+                                        cfg_config, (*ctx)->cancel_func,
+                                        (*ctx)->cancel_baton, pool));
   return SVN_NO_ERROR;
 }
 
@@ -241,216 +795,2762 @@ open_connection(svn_ra_session_t **session,
                 apr_pool_t *pool)
 {
   svn_client_ctx_t *ctx = NULL;
-  svn_config_t *cfg_config;
+  apr_hash_t *config;
 
   SVN_ERR(svn_ra_initialize(pool));
 
-  SVN_ERR(svn_config_ensure(config_dir, pool));
-  SVN_ERR(svn_client_create_context(&ctx, pool));
+  SVN_ERR(load_config(&config, config_dir, config_options, pool));
+  SVN_ERR(create_client_context(&ctx, config, non_interactive, username,
+                                password, config_dir, no_auth_cache, pool));
+
+  SVN_ERR(svn_client_open_ra_session(session, url, ctx, pool));
+  return SVN_NO_ERROR;
+}
+
+/* Set *SESSION to a new RA session to OPT_BATON->url, allocated in
+ * POOL, next to the one the dump runs in: through OPT_BATON->ctx if
+ * set, else with the connection parameters of OPT_BATON.
+ */
+static svn_error_t *
+open_another_session(svn_ra_session_t **session,
+                     const opt_baton_t *opt_baton,
+                     apr_pool_t *pool)
+{
+  if (opt_baton->ctx)
+    return svn_client_open_ra_session(session, opt_baton->url,
+                                      opt_baton->ctx, pool);
+
+  return open_connection(session, opt_baton->url,
+                         opt_baton->non_interactive,
+                         opt_baton->username, opt_baton->password,
+                         opt_baton->config_dir, opt_baton->no_auth_cache,
+                         opt_baton->config_options, pool);
+}
+
+/* Baton for revprops_receiver(). */
+struct revprops_baton
+{
+  /* The revision properties of each revision from START_REVISION on,
+     or NULL if not in the log, allocated in POOL. */
+  apr_hash_t **props;
+  svn_revnum_t start_revision;
+  svn_revnum_t end_revision;
+  apr_pool_t *pool;
+};
+
+/* Implements svn_log_entry_receiver_t, keeping the revision
+ * properties of LOG_ENTRY in the revprops_baton BATON. */
+static svn_error_t *
+revprops_receiver(void *baton,
+                  svn_log_entry_t *log_entry,
+                  apr_pool_t *pool)
+{
+  struct revprops_baton *rb = baton;
+  apr_hash_t *props;
+  apr_hash_index_t *hi;
+
+  if (log_entry->revision < rb->start_revision
+      || log_entry->revision > rb->end_revision)
+    return SVN_NO_ERROR;
+
+  props = apr_hash_make(rb->pool);
+  if (log_entry->revprops)
+    for (hi = apr_hash_first(pool, log_entry->revprops); hi;
+         hi = apr_hash_next(hi))
+      {
+        const void *key;
+        void *val;
+
+        apr_hash_this(hi, &key, NULL, &val);
+        apr_hash_set(props, apr_pstrdup(rb->pool, key), APR_HASH_KEY_STRING,
+                     svn_string_dup(val, rb->pool));
+      }
+
+  rb->props[log_entry->revision - rb->start_revision] = props;
+  return SVN_NO_ERROR;
+}
+
+/* Write a revision record, without any nodes, for each revision from
+ * START_REVISION to END_REVISION of the repository SESSION is open
+ * to, to STREAM.  OPT_BATON tells whether to report progress and what
+ * to call after each revision.  The revision properties come from the
+ * log, a batch of revisions at a time; those of revisions missing
+ * from the log of the session URL, or all of them if the server can't
+ * send them with the log, are fetched one by one.  Use POOL for
+ * allocations.
+ */
+static svn_error_t *
+dump_revprops(opt_baton_t *opt_baton,
+              svn_ra_session_t *session,
+              svn_revnum_t start_revision,
+              svn_revnum_t end_revision,
+              svn_stream_t *stream,
+              apr_pool_t *pool)
+{
+  apr_array_header_t *paths = apr_array_make(pool, 1, sizeof(const char *));
+  struct revprops_baton rb;
+  apr_pool_t *batch_pool = svn_pool_create(pool);
+  apr_pool_t *iterpool = svn_pool_create(pool);
+  svn_boolean_t use_log = TRUE;
+  svn_revnum_t batch_start;
+
+  APR_ARRAY_PUSH(paths, const char *) = "";
+  for (batch_start = start_revision; batch_start <= end_revision;
+       batch_start += REVPROPS_BATCH_SIZE)
+    {
+      svn_revnum_t rev;
+
+      svn_pool_clear(batch_pool);
+      rb.start_revision = batch_start;
+      rb.end_revision = batch_start + REVPROPS_BATCH_SIZE - 1;
+      if (rb.end_revision > end_revision)
+        rb.end_revision = end_revision;
+      rb.props = apr_pcalloc(batch_pool,
+                             (rb.end_revision - batch_start + 1)
+                               * sizeof(*rb.props));
+      rb.pool = batch_pool;
+
+      if (use_log)
+        {
+          svn_error_t *err = svn_ra_get_log2(session, paths, batch_start,
+                                             rb.end_revision, 0, FALSE,
+                                             TRUE, FALSE, NULL,
+                                             revprops_receiver, &rb,
+                                             batch_pool);
+
+          if (err && err->apr_err == SVN_ERR_RA_NOT_IMPLEMENTED)
+            {
+              svn_error_clear(err);
+              use_log = FALSE;
+            }
+          else
+            SVN_ERR(err);
+        }
+
+      for (rev = batch_start; rev <= rb.end_revision; rev++)
+        {
+          apr_hash_t *props = rb.props[rev - batch_start];
+
+          svn_pool_clear(iterpool);
+          if (! props)
+            SVN_ERR(svn_ra_rev_proplist(session, rev, &props, iterpool));
+
+          SVN_ERR(normalize_props(props, iterpool));
+          SVN_ERR(write_revision_record(stream, rev, props,
+                                        opt_baton->revision_length ? 0 : -1,
+                                        iterpool));
+          if (! opt_baton->quiet)
+            SVN_ERR(svn_cmdline_fprintf(stderr, iterpool,
+                                        "* Dumped revision %lu.\n", rev));
+          if (opt_baton->boundary_func)
+            SVN_ERR(opt_baton->boundary_func(opt_baton->boundary_baton));
+          SVN_ERR(check_revision_boundary(NULL));
+        }
+    }
+
+  svn_pool_destroy(iterpool);
+  svn_pool_destroy(batch_pool);
+  return SVN_NO_ERROR;
+}
+
+/* Baton for map_base_revision() and add_base_copy_tree(). */
+struct base_snapshot_baton
+{
+  /* The revision dumped as a tree of adds. */
+  svn_revnum_t revision;
+
+  /* A session of its own for looking up copy sources, opened with the
+     parameters in OPT_BATON when first needed.  POOL is used for
+     nothing else. */
+  svn_ra_session_t *session;
+  const opt_baton_t *opt_baton;
+  apr_pool_t *pool;
+
+#if APR_HAS_THREADS
+  /* Serializes the lookups of parallel workers. */
+  apr_thread_mutex_t *mutex;
+#endif
+};
+
+/* Set *SAME to whether PATH@REVISION, the source of a copy, is the
+ * same node in the base revision of BB, so that the copy can be made
+ * from there instead.
+ */
+static svn_error_t *
+check_base_copy_source(svn_boolean_t *same,
+                       struct base_snapshot_baton *bb,
+                       const char *path,
+                       svn_revnum_t revision)
+{
+  const opt_baton_t *opt_baton = bb->opt_baton;
+  svn_dirent_t *dirent;
+  apr_pool_t *subpool;
+  svn_error_t *err;
+
+  if (! bb->session)
+    SVN_ERR(open_another_session(&bb->session, opt_baton, bb->pool));
+
+  subpool = svn_pool_create(bb->pool);
+  err = svn_ra_stat(bb->session, (*path == '/') ? path + 1 : path,
+                    bb->revision, &dirent, subpool);
+
+  /* The last change of a directory counts the changes below it. */
+  if (! err)
+    *same = dirent && dirent->created_rev <= revision;
+
+  svn_pool_destroy(subpool);
+  return err;
+}
+
+/* Map *REVISION, the revision PATH is copied from, to the base
+ * revision of BATON, a struct base_snapshot_baton, if it is older: the
+ * dump doesn't have it.  If PATH changed in between, set *REVISION to
+ * SVN_INVALID_REVNUM instead, for add_base_copy_tree().  Implements the
+ * map_revision_func of struct dump_options.
+ */
+static svn_error_t *
+map_base_revision(svn_revnum_t *revision,
+                  const char *path,
+                  void *baton)
+{
+  struct base_snapshot_baton *bb = baton;
+  svn_boolean_t same;
+  svn_error_t *err;
+
+  if (*revision >= bb->revision)
+    return SVN_NO_ERROR;
+
+#if APR_HAS_THREADS
+  apr_thread_mutex_lock(bb->mutex);
+#endif
+  err = check_base_copy_source(&same, bb, path, *revision);
+#if APR_HAS_THREADS
+  apr_thread_mutex_unlock(bb->mutex);
+#endif
+  SVN_ERR(err);
+
+  *revision = same ? bb->revision : SVN_INVALID_REVNUM;
+  return SVN_NO_ERROR;
+}
+
+/* Baton of the editor add_tree() drives the dump editor through. */
+struct add_tree_baton
+{
+  /* The dump editor, and the directory baton the tree is added below */
+  const svn_delta_editor_t *editor;
+  void *parent_baton;
+
+  /* The path the tree is added as, and the name of its source in the
+     update, or "" if the source is the anchor of the update itself */
+  const char *path;
+  const char *target;
+};
+
+/* A directory or file of the update driving an add_tree_baton. */
+struct add_tree_node
+{
+  struct add_tree_baton *tb;
+
+  /* The baton of the node in the dump editor, or NULL for the anchor
+     of the update if that is not added itself */
+  void *baton;
+};
+
+/* Return the path the node PATH of the update driving TB is added as,
+ * allocated in POOL. */
+static const char *
+add_tree_path(const struct add_tree_baton *tb,
+              const char *path,
+              apr_pool_t *pool)
+{
+  return svn_relpath_join(tb->path,
+                          svn_relpath_skip_ancestor(tb->target, path),
+                          pool);
+}
+
+/* Set *CHILD to a new node below the directory PARENT of the update,
+ * adding PATH to the dump editor with ADD, its add_directory or
+ * add_file.  Allocate in POOL. */
+static svn_error_t *
+add_tree_child(void **child,
+               struct add_tree_node *parent,
+               const char *path,
+               svn_error_t *(*add)(const char *path,
+                                   void *parent_baton,
+                                   const char *copyfrom_path,
+                                   svn_revnum_t copyfrom_rev,
+                                   apr_pool_t *pool,
+                                   void **baton),
+               apr_pool_t *pool)
+{
+  struct add_tree_node *node = apr_pcalloc(pool, sizeof(*node));
+
+  node->tb = parent->tb;
+  SVN_ERR(add(add_tree_path(node->tb, path, pool),
+              parent->baton ? parent->baton : node->tb->parent_baton,
+              NULL, SVN_INVALID_REVNUM, pool, &node->baton));
+  *child = node;
+  return SVN_NO_ERROR;
+}
+
+/* Implements svn_delta_editor_t.open_root for add_tree(). */
+static svn_error_t *
+add_tree_open_root(void *edit_baton,
+                   svn_revnum_t base_revision,
+                   apr_pool_t *pool,
+                   void **root_baton)
+{
+  struct add_tree_baton *tb = edit_baton;
+  struct add_tree_node *root = apr_pcalloc(pool, sizeof(*root));
+
+  root->tb = tb;
+  if (! *tb->target)
+    SVN_ERR(tb->editor->add_directory(tb->path, tb->parent_baton, NULL,
+                                      SVN_INVALID_REVNUM, pool,
+                                      &root->baton));
+  *root_baton = root;
+  return SVN_NO_ERROR;
+}
+
+/* Implements svn_delta_editor_t.add_directory for add_tree(). */
+static svn_error_t *
+add_tree_add_directory(const char *path,
+                       void *parent_baton,
+                       const char *copyfrom_path,
+                       svn_revnum_t copyfrom_rev,
+                       apr_pool_t *pool,
+                       void **child_baton)
+{
+  struct add_tree_node *parent = parent_baton;
+
+  return add_tree_child(child_baton, parent, path,
+                        parent->tb->editor->add_directory, pool);
+}
+
+/* Implements svn_delta_editor_t.change_dir_prop for add_tree(). */
+static svn_error_t *
+add_tree_change_dir_prop(void *dir_baton,
+                         const char *name,
+                         const svn_string_t *value,
+                         apr_pool_t *pool)
+{
+  struct add_tree_node *dir = dir_baton;
+
+  /* The update sends the entry properties, too. */
+  if (! dir->baton || svn_property_kind(NULL, name) != svn_prop_regular_kind)
+    return SVN_NO_ERROR;
+  return dir->tb->editor->change_dir_prop(dir->baton, name, value, pool);
+}
+
+/* Implements svn_delta_editor_t.close_directory for add_tree(). */
+static svn_error_t *
+add_tree_close_directory(void *dir_baton,
+                         apr_pool_t *pool)
+{
+  struct add_tree_node *dir = dir_baton;
+
+  if (! dir->baton)
+    return SVN_NO_ERROR;
+  return dir->tb->editor->close_directory(dir->baton, pool);
+}
+
+/* Implements svn_delta_editor_t.add_file for add_tree(). */
+static svn_error_t *
+add_tree_add_file(const char *path,
+                  void *parent_baton,
+                  const char *copyfrom_path,
+                  svn_revnum_t copyfrom_rev,
+                  apr_pool_t *pool,
+                  void **file_baton)
+{
+  struct add_tree_node *parent = parent_baton;
+
+  return add_tree_child(file_baton, parent, path,
+                        parent->tb->editor->add_file, pool);
+}
+
+/* Implements svn_delta_editor_t.change_file_prop for add_tree(). */
+static svn_error_t *
+add_tree_change_file_prop(void *file_baton,
+                          const char *name,
+                          const svn_string_t *value,
+                          apr_pool_t *pool)
+{
+  struct add_tree_node *file = file_baton;
+
+  if (svn_property_kind(NULL, name) != svn_prop_regular_kind)
+    return SVN_NO_ERROR;
+  return file->tb->editor->change_file_prop(file->baton, name, value, pool);
+}
+
+/* Implements svn_delta_editor_t.apply_textdelta for add_tree(). */
+static svn_error_t *
+add_tree_apply_textdelta(void *file_baton,
+                         const char *base_checksum,
+                         apr_pool_t *pool,
+                         svn_txdelta_window_handler_t *handler,
+                         void **handler_baton)
+{
+  struct add_tree_node *file = file_baton;
+
+  return file->tb->editor->apply_textdelta(file->baton, base_checksum, pool,
+                                           handler, handler_baton);
+}
+
+/* Implements svn_delta_editor_t.close_file for add_tree(). */
+static svn_error_t *
+add_tree_close_file(void *file_baton,
+                    const char *text_checksum,
+                    apr_pool_t *pool)
+{
+  struct add_tree_node *file = file_baton;
+
+  return file->tb->editor->close_file(file->baton, text_checksum, pool);
+}
+
+/* Implements svn_delta_editor_t.absent_directory and absent_file for
+ * add_tree(): a tree with holes can't be added. */
+static svn_error_t *
+add_tree_absent(const char *path,
+                void *parent_baton,
+                apr_pool_t *pool)
+{
+  return svn_error_createf(SVN_ERR_AUTHZ_UNREADABLE, NULL,
+                           _("Can't read '%s' to add it to the dump"),
+                           path);
+}
+
+/* Drive EDITOR to add PATH below PARENT_BATON as SOURCE@REVISION
+ * without history.  Fetch the tree as for a checkout, with a single
+ * update report through SESSION, opened to the repository root, rather
+ * than a request per node.  Use POOL for temporary allocations.
+ */
+static svn_error_t *
+add_tree(const svn_delta_editor_t *editor,
+         void *parent_baton,
+         const char *path,
+         svn_ra_session_t *session,
+         const char *source,
+         svn_revnum_t revision,
+         apr_pool_t *pool)
+{
+  svn_delta_editor_t *tree_editor = svn_delta_default_editor(pool);
+  struct add_tree_baton *tb = apr_pcalloc(pool, sizeof(*tb));
+  const svn_ra_reporter3_t *reporter;
+  void *report_baton;
+  const char *root_url;
+  svn_error_t *err;
+
+  tb->editor = editor;
+  tb->parent_baton = parent_baton;
+  tb->path = path;
+  tb->target = svn_relpath_basename(source, pool);
+
+  tree_editor->open_root = add_tree_open_root;
+  tree_editor->add_directory = add_tree_add_directory;
+  tree_editor->change_dir_prop = add_tree_change_dir_prop;
+  tree_editor->close_directory = add_tree_close_directory;
+  tree_editor->absent_directory = add_tree_absent;
+  tree_editor->add_file = add_tree_add_file;
+  tree_editor->change_file_prop = add_tree_change_file_prop;
+  tree_editor->apply_textdelta = add_tree_apply_textdelta;
+  tree_editor->close_file = add_tree_close_file;
+  tree_editor->absent_file = add_tree_absent;
+
+  /* The target of an update is a single name, so the update is anchored
+     at the parent of the source.  Reporting the anchor empty makes the
+     target come as an add. */
+  SVN_ERR(svn_ra_get_repos_root2(session, &root_url, pool));
+  SVN_ERR(svn_ra_reparent(session,
+                          svn_path_url_add_component2(
+                            root_url, svn_relpath_dirname(source, pool),
+                            pool),
+                          pool));
+  err = svn_ra_do_update2(session, &reporter, &report_baton, revision,
+                          tb->target, svn_depth_infinity, FALSE,
+                          tree_editor, tb, pool);
+  if (! err)
+    err = reporter->set_path(report_baton, "", revision,
+                             svn_depth_infinity, TRUE, NULL, pool);
+  if (! err)
+    err = reporter->finish_report(report_baton, pool);
+
+  return svn_error_compose_create(err,
+                                  svn_ra_reparent(session, root_url, pool));
+}
+
+/* Drive EDITOR to add PATH below PARENT_BATON as a copy of
+ * COPYFROM_PATH@COPYFROM_REV without history, for a copy source that
+ * changed before the base revision of BATON, a struct
+ * base_snapshot_baton.  Implements the add_tree_func of struct
+ * dump_options.
+ */
+static svn_error_t *
+add_base_copy_tree(const svn_delta_editor_t *editor,
+                   void *parent_baton,
+                   const char *path,
+                   const char *copyfrom_path,
+                   svn_revnum_t copyfrom_rev,
+                   void *baton,
+                   apr_pool_t *pool)
+{
+  struct base_snapshot_baton *bb = baton;
+  svn_error_t *err;
+
+  if (*copyfrom_path == '/')
+    copyfrom_path++;
+
+  /* map_base_revision() opened the session.  The whole tree comes in
+     one report, so the lock is taken once per copy. */
+#if APR_HAS_THREADS
+  apr_thread_mutex_lock(bb->mutex);
+#endif
+  err = add_tree(editor, parent_baton, path, bb->session, copyfrom_path,
+                 copyfrom_rev, pool);
+#if APR_HAS_THREADS
+  apr_thread_mutex_unlock(bb->mutex);
+#endif
+  return err;
+}
+
+/* Write REVISION to STREAM as a revision record followed by an add
+ * record for every node in it, using SESSION and a dump editor with
+ * DUMP_OPTIONS.  The tree is fetched as for a checkout, with a single
+ * update report rather than a request per file.  SESSION must be
+ * opened to the repository root.  If NODES_LENGTH is set, collect the
+ * add records in a buffer first and give their length in the revision
+ * record.  Use POOL for allocations.
+ */
+static svn_error_t *
+dump_base_snapshot(svn_ra_session_t *session,
+                   svn_revnum_t revision,
+                   const struct dump_options *dump_options,
+                   svn_boolean_t nodes_length,
+                   svn_stream_t *stream,
+                   apr_pool_t *pool)
+{
+  const svn_delta_editor_t *editor;
+  void *edit_baton;
+  const svn_ra_reporter3_t *reporter;
+  void *report_baton;
+  apr_hash_t *rev_props;
+  const char *session_url, *root_url;
+  struct dump_options editor_options = *dump_options;
+  struct spillbuf *buf = NULL;
+  svn_stream_t *editor_stream = stream;
+
+  /* Below the root, the tree would lack the directories above it. */
+  SVN_ERR(svn_ra_get_session_url(session, &session_url, pool));
+  SVN_ERR(svn_ra_get_repos_root2(session, &root_url, pool));
+  if (strcmp(session_url, root_url) != 0)
+    return svn_error_createf(SVN_ERR_RA_ILLEGAL_URL, NULL,
+                             _("--base-snapshot requires the repository "
+                               "root URL '%s'"),
+                             root_url);
+
+  SVN_ERR(svn_ra_rev_proplist(session, revision, &rev_props, pool));
+  SVN_ERR(normalize_props(rev_props, pool));
+  if (nodes_length)
+    {
+      SVN_ERR(spillbuf_create(&buf, REVISION_SPILL_THRESHOLD, pool));
+      editor_stream = spillbuf_stream(buf, pool);
+
+      /* Spooled deltas must go to the buffer too, not past it. */
+      editor_options.get_output_file = NULL;
+    }
+  else
+    SVN_ERR(write_revision_record(stream, revision, rev_props, -1, pool));
+
+  SVN_ERR(get_dump_editor(&editor, &edit_baton, editor_stream,
+                          &editor_options, check_cancel, NULL, pool));
+
+  /* Report an empty working copy, so that everything is added, and
+     without copy sources. */
+  SVN_ERR(svn_ra_do_update2(session, &reporter, &report_baton, revision,
+                            "", svn_depth_infinity, FALSE, editor,
+                            edit_baton, pool));
+  SVN_ERR(reporter->set_path(report_baton, "", revision, svn_depth_infinity,
+                             TRUE, NULL, pool));
+  SVN_ERR(reporter->finish_report(report_baton, pool));
+
+  if (! buf)
+    return SVN_NO_ERROR;
+  SVN_ERR(write_revision_record(stream, revision, rev_props,
+                                spillbuf_size(buf), pool));
+  return write_buffer(buf, dump_options, stream, pool);
+}
+
+/* Baton for fetch_text() and fetch_props(). */
+struct fetch_text_baton
+{
+  /* A session of its own, opened to the repository root with the
+     parameters in OPT_BATON when first needed, in POOL. */
+  svn_ra_session_t *session;
+  const opt_baton_t *opt_baton;
+  apr_pool_t *pool;
+};
+
+/* Open the session of FB, unless that was done already.  Use POOL for
+ * temporary allocations.
+ */
+static svn_error_t *
+open_fetch_session(struct fetch_text_baton *fb,
+                   apr_pool_t *pool)
+{
+  const opt_baton_t *opt_baton = fb->opt_baton;
+  const char *root_url;
+
+  if (fb->session)
+    return SVN_NO_ERROR;
+
+  SVN_ERR(open_another_session(&fb->session, opt_baton, fb->pool));
+  SVN_ERR(svn_ra_get_repos_root2(fb->session, &root_url, pool));
+  return svn_ra_reparent(fb->session, root_url, pool);
+}
+
+/* Write the text of the file PATH@REVISION to STREAM, for the fulltext
+ * cache of the dump editor.  Implements the fetch_text_func of struct
+ * dump_options.
+ */
+static svn_error_t *
+fetch_text(svn_stream_t *stream,
+           const char *path,
+           svn_revnum_t revision,
+           void *baton,
+           apr_pool_t *pool)
+{
+  struct fetch_text_baton *fb = baton;
+
+  SVN_ERR(open_fetch_session(fb, pool));
+  return svn_ra_get_file(fb->session, (*path == '/') ? path + 1 : path,
+                         revision, stream, NULL, NULL, pool);
+}
+
+/* Set *PROPS to the properties of the node PATH@REVISION of KIND, for
+ * the full property lists of a --fulltext dump.  Implements the
+ * fetch_props_func of struct dump_options.
+ */
+static svn_error_t *
+fetch_props(apr_hash_t **props,
+            const char *path,
+            svn_node_kind_t kind,
+            svn_revnum_t revision,
+            void *baton,
+            apr_pool_t *pool)
+{
+  struct fetch_text_baton *fb = baton;
+
+  SVN_ERR(open_fetch_session(fb, pool));
+  if (*path == '/')
+    path++;
+
+  if (kind == svn_node_dir)
+    return svn_ra_get_dir2(fb->session, NULL, NULL, props, path, revision,
+                           0, pool);
+  return svn_ra_get_file(fb->session, path, revision, NULL, NULL, props,
+                         pool);
+}
+
+/* Return TRUE if ERR, or an error it wraps, looks like a dropped or
+ * timed out connection, after which a new session may well succeed.
+ * Only errors of the RA layer may be passed here: a broken pipe on the
+ * output looks the same.
+ */
+static svn_boolean_t
+is_retryable_error(const svn_error_t *err)
+{
+  for (; err; err = err->child)
+    {
+      if (err->apr_err == SVN_ERR_CANCELLED)
+        return FALSE;
+      if (err->apr_err == SVN_ERR_RA_SVN_CONNECTION_CLOSED
+          || err->apr_err == SVN_ERR_RA_SVN_IO_ERROR
+          || err->apr_err == SVN_ERR_RA_DAV_REQUEST_FAILED
+          || APR_STATUS_IS_ECONNRESET(err->apr_err)
+          || APR_STATUS_IS_ECONNABORTED(err->apr_err)
+          || APR_STATUS_IS_ETIMEDOUT(err->apr_err)
+          || APR_STATUS_IS_EPIPE(err->apr_err))
+        return TRUE;
+    }
+  return FALSE;
+}
+
+/* Wait for INTERVAL before looking for new revisions to follow.
+ * Return TRUE if a signal asked to stop following meanwhile.
+ */
+static svn_boolean_t
+wait_for_revisions(apr_interval_time_t interval)
+{
+  apr_time_t until = apr_time_now() + interval;
+
+  while (! stop_requested && ! cancelled)
+    {
+      apr_time_t now = apr_time_now();
+
+      if (now >= until)
+        break;
+      apr_sleep((until - now < FOLLOW_NAP) ? until - now : FOLLOW_NAP);
+    }
+
+  return stop_requested || cancelled;
+}
+
+/* Return TRUE, and clear ERR, if ERR is the stop at a revision
+ * boundary that a signal requests, which ends a dump following new
+ * revisions (as told by OPT_BATON) without an error.
+ */
+static svn_boolean_t
+is_follow_stop(const opt_baton_t *opt_baton,
+               svn_error_t *err)
+{
+  if (opt_baton->follow && err && err->apr_err == SVN_ERR_CANCELLED
+      && stop_requested)
+    {
+      svn_error_clear(err);
+      return TRUE;
+    }
+  return FALSE;
+}
+
+#if APR_HAS_THREADS
+/* A contiguous slice of the revision range dumped by one worker of a
+ * parallel dump. */
+struct dump_chunk
+{
+  svn_revnum_t start_revision;
+  svn_revnum_t end_revision;
+
+  /* The dumpstream for the revisions in this chunk, the offset in it
+     at which each revision ends (svn_filesize_t), and the pool they
+     live in; all created by the worker that claims the chunk. */
+  struct spillbuf *output;
+  apr_array_header_t *revision_ends;
+  apr_pool_t *pool;
+
+  /* Set once the worker is done with this chunk, successfully or
+     not (in which case ERR is set). */
+  svn_boolean_t done;
+  svn_error_t *err;
+};
+
+/* Shared state of a parallel dump. */
+struct parallel_dump_baton
+{
+  /* Protects everything below; COND is signalled whenever a chunk is
+     completed or written out. */
+  apr_thread_mutex_t *mutex;
+  apr_thread_cond_t *cond;
+
+  struct dump_chunk *chunks;
+  int nchunks;
+
+  /* Index of the next chunk to be claimed by a worker, and of the
+     next chunk to be written to the output. */
+  int next_claim;
+  int next_write;
+
+  /* How many chunks may be claimed ahead of NEXT_WRITE.  This bounds
+     the amount of output buffered while waiting for a slow chunk. */
+  int window;
+
+  /* Whether the replays should send text and property deltas. */
+  svn_boolean_t send_deltas;
+
+  /* Set when the dump has failed and workers should stop.  Only set
+     under the mutex, but check_worker_cancel() reads it without; hence
+     the atomic accesses. */
+  svn_boolean_t failed;
+};
+
+/* One worker of a parallel dump. */
+struct dump_worker
+{
+  struct parallel_dump_baton *pb;
+
+  /* The worker's own session, dump editor and replay baton. */
+  svn_ra_session_t *session;
+  struct replay_baton *replay_baton;
+
+  /* The chunk currently being dumped, the target of STREAM. */
+  struct dump_chunk *chunk;
+
+  /* Private counters, summed up when the dump is done. */
+  struct dump_stats stats;
+
+  apr_pool_t *pool;
+};
+
+/* Chunks buffer this many bytes of dumpstream in memory before
+   spilling to disk. */
+#define CHUNK_SPILL_THRESHOLD (16 * 1024 * 1024)
+
+/* A chunk holds at most this many revisions, so that the chunks
+   claimed ahead of the one being written hold a bounded part of the
+   dump, however long the range. */
+#define MAX_CHUNK_REVISIONS 100
+
+/* Implements svn_write_fn_t, writing to the output of the current
+ * chunk of the dump_worker BATON. */
+static svn_error_t *
+worker_write(void *baton,
+             const char *data,
+             apr_size_t *len)
+{
+  struct dump_worker *worker = baton;
+
+  return spillbuf_write(worker->chunk->output, data, *len);
+}
+
+/* Note the end of a revision in the output of the current chunk of
+ * the dump_worker BATON.  Called by replay_revend(). */
+static svn_error_t *
+worker_revision_boundary(void *baton)
+{
+  struct dump_worker *worker = baton;
+
+  APR_ARRAY_PUSH(worker->chunk->revision_ends, svn_filesize_t) =
+    spillbuf_size(worker->chunk->output);
+  return SVN_NO_ERROR;
+}
+
+/* Cancellation callback for workers; BATON is the parallel dump baton. */
+static svn_error_t *
+check_worker_cancel(void *baton)
+{
+  struct parallel_dump_baton *pb = baton;
+
+  if (__atomic_load_n(&pb->failed, __ATOMIC_SEQ_CST))
+    return svn_error_create(SVN_ERR_CANCELLED, NULL,
+                            _("Another dump worker failed"));
+  return check_cancel(NULL);
+}
+
+/* Dump CHUNK on behalf of WORKER. */
+static svn_error_t *
+dump_chunk(struct dump_worker *worker,
+           struct dump_chunk *chunk)
+{
+  chunk->pool = svn_pool_create(NULL);
+  SVN_ERR(spillbuf_create(&chunk->output, CHUNK_SPILL_THRESHOLD,
+                          chunk->pool));
+  chunk->revision_ends = apr_array_make(chunk->pool,
+                                        (int)(chunk->end_revision
+                                              - chunk->start_revision + 1),
+                                        sizeof(svn_filesize_t));
+  worker->chunk = chunk;
+
+  return svn_ra_replay_range(worker->session, chunk->start_revision,
+                             chunk->end_revision, 0, worker->pb->send_deltas,
+                             replay_revstart, replay_revend,
+                             worker->replay_baton, chunk->pool);
+}
+
+/* Thread body of a parallel dump worker.  DATA is a struct dump_worker.
+ * Claim chunks in order and dump them until there are none left or
+ * the dump has failed. */
+static void * APR_THREAD_FUNC
+worker_thread(apr_thread_t *tid,
+              void *data)
+{
+  struct dump_worker *worker = data;
+  struct parallel_dump_baton *pb = worker->pb;
+
+  while (1)
+    {
+      struct dump_chunk *chunk;
+      svn_error_t *err;
+
+      apr_thread_mutex_lock(pb->mutex);
+      while (! pb->failed && pb->next_claim < pb->nchunks
+             && pb->next_claim - pb->next_write >= pb->window)
+        apr_thread_cond_wait(pb->cond, pb->mutex);
+      if (pb->failed || pb->next_claim == pb->nchunks)
+        {
+          apr_thread_mutex_unlock(pb->mutex);
+          break;
+        }
+      chunk = &pb->chunks[pb->next_claim++];
+      apr_thread_mutex_unlock(pb->mutex);
+
+      err = dump_chunk(worker, chunk);
+
+      apr_thread_mutex_lock(pb->mutex);
+      chunk->err = err;
+      chunk->done = TRUE;
+      if (err)
+        __atomic_store_n(&pb->failed, TRUE, __ATOMIC_SEQ_CST);
+      apr_thread_cond_broadcast(pb->cond);
+      apr_thread_mutex_unlock(pb->mutex);
+    }
+
+  apr_thread_exit(tid, APR_SUCCESS);
+  return NULL;
+}
+
+/* Open the session of WORKER and set up its dump editor, with options
+ * from OPT_BATON and DUMP_OPTIONS.  Allocate in WORKER->pool.
+ */
+static svn_error_t *
+setup_worker(struct dump_worker *worker,
+             const opt_baton_t *opt_baton,
+             const struct dump_options *dump_options)
+{
+  struct dump_options worker_options = *dump_options;
+  struct replay_baton *rb;
+  svn_stream_t *worker_stream;
+
+  SVN_ERR(open_another_session(&worker->session, opt_baton,
+                               worker->pool));
+
+  worker_stream = svn_stream_create(worker, worker->pool);
+  svn_stream_set_write(worker_stream, worker_write);
+
+  rb = apr_pcalloc(worker->pool, sizeof(*rb));
+  rb->stream = worker_stream;
+  rb->quiet = TRUE;
+  rb->boundary_func = worker_revision_boundary;
+  rb->boundary_baton = worker;
+  rb->defer_stop = TRUE;
+
+  /* Hold each revision back until its length is known. */
+  if (opt_baton->revision_length)
+    {
+      SVN_ERR(spillbuf_create(&rb->revision_buffer,
+                              REVISION_SPILL_THRESHOLD, worker->pool));
+      rb->stream = spillbuf_stream(rb->revision_buffer, worker->pool);
+      rb->output = worker_stream;
+      rb->nodes_length = TRUE;
+    }
+  worker->replay_baton = rb;
+
+  if (dump_options->stats)
+    worker_options.stats = &worker->stats;
+  worker_options.get_output_file = NULL;
+  return get_dump_editor(&rb->editor, &rb->edit_baton, rb->stream,
+                         &worker_options, check_worker_cancel, worker->pb,
+                         worker->pool);
+}
+
+/* Write the revisions of CHUNK, the next in line, to STREAM one at a
+ * time, treating each as the dump of a serial replay would: call
+ * OPT_BATON->boundary_func after it, report it and honour a stop
+ * request.  Use DUMP_OPTIONS to find the output file and POOL for
+ * temporary allocations.
+ */
+static svn_error_t *
+write_chunk(struct dump_chunk *chunk,
+            const opt_baton_t *opt_baton,
+            const struct dump_options *dump_options,
+            svn_stream_t *stream,
+            apr_pool_t *pool)
+{
+  apr_pool_t *iterpool = svn_pool_create(pool);
+  svn_filesize_t offset = 0;
+  int i;
+
+  for (i = 0; i < chunk->revision_ends->nelts; i++)
+    {
+      svn_filesize_t end = APR_ARRAY_IDX(chunk->revision_ends, i,
+                                         svn_filesize_t);
+
+      svn_pool_clear(iterpool);
+      SVN_ERR(write_buffer_range(chunk->output, offset, end - offset,
+                                 dump_options, stream, iterpool));
+      offset = end;
+
+      if (! opt_baton->quiet)
+        svn_cmdline_fprintf(stderr, iterpool, "* Dumped revision %lu.\n",
+                            chunk->start_revision + i);
+      if (opt_baton->boundary_func)
+        SVN_ERR(opt_baton->boundary_func(opt_baton->boundary_baton));
+      SVN_ERR(check_revision_boundary(NULL));
+    }
+
+  svn_pool_destroy(iterpool);
+  return SVN_NO_ERROR;
+}
+
+/* Replay revisions START_REVISION thru END_REVISION (inclusive) using
+ * OPT_BATON->jobs concurrent workers, each with its own RA session
+ * and dump editor, and write the resulting dumpstream to STREAM in
+ * revision order.  The output is identical to that of a serial
+ * replay, and so are the calls of OPT_BATON->boundary_func and the
+ * revision boundaries a signal stops the dump at.  Options and
+ * counters for the dump editors are taken from DUMP_OPTIONS.  Use POOL
+ * for allocations.
+ */
+static svn_error_t *
+replay_range_parallel(opt_baton_t *opt_baton,
+                      svn_revnum_t start_revision,
+                      svn_revnum_t end_revision,
+                      const struct dump_options *dump_options,
+                      svn_stream_t *stream,
+                      apr_pool_t *pool)
+{
+  struct parallel_dump_baton *pb = apr_pcalloc(pool, sizeof(*pb));
+  struct dump_worker *workers;
+  apr_thread_t **threads;
+  svn_revnum_t nrevs = end_revision - start_revision + 1;
+  svn_revnum_t rev;
+  svn_error_t *err = SVN_NO_ERROR;
+  apr_pool_t *iterpool;
+  apr_status_t status;
+  int nworkers = opt_baton->jobs;
+  int i;
+
+  /* Cut the range into several chunks per worker, so that the
+     workers stay busy while the writer waits for the oldest chunk, and
+     into more for a long range. */
+  pb->nchunks = (nrevs < nworkers * 8) ? (int)nrevs : nworkers * 8;
+  if (nrevs / MAX_CHUNK_REVISIONS >= pb->nchunks)
+    pb->nchunks = (int)((nrevs + MAX_CHUNK_REVISIONS - 1)
+                        / MAX_CHUNK_REVISIONS);
+  if (nworkers > pb->nchunks)
+    nworkers = pb->nchunks;
+  pb->window = nworkers * 2;
+  pb->send_deltas = ! opt_baton->no_content;
+  pb->chunks = apr_pcalloc(pool, pb->nchunks * sizeof(*pb->chunks));
+  for (i = 0, rev = start_revision; i < pb->nchunks; i++)
+    {
+      svn_revnum_t len = nrevs / pb->nchunks + (i < nrevs % pb->nchunks);
+
+      pb->chunks[i].start_revision = rev;
+      pb->chunks[i].end_revision = rev + len - 1;
+      rev += len;
+    }
+
+  status = apr_thread_mutex_create(&pb->mutex, APR_THREAD_MUTEX_DEFAULT,
+                                   pool);
+  if (! status)
+    status = apr_thread_cond_create(&pb->cond, pool);
+  if (status)
+    return svn_error_wrap_apr(status, _("Can't create thread lock"));
+
+  /* Open all the sessions up front, so that any authentication
+     prompts happen here rather than in the workers. */
+  workers = apr_pcalloc(pool, nworkers * sizeof(*workers));
+  threads = apr_pcalloc(pool, nworkers * sizeof(*threads));
+  for (i = 0; i < nworkers && ! err; i++)
+    {
+      struct dump_worker *worker = &workers[i];
+
+      worker->pb = pb;
+      worker->pool = svn_pool_create(NULL);
+      err = setup_worker(worker, opt_baton, dump_options);
+    }
+
+  for (i = 0; i < nworkers && ! err; i++)
+    {
+      status = apr_thread_create(&threads[i], NULL, worker_thread,
+                                 &workers[i], pool);
+      if (status)
+        {
+          err = svn_error_wrap_apr(status, _("Can't create dump thread"));
+          apr_thread_mutex_lock(pb->mutex);
+          __atomic_store_n(&pb->failed, TRUE, __ATOMIC_SEQ_CST);
+          apr_thread_cond_broadcast(pb->cond);
+          apr_thread_mutex_unlock(pb->mutex);
+          break;
+        }
+    }
+
+  /* Stitch the chunks together in order as they complete. */
+  iterpool = svn_pool_create(pool);
+  while (! err && pb->next_write < pb->nchunks)
+    {
+      struct dump_chunk *chunk = &pb->chunks[pb->next_write];
+
+      svn_pool_clear(iterpool);
+
+      apr_thread_mutex_lock(pb->mutex);
+      while (! chunk->done && ! pb->failed)
+        apr_thread_cond_wait(pb->cond, pb->mutex);
+      apr_thread_mutex_unlock(pb->mutex);
+
+      if (! chunk->done)
+        break;
+      if (chunk->err)
+        {
+          err = chunk->err;
+          chunk->err = SVN_NO_ERROR;
+          break;
+        }
+
+      err = write_chunk(chunk, opt_baton, dump_options, stream, iterpool);
+      svn_pool_destroy(chunk->pool);
+      chunk->pool = NULL;
+
+      apr_thread_mutex_lock(pb->mutex);
+      if (err)
+        __atomic_store_n(&pb->failed, TRUE, __ATOMIC_SEQ_CST);
+      else
+        pb->next_write++;
+      apr_thread_cond_broadcast(pb->cond);
+      apr_thread_mutex_unlock(pb->mutex);
+    }
+  svn_pool_destroy(iterpool);
+
+  for (i = 0; i < nworkers; i++)
+    if (threads[i])
+      {
+        apr_status_t retval;
+        apr_thread_join(&retval, threads[i]);
+      }
+
+  /* A worker failing first makes us stop without an error of our own;
+     report the first failure in chunk order then, ignoring the other
+     workers that were merely cancelled because of it. */
+  for (i = 0; i < pb->nchunks; i++)
+    {
+      svn_error_t *chunk_err = pb->chunks[i].err;
+
+      if (chunk_err)
+        {
+          if (! err || (err->apr_err == SVN_ERR_CANCELLED
+                        && chunk_err->apr_err != SVN_ERR_CANCELLED))
+            {
+              svn_error_clear(err);
+              err = chunk_err;
+            }
+          else
+            svn_error_clear(chunk_err);
+        }
+      if (pb->chunks[i].pool)
+        svn_pool_destroy(pb->chunks[i].pool);
+    }
+
+  for (i = 0; i < nworkers; i++)
+    {
+      if (dump_options->stats)
+        {
+          dump_options->stats->text_deltas += workers[i].stats.text_deltas;
+          dump_options->stats->delta_spills += workers[i].stats.delta_spills;
+          dump_options->stats->delta_spill_bytes +=
+            workers[i].stats.delta_spill_bytes;
+        }
+      if (workers[i].pool)
+        svn_pool_destroy(workers[i].pool);
+    }
+
+  return err;
+}
+#endif
+
+/* Replay revisions OPT_BATON->start_revision thru
+ * OPT_BATON->end_revision (inclusive) of the repository located at
+ * OPT_BATON->url, to which OPT_BATON->session is open, using callbacks
+ * which generate Subversion repository dumpstreams describing the
+ * changes made in those revisions.  If OPT_BATON->quiet is set, don't
+ * generate progress messages.  If OPT_BATON->jobs is greater than one,
+ * split the range among that many concurrent sessions.  DUMP_OPTIONS
+ * are passed on to the dump editor.  OPT_BATON->boundary_func is
+ * called after each revision is written.  Write the dumpstream to
+ * OUTPUT_STREAM, which is left open, or to the outputs of
+ * OPT_BATON->split if that is set.
+ *
+ * Unless splitting or dumping in parallel, collect each revision in a
+ * buffer and only write it out once it is complete.  If the replay
+ * then fails with a connection error, open a new session and dump the
+ * failed revision again, waiting a little longer before each attempt,
+ * up to OPT_BATON->retries times.
+ *
+ * If OPT_BATON->revision_length is set, collect each revision in a
+ * buffer even when not retrying, and only write its revision record
+ * once the length of its node records is known.
+ *
+ * If OPT_BATON->revprops_only is set, only write revision records.
+ *
+ * If OPT_BATON->base_snapshot is set, dump START_REVISION as a tree of
+ * adds, and make later copies from older revisions copy from it.
+ *
+ * If OPT_BATON->follow is set, keep the session and the dump editor
+ * once END_REVISION is done, look for new revisions every
+ * OPT_BATON->poll_interval and dump them too, until a signal stops
+ * the dump at a revision boundary.
+ */
+static svn_error_t *
+replay_revisions(opt_baton_t *opt_baton,
+                 const struct dump_options *dump_options,
+                 svn_stream_t *output_stream,
+                 apr_pool_t *pool)
+{
+  svn_ra_session_t *session = opt_baton->session;
+  svn_revnum_t start_revision = opt_baton->start_revision;
+  svn_revnum_t end_revision = opt_baton->end_revision;
+  svn_boolean_t quiet = opt_baton->quiet;
+  const svn_delta_editor_t *dump_editor;
+  struct replay_baton *replay_baton;
+  struct dump_options editor_options = *dump_options;
+  void *dump_baton;
+  const char *uuid;
+  apr_pool_t *session_pool = NULL;
+  apr_pool_t *editor_pool;
+  apr_pool_t *iterpool;
+  apr_interval_time_t delay = RETRY_INITIAL_DELAY;
+  int attempt = 0;
+
+  /* Write the magic header and UUID, unless we're appending to a
+     dumpfile which has them already. */
+  if (opt_baton->split)
+    {
+      SVN_ERR(svn_ra_get_uuid2(session, &uuid, pool));
+      SVN_ERR(split_dump_write_header(opt_baton->split, uuid, pool));
+    }
+  else if (opt_baton->no_content)
+    {
+      SVN_ERR(svn_stream_printf(output_stream, pool,
+                                DUMP_SKELETON_MAGIC_HEADER ": %d\n\n",
+                                DUMP_SKELETON_VERSION));
+      SVN_ERR(svn_ra_get_uuid2(session, &uuid, pool));
+      SVN_ERR(svn_stream_printf(output_stream, pool,
+                                SVN_REPOS_DUMPFILE_UUID ": %s\n\n", uuid));
+    }
+  else if (! opt_baton->append)
+    {
+      SVN_ERR(svn_stream_printf(output_stream, pool,
+                                SVN_REPOS_DUMPFILE_MAGIC_HEADER ": %d\n\n",
+                                SVN_REPOS_DUMPFILE_FORMAT_VERSION));
+      SVN_ERR(svn_ra_get_uuid2(session, &uuid, pool));
+      SVN_ERR(svn_stream_printf(output_stream, pool,
+                                SVN_REPOS_DUMPFILE_UUID ": %s\n\n", uuid));
+    }
+
+  /* Fake revision 0 if necessary */
+  if (start_revision == 0)
+    {
+      apr_hash_t *prophash;
+
+      SVN_ERR(svn_ra_rev_proplist(session, start_revision,
+                                  &prophash, pool));
+      if (opt_baton->split)
+        SVN_ERR(split_dump_start_revision(opt_baton->split, start_revision,
+                                          prophash, pool));
+      else
+        SVN_ERR(write_revision_record(output_stream, start_revision,
+                                      prophash,
+                                      opt_baton->revision_length ? 0 : -1,
+                                      pool));
+      if (! quiet)
+        svn_cmdline_fprintf(stderr, pool, "* Dumped revision %lu.\n",
+                            start_revision);
+      if (opt_baton->boundary_func)
+        SVN_ERR(opt_baton->boundary_func(opt_baton->boundary_baton));
+
+      start_revision++;
+    }
+  else if (opt_baton->base_snapshot && start_revision <= end_revision)
+    {
+      struct base_snapshot_baton *bb = apr_pcalloc(pool, sizeof(*bb));
+
+      if (opt_baton->fulltext_cache)
+        SVN_ERR(fulltext_cache_start_revision(opt_baton->fulltext_cache,
+                                              start_revision, pool));
+      SVN_ERR(dump_base_snapshot(session, start_revision, dump_options,
+                                 opt_baton->revision_length, output_stream,
+                                 pool));
+      if (! quiet)
+        svn_cmdline_fprintf(stderr, pool, "* Dumped revision %lu.\n",
+                            start_revision);
+      if (opt_baton->boundary_func)
+        SVN_ERR(opt_baton->boundary_func(opt_baton->boundary_baton));
+      SVN_ERR(check_revision_boundary(NULL));
+
+      bb->revision = start_revision;
+      bb->opt_baton = opt_baton;
+      bb->pool = svn_pool_create(pool);
+#if APR_HAS_THREADS
+      {
+        apr_status_t status = apr_thread_mutex_create(&bb->mutex,
+                                                      APR_THREAD_MUTEX_DEFAULT,
+                                                      pool);
+        if (status)
+          return svn_error_wrap_apr(status, _("Can't create thread lock"));
+      }
+#endif
+      editor_options.map_revision_func = map_base_revision;
+      editor_options.add_tree_func = add_base_copy_tree;
+      editor_options.revision_baton = bb;
+
+      start_revision++;
+    }
+
+  if (start_revision > end_revision && ! opt_baton->follow)
+    return SVN_NO_ERROR;
+
+  if (opt_baton->revprops_only)
+    return dump_revprops(opt_baton, session, start_revision, end_revision,
+                         output_stream, pool);
+
+#if APR_HAS_THREADS
+  if (opt_baton->jobs > 1 && end_revision > start_revision)
+    {
+      svn_error_t *err = replay_range_parallel(opt_baton, start_revision,
+                                               end_revision, &editor_options,
+                                               output_stream, pool);
+
+      /* Follow new revisions one at a time. */
+      if (! opt_baton->follow)
+        return err;
+      if (is_follow_stop(opt_baton, err))
+        return SVN_NO_ERROR;
+      SVN_ERR(err);
+      start_revision = end_revision + 1;
+    }
+#endif
+
+  replay_baton = apr_pcalloc(pool, sizeof(*replay_baton));
+  replay_baton->stream = output_stream;
+  replay_baton->split = opt_baton->split;
+  replay_baton->quiet = quiet;
+  replay_baton->boundary_func = opt_baton->boundary_func;
+  replay_baton->boundary_baton = opt_baton->boundary_baton;
+  replay_baton->fulltext_cache = opt_baton->fulltext_cache;
+
+  if ((opt_baton->retries > 0 || opt_baton->revision_length)
+      && ! opt_baton->split)
+    {
+      SVN_ERR(spillbuf_create(&replay_baton->revision_buffer,
+                              REVISION_SPILL_THRESHOLD, pool));
+      replay_baton->stream = spillbuf_stream(replay_baton->revision_buffer,
+                                             pool);
+      replay_baton->output = output_stream;
+      replay_baton->output_options = dump_options;
+      replay_baton->nodes_length = opt_baton->revision_length;
+
+      /* Spooled deltas must go to the buffer too, not past it. */
+      editor_options.get_output_file = NULL;
+    }
+
+  editor_pool = svn_pool_create(pool);
+  iterpool = svn_pool_create(pool);
+  replay_baton->next_revision = start_revision;
+  while (1)
+    {
+      svn_error_t *err = SVN_NO_ERROR;
+
+      svn_pool_clear(iterpool);
+      if (! session)
+        {
+          session_pool = svn_pool_create(pool);
+          err = open_another_session(&session, opt_baton, session_pool);
+        }
+
+      /* The editor lives on from one replay to the next.  A failure
+         may leave it halfway through a revision, though; start over
+         with a new one then. */
+      if (! err && ! replay_baton->editor)
+        {
+          if (opt_baton->split)
+            err = split_dump_get_editor(&dump_editor, &dump_baton,
+                                        opt_baton->split, check_cancel, NULL,
+                                        editor_pool);
+          else
+            err = get_dump_editor(&dump_editor, &dump_baton,
+                                  replay_baton->stream, &editor_options,
+                                  check_cancel, NULL, editor_pool);
+          if (! err)
+            {
+              replay_baton->editor = dump_editor;
+              replay_baton->edit_baton = dump_baton;
+            }
+        }
+
+      if (! err)
+        {
+          if (start_revision <= end_revision)
+            {
+              err = svn_ra_replay_range(session, start_revision, end_revision,
+                                        0, ! opt_baton->no_content,
+                                        replay_revstart,
+                                        replay_revend, replay_baton,
+                                        iterpool);
+              if (! err)
+                start_revision = end_revision + 1;
+            }
+          else if (! opt_baton->follow
+                   || wait_for_revisions(opt_baton->poll_interval))
+            break;
+          else
+            err = svn_ra_get_latest_revnum(session, &end_revision, iterpool);
+        }
+
+      if (! err)
+        {
+          attempt = 0;
+          delay = RETRY_INITIAL_DELAY;
+          continue;
+        }
+      if (is_follow_stop(opt_baton, err))
+        break;
+      if (opt_baton->retries == 0 || ! replay_baton->revision_buffer
+          || replay_baton->output_failed || ! is_retryable_error(err))
+        return err;
+
+      /* Each revision that got through earns the next one a fresh
+         set of attempts. */
+      if (replay_baton->next_revision > start_revision)
+        {
+          start_revision = replay_baton->next_revision;
+          attempt = 0;
+          delay = RETRY_INITIAL_DELAY;
+        }
+      if (attempt == opt_baton->retries)
+        return svn_error_createf(err->apr_err, err,
+                                 _("Giving up on revision %ld after %d "
+                                   "retries"),
+                                 start_revision, attempt);
+
+      attempt++;
+      opt_baton->retry_count++;
+      svn_handle_warning2(stderr, err, "svnrdump: ");
+      svn_error_clear(err);
+      SVN_ERR(svn_cmdline_fprintf(stderr, pool,
+                                  _("* Retrying revision %ld in %d ms "
+                                    "(attempt %d of %d).\n"),
+                                  start_revision,
+                                  (int)apr_time_as_msec(delay),
+                                  attempt, opt_baton->retries));
+      apr_sleep(delay);
+      SVN_ERR(check_cancel(NULL));
+      delay = (delay * 2 > RETRY_MAX_DELAY) ? RETRY_MAX_DELAY : delay * 2;
+
+      replay_baton->editor = NULL;
+      svn_pool_clear(editor_pool);
+      if (session_pool)
+        svn_pool_destroy(session_pool);
+      session_pool = NULL;
+      session = NULL;
+    }
+  svn_pool_destroy(iterpool);
+
+  return SVN_NO_ERROR;
+}
+
+/* Read a dumpstream from stdin, and use it to feed a loader capable
+ * of transmitting that information to the repository located at URL
+ * (to which SESSION has been opened).
+ */
+static svn_error_t *
+load_revisions(svn_ra_session_t *session,
+               const char *url,
+               svn_boolean_t quiet,
+               apr_pool_t *pool)
+{
+  apr_file_t *stdin_file;
+  svn_stream_t *stdin_stream;
+  const svn_repos_parse_fns2_t *parser;
+  void *parse_baton;
+
+  apr_file_open_stdin(&stdin_file, pool);
+  stdin_stream = svn_stream_from_aprfile2(stdin_file, FALSE, pool);
+
+  SVN_ERR(get_dumpstream_loader(&parser, &parse_baton, session, pool));
+  SVN_ERR(drive_dumpstream_loader(stdin_stream, parser, parse_baton,
+                                  session, check_cancel, NULL, pool));
+
+  svn_stream_close(stdin_stream);
+
+  return SVN_NO_ERROR;
+}
+
+/* Return a program name for this program, the basename of the path
+ * represented by PROGNAME if not NULL; use "svnrdump" otherwise.
+ */
+static const char *
+ensure_appname(const char *progname,
+               apr_pool_t *pool)
+{
+  if (!progname)
+    return "svnrdump";
+
+  return svn_dirent_basename(svn_dirent_internal_style(progname, pool), NULL);
+}
+
+/* Print a simple usage string. */
+static svn_error_t *
+usage(const char *progname,
+      apr_pool_t *pool)
+{
+  return svn_cmdline_fprintf(stderr, pool,
+                             _("Type '%s help' for usage.\n"),
+                             ensure_appname(progname, pool));
+}
+
+/* Print information about the version of this program and dependent
+ * modules.
+ */
+static svn_error_t *
+version(const char *progname,
+        apr_pool_t *pool)
+{
+  svn_stringbuf_t *version_footer = 
+    svn_stringbuf_create(_("The following repository access (RA) modules "
+                           "are available:\n\n"),
+                         pool);
+
+  SVN_ERR(svn_ra_print_modules(version_footer, pool));
+  return svn_opt_print_help3(NULL, ensure_appname(progname, pool),
+                             TRUE, FALSE, version_footer->data,
+                             NULL, NULL, NULL, NULL, NULL, pool);
+}
+
+
+/* Parse ARG, a byte count with an optional K, M or G suffix, into
+ * *SIZE.  Use POOL for error allocations.
+ */
+static svn_error_t *
+parse_size(apr_size_t *size,
+           const char *arg,
+           apr_pool_t *pool)
+{
+  char *end;
+  apr_int64_t val = apr_strtoi64(arg, &end, 10);
+  apr_int64_t multiplier = 1;
+
+  switch (*end)
+    {
+    case 'k': case 'K':
+      multiplier = 1024;
+      end++;
+      break;
+    case 'm': case 'M':
+      multiplier = 1024 * 1024;
+      end++;
+      break;
+    case 'g': case 'G':
+      multiplier = 1024 * 1024 * 1024;
+      end++;
+      break;
+    }
+
+  if (end == arg || *end != '\0' || val < 0
+      || (apr_uint64_t)val * multiplier > APR_SIZE_MAX)
+    return svn_error_createf(SVN_ERR_CL_ARG_PARSING_ERROR, NULL,
+                             _("Invalid size '%s'"), arg);
+
+  *size = (apr_size_t)(val * multiplier);
+  return SVN_NO_ERROR;
+}
+
+/* Return TRUE if ARG is a number from MIN to MAX, and set *N to it. */
+static svn_boolean_t
+parse_int(int *n,
+          const char *arg,
+          int min,
+          int max)
+{
+  svn_error_t *err = svn_cstring_atoi(n, arg);
+
+  if (err)
+    {
+      svn_error_clear(err);
+      return FALSE;
+    }
+  return *n >= min && *n <= max;
+}
+
+/* Append ARG, a path given on the command line, to *PREFIXES (created
+ * in POOL if NULL) without leading and trailing slashes, the form the
+ * dump editor matches node paths against.
+ */
+static svn_error_t *
+add_path_prefix(apr_array_header_t **prefixes,
+                const char *arg,
+                apr_pool_t *pool)
+{
+  const char *prefix;
+  apr_size_t len;
+
+  SVN_ERR(svn_utf_cstring_to_utf8(&prefix, arg, pool));
+  while (*prefix == '/')
+    prefix++;
+  len = strlen(prefix);
+  while (len > 0 && prefix[len - 1] == '/')
+    len--;
+
+  if (! *prefixes)
+    *prefixes = apr_array_make(pool, 1, sizeof(const char *));
+  APR_ARRAY_PUSH(*prefixes, const char *) = apr_pstrndup(pool, prefix, len);
+  return SVN_NO_ERROR;
+}
+
+/* Print the counters in STATS to stderr, using POOL for temporary
+ * allocations.
+ */
+static svn_error_t *
+print_dump_stats(const struct dump_stats *stats,
+                 apr_pool_t *pool)
+{
+  return svn_cmdline_fprintf(stderr, pool,
+                             _("* Text deltas: %" APR_UINT64_T_FMT
+                               ", spilled to disk: %" APR_UINT64_T_FMT
+                               " (%" APR_UINT64_T_FMT " bytes), "
+                               "moved by the kernel: %" APR_UINT64_T_FMT
+                               " bytes.\n"),
+                             stats->text_deltas, stats->delta_spills,
+                             stats->delta_spill_bytes,
+                             stats->delta_kernel_copy_bytes);
+}
+
+/* Print the counters of an output queue in STATS to stderr, using
+ * POOL for temporary allocations.
+ */
+static svn_error_t *
+print_queue_stats(const struct write_queue_stats *stats,
+                  apr_pool_t *pool)
+{
+  return svn_cmdline_fprintf(stderr, pool,
+                             _("* Output queue: %" APR_UINT64_T_FMT
+                               " buffers (%" APR_UINT64_T_FMT " bytes), "
+                               "high-water mark %u of %u; "
+                               "waited %" APR_TIME_T_FMT " ms for output, "
+                               "%" APR_TIME_T_FMT " ms for input.\n"),
+                             stats->buffers, stats->bytes,
+                             stats->high_water, stats->depth,
+                             apr_time_as_msec(stats->producer_stall),
+                             apr_time_as_msec(stats->writer_stall));
+}
+
+/* Print the counters of an output sink in STATS to stderr, using POOL
+ * for temporary allocations.
+ */
+static svn_error_t *
+print_sink_stats(const struct output_sink_stats *stats,
+                 apr_pool_t *pool)
+{
+  return svn_cmdline_fprintf(stderr, pool,
+                             _("* Output buffer: %" APR_UINT64_T_FMT
+                               " writes (%" APR_UINT64_T_FMT
+                               " bytes).\n"),
+                             stats->writes, stats->bytes);
+}
+
+/* Print the counters of an io_uring writer in STATS to stderr, using
+ * POOL for temporary allocations.
+ */
+static svn_error_t *
+print_uring_stats(const struct uring_writer_stats *stats,
+                  apr_pool_t *pool)
+{
+  return svn_cmdline_fprintf(stderr, pool,
+                             _("* io_uring: %" APR_UINT64_T_FMT
+                               " writes (%" APR_UINT64_T_FMT " bytes%s), "
+                               "up to %u in flight; "
+                               "waited %" APR_TIME_T_FMT " ms for them.\n"),
+                             stats->writes, stats->bytes,
+                             stats->direct ? ", O_DIRECT" : "",
+                             stats->high_water,
+                             apr_time_as_msec(stats->stall));
+}
+
+/* Print the counters of an output compressor in STATS to stderr, using
+ * POOL for temporary allocations.
+ */
+static svn_error_t *
+print_compress_stats(const struct compress_stats *stats,
+                     apr_pool_t *pool)
+{
+  return svn_cmdline_fprintf(stderr, pool,
+                             _("* Compression: %" APR_UINT64_T_FMT
+                               " blocks, %" APR_UINT64_T_FMT
+                               " bytes in, %" APR_UINT64_T_FMT
+                               " bytes out.\n"),
+                             stats->blocks, stats->bytes_in,
+                             stats->bytes_out);
+}
+
+/* Print the fulltext cache statistics in STATS to stderr.  Use POOL
+ * for allocations.
+ */
+static svn_error_t *
+print_fulltext_stats(const struct fulltext_cache_stats *stats,
+                     apr_pool_t *pool)
+{
+  return svn_cmdline_fprintf(stderr, pool,
+                             _("* Fulltext cache: %" APR_UINT64_T_FMT
+                               " hits, %" APR_UINT64_T_FMT
+                               " misses, %" APR_UINT64_T_FMT
+                               " texts stored, %" APR_UINT64_T_FMT
+                               " evicted.\n"),
+                             stats->hits, stats->misses, stats->stores,
+                             stats->evictions);
+}
+
+/* A statement macro, similar to @c SVN_ERR, but returns an integer.
+ * Evaluate @a expr. If it yields an error, handle that error and
+ * return @c EXIT_FAILURE.
+ */
+#define SVNRDUMP_ERR(expr)                                               \
+  do                                                                     \
+    {                                                                    \
+      svn_error_t *svn_err__temp = (expr);                               \
+      if (svn_err__temp)                                                 \
+        {                                                                \
+          svn_handle_error2(svn_err__temp, stderr, FALSE, "svnrdump: "); \
+          svn_error_clear(svn_err__temp);                                \
+          return EXIT_FAILURE;                                           \
+        }                                                                \
+    }                                                                    \
+  while (0)
+
+/* Open the partial dumpfile OPT_BATON->resume_file (creating it if
+ * need be), cut off whatever follows the last complete revision, and
+ * set *FILE to it, positioned for appending.  Adjust OPT_BATON so that
+ * the dump continues where the file left off.  Allocate in POOL.
+ */
+static svn_error_t *
+open_resume_file(apr_file_t **file,
+                 opt_baton_t *opt_baton,
+                 apr_pool_t *pool)
+{
+  apr_file_t *resume_file;
+  struct resume_point *point;
+  const char *uuid;
+  apr_off_t offset;
+
+  SVN_ERR(svn_io_file_open(&resume_file, opt_baton->resume_file,
+                           APR_READ | APR_WRITE | APR_CREATE | APR_BINARY,
+                           APR_OS_DEFAULT, pool));
+  SVN_ERR(find_resume_point(&point, resume_file, pool));
+
+  if (point->has_header)
+    {
+      SVN_ERR(svn_ra_get_uuid2(opt_baton->session, &uuid, pool));
+      if (strcmp(uuid, point->uuid) != 0)
+        return svn_error_createf(SVN_ERR_INCORRECT_PARAMS, NULL,
+                                 _("'%s' is a dump of repository %s, "
+                                   "not of %s"),
+                                 svn_dirent_local_style(
+                                   opt_baton->resume_file, pool),
+                                 point->uuid, uuid);
+    }
+
+  if (SVN_IS_VALID_REVNUM(point->revision))
+    {
+      if (point->revision > opt_baton->end_revision)
+        return svn_error_createf(SVN_ERR_INCORRECT_PARAMS, NULL,
+                                 _("'%s' already extends past "
+                                   "revision %ld"),
+                                 svn_dirent_local_style(
+                                   opt_baton->resume_file, pool),
+                                 opt_baton->end_revision);
+      /* Picking up at LOWER would leave the revisions in between out
+         of the file. */
+      if (point->revision < opt_baton->start_revision)
+        return svn_error_createf(SVN_ERR_INCORRECT_PARAMS, NULL,
+                                 _("'%s' ends before revision %ld; "
+                                   "resume it from revision %ld"),
+                                 svn_dirent_local_style(
+                                   opt_baton->resume_file, pool),
+                                 opt_baton->start_revision,
+                                 point->revision);
+      opt_baton->start_revision = point->revision;
+    }
+
+  SVN_ERR(svn_io_file_trunc(resume_file, point->offset, pool));
+  offset = 0;
+  SVN_ERR(svn_io_file_seek(resume_file, APR_END, &offset, pool));
+  opt_baton->append = point->has_header;
+
+  if (! opt_baton->quiet)
+    SVN_ERR(svn_cmdline_fprintf(stderr, pool,
+                                _("* Resuming at revision %ld.\n"),
+                                opt_baton->start_revision));
+
+  /* Let a signal stop the dump only once a revision is complete, so
+     that the file can be resumed again without losing anything. */
+  stop_at_revision_boundary = TRUE;
+
+  *file = resume_file;
+  return SVN_NO_ERROR;
+}
+
+/* The layers between the dump and its destination; unused layers are
+   NULL.  From the dump's point of view: an optional compressor, then
+   either an output queue or an output sink (unless the destination
+   is an io_uring writer, which has buffers of its own), then the
+   destination. */
+struct output_chain
+{
+  struct compress_stream *compressor;
+  struct write_queue *queue;
+  struct output_sink *sink;
+  enum output_flush_policy flush_policy;
+
+  /* The destination, if it is a file written synchronously, or an
+     io_uring writer. */
+  apr_file_t *file;
+  struct uring_writer *uring;
+
+  /* The fanout in front of the chain, if it is one of several outputs.
+     The chain is then only used by the fanout's writer thread. */
+  struct fanout *fanout;
+};
+
+/* Tell the layers of the output chain BATON that the dump has reached
+ * a revision boundary. */
+static svn_error_t *
+output_boundary(void *baton)
+{
+  struct output_chain *chain = baton;
+
+  if (chain->flush_policy != output_flush_at_revision)
+    {
+      if (chain->compressor)
+        SVN_ERR(compress_stream_boundary(chain->compressor));
+    }
+  else
+    {
+      /* Compressed data must come out of the compressor too. */
+      if (chain->compressor)
+        SVN_ERR(compress_stream_flush(chain->compressor));
+      if (chain->queue)
+        SVN_ERR(write_queue_flush(chain->queue));
+      if (chain->sink)
+        SVN_ERR(output_sink_flush(chain->sink));
+      if (chain->uring && ! chain->queue)
+        SVN_ERR(uring_writer_flush(chain->uring));
+    }
+
+  return SVN_NO_ERROR;
+}
+
+/* Set *FILE to the destination file of the output chain BATON, with
+ * everything written to the chain so far in it, if data can be written
+ * to it directly; else set *FILE to NULL.  Implements the
+ * get_output_file callback of struct dump_options.
+ */
+static svn_error_t *
+chain_output_file(apr_file_t **file,
+                  void *baton)
+{
+  struct output_chain *chain = baton;
+
+  /* Compressed data can't bypass the compressor, and the writer thread
+     owns the destination of a queue or a fanout. */
+  *file = NULL;
+  if (chain->compressor || chain->queue || chain->fanout || ! chain->file)
+    return SVN_NO_ERROR;
+
+  if (chain->sink)
+    SVN_ERR(output_sink_flush(chain->sink));
+  *file = chain->file;
+  return SVN_NO_ERROR;
+}
+
+/* Open the destination of the dump as OPT_BATON asks for: the
+ * --resume or --output file, or stdout.  Record it in CHAIN and set
+ * *STREAM to a stream writing to it.  Allocate in POOL.
+ */
+static svn_error_t *
+open_destination(svn_stream_t **stream,
+                 struct output_chain *chain,
+                 opt_baton_t *opt_baton,
+                 apr_pool_t *pool)
+{
+  if (opt_baton->resume_file)
+    {
+      SVN_ERR(open_resume_file(&chain->file, opt_baton, pool));
+      *stream = svn_stream_from_aprfile2(chain->file, FALSE, pool);
+      return SVN_NO_ERROR;
+    }
+
+  if (opt_baton->output_file && opt_baton->io_uring)
+    {
+      svn_error_t *err;
+
+      err = uring_writer_create(&chain->uring, opt_baton->output_file,
+                                opt_baton->direct, opt_baton->preallocate,
+                                opt_baton->output_buffer
+                                  ? opt_baton->output_buffer
+                                  : OUTPUT_SINK_DEFAULT_BUFFER_SIZE,
+                                URING_WRITER_DEFAULT_DEPTH, pool);
+      if (! err)
+        {
+          *stream = uring_writer_stream(chain->uring, pool);
+          return SVN_NO_ERROR;
+        }
+      if (err->apr_err != SVN_ERR_UNSUPPORTED_FEATURE)
+        return err;
+
+      /* Still keep the disk away from the thread driving the dump, if
+         we can. */
+      svn_handle_warning2(stderr, err, "svnrdump: ");
+      svn_error_clear(err);
+#if APR_HAS_THREADS
+      if (opt_baton->output_queue == 0)
+        opt_baton->output_queue = URING_WRITER_DEFAULT_DEPTH;
+#endif
+    }
+
+  if (opt_baton->output_file)
+    {
+      SVN_ERR(svn_io_file_open(&chain->file, opt_baton->output_file,
+                               APR_WRITE | APR_CREATE | APR_TRUNCATE
+                               | APR_BINARY, APR_OS_DEFAULT, pool));
+      *stream = svn_stream_from_aprfile2(chain->file, FALSE, pool);
+    }
+  else
+    {
+      apr_status_t status = apr_file_open_stdout(&chain->file, pool);
+
+      if (status)
+        return svn_error_wrap_apr(status, _("Can't open stdout"));
+      *stream = svn_stream_from_aprfile2(chain->file, TRUE, pool);
+    }
+
+  return SVN_NO_ERROR;
+}
+
+/* Set up the layers of CHAIN on top of TARGET as OPT_BATON asks for,
+ * and set *STREAM to the stream the whole dump is to be written to.
+ * Allocate in POOL.
+ */
+static svn_error_t *
+open_output_chain(svn_stream_t **stream,
+                  struct output_chain *chain,
+                  svn_stream_t *target,
+                  opt_baton_t *opt_baton,
+                  apr_pool_t *pool)
+{
+  chain->flush_policy = opt_baton->flush_policy;
+
+  /* Either hand the output to a writer thread, so that the network
+     and the output don't wait for each other, or collect it in a
+     large buffer, so that it doesn't take a system call per header
+     line.  The queue's buffers double as the latter. */
+  if (opt_baton->output_queue > 0)
+    {
+      SVN_ERR(write_queue_create(&chain->queue, target,
+                                 opt_baton->output_buffer
+                                   ? opt_baton->output_buffer
+                                   : WRITE_QUEUE_DEFAULT_BUFFER_SIZE,
+                                 opt_baton->output_queue, pool));
+      target = write_queue_stream(chain->queue, pool);
+    }
+  else if (opt_baton->output_buffer > 0 && ! chain->uring)
+    {
+      SVN_ERR(output_sink_create(&chain->sink, target,
+                                 opt_baton->output_buffer, pool));
+      target = output_sink_stream(chain->sink, pool);
+    }
+
+  /* Compress in front of the rest, so that they only have the
+     (smaller) compressed data to deal with. */
+  if (opt_baton->compress)
+    {
+      enum compress_format format;
+
+      SVN_ERR(compress_parse_format(&format, opt_baton->compress));
+      SVN_ERR(compress_check_level(format, opt_baton->compress_level));
+      SVN_ERR(compress_stream_create(&chain->compressor, target, format,
+                                     opt_baton->compress_level,
+                                     opt_baton->compress_threads,
+                                     COMPRESS_DEFAULT_BLOCK_SIZE, pool));
+      target = compress_stream_get(chain->compressor, pool);
+    }
+
+  opt_baton->boundary_func = output_boundary;
+  opt_baton->boundary_baton = chain;
+
+  *stream = target;
+  return SVN_NO_ERROR;
+}
+
+/* Add an output for SPEC, a --tee argument, to FANOUT: a file with
+ * its own output chain, tuned by the options in SPEC and by
+ * OPT_BATON.  Allocate in POOL.
+ */
+static svn_error_t *
+add_tee_output(struct fanout *fanout,
+               const char *spec,
+               opt_baton_t *opt_baton,
+               apr_pool_t *pool)
+{
+  struct output_chain *chain = apr_pcalloc(pool, sizeof(*chain));
+  apr_array_header_t *fields = svn_cstring_split(spec, ",", TRUE, pool);
+  const char *path;
+  const char *compress = NULL;
+  int compress_level = -1;
+  apr_size_t buffer_size = opt_baton->output_buffer;
+  svn_stream_t *stream;
+  int i;
+
+  if (fields->nelts == 0)
+    return svn_error_createf(SVN_ERR_CL_ARG_PARSING_ERROR, NULL,
+                             _("Invalid --tee argument '%s'"), spec);
+
+  for (i = 1; i < fields->nelts; i++)
+    {
+      const char *field = APR_ARRAY_IDX(fields, i, const char *);
+
+      if (strncmp(field, "compress=", 9) == 0)
+        compress = field + 9;
+      else if (strncmp(field, "level=", 6) == 0)
+        {
+          svn_error_t *err = svn_cstring_atoi(&compress_level, field + 6);
+
+          if (err)
+            return svn_error_createf(SVN_ERR_CL_ARG_PARSING_ERROR, err,
+                                     _("Invalid --tee option '%s'"), field);
+        }
+      else if (strncmp(field, "buffer=", 7) == 0)
+        SVN_ERR(parse_size(&buffer_size, field + 7, pool));
+      else
+        return svn_error_createf(SVN_ERR_CL_ARG_PARSING_ERROR, NULL,
+                                 _("Invalid --tee option '%s'"), field);
+    }
+
+  SVN_ERR(svn_utf_cstring_to_utf8(&path, APR_ARRAY_IDX(fields, 0,
+                                                       const char *),
+                                  pool));
+  path = svn_dirent_internal_style(path, pool);
+  SVN_ERR(svn_io_file_open(&chain->file, path,
+                           APR_WRITE | APR_CREATE | APR_TRUNCATE
+                           | APR_BINARY, APR_OS_DEFAULT, pool));
+  stream = svn_stream_from_aprfile2(chain->file, FALSE, pool);
+
+  /* The output has a writer thread of its own already; give it a
+     buffer, and compress on that thread. */
+  chain->flush_policy = opt_baton->flush_policy;
+  if (buffer_size > 0)
+    {
+      SVN_ERR(output_sink_create(&chain->sink, stream, buffer_size, pool));
+      stream = output_sink_stream(chain->sink, pool);
+    }
+  if (compress)
+    {
+      enum compress_format format;
+
+      SVN_ERR(compress_parse_format(&format, compress));
+      SVN_ERR(compress_check_level(format, compress_level));
+      SVN_ERR(compress_stream_create(&chain->compressor, stream, format,
+                                     compress_level, 0,
+                                     COMPRESS_DEFAULT_BLOCK_SIZE, pool));
+      stream = compress_stream_get(chain->compressor, pool);
+    }
+
+  return fanout_add_output(fanout, path, stream, output_boundary, chain);
+}
+
+/* Put a fanout in front of CHAIN, the main output chain whose top is
+ * TARGET, and add an output for each --tee argument of OPT_BATON.  Set
+ * *STREAM to the stream the whole dump is to be written to.  Allocate
+ * in POOL.
+ */
+static svn_error_t *
+open_fanout(svn_stream_t **stream,
+            struct output_chain *chain,
+            svn_stream_t *target,
+            opt_baton_t *opt_baton,
+            apr_pool_t *pool)
+{
+  int i;
+
+  SVN_ERR(fanout_create(&chain->fanout, opt_baton->tee_policy,
+                        opt_baton->tee_stall_limit,
+                        FANOUT_DEFAULT_BUFFER_SIZE, FANOUT_DEFAULT_DEPTH,
+                        opt_baton->flush_policy == output_flush_at_revision,
+                        pool));
+
+  /* The main output learns about revision boundaries from its writer
+     thread now. */
+  SVN_ERR(fanout_add_output(chain->fanout,
+                            opt_baton->output_file ? opt_baton->output_file
+                                                   : "stdout",
+                            target, opt_baton->boundary_func,
+                            opt_baton->boundary_baton));
+  for (i = 0; i < opt_baton->tees->nelts; i++)
+    SVN_ERR(add_tee_output(chain->fanout,
+                           APR_ARRAY_IDX(opt_baton->tees, i, const char *),
+                           opt_baton, pool));
+
+  opt_baton->boundary_func = fanout_boundary;
+  opt_baton->boundary_baton = chain->fanout;
+
+  *stream = fanout_stream(chain->fanout, pool);
+  return SVN_NO_ERROR;
+}
+
+/* Print the counters of FANOUT and its outputs to stderr, using POOL
+ * for temporary allocations.
+ */
+static svn_error_t *
+print_fanout_stats(const struct fanout *fanout,
+                   apr_pool_t *pool)
+{
+  const struct fanout_stats *stats = fanout_get_stats(fanout);
+  int i;
+
+  SVN_ERR(svn_cmdline_fprintf(stderr, pool,
+                              _("* Fanout: %" APR_UINT64_T_FMT
+                                " buffers (%" APR_UINT64_T_FMT " bytes); "
+                                "waited %" APR_TIME_T_FMT " ms for the "
+                                "outputs.\n"),
+                              stats->buffers, stats->bytes,
+                              apr_time_as_msec(stats->producer_stall)));
+
+  for (i = 0; i < fanout_output_count(fanout); i++)
+    {
+      const struct fanout_output_stats *output_stats =
+        fanout_get_output_stats(fanout, i);
+
+      SVN_ERR(svn_cmdline_fprintf(stderr, pool,
+                                  _("*   %s: %" APR_UINT64_T_FMT " bytes, "
+                                    "waited %" APR_TIME_T_FMT " ms for "
+                                    "input%s.\n"),
+                                  output_stats->name, output_stats->bytes,
+                                  apr_time_as_msec(output_stats->stall),
+                                  output_stats->dropped ? _(", dropped")
+                                                        : ""));
+    }
+
+  return SVN_NO_ERROR;
+}
+
+/* Warn about the outputs of FANOUT that were dropped. */
+static void
+warn_dropped_outputs(const struct fanout *fanout)
+{
+  int i;
+
+  for (i = 0; i < fanout_output_count(fanout); i++)
+    {
+      const struct fanout_output_stats *output_stats =
+        fanout_get_output_stats(fanout, i);
+
+      if (output_stats->dropped)
+        {
+          svn_error_t *warning =
+            svn_error_createf(SVN_ERR_IO_WRITE_ERROR, NULL,
+                              _("Output '%s' fell behind or failed and is "
+                                "incomplete"), output_stats->name);
+
+          svn_handle_warning2(stderr, warning, "svnrdump: ");
+          svn_error_clear(warning);
+        }
+    }
+}
+
+/* Create OPT_BATON->split with an output for each PREFIX=FILE argument
+ * of OPT_BATON->split_by, whose dump editor is tuned by DUMP_OPTIONS.
+ * Allocate in POOL.
+ */
+static svn_error_t *
+open_split_outputs(opt_baton_t *opt_baton,
+                   const struct dump_options *dump_options,
+                   apr_pool_t *pool)
+{
+  int i;
+
+  SVN_ERR(split_dump_create(&(opt_baton->split), opt_baton->drop_empty_revs,
+                            pool));
+
+  for (i = 0; i < opt_baton->split_by->nelts; i++)
+    {
+      const char *arg = APR_ARRAY_IDX(opt_baton->split_by, i, const char *);
+      const char *eq = strchr(arg, '=');
+      apr_array_header_t *prefixes = NULL;
+      const char *path;
+      svn_stream_t *stream;
+
+      if (! eq || eq[1] == '\0')
+        return svn_error_createf(SVN_ERR_CL_ARG_PARSING_ERROR, NULL,
+                                 _("Invalid --split-by argument '%s'; "
+                                   "expected PREFIX=FILE"), arg);
+
+      SVN_ERR(add_path_prefix(&prefixes, apr_pstrndup(pool, arg, eq - arg),
+                              pool));
+      SVN_ERR(svn_utf_cstring_to_utf8(&path, eq + 1, pool));
+      path = svn_dirent_internal_style(path, pool);
+
+      SVN_ERR(svn_stream_open_writable(&stream, path, pool, pool));
+      if (opt_baton->output_buffer > 0)
+        {
+          struct output_sink *sink;
+
+          SVN_ERR(output_sink_create(&sink, stream, opt_baton->output_buffer,
+                                     pool));
+          stream = output_sink_stream(sink, pool);
+        }
+
+      SVN_ERR(split_dump_add_output(opt_baton->split,
+                                    APR_ARRAY_IDX(prefixes, 0, const char *),
+                                    stream, dump_options, pool));
+    }
+
+  return SVN_NO_ERROR;
+}
+
+/* Fill in the dump editor options in DUMP_OPTIONS that are given by
+ * OPT_BATON.
+ */
+static void
+init_dump_options(struct dump_options *dump_options,
+                  const opt_baton_t *opt_baton)
+{
+  dump_options->spill_threshold = opt_baton->spill_threshold;
+  dump_options->svndiff_version = opt_baton->svndiff_version;
+  dump_options->compression_level = opt_baton->svndiff_level;
+  dump_options->include_prefixes = opt_baton->include_prefixes;
+  dump_options->exclude_prefixes = opt_baton->exclude_prefixes;
+  dump_options->drop_props = opt_baton->drop_props;
+  dump_options->no_content = opt_baton->no_content;
+}
+
+/* Dump the revisions given by OPT_BATON to the destination it names,
+ * through the output layers it asks for, which are set up in CHAIN.
+ * DUMP_OPTIONS are passed on to the dump editor.  Use POOL for
+ * allocations.
+ */
+static svn_error_t *
+dump_to_destination(struct output_chain *chain,
+                    opt_baton_t *opt_baton,
+                    struct dump_options *dump_options,
+                    apr_pool_t *pool)
+{
+  svn_stream_t *output_stream;
+  svn_error_t *err;
 
-  SVN_ERR(svn_config_get_config(&(ctx->config), config_dir, pool));
+  SVN_ERR(open_destination(&output_stream, chain, opt_baton, pool));
 
-  if (config_options)
-    SVN_ERR(svn_cmdline__apply_config_options(ctx->config, config_options,
-                                              "svnrdump: ", "--config-option"));
+  /* Let spooled text deltas go straight to the destination file. */
+  dump_options->get_output_file = chain_output_file;
+  dump_options->output_file_baton = chain;
 
-  cfg_config = apr_hash_get(ctx->config, SVN_CONFIG_CATEGORY_CONFIG,
-                            APR_HASH_KEY_STRING);
+  SVN_ERR(open_output_chain(&output_stream, chain, output_stream,
+                            opt_baton, pool));
+  if (opt_baton->tees)
+    SVN_ERR(open_fanout(&output_stream, chain, output_stream, opt_baton,
+                        pool));
 
-  /* Set up our cancellation support. */
-  ctx->cancel_func = check_cancel;
+  err = replay_revisions(opt_baton, dump_options, output_stream, pool);
+  SVN_ERR(svn_error_compose_create(err, svn_stream_close(output_stream)));
+  if (chain->fanout)
+    warn_dropped_outputs(chain->fanout);
 
-  /* Default authentication providers for non-interactive use */
-  SVN_ERR(svn_cmdline_create_auth_baton(&(ctx->auth_baton), non_interactive,
-                                        username, password, config_dir,
-                                        no_auth_cache, FALSE, cfg_config,
-                                        ctx->cancel_func, ctx->cancel_baton,
-                                        pool));
-  SVN_ERR(svn_client_open_ra_session(session, url, ctx, pool));
   return SVN_NO_ERROR;
 }
 
-/* Replay revisions START_REVISION thru END_REVISION (inclusive) of
- * the repository located at URL, using callbacks which generate
- * Subversion repository dumpstreams describing the changes made in
- * those revisions.  If QUIET is set, don't generate progress
- * messages.
- */
+/* Handle the "dump" subcommand.  Implements `svn_opt_subcommand_t'.  */
 static svn_error_t *
-replay_revisions(svn_ra_session_t *session,
-                 const char *url,
-                 svn_revnum_t start_revision,
-                 svn_revnum_t end_revision,
-                 svn_boolean_t quiet,
-                 apr_pool_t *pool)
+dump_cmd(apr_getopt_t *os,
+         void *baton,
+         apr_pool_t *pool)
 {
-  const svn_delta_editor_t *dump_editor;
-  struct replay_baton *replay_baton;
-  void *dump_baton;
-  const char *uuid;
-  svn_stream_t *stdout_stream;
+  opt_baton_t *opt_baton = baton;
+  struct dump_options dump_options = { 0 };
+  struct dump_stats stats = { 0 };
+  struct output_chain chain = { 0 };
+  svn_error_t *err;
 
-  SVN_ERR(svn_stream_for_stdout(&stdout_stream, pool));
+  init_dump_options(&dump_options, opt_baton);
+  if (opt_baton->stats)
+    dump_options.stats = &stats;
 
-  SVN_ERR(get_dump_editor(&dump_editor, &dump_baton, stdout_stream, 
-                          check_cancel, NULL, pool));
+  /* A compressed file can't be scanned for the point to resume at. */
+  if (opt_baton->resume_file && opt_baton->compress)
+    return svn_error_create(SVN_ERR_CL_MUTUALLY_EXCLUSIVE_ARGS, NULL,
+                            _("--resume and --compress can't be used "
+                              "together"));
 
-  replay_baton = apr_pcalloc(pool, sizeof(*replay_baton));
-  replay_baton->editor = dump_editor;
-  replay_baton->edit_baton = dump_baton;
-  replay_baton->quiet = quiet;
+  if (opt_baton->resume_file && opt_baton->output_file)
+    return svn_error_create(SVN_ERR_CL_MUTUALLY_EXCLUSIVE_ARGS, NULL,
+                            _("--resume and --output can't be used "
+                              "together"));
+  if (opt_baton->resume_file && opt_baton->no_content)
+    return svn_error_create(SVN_ERR_CL_MUTUALLY_EXCLUSIVE_ARGS, NULL,
+                            _("--resume and --no-content can't be used "
+                              "together"));
+  if (opt_baton->resume_file && opt_baton->tees)
+    return svn_error_create(SVN_ERR_CL_MUTUALLY_EXCLUSIVE_ARGS, NULL,
+                            _("--resume and --tee can't be used "
+                              "together"));
+  if (opt_baton->resume_file && opt_baton->base_snapshot)
+    return svn_error_create(SVN_ERR_CL_MUTUALLY_EXCLUSIVE_ARGS, NULL,
+                            _("--resume and --base-snapshot can't be used "
+                              "together"));
+  if (opt_baton->base_snapshot
+      && (opt_baton->no_content || opt_baton->revprops_only))
+    return svn_error_create(SVN_ERR_CL_MUTUALLY_EXCLUSIVE_ARGS, NULL,
+                            _("--base-snapshot can't be used with "
+                              "--no-content or --revprops-only"));
+  if (opt_baton->revision_length && opt_baton->split_by)
+    return svn_error_create(SVN_ERR_CL_MUTUALLY_EXCLUSIVE_ARGS, NULL,
+                            _("--revision-length can't be used with "
+                              "--split-by"));
+  if (opt_baton->io_uring && ! opt_baton->output_file)
+    return svn_error_create(SVN_ERR_CL_ARG_PARSING_ERROR, NULL,
+                            _("--io-uring requires --output"));
+  if ((opt_baton->direct || opt_baton->preallocate) && ! opt_baton->io_uring)
+    return svn_error_create(SVN_ERR_CL_ARG_PARSING_ERROR, NULL,
+                            _("--direct and --preallocate require "
+                              "--io-uring"));
 
-  /* Write the magic header and UUID */
-  SVN_ERR(svn_stream_printf(stdout_stream, pool,
-                            SVN_REPOS_DUMPFILE_MAGIC_HEADER ": %d\n\n",
-                            SVN_REPOS_DUMPFILE_FORMAT_VERSION));
-  SVN_ERR(svn_ra_get_uuid2(session, &uuid, pool));
-  SVN_ERR(svn_stream_printf(stdout_stream, pool,
-                            SVN_REPOS_DUMPFILE_UUID ": %s\n\n", uuid));
+  if (opt_baton->split_by)
+    {
+      if (opt_baton->output_file || opt_baton->resume_file
+          || opt_baton->tees || opt_baton->compress
+          || opt_baton->include_prefixes || opt_baton->jobs > 1
+          || opt_baton->follow || opt_baton->no_content
+          || opt_baton->revprops_only || opt_baton->base_snapshot
+          || opt_baton->fulltext_dir)
+        return svn_error_create(SVN_ERR_CL_MUTUALLY_EXCLUSIVE_ARGS, NULL,
+                                _("--split-by can't be used with --output, "
+                                  "--resume, --tee, --compress, --include, "
+                                  "--jobs, --follow, --no-content, "
+                                  "--revprops-only, --base-snapshot or "
+                                  "--fulltext"));
 
-  /* Fake revision 0 if necessary */
-  if (start_revision == 0)
+      SVN_ERR(open_split_outputs(opt_baton, &dump_options, pool));
+      err = replay_revisions(opt_baton, &dump_options, NULL, pool);
+      SVN_ERR(svn_error_compose_create(err,
+                                       split_dump_close(opt_baton->split)));
+
+      if (opt_baton->stats)
+        SVN_ERR(print_dump_stats(&stats, pool));
+      return SVN_NO_ERROR;
+    }
+  if (opt_baton->drop_empty_revs)
+    return svn_error_create(SVN_ERR_CL_ARG_PARSING_ERROR, NULL,
+                            _("--drop-empty-revs requires --split-by"));
+  if (opt_baton->revprops_only && opt_baton->follow)
+    return svn_error_create(SVN_ERR_CL_MUTUALLY_EXCLUSIVE_ARGS, NULL,
+                            _("--revprops-only and --follow can't be used "
+                              "together"));
+
+  /* Each full text builds on one from an earlier revision, so the
+     revisions have to be dumped in order. */
+  if (opt_baton->fulltext_dir
+      && (opt_baton->no_content || opt_baton->revprops_only
+          || opt_baton->jobs > 1))
+    return svn_error_create(SVN_ERR_CL_MUTUALLY_EXCLUSIVE_ARGS, NULL,
+                            _("--fulltext can't be used with --no-content, "
+                              "--revprops-only or --jobs"));
+  if (opt_baton->fulltext_dir)
     {
-      apr_hash_t *prophash;
-      svn_stringbuf_t *propstring;
-      svn_stream_t *propstream;
-      SVN_ERR(svn_stream_printf(stdout_stream, pool,
-                                SVN_REPOS_DUMPFILE_REVISION_NUMBER
-                                ": %ld\n", start_revision));
+      struct fetch_text_baton *fb = apr_pcalloc(pool, sizeof(*fb));
 
-      prophash = apr_hash_make(pool);
-      propstring = svn_stringbuf_create("", pool);
+      fb->opt_baton = opt_baton;
+      fb->pool = pool;
+      SVN_ERR(fulltext_cache_open(&opt_baton->fulltext_cache,
+                                  opt_baton->fulltext_dir, opt_baton->url,
+                                  opt_baton->fulltext_cache_size, pool));
+      dump_options.fulltext_cache = opt_baton->fulltext_cache;
+      dump_options.fetch_text_func = fetch_text;
+      dump_options.fetch_props_func = fetch_props;
+      dump_options.fetch_text_baton = fb;
+    }
 
-      SVN_ERR(svn_ra_rev_proplist(session, start_revision,
-                                  &prophash, pool));
+  /* Pass every revision on as soon as it is complete, and let a signal
+     end the dump only between revisions. */
+  if (opt_baton->follow)
+    {
+      opt_baton->flush_policy = output_flush_at_revision;
+      stop_at_revision_boundary = TRUE;
+    }
 
-      propstream = svn_stream_from_stringbuf(propstring, pool);
-      SVN_ERR(svn_hash_write2(prophash, propstream, "PROPS-END", pool));
-      SVN_ERR(svn_stream_close(propstream));
-
-      /* Property-content-length: 14; Content-length: 14 */
-      SVN_ERR(svn_stream_printf(stdout_stream, pool,
-                                SVN_REPOS_DUMPFILE_PROP_CONTENT_LENGTH
-                                ": %" APR_SIZE_T_FMT "\n",
-                                propstring->len));
-      SVN_ERR(svn_stream_printf(stdout_stream, pool,
-                                SVN_REPOS_DUMPFILE_CONTENT_LENGTH
-                                ": %" APR_SIZE_T_FMT "\n\n",
-                                propstring->len));
-      /* The properties */
-      SVN_ERR(svn_stream_write(stdout_stream, propstring->data,
-                               &(propstring->len)));
-      SVN_ERR(svn_stream_printf(stdout_stream, pool, "\n"));
-      if (! quiet)
-        svn_cmdline_fprintf(stderr, pool, "* Dumped revision %lu.\n",
-                            start_revision);
+  /* Keep what the cache learned, even from a failed dump. */
+  err = dump_to_destination(&chain, opt_baton, &dump_options, pool);
+  if (opt_baton->fulltext_cache)
+    err = svn_error_compose_create(
+            err, fulltext_cache_close(opt_baton->fulltext_cache, pool));
+  SVN_ERR(err);
 
-      start_revision++;
+  if (opt_baton->stats)
+    {
+      SVN_ERR(print_dump_stats(&stats, pool));
+      SVN_ERR(svn_cmdline_fprintf(stderr, pool,
+                                  _("* Connection retries: %d.\n"),
+                                  opt_baton->retry_count));
+      if (chain.queue)
+        SVN_ERR(print_queue_stats(write_queue_get_stats(chain.queue), pool));
+      if (chain.sink)
+        SVN_ERR(print_sink_stats(output_sink_get_stats(chain.sink), pool));
+      if (chain.uring)
+        SVN_ERR(print_uring_stats(uring_writer_get_stats(chain.uring),
+                                  pool));
+      if (chain.compressor)
+        SVN_ERR(print_compress_stats(
+                  compress_stream_get_stats(chain.compressor), pool));
+      if (chain.fanout)
+        SVN_ERR(print_fanout_stats(chain.fanout, pool));
+      if (opt_baton->fulltext_cache)
+        SVN_ERR(print_fulltext_stats(
+                  fulltext_cache_get_stats(opt_baton->fulltext_cache),
+                  pool));
     }
 
-  SVN_ERR(svn_ra_replay_range(session, start_revision, end_revision,
-                              0, TRUE, replay_revstart, replay_revend,
-                              replay_baton, pool));
-  SVN_ERR(svn_stream_close(stdout_stream));
   return SVN_NO_ERROR;
 }
 
-/* Read a dumpstream from stdin, and use it to feed a loader capable
- * of transmitting that information to the repository located at URL
- * (to which SESSION has been opened).
+/* One repository of a "dump-many" run. */
+struct many_dump_job
+{
+  const char *url;
+  const char *output_file;
+
+  /* The outcome: the error the dump failed with, if any, the last
+     revision dumped and how long it took. */
+  svn_error_t *err;
+  svn_revnum_t end_revision;
+  apr_interval_time_t elapsed;
+};
+
+/* Shared state of a "dump-many" run. */
+struct many_dump_baton
+{
+  opt_baton_t *opt_baton;
+
+  struct many_dump_job *jobs;
+  int njobs;
+
+  /* Index of the next job to be claimed, protected by MUTEX if there
+     are several workers. */
+  int next_job;
+#if APR_HAS_THREADS
+  apr_thread_mutex_t *mutex;
+#endif
+};
+
+/* One worker of a "dump-many" run, with its own client context. */
+struct many_dump_worker
+{
+  struct many_dump_baton *mb;
+  svn_client_ctx_t *ctx;
+  apr_pool_t *pool;
+};
+
+/* Parse the contents of LISTFILE into the jobs of MB, allocated in
+ * POOL.
  */
 static svn_error_t *
-load_revisions(svn_ra_session_t *session,
-               const char *url,
-               svn_boolean_t quiet,
-               apr_pool_t *pool)
+read_many_dump_list(struct many_dump_baton *mb,
+                    const char *listfile,
+                    apr_pool_t *pool)
 {
-  apr_file_t *stdin_file;
-  svn_stream_t *stdin_stream;
-  const svn_repos_parse_fns2_t *parser;
-  void *parse_baton;
+  svn_stringbuf_t *contents;
+  apr_array_header_t *lines;
+  int i;
 
-  apr_file_open_stdin(&stdin_file, pool);
-  stdin_stream = svn_stream_from_aprfile2(stdin_file, FALSE, pool);
+  SVN_ERR(svn_stringbuf_from_file2(&contents, listfile, pool));
+  lines = svn_cstring_split(contents->data, "\n", TRUE, pool);
 
-  SVN_ERR(get_dumpstream_loader(&parser, &parse_baton, session, pool));
-  SVN_ERR(drive_dumpstream_loader(stdin_stream, parser, parse_baton,
-                                  session, check_cancel, NULL, pool));
+  mb->jobs = apr_pcalloc(pool, lines->nelts * sizeof(*mb->jobs));
+  for (i = 0; i < lines->nelts; i++)
+    {
+      const char *line = APR_ARRAY_IDX(lines, i, const char *);
+      struct many_dump_job *job = &mb->jobs[mb->njobs];
+      apr_array_header_t *fields;
 
-  svn_stream_close(stdin_stream);
+      if (*line == '\0' || *line == '#')
+        continue;
+
+      fields = svn_cstring_split(line, " \t", TRUE, pool);
+      if (fields->nelts != 2
+          || ! svn_path_is_url(APR_ARRAY_IDX(fields, 0, const char *)))
+        return svn_error_createf(SVN_ERR_CL_ARG_PARSING_ERROR, NULL,
+                                 _("Invalid line in '%s': '%s'; expected "
+                                   "URL FILE"), listfile, line);
+
+      SVN_ERR(svn_utf_cstring_to_utf8(&job->url,
+                                      APR_ARRAY_IDX(fields, 0, const char *),
+                                      pool));
+      job->url = svn_uri_canonicalize(job->url, pool);
+      SVN_ERR(svn_utf_cstring_to_utf8(&job->output_file,
+                                      APR_ARRAY_IDX(fields, 1, const char *),
+                                      pool));
+      job->output_file = svn_dirent_internal_style(job->output_file, pool);
+      mb->njobs++;
+    }
 
   return SVN_NO_ERROR;
 }
 
-/* Return a program name for this program, the basename of the path
- * represented by PROGNAME if not NULL; use "svnrdump" otherwise.
+/* Dump all revisions of the repository of JOB to its output file,
+ * opening the session with CTX and taking all other options from
+ * MB->opt_baton.  Use POOL for allocations.
  */
-static const char *
-ensure_appname(const char *progname,
-               apr_pool_t *pool)
+static svn_error_t *
+dump_one_repository(struct many_dump_job *job,
+                    svn_client_ctx_t *ctx,
+                    struct many_dump_baton *mb,
+                    apr_pool_t *pool)
 {
-  if (!progname)
-    return "svnrdump";
+  opt_baton_t repos_baton = *mb->opt_baton;
+  struct dump_options dump_options = { 0 };
+  struct output_chain chain = { 0 };
 
-  return svn_dirent_basename(svn_dirent_internal_style(progname, pool), NULL);
+  repos_baton.url = job->url;
+  repos_baton.output_file = job->output_file;
+  repos_baton.quiet = TRUE;
+  repos_baton.jobs = 1;
+  repos_baton.retry_count = 0;
+  repos_baton.start_revision = 0;
+  repos_baton.boundary_func = NULL;
+  repos_baton.boundary_baton = NULL;
+  repos_baton.ctx = ctx;
+
+  SVN_ERR(open_another_session(&repos_baton.session, &repos_baton, pool));
+  SVN_ERR(svn_ra_get_latest_revnum(repos_baton.session,
+                                   &repos_baton.end_revision, pool));
+  job->end_revision = repos_baton.end_revision;
+
+  init_dump_options(&dump_options, &repos_baton);
+  return dump_to_destination(&chain, &repos_baton, &dump_options, pool);
 }
 
-/* Print a simple usage string. */
-static svn_error_t *
-usage(const char *progname,
-      apr_pool_t *pool)
+/* Claim the jobs of WORKER's run one at a time and dump them, until
+ * there are none left.  A failed dump is recorded in its job and
+ * doesn't stop the others.
+ */
+static void
+run_many_dump_jobs(struct many_dump_worker *worker)
 {
-  return svn_cmdline_fprintf(stderr, pool,
-                             _("Type '%s help' for usage.\n"),
-                             ensure_appname(progname, pool));
+  struct many_dump_baton *mb = worker->mb;
+  apr_pool_t *iterpool = svn_pool_create(worker->pool);
+
+  while (1)
+    {
+      struct many_dump_job *job;
+      apr_time_t start;
+
+#if APR_HAS_THREADS
+      if (mb->mutex)
+        apr_thread_mutex_lock(mb->mutex);
+#endif
+      job = (mb->next_job < mb->njobs) ? &mb->jobs[mb->next_job++] : NULL;
+#if APR_HAS_THREADS
+      if (mb->mutex)
+        apr_thread_mutex_unlock(mb->mutex);
+#endif
+      if (! job)
+        break;
+
+      svn_pool_clear(iterpool);
+      start = apr_time_now();
+      job->err = check_cancel(NULL);
+      if (! job->err)
+        job->err = dump_one_repository(job, worker->ctx, mb, iterpool);
+      job->elapsed = apr_time_now() - start;
+
+      if (! job->err && ! mb->opt_baton->quiet)
+        svn_error_clear(svn_cmdline_fprintf(stderr, iterpool,
+                                            _("* Dumped %s.\n"), job->url));
+    }
+
+  svn_pool_destroy(iterpool);
 }
 
-/* Print information about the version of this program and dependent
- * modules.
+#if APR_HAS_THREADS
+/* Thread body of a "dump-many" worker.  DATA is a struct
+ * many_dump_worker. */
+static void * APR_THREAD_FUNC
+many_dump_thread(apr_thread_t *tid,
+                 void *data)
+{
+  run_many_dump_jobs(data);
+  apr_thread_exit(tid, APR_SUCCESS);
+  return NULL;
+}
+#endif
+
+/* Print a line per failed job of MB, and unless quiet one per
+ * successful job and the totals, taking TOTAL to run, to stderr.
+ * Use POOL for temporary allocations.
  */
 static svn_error_t *
-version(const char *progname,
-        apr_pool_t *pool)
+print_many_dump_summary(const struct many_dump_baton *mb,
+                        apr_interval_time_t total,
+                        apr_pool_t *pool)
 {
-  svn_stringbuf_t *version_footer = 
-    svn_stringbuf_create(_("The following repository access (RA) modules "
-                           "are available:\n\n"),
-                         pool);
+  svn_boolean_t quiet = mb->opt_baton->quiet;
+  int failed = 0;
+  int i;
 
-  SVN_ERR(svn_ra_print_modules(version_footer, pool));
-  return svn_opt_print_help3(NULL, ensure_appname(progname, pool),
-                             TRUE, FALSE, version_footer->data,
-                             NULL, NULL, NULL, NULL, NULL, pool);
+  for (i = 0; i < mb->njobs; i++)
+    {
+      const struct many_dump_job *job = &mb->jobs[i];
+      double seconds = (double)job->elapsed / APR_USEC_PER_SEC;
+
+      if (job->err)
+        {
+          failed++;
+          SVN_ERR(svn_cmdline_fprintf(stderr, pool,
+                                      _("* FAILED %s after %.2f s:\n"),
+                                      job->url, seconds));
+          svn_handle_error2(job->err, stderr, FALSE, "svnrdump:   ");
+        }
+      else if (! quiet)
+        SVN_ERR(svn_cmdline_fprintf(stderr, pool,
+                                    _("* OK     %s: revisions 0-%ld to %s in "
+                                      "%.2f s\n"),
+                                    job->url, job->end_revision,
+                                    svn_dirent_local_style(job->output_file,
+                                                           pool),
+                                    seconds));
+    }
+
+  if (! quiet || failed)
+    SVN_ERR(svn_cmdline_fprintf(stderr, pool,
+                                _("* Dumped %d of %d repositories in "
+                                  "%.2f s.\n"),
+                                mb->njobs - failed, mb->njobs,
+                                (double)total / APR_USEC_PER_SEC));
+  return SVN_NO_ERROR;
 }
 
+/* Handle the "dump-many" subcommand.  Implements
+ * `svn_opt_subcommand_t'.  */
+static svn_error_t *
+dump_many_cmd(apr_getopt_t *os,
+              void *baton,
+              apr_pool_t *pool)
+{
+  opt_baton_t *opt_baton = baton;
+  struct many_dump_baton *mb = apr_pcalloc(pool, sizeof(*mb));
+  struct many_dump_worker *workers;
+  const char *listfile;
+  apr_time_t start = apr_time_now();
+  svn_error_t *err = SVN_NO_ERROR;
+  int nworkers = opt_baton->jobs;
+  int i;
 
-/* A statement macro, similar to @c SVN_ERR, but returns an integer.
- * Evaluate @a expr. If it yields an error, handle that error and
- * return @c EXIT_FAILURE.
- */
-#define SVNRDUMP_ERR(expr)                                               \
-  do                                                                     \
-    {                                                                    \
-      svn_error_t *svn_err__temp = (expr);                               \
-      if (svn_err__temp)                                                 \
-        {                                                                \
-          svn_handle_error2(svn_err__temp, stderr, FALSE, "svnrdump: "); \
-          svn_error_clear(svn_err__temp);                                \
-          return EXIT_FAILURE;                                           \
-        }                                                                \
-    }                                                                    \
-  while (0)
+  mb->opt_baton = opt_baton;
+  SVN_ERR(svn_utf_cstring_to_utf8(&listfile, os->argv[os->ind], pool));
+  listfile = svn_dirent_internal_style(listfile, pool);
+  SVN_ERR(read_many_dump_list(mb, listfile, pool));
+  if (mb->njobs == 0)
+    return SVN_NO_ERROR;
 
-/* Handle the "dump" subcommand.  Implements `svn_opt_subcommand_t'.  */
+  if (nworkers > mb->njobs)
+    nworkers = mb->njobs;
+
+  /* Sessions are opened by the workers, so prompts from several of
+     them at once would fight over the terminal.  Concurrent jobs
+     authenticate without prompting. */
+  if (nworkers > 1)
+    opt_baton->non_interactive = TRUE;
+
+  /* Each worker has a context and a configuration of its own: the
+     cached credentials of an auth baton, and the values svn_config_t
+     expands as they are read, aren't safe to share between
+     threads. */
+  SVN_ERR(svn_ra_initialize(pool));
+  workers = apr_pcalloc(pool, nworkers * sizeof(*workers));
+  for (i = 0; i < nworkers && ! err; i++)
+    {
+      apr_hash_t *config;
+
+      workers[i].mb = mb;
+      workers[i].pool = svn_pool_create(NULL);
+      err = load_config(&config, opt_baton->config_dir,
+                        opt_baton->config_options, workers[i].pool);
+      if (! err)
+        err = create_client_context(&workers[i].ctx, config,
+                                    opt_baton->non_interactive,
+                                    opt_baton->username,
+                                    opt_baton->password,
+                                    opt_baton->config_dir,
+                                    opt_baton->no_auth_cache,
+                                    workers[i].pool);
+    }
+
+#if APR_HAS_THREADS
+  if (! err && nworkers > 1)
+    {
+      apr_thread_t **threads = apr_pcalloc(pool,
+                                           nworkers * sizeof(*threads));
+      apr_status_t status;
+
+      status = apr_thread_mutex_create(&mb->mutex, APR_THREAD_MUTEX_DEFAULT,
+                                       pool);
+      if (status)
+        err = svn_error_wrap_apr(status, _("Can't create thread lock"));
+      for (i = 0; i < nworkers && ! err; i++)
+        {
+          status = apr_thread_create(&threads[i], NULL, many_dump_thread,
+                                     &workers[i], pool);
+          if (status)
+            err = svn_error_wrap_apr(status, _("Can't create dump thread"));
+        }
+
+      /* The threads that did start work through all the jobs. */
+      if (threads[0])
+        {
+          svn_error_clear(err);
+          err = SVN_NO_ERROR;
+        }
+
+      for (i = 0; i < nworkers; i++)
+        if (threads[i])
+          {
+            apr_status_t retval;
+            apr_thread_join(&retval, threads[i]);
+          }
+    }
+  else
+#endif
+  if (! err)
+    run_many_dump_jobs(&workers[0]);
+
+  for (i = 0; i < nworkers; i++)
+    if (workers[i].pool)
+      svn_pool_destroy(workers[i].pool);
+  if (err)
+    return err;
+
+  SVN_ERR(print_many_dump_summary(mb, apr_time_now() - start, pool));
+
+  for (i = 0; i < mb->njobs; i++)
+    if (mb->jobs[i].err)
+      {
+        if (! err)
+          err = svn_error_createf(mb->jobs[i].err->apr_err, NULL,
+                                  _("Some repositories could not be "
+                                    "dumped"));
+        svn_error_clear(mb->jobs[i].err);
+      }
+
+  return err;
+}
+
+/* Handle the "plan" subcommand.  Implements `svn_opt_subcommand_t'.  */
 static svn_error_t *
-dump_cmd(apr_getopt_t *os,
+plan_cmd(apr_getopt_t *os,
          void *baton,
          apr_pool_t *pool)
 {
   opt_baton_t *opt_baton = baton;
-  return replay_revisions(opt_baton->session, opt_baton->url,
-                          opt_baton->start_revision, opt_baton->end_revision,
-                          opt_baton->quiet, pool);
+  apr_array_header_t *parts;
+  apr_uint64_t total;
+  int i;
+
+  if (opt_baton->parts < 1)
+    return svn_error_create(SVN_ERR_CL_ARG_PARSING_ERROR, NULL,
+                            _("plan requires --parts"));
+
+  SVN_ERR(plan_dump(&parts, &total, opt_baton->session,
+                    opt_baton->start_revision, opt_baton->end_revision,
+                    opt_baton->parts, opt_baton->probe_sizes,
+                    check_cancel, NULL, pool));
+
+  for (i = 0; i < parts->nelts; i++)
+    {
+      const struct plan_part *part = &APR_ARRAY_IDX(parts, i,
+                                                    struct plan_part);
+
+      SVN_ERR(svn_cmdline_printf(pool, "%ld:%ld %" APR_UINT64_T_FMT "\n",
+                                 part->start_revision, part->end_revision,
+                                 part->estimated_size));
+    }
+
+  if (! opt_baton->quiet)
+    SVN_ERR(svn_cmdline_fprintf(stderr, pool,
+                                _("* Predicted dump size: %" APR_UINT64_T_FMT
+                                  " bytes in %d parts.\n"),
+                                total, parts->nelts));
+  return svn_cmdline_fflush(stdout);
 }
 
 /* Handle the "load" subcommand.  Implements `svn_opt_subcommand_t'.  */
@@ -497,6 +3597,8 @@ main(int argc, const char **argv)
   apr_array_header_t *config_options = NULL;
   apr_getopt_t *os;
   const char *first_arg;
+  apr_array_header_t *received_opts;
+  int i;
 
   if (svn_cmdline_init ("svnrdump", stderr) != EXIT_SUCCESS)
     return EXIT_FAILURE;
@@ -506,10 +3608,23 @@ main(int argc, const char **argv)
   opt_baton->start_revision = svn_opt_revision_unspecified;
   opt_baton->end_revision = svn_opt_revision_unspecified;
   opt_baton->url = NULL;
+  opt_baton->spill_threshold = SPILLBUF_DEFAULT_THRESHOLD;
+  opt_baton->jobs = 1;
+  opt_baton->output_buffer = OUTPUT_SINK_DEFAULT_BUFFER_SIZE;
+  opt_baton->flush_policy = output_flush_when_full;
+  opt_baton->tee_policy = fanout_block;
+  opt_baton->tee_stall_limit = FANOUT_DEFAULT_STALL_LIMIT;
+  opt_baton->retries = 3;
+  opt_baton->fulltext_cache_size = FULLTEXT_DEFAULT_CACHE_SIZE;
+  opt_baton->poll_interval = apr_time_from_sec(2);
+  opt_baton->compress_level = -1;
+  opt_baton->compress_threads = 1;
+  opt_baton->svndiff_level = -1;
 
   SVNRDUMP_ERR(svn_cmdline__getopt_init(&os, argc, argv, pool));
 
   os->interleave = TRUE; /* Options and arguments can be interleaved */
+  received_opts = apr_array_make(pool, SVN_OPT_MAX_OPTIONS, sizeof(int));
 
   /* Set up our cancellation support. */
   apr_signal(SIGINT, signal_handler);
@@ -549,6 +3664,9 @@ main(int argc, const char **argv)
           exit(EXIT_FAILURE);
         }
 
+      /* Stash the option code in an array before parsing it. */
+      APR_ARRAY_PUSH(received_opts, int) = opt;
+
       switch(opt)
         {
         case 'r':
@@ -595,6 +3713,248 @@ main(int argc, const char **argv)
         case opt_non_interactive:
           non_interactive = TRUE;
           break;
+        case opt_resume:
+          SVNRDUMP_ERR(svn_utf_cstring_to_utf8(&(opt_baton->resume_file),
+                                               opt_arg, pool));
+          opt_baton->resume_file =
+            svn_dirent_internal_style(opt_baton->resume_file, pool);
+          break;
+        case opt_output_queue:
+          if (! parse_int(&opt_baton->output_queue, opt_arg, 0,
+                          APR_INT32_MAX))
+            {
+              SVN_INT_ERR(svn_cmdline_fprintf(stderr, pool,
+                                              _("Invalid queue length "
+                                                "'%s'\n"), opt_arg));
+              exit(EXIT_FAILURE);
+            }
+          break;
+        case opt_spill_threshold:
+          SVNRDUMP_ERR(parse_size(&(opt_baton->spill_threshold), opt_arg,
+                                  pool));
+          break;
+        case opt_stats:
+          opt_baton->stats = TRUE;
+          break;
+        case opt_revprops_only:
+          opt_baton->revprops_only = TRUE;
+          break;
+        case opt_no_content:
+          opt_baton->no_content = TRUE;
+          break;
+        case opt_base_snapshot:
+          opt_baton->base_snapshot = TRUE;
+          break;
+        case opt_revision_length:
+          opt_baton->revision_length = TRUE;
+          break;
+        case opt_fulltext:
+          SVNRDUMP_ERR(svn_utf_cstring_to_utf8(&(opt_baton->fulltext_dir),
+                                               opt_arg, pool));
+          opt_baton->fulltext_dir =
+            svn_dirent_internal_style(opt_baton->fulltext_dir, pool);
+          break;
+        case opt_fulltext_cache_size:
+          SVNRDUMP_ERR(parse_size(&(opt_baton->fulltext_cache_size), opt_arg,
+                                  pool));
+          break;
+        case opt_include:
+          SVNRDUMP_ERR(add_path_prefix(&(opt_baton->include_prefixes),
+                                       opt_arg, pool));
+          break;
+        case opt_exclude:
+          SVNRDUMP_ERR(add_path_prefix(&(opt_baton->exclude_prefixes),
+                                       opt_arg, pool));
+          break;
+        case opt_drop_prop:
+          {
+            const char *name;
+
+            SVNRDUMP_ERR(svn_utf_cstring_to_utf8(&name, opt_arg, pool));
+            if (! opt_baton->drop_props)
+              opt_baton->drop_props = apr_hash_make(pool);
+            apr_hash_set(opt_baton->drop_props, name, APR_HASH_KEY_STRING,
+                         name);
+          }
+          break;
+        case opt_split_by:
+          if (! opt_baton->split_by)
+            opt_baton->split_by = apr_array_make(pool, 4,
+                                                 sizeof(const char *));
+          APR_ARRAY_PUSH(opt_baton->split_by, const char *) = opt_arg;
+          break;
+        case opt_drop_empty_revs:
+          opt_baton->drop_empty_revs = TRUE;
+          break;
+        case opt_tee:
+          if (! opt_baton->tees)
+            opt_baton->tees = apr_array_make(pool, 4, sizeof(const char *));
+          APR_ARRAY_PUSH(opt_baton->tees, const char *) = opt_arg;
+          break;
+        case opt_tee_policy:
+          if (strcmp(opt_arg, "block") == 0)
+            opt_baton->tee_policy = fanout_block;
+          else if (strcmp(opt_arg, "drop") == 0)
+            opt_baton->tee_policy = fanout_drop;
+          else if (strcmp(opt_arg, "fail") == 0)
+            opt_baton->tee_policy = fanout_fail;
+          else
+            {
+              SVN_INT_ERR(svn_cmdline_fprintf(stderr, pool,
+                                              _("Invalid tee policy "
+                                                "'%s'\n"), opt_arg));
+              exit(EXIT_FAILURE);
+            }
+          break;
+        case opt_tee_stall_limit:
+          {
+            int msec;
+
+            if (! parse_int(&msec, opt_arg, 1, APR_INT32_MAX))
+              {
+                SVN_INT_ERR(svn_cmdline_fprintf(stderr, pool,
+                                                _("Invalid stall limit "
+                                                  "'%s'\n"), opt_arg));
+                exit(EXIT_FAILURE);
+              }
+            opt_baton->tee_stall_limit = apr_time_from_msec(msec);
+          }
+          break;
+        case opt_output:
+          SVNRDUMP_ERR(svn_utf_cstring_to_utf8(&(opt_baton->output_file),
+                                               opt_arg, pool));
+          opt_baton->output_file =
+            svn_dirent_internal_style(opt_baton->output_file, pool);
+          break;
+        case opt_io_uring:
+          opt_baton->io_uring = TRUE;
+          break;
+        case opt_direct:
+          opt_baton->direct = TRUE;
+          break;
+        case opt_preallocate:
+          SVNRDUMP_ERR(parse_size(&(opt_baton->preallocate), opt_arg, pool));
+          break;
+        case opt_output_buffer:
+          SVNRDUMP_ERR(parse_size(&(opt_baton->output_buffer), opt_arg,
+                                  pool));
+          break;
+        case opt_flush:
+          if (strcmp(opt_arg, "full") == 0)
+            opt_baton->flush_policy = output_flush_when_full;
+          else if (strcmp(opt_arg, "revision") == 0)
+            opt_baton->flush_policy = output_flush_at_revision;
+          else
+            {
+              SVN_INT_ERR(svn_cmdline_fprintf(stderr, pool,
+                                              _("Invalid flush policy "
+                                                "'%s'\n"), opt_arg));
+              exit(EXIT_FAILURE);
+            }
+          break;
+        case opt_svndiff_version:
+          if (! parse_int(&opt_baton->svndiff_version, opt_arg, 0,
+                          DUMP_MAX_SVNDIFF_VERSION))
+            {
+              SVN_INT_ERR(svn_cmdline_fprintf(stderr, pool,
+                                              _("Unsupported svndiff "
+                                                "version '%s'\n"), opt_arg));
+              exit(EXIT_FAILURE);
+            }
+          break;
+        case opt_svndiff_level:
+          if (! parse_int(&opt_baton->svndiff_level, opt_arg,
+                          SVN_DELTA_COMPRESSION_LEVEL_NONE,
+                          SVN_DELTA_COMPRESSION_LEVEL_MAX))
+            {
+              SVN_INT_ERR(svn_cmdline_fprintf(stderr, pool,
+                                              _("Invalid compression level "
+                                                "'%s'\n"), opt_arg));
+              exit(EXIT_FAILURE);
+            }
+          break;
+        case opt_compress:
+          opt_baton->compress = opt_arg;
+          break;
+        case opt_compress_level:
+          /* The maximum depends on the format; see
+             compress_check_level(). */
+          if (! parse_int(&opt_baton->compress_level, opt_arg, -1,
+                          APR_INT32_MAX))
+            {
+              SVN_INT_ERR(svn_cmdline_fprintf(stderr, pool,
+                                              _("Invalid compression level "
+                                                "'%s'\n"), opt_arg));
+              exit(EXIT_FAILURE);
+            }
+          break;
+        case opt_compress_threads:
+          if (! parse_int(&opt_baton->compress_threads, opt_arg, 0,
+                          APR_INT32_MAX))
+            {
+              SVN_INT_ERR(svn_cmdline_fprintf(stderr, pool,
+                                              _("Invalid number of "
+                                                "compression threads "
+                                                "'%s'\n"), opt_arg));
+              exit(EXIT_FAILURE);
+            }
+          break;
+        case opt_follow:
+          opt_baton->follow = TRUE;
+          break;
+        case opt_poll_interval:
+          {
+            int sec;
+
+            if (! parse_int(&sec, opt_arg, 1, APR_INT32_MAX))
+              {
+                SVN_INT_ERR(svn_cmdline_fprintf(stderr, pool,
+                                                _("Invalid poll interval "
+                                                  "'%s'\n"), opt_arg));
+                exit(EXIT_FAILURE);
+              }
+            opt_baton->poll_interval = apr_time_from_sec(sec);
+          }
+          break;
+        case opt_parts:
+          if (! parse_int(&opt_baton->parts, opt_arg, 1, APR_INT32_MAX))
+            {
+              SVN_INT_ERR(svn_cmdline_fprintf(stderr, pool,
+                                              _("Invalid number of parts "
+                                                "'%s'\n"), opt_arg));
+              exit(EXIT_FAILURE);
+            }
+          break;
+        case opt_probe_sizes:
+          opt_baton->probe_sizes = TRUE;
+          break;
+        case opt_retries:
+          if (! parse_int(&opt_baton->retries, opt_arg, 0, APR_INT32_MAX))
+            {
+              SVN_INT_ERR(svn_cmdline_fprintf(stderr, pool,
+                                              _("Invalid number of retries "
+                                                "'%s'\n"), opt_arg));
+              exit(EXIT_FAILURE);
+            }
+          break;
+        case opt_jobs:
+          if (! parse_int(&opt_baton->jobs, opt_arg, 1, APR_INT32_MAX))
+            {
+              SVN_INT_ERR(svn_cmdline_fprintf(stderr, pool,
+                                              _("Invalid number of jobs "
+                                                "'%s'\n"), opt_arg));
+              exit(EXIT_FAILURE);
+            }
+#if ! APR_HAS_THREADS
+          if (opt_baton->jobs > 1)
+            {
+              SVN_INT_ERR(svn_cmdline_fprintf(stderr, pool,
+                                              _("--jobs requires thread "
+                                                "support\n")));
+              exit(EXIT_FAILURE);
+            }
+#endif
+          break;
         case opt_config_option:
           if (!config_options)
               config_options =
@@ -642,6 +4002,54 @@ main(int argc, const char **argv)
       exit(EXIT_SUCCESS);
     }
 
+  /* Check that the subcommand wasn't passed any inappropriate
+     options: dump-many, for one, runs every job with the options it
+     was given, and most of those of dump don't make sense there. */
+  for (i = 0; i < received_opts->nelts; i++)
+    {
+      int opt_id = APR_ARRAY_IDX(received_opts, i, int);
+
+      if (! svn_opt_subcommand_takes_option3(subcommand, opt_id,
+                                             svnrdump__global_options))
+        {
+          const char *optstr;
+          const apr_getopt_option_t *badopt =
+            svn_opt_get_option_from_code2(opt_id, svnrdump__options,
+                                          subcommand, pool);
+
+          svn_opt_format_option(&optstr, badopt, FALSE, pool);
+          svn_error_clear(svn_cmdline_fprintf(stderr, pool,
+                                              _("Subcommand '%s' doesn't "
+                                                "accept option '%s'\n"
+                                                "Type 'svnrdump help %s' "
+                                                "for usage.\n"),
+                                              subcommand->name, optstr,
+                                              subcommand->name));
+          svn_pool_destroy(pool);
+          exit(EXIT_FAILURE);
+        }
+    }
+
+  opt_baton->non_interactive = non_interactive;
+  opt_baton->username = username;
+  opt_baton->password = password;
+  opt_baton->config_dir = config_dir;
+  opt_baton->no_auth_cache = no_auth_cache;
+  opt_baton->config_options = config_options;
+
+  /* dump-many finds its URLs in the file it is given. */
+  if (strcmp(subcommand->name, "dump-many") == 0)
+    {
+      if (os->ind != os->argc - 1)
+        {
+          SVNRDUMP_ERR(usage(argv[0], pool));
+          exit(EXIT_FAILURE);
+        }
+      SVNRDUMP_ERR((*subcommand->cmd_func)(os, opt_baton, pool));
+      svn_pool_destroy(pool);
+      return EXIT_SUCCESS;
+    }
+
   /* Only continue if the only not option argument is a url */
   if ((os->ind != os->argc-1)
       || !svn_path_is_url(os->argv[os->ind]))
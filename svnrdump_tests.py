@@ -25,7 +25,7 @@
 ######################################################################
 
 # General modules
-import sys, os
+import sys, os, re, zlib, time, signal, subprocess
 
 # Our testing module
 import svntest
@@ -66,11 +66,12 @@ def build_repos(sbox):
   svntest.main.create_repos(sbox.repo_dir)
 
 def run_dump_test(sbox, dumpfile_name, expected_dumpfile_name = None,
-                  subdir = None):
+                  subdir = None, extra_args = []):
   """Load a dumpfile using 'svnadmin load', dump it with 'svnrdump
   dump' and check that the same dumpfile is produced or that
   expected_dumpfile_name is produced if provided. Additionally, the
-  subdir argument appends itself to the URL"""
+  subdir argument appends itself to the URL and extra_args are passed
+  on to 'svnrdump dump'"""
 
   # Create an empty sanbox repository
   build_repos(sbox)
@@ -95,7 +96,7 @@ def run_dump_test(sbox, dumpfile_name, expected_dumpfile_name = None,
   svnrdump_dumpfile = \
       svntest.actions.run_and_verify_svnrdump(None, svntest.verify.AnyOutput,
                                               [], 0, '-q', 'dump',
-                                              repo_url)
+                                              repo_url, *extra_args)
 
   if expected_dumpfile_name:
     svnadmin_dumpfile = open(os.path.join(svnrdump_tests_dir,
@@ -107,6 +108,64 @@ def run_dump_test(sbox, dumpfile_name, expected_dumpfile_name = None,
     "Dump files", "DUMP", svnadmin_dumpfile, svnrdump_dumpfile,
     None, mismatched_headers_re)
 
+def decompress_gzip(data):
+  """Return data, a series of gzip members as written by svnrdump
+  --compress gzip, decompressed"""
+
+  contents = ''
+  while data:
+    decompressor = zlib.decompressobj(zlib.MAX_WBITS + 16)
+    contents += decompressor.decompress(data)
+    data = decompressor.unused_data
+  return contents
+
+def svnrdump_dump(sbox, *args):
+  """Dump the sbox repository with 'svnrdump dump -q' and args and
+  return the lines of its standard output"""
+
+  return \
+      svntest.actions.run_and_verify_svnrdump(None, svntest.verify.AnyOutput,
+                                              [], 0, '-q', 'dump',
+                                              sbox.repo_url, *args)
+
+def run_variant_dump_test(sbox, extra_args, outputs = [None],
+                          expected_stderr = []):
+  """Build the standard sbox repository, dump it with 'svnrdump dump',
+  then again with extra_args, and check that every output of the
+  second dump is the same dumpfile.  An output is a file name, None
+  for the standard output, or a pair of either and a function
+  decoding its contents first.  Return the standard output lines of
+  the second dump."""
+
+  sbox.build(read_only = True, create_wc = False)
+  full_dump = svnrdump_dump(sbox)
+
+  if None in outputs or None in [output[0] for output in outputs
+                                  if isinstance(output, tuple)]:
+    expected_stdout = svntest.verify.AnyOutput
+  else:
+    expected_stdout = []
+  variant_dump = \
+      svntest.actions.run_and_verify_svnrdump(None, expected_stdout,
+                                              expected_stderr, 0, '-q',
+                                              'dump', sbox.repo_url,
+                                              *extra_args)
+
+  for output in outputs:
+    decode = None
+    if isinstance(output, tuple):
+      output, decode = output
+    if output is None:
+      data = ''.join(variant_dump)
+    else:
+      data = open(output, 'rb').read()
+    if decode:
+      data = decode(data)
+    svntest.verify.compare_and_display_lines(
+      "Dump files", "DUMP", full_dump, data.splitlines(True))
+
+  return variant_dump
+
 def run_load_test(sbox, dumpfile_name, expected_dumpfile_name = None):
   """Load a dumpfile using 'svnrdump load', dump it with 'svnadmin
   dump' and check that the same dumpfile is produced"""
@@ -317,6 +376,533 @@ def descend_into_replace_dump(sbox):
   run_dump_test(sbox, "descend-into-replace.dump", subdir='/trunk/H',
                 expected_dumpfile_name = "descend-into-replace.expected.dump")
 
+def spill_all_deltas_dump(sbox):
+  "dump: text deltas spilled to disk"
+  run_dump_test(sbox, "modified-in-place.dump",
+                extra_args=['--spill-threshold', '0'])
+
+def parallel_dump(sbox):
+  "dump: with several concurrent jobs"
+  run_dump_test(sbox, "skeleton.dump", extra_args=['--jobs', '3'])
+
+def output_queue_dump(sbox):
+  "dump: through an output writer thread"
+  run_dump_test(sbox, "copy-and-modify.dump",
+                extra_args=['--output-queue', '2'])
+
+def small_output_buffer_dump(sbox):
+  "dump: small output buffer flushed per revision"
+  run_dump_test(sbox, "copy-and-modify.dump",
+                extra_args=['--output-buffer', '1K', '--flush', 'revision'])
+
+def resume_dump(sbox):
+  "dump: resume an interrupted dump"
+  sbox.build(read_only = True, create_wc = False)
+
+  full_dump = svnrdump_dump(sbox)
+
+  # Simulate a dump that died in the middle of a record.
+  partial_file = sbox.get_tempname('partial-dump')
+  contents = ''.join(full_dump)
+  open(partial_file, 'wb').write(contents[:len(contents) * 2 // 3])
+
+  svntest.actions.run_and_verify_svnrdump(None, [], [], 0, '-q', 'dump',
+                                          sbox.repo_url,
+                                          '--resume', partial_file)
+
+  svntest.verify.compare_and_display_lines(
+    "Dump files", "DUMP", full_dump, open(partial_file, 'rb').readlines())
+
+  # A file that ends before LOWER can't be resumed from there without a
+  # gap, and is left alone.
+  partial = contents[:contents.index('Revision-number: 1\n')]
+  open(partial_file, 'wb').write(partial)
+  svntest.actions.run_and_verify_svnrdump(None, [], svntest.verify.AnyOutput,
+                                          1, '-q', 'dump', sbox.repo_url,
+                                          '-r', '1', '--resume', partial_file)
+  if open(partial_file, 'rb').read() != partial:
+    raise svntest.Failure('%s was changed' % partial_file)
+
+def spill_to_file_dump(sbox):
+  "dump: spilled deltas copied into a dumpfile"
+  sbox.build(read_only = True, create_wc = False)
+  full_dump = svnrdump_dump(sbox)
+
+  # Spool every delta, so that all of them are copied from the spool
+  # file to the dumpfile; without retries, revisions aren't buffered on
+  # the way.
+  dump_file = sbox.get_tempname('dump')
+  exit_code, output, errput = \
+      svntest.main.run_svnrdump(None, 'dump', '-q', sbox.repo_url,
+                                '--spill-threshold', '0', '--retries', '0',
+                                '--output', dump_file, '--stats')
+  if exit_code != 0 or output:
+    raise svntest.Failure("dump failed: %s" % errput)
+  svntest.verify.compare_and_display_lines(
+    "Dump files", "DUMP", full_dump, open(dump_file, 'rb').readlines())
+
+  # On Linux, the kernel moves all of them.
+  stats = None
+  for line in errput:
+    stats = stats or re.match(r'\* Text deltas: \d+, spilled to disk: \d+ '
+                              r'\((\d+) bytes\), moved by the kernel: '
+                              r'(\d+) bytes', line)
+  if not stats:
+    raise svntest.Failure("No delta statistics: %s" % errput)
+  spilled, kernel_copied = int(stats.group(1)), int(stats.group(2))
+  if spilled == 0:
+    raise svntest.Failure("No deltas spilled")
+  if sys.platform.startswith('linux') and kernel_copied != spilled:
+    raise svntest.Failure("Only %d of %d spilled bytes moved by the kernel"
+                          % (kernel_copied, spilled))
+
+def output_file_dump(sbox):
+  "dump: to a file through io_uring"
+
+  # Systems without io_uring fall back to a writer thread, with a
+  # warning.
+  dump_file = sbox.get_tempname('dump')
+  run_variant_dump_test(sbox, ['--output', dump_file, '--io-uring',
+                               '--direct', '--output-buffer', '8K'],
+                        outputs = [dump_file], expected_stderr = None)
+
+def compressed_dump(sbox):
+  "dump: gzip-compressed output"
+
+  # The output is a series of gzip members, one per block.
+  run_variant_dump_test(sbox, ['--compress', 'gzip',
+                               '--compress-threads', '2'],
+                        outputs = [(None, decompress_gzip)])
+
+def svndiff1_dump(sbox):
+  "dump: svndiff1 text deltas"
+  svnrdump_tests_dir = os.path.join(os.path.dirname(sys.argv[0]),
+                                   'svnrdump_tests_data')
+  expected_dumpfile = open(os.path.join(svnrdump_tests_dir,
+                                        'modified-in-place.dump'),
+                           'rb').readlines()
+
+  build_repos(sbox)
+  svntest.actions.run_and_verify_load(sbox.repo_dir, expected_dumpfile)
+  svndiff1_dumpfile = svnrdump_dump(sbox, '--svndiff-version', '1')
+
+  # The compressed deltas must load back into the same history.
+  build_repos(sbox)
+  svntest.actions.run_and_verify_load(sbox.repo_dir, svndiff1_dumpfile)
+  svnrdump_dumpfile = svnrdump_dump(sbox)
+
+  svntest.verify.compare_and_display_lines(
+    "Dump files", "DUMP", expected_dumpfile, svnrdump_dumpfile,
+    None, mismatched_headers_re)
+
+def filtered_dump(sbox):
+  "dump: --exclude and --drop-prop"
+  sbox.build()
+  svntest.actions.run_and_verify_svn(None, None, [], 'propset',
+                                     'secret', 'x',
+                                     os.path.join(sbox.wc_dir, 'A', 'mu'))
+  svntest.actions.run_and_verify_svn(None, None, [], 'commit',
+                                     '-m', 'prop', sbox.wc_dir)
+
+  filtered = svnrdump_dump(sbox, '--exclude', '/A/B/', '--drop-prop', 'secret')
+  for line in filtered:
+    if line.startswith('Node-path: A/B') or line.startswith('secret'):
+      raise svntest.Failure("Filtered content dumped: " + line)
+
+  # What is left must still load.
+  build_repos(sbox)
+  svntest.actions.run_and_verify_load(sbox.repo_dir, filtered)
+
+  # Copying from a path that is left out can't be dumped.
+  svntest.actions.run_and_verify_svn(None, None, [], 'copy',
+                                     '-m', 'copy', sbox.repo_url + '/A',
+                                     sbox.repo_url + '/A2')
+  svntest.actions.run_and_verify_svnrdump(None, svntest.verify.AnyOutput,
+                                          svntest.verify.AnyOutput, 1,
+                                          '-q', 'dump', sbox.repo_url,
+                                          '--exclude', 'A')
+
+def split_dump(sbox):
+  "dump: split subtrees into separate dumpfiles"
+  sbox.build(create_wc = False)
+
+  b_file = sbox.get_tempname('B-dump')
+  g_file = sbox.get_tempname('G-dump')
+  svntest.actions.run_and_verify_svnrdump(None, [], [], 0, '-q', 'dump',
+                                          sbox.repo_url,
+                                          '--split-by', 'A/B=' + b_file,
+                                          '--split-by', '/A/D/G/=' + g_file)
+
+  # Each output holds its subtree, rooted at the prefix.
+  for dump_file, expected_paths in [
+      (b_file, ['E', 'E/alpha', 'E/beta', 'F', 'lambda']),
+      (g_file, ['pi', 'rho', 'tau'])]:
+    dumpfile = open(dump_file, 'rb').readlines()
+    paths = [line[len('Node-path: '):].rstrip('\n') for line in dumpfile
+             if line.startswith('Node-path: ')]
+    if sorted(paths) != expected_paths:
+      raise svntest.Failure("Unexpected nodes in split dump: %s" % paths)
+
+    build_repos(sbox)
+    svntest.actions.run_and_verify_load(sbox.repo_dir, dumpfile)
+
+def tee_dump(sbox):
+  "dump: --tee to extra outputs"
+  plain_file = sbox.get_tempname('tee-plain')
+  gzip_file = sbox.get_tempname('tee-gzip')
+  run_variant_dump_test(sbox, ['--tee', plain_file,
+                               '--tee', gzip_file + ',compress=gzip'],
+                        outputs = [None, plain_file,
+                                   (gzip_file, decompress_gzip)])
+
+def unbuffered_revisions_dump(sbox):
+  "dump: --retries 0 writes revisions unbuffered"
+  run_variant_dump_test(sbox, ['--retries', '0'])
+
+def wait_for_line(path, line, timeout = 30):
+  "Wait until file PATH contains LINE; fail after TIMEOUT seconds."
+  deadline = time.time() + timeout
+  while time.time() < deadline:
+    if os.path.exists(path) and line in open(path, 'rb').readlines():
+      return
+    time.sleep(0.2)
+  raise svntest.Failure("'%s' did not show up in the dump" % line.rstrip())
+
+def follow_dump(sbox):
+  "dump: --follow new revisions"
+  sbox.build(create_wc = False)
+
+  dump_file = sbox.get_tempname('follow-dump')
+  args = svntest.main._with_auth(svntest.main._with_config_dir(
+           ('dump', '-q', sbox.repo_url, '--follow', '--poll-interval', '1',
+            '--output', dump_file)))
+  proc = subprocess.Popen([svntest.main.svnrdump_binary] + list(args))
+  try:
+    wait_for_line(dump_file, 'Revision-number: 1\n')
+    svntest.actions.run_and_verify_svn(None, None, [], 'mkdir',
+                                       '-m', 'new', sbox.repo_url + '/new')
+    wait_for_line(dump_file, 'Revision-number: 2\n')
+  finally:
+    os.kill(proc.pid, signal.SIGINT)
+    exit_code = proc.wait()
+  if exit_code != 0:
+    raise svntest.Failure("svnrdump --follow exited with %d" % exit_code)
+
+  full_dump = svnrdump_dump(sbox)
+  svntest.verify.compare_and_display_lines(
+    "Dump files", "DUMP", full_dump, open(dump_file, 'rb').readlines())
+
+def dump_many(sbox):
+  "dump-many: several repositories from a list"
+  sbox.build(read_only = True, create_wc = False)
+
+  full_dump = svnrdump_dump(sbox)
+
+  dump_files = [sbox.get_tempname('many-1'), sbox.get_tempname('many-2')]
+  missing_file = sbox.get_tempname('many-missing')
+  list_file = sbox.get_tempname('many-list')
+  open(list_file, 'w').write(
+    '# url file\n'
+    '%s %s\n'
+    '\n'
+    '%s-missing %s\n'
+    '%s\t%s\n' % (sbox.repo_url, dump_files[0],
+                   sbox.repo_url, missing_file,
+                   sbox.repo_url, dump_files[1]))
+
+  # The missing repository fails the run, but not the other dumps.
+  svntest.actions.run_and_verify_svnrdump(None, [], svntest.verify.AnyOutput,
+                                          1, '-q', 'dump-many', list_file,
+                                          '--jobs', '2')
+  for dump_file in dump_files:
+    svntest.verify.compare_and_display_lines(
+      "Dump files", "DUMP", full_dump, open(dump_file, 'rb').readlines())
+
+  # Options of dump that don't apply to a list of repositories, like
+  # those that would have every job write to the same file, are refused.
+  for option in [['--resume', missing_file], ['--tee', missing_file],
+                 ['--follow'], ['-r', '1']]:
+    svntest.actions.run_and_verify_svnrdump(None, [],
+                                            svntest.verify.AnyOutput, 1,
+                                            '-q', 'dump-many', list_file,
+                                            *option)
+  if os.path.exists(missing_file):
+    raise svntest.Failure('dump-many wrote to %s' % missing_file)
+
+def plan_ranges(sbox):
+  "plan: balanced revision ranges"
+  sbox.build(create_wc = False)
+  for dir in ['X', 'Y']:
+    svntest.actions.run_and_verify_svn(None, None, [], 'mkdir',
+                                       '-m', 'mkdir', sbox.repo_url + '/' + dir)
+
+  # The import of the Greek tree in r1 outweighs the small commits
+  # after it.
+  for probe in [[], ['--probe-sizes']]:
+    exit_code, output, errput = \
+        svntest.main.run_svnrdump(None, 'plan', '-q', sbox.repo_url,
+                                  '--parts', '2', *probe)
+    if exit_code != 0 or errput:
+      raise svntest.Failure("plan failed: %s" % errput)
+    ranges = [line.split()[0] for line in output]
+    if ranges != ['0:1', '2:3']:
+      raise svntest.Failure("Unexpected plan: %s" % output)
+
+def no_content_dump(sbox):
+  "dump: --no-content skeleton"
+  sbox.build()
+  mu_path = os.path.join(sbox.wc_dir, 'A', 'mu')
+  svntest.main.file_append(mu_path, 'more text\n')
+  svntest.actions.run_and_verify_svn(None, None, [], 'propset',
+                                     'color', 'red', mu_path)
+  svntest.actions.run_and_verify_svn(None, None, [], 'commit',
+                                     '-m', 'change', sbox.wc_dir)
+
+  full_dump = svnrdump_dump(sbox)
+  skeleton = svnrdump_dump(sbox, '--no-content')
+
+  if skeleton[0] != 'SVN-rdump-skeleton-version: 1\n':
+    raise svntest.Failure("Skeleton dump not marked as such")
+  for line in skeleton:
+    if line.startswith('Text-content-length: ') or line.startswith('red'):
+      raise svntest.Failure("Content in skeleton dump: " + line)
+  if 'Text-changed: true\n' not in skeleton \
+     or 'Props-changed: true\n' not in skeleton:
+    raise svntest.Failure("Changes not noted in skeleton dump")
+
+  # The same nodes are there.
+  nodes = [line for line in full_dump if line.startswith('Node-')]
+  skeleton_nodes = [line for line in skeleton if line.startswith('Node-')]
+  svntest.verify.compare_and_display_lines(
+    "Node headers", "DUMP", nodes, skeleton_nodes)
+
+def revprops_only_dump(sbox):
+  "dump: --revprops-only"
+  sbox.build(create_wc = False)
+  svntest.actions.run_and_verify_svn(None, None, [], 'mkdir',
+                                     '-m', 'mkdir', sbox.repo_url + '/X')
+
+  full_dump = svnrdump_dump(sbox)
+  revprops_dump = svnrdump_dump(sbox, '--revprops-only')
+
+  # The revision records are those of the full dump, without nodes.
+  revisions = [line for line in full_dump
+               if line.startswith('Revision-number: ')]
+  for line in revprops_dump:
+    if line.startswith('Node-path: '):
+      raise svntest.Failure("Node in revprops dump: " + line)
+  svntest.verify.compare_and_display_lines(
+    "Revision records", "DUMP", revisions,
+    [line for line in revprops_dump if line.startswith('Revision-number: ')])
+  if 'mkdir\n' not in revprops_dump:
+    raise svntest.Failure("Log message missing from revprops dump")
+
+  build_repos(sbox)
+  svntest.actions.run_and_verify_load(sbox.repo_dir, revprops_dump)
+
+def base_snapshot_dump(sbox):
+  "dump: --base-snapshot of a later revision"
+  sbox.build(create_wc = False)
+  svntest.actions.run_and_verify_svn(None, None, [], 'mkdir',
+                                     '-m', 'mkdir', sbox.repo_url + '/X')
+  svntest.actions.run_and_verify_svn(None, None, [], 'copy', '-r', '1',
+                                     '-m', 'copy', sbox.repo_url + '/A',
+                                     sbox.repo_url + '/B')
+  exit_code, expected_tree, errput = \
+      svntest.main.run_svn(None, 'list', '-R', sbox.repo_url)
+
+  # The copy from r1 is made from the base revision r2 instead.
+  dump = svnrdump_dump(sbox, '-r', '2:3', '--base-snapshot')
+  if 'Node-copyfrom-rev: 2\n' not in dump:
+    raise svntest.Failure("Copy source not mapped to the base revision")
+
+  build_repos(sbox)
+  svntest.actions.run_and_verify_load(sbox.repo_dir, dump)
+  svntest.actions.run_and_verify_svn(None, expected_tree, [], 'list', '-R',
+                                     sbox.repo_url)
+
+def base_snapshot_changed_source_dump(sbox):
+  "dump: --base-snapshot with a changed copy source"
+  sbox.build()
+  mu_path = os.path.join(sbox.wc_dir, 'A', 'mu')
+  svntest.main.file_append(mu_path, 'more text\n')
+  svntest.actions.run_and_verify_svn(None, None, [], 'commit',
+                                     '-m', 'change', sbox.wc_dir)
+  svntest.actions.run_and_verify_svn(None, None, [], 'copy', '-r', '1',
+                                     '-m', 'copy', sbox.repo_url + '/A',
+                                     sbox.repo_url + '/B')
+  exit_code, expected_tree, errput = \
+      svntest.main.run_svn(None, 'list', '-R', sbox.repo_url)
+  exit_code, expected_mu, errput = \
+      svntest.main.run_svn(None, 'cat', sbox.repo_url + '/B/mu')
+
+  # A/mu changed after r1, so the base revision r2 can't stand in for
+  # the copy source; B is added as a tree instead.
+  dump = svnrdump_dump(sbox, '-r', '2:3', '--base-snapshot')
+  if 'Node-copyfrom-path: A\n' in dump:
+    raise svntest.Failure("Copy made from a changed base")
+
+  build_repos(sbox)
+  svntest.actions.run_and_verify_load(sbox.repo_dir, dump)
+  svntest.actions.run_and_verify_svn(None, expected_tree, [], 'list', '-R',
+                                     sbox.repo_url)
+  svntest.actions.run_and_verify_svn(None, expected_mu, [], 'cat',
+                                     sbox.repo_url + '/B/mu')
+
+def fulltext_dump(sbox):
+  "dump: --fulltext with a persistent cache"
+  sbox.build()
+  mu_path = os.path.join(sbox.wc_dir, 'A', 'mu')
+  svntest.main.file_append(mu_path, 'more text\n')
+  svntest.actions.run_and_verify_svn(None, None, [], 'propset',
+                                     'color', 'red', mu_path)
+  svntest.actions.run_and_verify_svn(None, None, [], 'commit',
+                                     '-m', 'change', sbox.wc_dir)
+  svntest.actions.run_and_verify_svn(None, None, [], 'copy', '-m', 'copy',
+                                     sbox.repo_url + '/A/mu',
+                                     sbox.repo_url + '/A/mu2')
+  svntest.main.file_append(mu_path, 'even more text\n')
+  svntest.actions.run_and_verify_svn(None, None, [], 'propset',
+                                     'shape', 'round', mu_path)
+  lambda_path = os.path.join(sbox.wc_dir, 'A', 'B', 'lambda')
+  svntest.actions.run_and_verify_svn(None, None, [], 'copy', lambda_path,
+                                     lambda_path + '2')
+  svntest.actions.run_and_verify_svn(None, None, [], 'commit',
+                                     '-m', 'change', sbox.wc_dir)
+
+  # The second run finds the text and the properties r4 changes, and the
+  # text of the unchanged copy, in the cache.
+  cache_dir = sbox.get_tempname('fulltext-cache')
+  dump = svnrdump_dump(sbox, '-r', '0:3', '--fulltext', cache_dir)
+  exit_code, output, errput = \
+      svntest.main.run_svnrdump(None, 'dump', '-q', '--stats',
+                                sbox.repo_url, '-r', '4',
+                                '--fulltext', cache_dir)
+  if exit_code != 0:
+    raise svntest.Failure("Incremental fulltext dump failed")
+  if not [line for line in errput
+          if line.startswith('* Fulltext cache: ') and ' 0 misses' in line]:
+    raise svntest.Failure("Incremental fulltext dump missed the cache")
+  dump += output[4:]
+
+  # The texts, checksums and property lists are those of svnadmin
+  # dump.
+  if 'Text-delta: true\n' in dump or 'Prop-delta: true\n' in dump:
+    raise svntest.Failure("Delta in fulltext dump")
+  texts = [line for line in dump if line.startswith('Text-')]
+  if 'Text-copy-source-sha1: ' not in ''.join(texts):
+    raise svntest.Failure("Copy source missing from fulltext dump")
+  svnadmin_dump = svntest.actions.run_and_verify_dump(sbox.repo_dir)
+  svntest.verify.compare_and_display_lines(
+    "Text headers", "DUMP",
+    sorted([line for line in svnadmin_dump if line.startswith('Text-')]),
+    sorted(texts))
+  svntest.verify.compare_and_display_lines(
+    "Property headers", "DUMP",
+    sorted([line for line in svnadmin_dump if line.startswith('Prop-')]),
+    sorted([line for line in dump if line.startswith('Prop-')]))
+  if 'color\n' not in dump[dump.index('Revision-number: 4\n'):]:
+    raise svntest.Failure("Unchanged property missing from r4")
+
+  build_repos(sbox)
+  svntest.actions.run_and_verify_load(sbox.repo_dir, dump)
+
+def dir_props_dump(sbox):
+  "dump: several directory property changes"
+  sbox.build()
+  A_path = os.path.join(sbox.wc_dir, 'A')
+  for name in ['p1', 'p2', 'p3']:
+    svntest.actions.run_and_verify_svn(None, None, [], 'propset',
+                                       name, 'v', A_path)
+  svntest.actions.run_and_verify_svn(None, None, [], 'commit',
+                                     '-m', 'props', sbox.wc_dir)
+
+  # One record with one property block for the directory.
+  dump = svnrdump_dump(sbox)
+  revision_2 = dump[dump.index('Revision-number: 2\n'):]
+  if revision_2.count('Node-path: A\n') != 1 \
+     or revision_2.count('PROPS-END\n') != 2:
+    raise svntest.Failure("Directory property changes not coalesced")
+
+  build_repos(sbox)
+  svntest.actions.run_and_verify_load(sbox.repo_dir, dump)
+  exit_code, output, errput = \
+      svntest.main.run_svn(None, 'proplist', sbox.repo_url + '/A')
+  if len([line for line in output if line.strip() in ['p1', 'p2', 'p3']]) != 3:
+    raise svntest.Failure("Directory properties lost: %s" % output)
+
+def revision_length_dump(sbox):
+  "dump: --revision-length"
+  sbox.build(create_wc = False)
+  svntest.actions.run_and_verify_svn(None, None, [], 'copy',
+                                     '-m', 'copy', sbox.repo_url + '/A',
+                                     sbox.repo_url + '/B')
+
+  plain_dump = svnrdump_dump(sbox)
+  for args in [[], ['--retries', '0'], ['--jobs', '2']]:
+    dump = svnrdump_dump(sbox, '--revision-length', *args)
+
+    # Each length leads from the end of the revision record to the next
+    # one, or to the end of the dump.
+    lengths = [line for line in dump
+               if line.startswith('SVN-rdump-Nodes-length: ')]
+    if len(lengths) != 3:
+      raise svntest.Failure("Lengths missing from dump: %s" % lengths)
+    data = ''.join(dump)
+    pos = data.index('Revision-number: ')
+    while pos < len(data):
+      header_end = data.index('\n\n', pos) + 2
+      headers = data[pos:header_end]
+      prop_length = int(headers.split('Content-length: ')[1].split('\n')[0])
+      nodes_length = \
+          int(headers.split('SVN-rdump-Nodes-length: ')[1].split('\n')[0])
+      pos = header_end + prop_length + 1 + nodes_length
+      if pos < len(data) and not data.startswith('Revision-number: ', pos):
+        raise svntest.Failure("Wrong length at offset %d" % header_end)
+    if pos != len(data):
+      raise svntest.Failure("Lengths run past the end of the dump")
+
+    # Otherwise, the dump is the same.
+    svntest.verify.compare_and_display_lines(
+      "Dump with lengths", "DUMP", plain_dump,
+      [line for line in dump if line not in lengths])
+
+  build_repos(sbox)
+  svntest.actions.run_and_verify_load(sbox.repo_dir, dump)
+
+def sorted_output_dump(sbox):
+  "dump: properties and deletions in sorted order"
+  sbox.build()
+  mu_path = os.path.join(sbox.wc_dir, 'A', 'mu')
+  for name in ['zeta', 'kappa', 'alpha', 'mu']:
+    svntest.actions.run_and_verify_svn(None, None, [], 'propset',
+                                       name, 'v', mu_path)
+  svntest.actions.run_and_verify_svn(None, None, [], 'commit',
+                                     '-m', 'props', sbox.wc_dir)
+  svntest.actions.run_and_verify_svn(None, None, [], 'rm',
+                                     os.path.join(sbox.wc_dir, 'A', 'D', 'H'),
+                                     os.path.join(sbox.wc_dir, 'A', 'D', 'G'),
+                                     os.path.join(sbox.wc_dir, 'A', 'D',
+                                                  'gamma'))
+  svntest.actions.run_and_verify_svn(None, None, [], 'commit',
+                                     '-m', 'rm', sbox.wc_dir)
+
+  dump = svnrdump_dump(sbox)
+  revision_2 = dump[dump.index('Revision-number: 2\n'):
+                    dump.index('Revision-number: 3\n')]
+  node = revision_2[revision_2.index('Node-path: A/mu\n'):]
+  names = [node[i + 1] for i in range(len(node)) if node[i].startswith('K ')]
+  if names != sorted(names) or len(names) != 4:
+    raise svntest.Failure("Properties not sorted: %s" % names)
+  revision_3 = dump[dump.index('Revision-number: 3\n'):]
+  deleted = [line for line in revision_3 if line.startswith('Node-path: ')]
+  if deleted != sorted(deleted) or len(deleted) != 3:
+    raise svntest.Failure("Deletions not sorted: %s" % deleted)
+
+  # A second dump is the same, byte for byte.
+  svntest.actions.run_and_verify_svnrdump(None, dump, [], 0, '-q', 'dump',
+                                          sbox.repo_url)
+
 ########################################################################
 # Run the tests
 
@@ -358,6 +944,30 @@ test_list = [ None,
               commit_a_copy_of_root_dump,
               commit_a_copy_of_root_load,
               Wimp("Issue 3641", descend_into_replace_dump),
+              spill_all_deltas_dump,
+              parallel_dump,
+              output_queue_dump,
+              resume_dump,
+              compressed_dump,
+              svndiff1_dump,
+              small_output_buffer_dump,
+              spill_to_file_dump,
+              output_file_dump,
+              filtered_dump,
+              split_dump,
+              tee_dump,
+              unbuffered_revisions_dump,
+              follow_dump,
+              dump_many,
+              plan_ranges,
+              no_content_dump,
+              revprops_only_dump,
+              base_snapshot_dump,
+              base_snapshot_changed_source_dump,
+              fulltext_dump,
+              dir_props_dump,
+              revision_length_dump,
+              sorted_output_dump,
              ]
 
 if __name__ == '__main__':
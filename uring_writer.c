@@ -0,0 +1,591 @@
+/*
+ *  uring_writer.c: Asynchronous output to a local file through Linux
+ *  io_uring.
+ *
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ */
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if defined(__NR_io_uring_setup) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+#include <apr_time.h>
+
+#include "svn_pools.h"
+#include "svn_io.h"
+#include "svn_path.h"
+#include "svn_dirent_uri.h"
+
+#include "svn17_compat.h"
+#include "uring_writer.h"
+
+#ifdef HAVE_IO_URING
+
+/* Buffers are aligned (and, with O_DIRECT, written in multiples of)
+   this many bytes, which satisfies the alignment O_DIRECT needs on
+   any common filesystem. */
+#define ALIGNMENT 4096
+
+/* One output buffer. */
+struct uring_buffer
+{
+  char *data;
+  apr_size_t len;
+
+  /* What is still to be written of a submitted buffer, and where. */
+  struct iovec iov;
+  apr_off_t offset;
+  svn_boolean_t in_flight;
+};
+
+/* The submission and completion rings shared with the kernel, as laid
+   out by io_uring_setup(2). */
+struct ring
+{
+  int fd;
+
+  void *sq_ptr;
+  size_t sq_len;
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  struct io_uring_sqe *sqes;
+  size_t sqes_len;
+
+  void *cq_ptr;
+  size_t cq_len;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  struct io_uring_cqe *cqes;
+};
+
+struct uring_writer
+{
+  int fd;
+  struct ring ring;
+
+  struct uring_buffer *buffers;
+  int depth;
+  apr_size_t buffer_size;
+
+  /* The buffer being filled, or NULL, and the number in flight. */
+  struct uring_buffer *current;
+  apr_uint32_t in_flight;
+
+  /* Where the next buffer goes, and how long the file really is;
+     with O_DIRECT, the last write may run past the end. */
+  apr_off_t next_offset;
+  apr_off_t size;
+
+  /* The first write error reported by the kernel. */
+  svn_error_t *err;
+
+  svn_boolean_t closed;
+  struct uring_writer_stats stats;
+};
+
+/* Set up RING with ENTRIES entries. */
+static svn_error_t *
+ring_setup(struct ring *ring,
+           unsigned entries)
+{
+  struct io_uring_params params;
+
+  memset(&params, 0, sizeof(params));
+  ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+  if (ring->fd < 0)
+    {
+      /* Old kernels, and sandboxes that filter the system call. */
+      if (errno == ENOSYS || errno == EPERM)
+        return svn_error_create(SVN_ERR_UNSUPPORTED_FEATURE, NULL,
+                                _("io_uring is not available"));
+      return svn_error_wrap_apr(apr_get_os_error(),
+                                _("Can't set up io_uring"));
+    }
+
+  ring->sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cq_len = params.cq_off.cqes
+                 + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+      if (ring->cq_len > ring->sq_len)
+        ring->sq_len = ring->cq_len;
+      ring->cq_len = 0;
+    }
+
+  ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd,
+                      IORING_OFF_SQ_RING);
+  if (ring->sq_ptr == MAP_FAILED)
+    goto failed;
+
+  if (ring->cq_len)
+    {
+      ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ring->fd,
+                          IORING_OFF_CQ_RING);
+      if (ring->cq_ptr == MAP_FAILED)
+        goto failed;
+    }
+  else
+    ring->cq_ptr = ring->sq_ptr;
+
+  ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED)
+    goto failed;
+
+  ring->sq_head = (unsigned *)((char *)ring->sq_ptr + params.sq_off.head);
+  ring->sq_tail = (unsigned *)((char *)ring->sq_ptr + params.sq_off.tail);
+  ring->sq_mask = (unsigned *)((char *)ring->sq_ptr
+                               + params.sq_off.ring_mask);
+  ring->sq_array = (unsigned *)((char *)ring->sq_ptr + params.sq_off.array);
+  ring->cq_head = (unsigned *)((char *)ring->cq_ptr + params.cq_off.head);
+  ring->cq_tail = (unsigned *)((char *)ring->cq_ptr + params.cq_off.tail);
+  ring->cq_mask = (unsigned *)((char *)ring->cq_ptr
+                               + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ptr
+                                       + params.cq_off.cqes);
+  return SVN_NO_ERROR;
+
+ failed:
+  {
+    apr_status_t status = apr_get_os_error();
+
+    if (ring->sq_ptr && ring->sq_ptr != MAP_FAILED)
+      munmap(ring->sq_ptr, ring->sq_len);
+    if (ring->cq_len && ring->cq_ptr && ring->cq_ptr != MAP_FAILED)
+      munmap(ring->cq_ptr, ring->cq_len);
+    close(ring->fd);
+    ring->fd = -1;
+    return svn_error_wrap_apr(status, _("Can't map io_uring"));
+  }
+}
+
+/* Release RING. */
+static void
+ring_destroy(struct ring *ring)
+{
+  if (ring->fd < 0)
+    return;
+
+  munmap(ring->sqes, ring->sqes_len);
+  if (ring->cq_len)
+    munmap(ring->cq_ptr, ring->cq_len);
+  munmap(ring->sq_ptr, ring->sq_len);
+  close(ring->fd);
+  ring->fd = -1;
+}
+
+/* Queue a write of BUFFER's remaining data on WRITER's ring and hand
+ * it to the kernel. */
+static svn_error_t *
+submit(struct uring_writer *writer,
+       struct uring_buffer *buffer)
+{
+  struct ring *ring = &writer->ring;
+  unsigned tail = *ring->sq_tail;
+  unsigned index = tail & *ring->sq_mask;
+  struct io_uring_sqe *sqe = &ring->sqes[index];
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_WRITEV;
+  sqe->fd = writer->fd;
+  sqe->addr = (unsigned long)&buffer->iov;
+  sqe->len = 1;
+  sqe->off = buffer->offset;
+  sqe->user_data = buffer - writer->buffers;
+  ring->sq_array[index] = index;
+
+  /* Publish the entry before the new tail. */
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  while (syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0) < 0)
+    if (errno != EINTR)
+      return svn_error_wrap_apr(apr_get_os_error(),
+                                _("Can't submit write"));
+
+  return SVN_NO_ERROR;
+}
+
+/* Reap the completed writes of WRITER.  If WAIT is TRUE, wait for at
+ * least one if none has completed yet. */
+static svn_error_t *
+reap(struct uring_writer *writer,
+     svn_boolean_t wait)
+{
+  struct ring *ring = &writer->ring;
+  unsigned head = *ring->cq_head;
+  unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+  if (head == tail && wait)
+    {
+      apr_time_t start = apr_time_now();
+
+      while (syscall(__NR_io_uring_enter, ring->fd, 0, 1,
+                     IORING_ENTER_GETEVENTS, NULL, 0) < 0)
+        if (errno != EINTR)
+          return svn_error_wrap_apr(apr_get_os_error(),
+                                    _("Can't wait for write"));
+
+      writer->stats.stall += apr_time_now() - start;
+      tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    }
+
+  for (; head != tail; head++)
+    {
+      struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+      struct uring_buffer *buffer = &writer->buffers[cqe->user_data];
+      int res = cqe->res;
+
+      if (res < 0 && ! writer->err)
+        writer->err = svn_error_wrap_apr(APR_FROM_OS_ERROR(-res),
+                                         _("Can't write to output file"));
+
+      /* Sending the rest again after a write that made no progress
+         could go on forever. */
+      if (res == 0 && buffer->iov.iov_len && ! writer->err)
+        writer->err = svn_error_create(SVN_ERR_IO_WRITE_ERROR, NULL,
+                                       _("Can't write to output file: "
+                                         "no data was written"));
+
+      if (res > 0 && (size_t)res < buffer->iov.iov_len && ! writer->err)
+        {
+          /* Short write; send the rest after it. */
+          buffer->iov.iov_base = (char *)buffer->iov.iov_base + res;
+          buffer->iov.iov_len -= res;
+          buffer->offset += res;
+          SVN_ERR(submit(writer, buffer));
+          continue;
+        }
+
+      buffer->in_flight = FALSE;
+      writer->in_flight--;
+    }
+  __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+  return SVN_NO_ERROR;
+}
+
+/* Submit the buffer WRITER is filling, padding it to ALIGNMENT with
+ * zeros if PAD is TRUE. */
+static svn_error_t *
+submit_current(struct uring_writer *writer,
+               svn_boolean_t pad)
+{
+  struct uring_buffer *buffer = writer->current;
+  apr_size_t len = buffer->len;
+
+  if (pad && len % ALIGNMENT)
+    {
+      apr_size_t padded = len + ALIGNMENT - len % ALIGNMENT;
+
+      memset(buffer->data + len, 0, padded - len);
+      len = padded;
+    }
+
+  buffer->iov.iov_base = buffer->data;
+  buffer->iov.iov_len = len;
+  buffer->offset = writer->next_offset;
+  buffer->in_flight = TRUE;
+  writer->current = NULL;
+
+  writer->next_offset += len;
+  writer->in_flight++;
+  if (writer->in_flight > writer->stats.high_water)
+    writer->stats.high_water = writer->in_flight;
+  writer->stats.writes++;
+  writer->stats.bytes += buffer->len;
+
+  return submit(writer, buffer);
+}
+
+/* Make a free buffer of WRITER current, waiting for one if necessary. */
+static svn_error_t *
+claim_buffer(struct uring_writer *writer)
+{
+  while (1)
+    {
+      int i;
+
+      SVN_ERR(writer->err ? svn_error_dup(writer->err) : SVN_NO_ERROR);
+
+      for (i = 0; i < writer->depth; i++)
+        if (! writer->buffers[i].in_flight)
+          {
+            writer->current = &writer->buffers[i];
+            writer->current->len = 0;
+            return SVN_NO_ERROR;
+          }
+
+      SVN_ERR(reap(writer, TRUE));
+    }
+}
+
+/* Implements svn_write_fn_t for uring_writer_stream(). */
+static svn_error_t *
+write_handler(void *baton,
+              const char *data,
+              apr_size_t *len)
+{
+  struct uring_writer *writer = baton;
+  apr_size_t remaining = *len;
+
+  while (remaining)
+    {
+      struct uring_buffer *buffer;
+      apr_size_t chunk;
+
+      if (! writer->current)
+        SVN_ERR(claim_buffer(writer));
+
+      buffer = writer->current;
+      chunk = writer->buffer_size - buffer->len;
+      if (chunk > remaining)
+        chunk = remaining;
+
+      memcpy(buffer->data + buffer->len, data, chunk);
+      buffer->len += chunk;
+      writer->size += chunk;
+      data += chunk;
+      remaining -= chunk;
+
+      if (buffer->len == writer->buffer_size)
+        {
+          SVN_ERR(submit_current(writer, FALSE));
+
+          /* Pick up finished writes, without waiting for any. */
+          SVN_ERR(reap(writer, FALSE));
+        }
+    }
+
+  return SVN_NO_ERROR;
+}
+
+/* Close the file and the ring of WRITER, if still open. */
+static apr_status_t
+cleanup_writer(void *baton)
+{
+  struct uring_writer *writer = baton;
+
+  ring_destroy(&writer->ring);
+  if (writer->fd >= 0)
+    close(writer->fd);
+  writer->fd = -1;
+  return APR_SUCCESS;
+}
+
+/* Implements svn_close_fn_t for uring_writer_stream(). */
+static svn_error_t *
+close_handler(void *baton)
+{
+  struct uring_writer *writer = baton;
+  svn_error_t *err = SVN_NO_ERROR;
+
+  if (writer->closed)
+    return SVN_NO_ERROR;
+  writer->closed = TRUE;
+
+  if (writer->current && writer->current->len)
+    err = submit_current(writer, writer->stats.direct);
+  while (! err && writer->in_flight)
+    err = reap(writer, TRUE);
+  if (! err && writer->err)
+    err = svn_error_dup(writer->err);
+
+  /* Drop the padding of the last O_DIRECT write. */
+  if (! err && writer->next_offset != writer->size
+      && ftruncate(writer->fd, writer->size) < 0)
+    err = svn_error_wrap_apr(apr_get_os_error(),
+                             _("Can't truncate output file"));
+
+  /* Buffers may still be in flight after an error; the kernel must
+     be done with them before they are freed. */
+  while (err && writer->in_flight)
+    {
+      svn_error_t *reap_err = reap(writer, TRUE);
+
+      if (reap_err)
+        {
+          /* Closing the ring below cancels what is left. */
+          svn_error_clear(reap_err);
+          break;
+        }
+    }
+
+  if (! err && close(writer->fd) < 0)
+    err = svn_error_wrap_apr(apr_get_os_error(),
+                             _("Can't close output file"));
+  else if (err)
+    close(writer->fd);
+  writer->fd = -1;
+  ring_destroy(&writer->ring);
+
+  svn_error_clear(writer->err);
+  writer->err = SVN_NO_ERROR;
+  return err;
+}
+
+svn_error_t *
+uring_writer_create(struct uring_writer **writer,
+                    const char *path,
+                    svn_boolean_t direct,
+                    apr_off_t preallocate,
+                    apr_size_t buffer_size,
+                    int depth,
+                    apr_pool_t *pool)
+{
+  struct uring_writer *new_writer = apr_pcalloc(pool, sizeof(*new_writer));
+  const char *path_apr;
+  int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+  int i;
+
+  SVN_ERR_ASSERT(buffer_size > 0 && depth > 0);
+
+  new_writer->fd = -1;
+  new_writer->ring.fd = -1;
+  SVN_ERR(ring_setup(&new_writer->ring, depth));
+  apr_pool_cleanup_register(pool, new_writer, cleanup_writer,
+                            apr_pool_cleanup_null);
+
+  SVN_ERR(svn_path_cstring_from_utf8(&path_apr, path, pool));
+  if (direct)
+    {
+      new_writer->fd = open(path_apr, flags | O_DIRECT, 0666);
+
+      /* tmpfs and friends refuse O_DIRECT; fall back to buffered. */
+      new_writer->stats.direct = (new_writer->fd >= 0);
+    }
+  if (new_writer->fd < 0)
+    new_writer->fd = open(path_apr, flags, 0666);
+  if (new_writer->fd < 0)
+    return svn_error_wrap_apr(apr_get_os_error(), _("Can't open '%s'"),
+                              svn_dirent_local_style(path, pool));
+
+  if (preallocate > 0
+      && fallocate(new_writer->fd, FALLOC_FL_KEEP_SIZE, 0, preallocate) < 0
+      && errno != EOPNOTSUPP && errno != ENOSYS)
+    return svn_error_wrap_apr(apr_get_os_error(),
+                              _("Can't preallocate '%s'"),
+                              svn_dirent_local_style(path, pool));
+
+  new_writer->depth = depth;
+  new_writer->buffer_size = (buffer_size + ALIGNMENT - 1)
+                            / ALIGNMENT * ALIGNMENT;
+  new_writer->buffers = apr_pcalloc(pool,
+                                    depth * sizeof(*new_writer->buffers));
+  for (i = 0; i < depth; i++)
+    {
+      /* Over-allocate so that the buffers can be aligned. */
+      char *block = apr_palloc(pool, new_writer->buffer_size + ALIGNMENT);
+
+      new_writer->buffers[i].data =
+        (char *)(((apr_uintptr_t)block + ALIGNMENT - 1)
+                 & ~(apr_uintptr_t)(ALIGNMENT - 1));
+    }
+
+  *writer = new_writer;
+  return SVN_NO_ERROR;
+}
+
+svn_error_t *
+uring_writer_flush(struct uring_writer *writer)
+{
+  if (writer->err)
+    return svn_error_dup(writer->err);
+
+  if (! writer->stats.direct && writer->current && writer->current->len)
+    SVN_ERR(submit_current(writer, FALSE));
+
+  return reap(writer, FALSE);
+}
+
+#else /* ! HAVE_IO_URING */
+
+struct uring_writer
+{
+  struct uring_writer_stats stats;
+};
+
+svn_error_t *
+uring_writer_create(struct uring_writer **writer,
+                    const char *path,
+                    svn_boolean_t direct,
+                    apr_off_t preallocate,
+                    apr_size_t buffer_size,
+                    int depth,
+                    apr_pool_t *pool)
+{
+  return svn_error_create(SVN_ERR_UNSUPPORTED_FEATURE, NULL,
+                          _("io_uring is not available"));
+}
+
+static svn_error_t *
+write_handler(void *baton,
+              const char *data,
+              apr_size_t *len)
+{
+  return SVN_NO_ERROR;
+}
+
+static svn_error_t *
+close_handler(void *baton)
+{
+  return SVN_NO_ERROR;
+}
+
+svn_error_t *
+uring_writer_flush(struct uring_writer *writer)
+{
+  return SVN_NO_ERROR;
+}
+
+#endif /* HAVE_IO_URING */
+
+svn_stream_t *
+uring_writer_stream(struct uring_writer *writer,
+                    apr_pool_t *pool)
+{
+  svn_stream_t *stream = svn_stream_create(writer, pool);
+
+  svn_stream_set_write(stream, write_handler);
+  svn_stream_set_close(stream, close_handler);
+  return stream;
+}
+
+const struct uring_writer_stats *
+uring_writer_get_stats(const struct uring_writer *writer)
+{
+  return &writer->stats;
+}
@@ -0,0 +1,106 @@
+/**
+ * @copyright
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ * @endcopyright
+ *
+ * @file uring_writer.h
+ * @brief Asynchronous output to a local file through Linux io_uring.
+ */
+
+#ifndef URING_WRITER_H_
+#define URING_WRITER_H_
+
+/** The default number of writes kept in flight. */
+#define URING_WRITER_DEFAULT_DEPTH 8
+
+/**
+ * Counters describing how a uring writer was used.  The wait time is
+ * in microseconds.
+ */
+struct uring_writer_stats
+{
+  /* writes submitted, the bytes they carried, and the most ever in
+     flight at once */
+  apr_uint64_t writes;
+  apr_uint64_t bytes;
+  apr_uint32_t high_water;
+
+  /* whether the file was opened with O_DIRECT */
+  svn_boolean_t direct;
+
+  /* time spent waiting for a buffer to come back from the kernel */
+  apr_time_t stall;
+};
+
+/**
+ * An opaque uring writer.
+ */
+struct uring_writer;
+
+/**
+ * Create (or truncate) the file @a path and set @a *writer to a writer
+ * filling it through io_uring, allocated in @a pool.  Output is
+ * collected in @a depth buffers of @a buffer_size bytes (rounded up
+ * to the page size), each submitted as one write as soon as it is
+ * full, so that up to @a depth writes are in flight and the caller
+ * only waits for the disk when all of them are.
+ *
+ * If @a direct is TRUE, try to open the file with O_DIRECT to bypass
+ * the page cache; filesystems which don't support that get buffered
+ * I/O.  If @a preallocate is not zero, reserve that many bytes for
+ * the file up front (without changing its size).
+ *
+ * Return an SVN_ERR_UNSUPPORTED_FEATURE error if io_uring is not
+ * available on this system.
+ */
+svn_error_t *
+uring_writer_create(struct uring_writer **writer,
+                    const char *path,
+                    svn_boolean_t direct,
+                    apr_off_t preallocate,
+                    apr_size_t buffer_size,
+                    int depth,
+                    apr_pool_t *pool);
+
+/**
+ * Return a writable stream, allocated in @a pool, feeding @a writer.
+ * Closing it writes out what is left, waits for all writes to
+ * complete and closes the file.  The stream must only be used by one
+ * thread.
+ */
+svn_stream_t *
+uring_writer_stream(struct uring_writer *writer,
+                    apr_pool_t *pool);
+
+/**
+ * Submit the partially filled buffer of @a writer, if any.  Without
+ * O_DIRECT this makes everything written so far reach the kernel;
+ * with O_DIRECT, where writes have to stay aligned, it does nothing.
+ */
+svn_error_t *
+uring_writer_flush(struct uring_writer *writer);
+
+/**
+ * Return the counters of @a writer.
+ */
+const struct uring_writer_stats *
+uring_writer_get_stats(const struct uring_writer *writer);
+
+#endif
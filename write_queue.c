@@ -0,0 +1,392 @@
+/*
+ *  write_queue.c: A bounded queue of output buffers drained by a
+ *  dedicated writer thread.
+ *
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ */
+
+#include <apr_thread_proc.h>
+#include <apr_thread_mutex.h>
+#include <apr_thread_cond.h>
+#include <apr_time.h>
+
+#include "svn_pools.h"
+#include "svn_io.h"
+
+#include "svn17_compat.h"
+#include "write_queue.h"
+
+/* The indexes and flags shared by the producer and the writer are
+   accessed with sequentially consistent atomics.  That orders the
+   contents of a slot before the index publishing or releasing it.  It
+   also means that a side deciding to wait, which sets its flag and
+   then looks at the queue, and the other side, which updates the
+   queue and then looks at the flag, can't both miss each other's
+   store; see wake(). */
+#define ATOMIC_LOAD(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define ATOMIC_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+
+/* One buffer of the queue. */
+struct queue_slot
+{
+  char *data;
+  apr_size_t len;
+};
+
+/* The queue is a ring of DEPTH slots shared by exactly one producer
+ * and one consumer (the writer thread).  TAIL counts the buffers
+ * published by the producer, HEAD those written by the writer; both
+ * only ever increase (modulo 2^32), so TAIL - HEAD is the number of
+ * buffers in flight.  The producer fills the slot at TAIL before
+ * publishing it, the writer drains the slot at HEAD before releasing
+ * it.  Each index is only modified by its owner, which is what makes
+ * the fast path lock-free; the mutex and condition are only used by a
+ * side that has to wait. */
+struct write_queue
+{
+  struct queue_slot *slots;
+  apr_uint32_t depth;
+  apr_size_t buffer_size;
+
+  apr_uint32_t tail;
+  apr_uint32_t head;
+
+  /* Whether the producer holds the slot at TAIL for filling. */
+  svn_boolean_t filling;
+
+  /* Flags: the producer has no more data; the writer failed; either
+     side is blocked on COND. */
+  apr_uint32_t closing;
+  apr_uint32_t failed;
+  apr_uint32_t producer_waiting;
+  apr_uint32_t writer_waiting;
+
+  apr_thread_mutex_t *mutex;
+  apr_thread_cond_t *cond;
+  apr_thread_t *thread;
+  svn_boolean_t closed;
+
+  /* Where the writer writes to, and the error it ran into, if any.
+     ERR is only read by the producer after FAILED is set. */
+  svn_stream_t *target;
+  svn_error_t *err;
+
+  struct write_queue_stats stats;
+};
+
+/* Wake up the other side of QUEUE if WAITING says it is blocked.  The
+ * caller has just updated the queue.  A side only blocks after setting
+ * its flag and then finding nothing to do, with the mutex held until
+ * it waits; so either it sees the update, or we see its flag and
+ * broadcast once it is waiting. */
+static void
+wake(struct write_queue *queue,
+     apr_uint32_t *waiting)
+{
+  if (ATOMIC_LOAD(waiting))
+    {
+      apr_thread_mutex_lock(queue->mutex);
+      apr_thread_cond_broadcast(queue->cond);
+      apr_thread_mutex_unlock(queue->mutex);
+    }
+}
+
+/* Return TRUE if the producer of QUEUE can claim a free slot. */
+static svn_boolean_t
+slot_available(struct write_queue *queue)
+{
+  return queue->tail - ATOMIC_LOAD(&queue->head) < queue->depth;
+}
+
+/* Return TRUE if the writer of QUEUE has a published slot to drain. */
+static svn_boolean_t
+slot_published(struct write_queue *queue)
+{
+  return ATOMIC_LOAD(&queue->tail) != queue->head;
+}
+
+/* Return the error to hand to the producer of the failed QUEUE. */
+static svn_error_t *
+writer_error(struct write_queue *queue)
+{
+  svn_error_t *err = queue->err;
+
+  if (err)
+    {
+      /* Hand over the original error once, a generic one after. */
+      queue->err = SVN_NO_ERROR;
+      return err;
+    }
+  return svn_error_create(SVN_ERR_IO_WRITE_ERROR, NULL,
+                          _("Output writer failed"));
+}
+
+/* Make the slot the producer of QUEUE has been filling available to
+ * the writer. */
+static void
+publish(struct write_queue *queue)
+{
+  struct queue_slot *slot = &queue->slots[queue->tail % queue->depth];
+  apr_uint32_t in_flight;
+
+  queue->stats.buffers++;
+  queue->stats.bytes += slot->len;
+
+  ATOMIC_STORE(&queue->tail, queue->tail + 1);
+  queue->filling = FALSE;
+
+  in_flight = queue->tail - ATOMIC_LOAD(&queue->head);
+  if (in_flight > queue->stats.high_water)
+    queue->stats.high_water = in_flight;
+
+  wake(queue, &queue->writer_waiting);
+}
+
+/* Claim the slot at TAIL for the producer of QUEUE, waiting for the
+ * writer to free it if necessary. */
+static svn_error_t *
+claim_slot(struct write_queue *queue)
+{
+  if (! slot_available(queue) && ! ATOMIC_LOAD(&queue->failed))
+    {
+      apr_time_t start = apr_time_now();
+
+      apr_thread_mutex_lock(queue->mutex);
+      ATOMIC_STORE(&queue->producer_waiting, 1);
+      while (! slot_available(queue) && ! ATOMIC_LOAD(&queue->failed))
+        apr_thread_cond_wait(queue->cond, queue->mutex);
+      ATOMIC_STORE(&queue->producer_waiting, 0);
+      apr_thread_mutex_unlock(queue->mutex);
+
+      queue->stats.producer_stall += apr_time_now() - start;
+    }
+
+  if (ATOMIC_LOAD(&queue->failed))
+    return writer_error(queue);
+
+  queue->slots[queue->tail % queue->depth].len = 0;
+  queue->filling = TRUE;
+  return SVN_NO_ERROR;
+}
+
+/* Implements svn_write_fn_t for write_queue_stream(). */
+static svn_error_t *
+write_handler(void *baton,
+              const char *data,
+              apr_size_t *len)
+{
+  struct write_queue *queue = baton;
+  apr_size_t remaining = *len;
+
+  if (queue->closed)
+    return svn_error_create(SVN_ERR_IO_WRITE_ERROR, NULL,
+                            _("Write to a closed output queue"));
+
+  while (remaining)
+    {
+      struct queue_slot *slot;
+      apr_size_t chunk;
+
+      if (! queue->filling)
+        SVN_ERR(claim_slot(queue));
+
+      slot = &queue->slots[queue->tail % queue->depth];
+      chunk = queue->buffer_size - slot->len;
+      if (chunk > remaining)
+        chunk = remaining;
+
+      memcpy(slot->data + slot->len, data, chunk);
+      slot->len += chunk;
+      data += chunk;
+      remaining -= chunk;
+
+      if (slot->len == queue->buffer_size)
+        publish(queue);
+    }
+
+  return SVN_NO_ERROR;
+}
+
+/* Implements svn_close_fn_t for write_queue_stream(). */
+static svn_error_t *
+close_handler(void *baton)
+{
+  return write_queue_close(baton);
+}
+
+#if APR_HAS_THREADS
+/* Thread body of the writer.  DATA is the write queue. */
+static void * APR_THREAD_FUNC
+writer_thread(apr_thread_t *tid,
+              void *data)
+{
+  struct write_queue *queue = data;
+
+  while (1)
+    {
+      struct queue_slot *slot;
+      apr_size_t len;
+      svn_error_t *err;
+
+      if (! slot_published(queue))
+        {
+          apr_time_t start;
+
+          if (ATOMIC_LOAD(&queue->closing) && ! slot_published(queue))
+            break;
+
+          start = apr_time_now();
+          apr_thread_mutex_lock(queue->mutex);
+          ATOMIC_STORE(&queue->writer_waiting, 1);
+          while (! slot_published(queue)
+                 && ! ATOMIC_LOAD(&queue->closing))
+            apr_thread_cond_wait(queue->cond, queue->mutex);
+          ATOMIC_STORE(&queue->writer_waiting, 0);
+          apr_thread_mutex_unlock(queue->mutex);
+          queue->stats.writer_stall += apr_time_now() - start;
+          continue;
+        }
+
+      slot = &queue->slots[queue->head % queue->depth];
+      len = slot->len;
+      err = svn_stream_write(queue->target, slot->data, &len);
+      if (err)
+        {
+          queue->err = err;
+          ATOMIC_STORE(&queue->failed, 1);
+          wake(queue, &queue->producer_waiting);
+          break;
+        }
+
+      ATOMIC_STORE(&queue->head, queue->head + 1);
+      wake(queue, &queue->producer_waiting);
+    }
+
+  if (! ATOMIC_LOAD(&queue->failed))
+    queue->err = svn_stream_close(queue->target);
+
+  apr_thread_exit(tid, APR_SUCCESS);
+  return NULL;
+}
+#endif
+
+svn_error_t *
+write_queue_create(struct write_queue **queue,
+                   svn_stream_t *target,
+                   apr_size_t buffer_size,
+                   int depth,
+                   apr_pool_t *pool)
+{
+#if APR_HAS_THREADS
+  struct write_queue *new_queue = apr_pcalloc(pool, sizeof(*new_queue));
+  apr_status_t status;
+  int i;
+
+  SVN_ERR_ASSERT(buffer_size > 0 && depth > 0);
+
+  new_queue->depth = depth;
+  new_queue->buffer_size = buffer_size;
+  new_queue->target = target;
+  new_queue->stats.depth = depth;
+  new_queue->slots = apr_pcalloc(pool, depth * sizeof(*new_queue->slots));
+  for (i = 0; i < depth; i++)
+    new_queue->slots[i].data = apr_palloc(pool, buffer_size);
+
+  status = apr_thread_mutex_create(&new_queue->mutex,
+                                   APR_THREAD_MUTEX_DEFAULT, pool);
+  if (! status)
+    status = apr_thread_cond_create(&new_queue->cond, pool);
+  if (! status)
+    status = apr_thread_create(&new_queue->thread, NULL, writer_thread,
+                               new_queue, pool);
+  if (status)
+    return svn_error_wrap_apr(status, _("Can't start output writer thread"));
+
+  *queue = new_queue;
+  return SVN_NO_ERROR;
+#else
+  return svn_error_create(SVN_ERR_UNSUPPORTED_FEATURE, NULL,
+                          _("An output queue requires thread support"));
+#endif
+}
+
+svn_stream_t *
+write_queue_stream(struct write_queue *queue,
+                   apr_pool_t *pool)
+{
+  svn_stream_t *stream = svn_stream_create(queue, pool);
+
+  svn_stream_set_write(stream, write_handler);
+  svn_stream_set_close(stream, close_handler);
+  return stream;
+}
+
+svn_error_t *
+write_queue_flush(struct write_queue *queue)
+{
+  if (ATOMIC_LOAD(&queue->failed))
+    return writer_error(queue);
+
+  if (queue->filling && queue->slots[queue->tail % queue->depth].len)
+    publish(queue);
+
+  return SVN_NO_ERROR;
+}
+
+svn_error_t *
+write_queue_close(struct write_queue *queue)
+{
+  svn_error_t *err;
+
+  if (queue->closed)
+    return SVN_NO_ERROR;
+  queue->closed = TRUE;
+
+  err = write_queue_flush(queue);
+
+  ATOMIC_STORE(&queue->closing, 1);
+  apr_thread_mutex_lock(queue->mutex);
+  apr_thread_cond_broadcast(queue->cond);
+  apr_thread_mutex_unlock(queue->mutex);
+
+#if APR_HAS_THREADS
+  {
+    apr_status_t retval;
+    apr_thread_join(&retval, queue->thread);
+  }
+#endif
+
+  if (err)
+    {
+      svn_error_clear(queue->err);
+      queue->err = SVN_NO_ERROR;
+      return err;
+    }
+
+  err = queue->err;
+  queue->err = SVN_NO_ERROR;
+  return err;
+}
+
+const struct write_queue_stats *
+write_queue_get_stats(const struct write_queue *queue)
+{
+  return &queue->stats;
+}
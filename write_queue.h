@@ -0,0 +1,108 @@
+/**
+ * @copyright
+ * ====================================================================
+ *    Licensed to the Apache Software Foundation (ASF) under one
+ *    or more contributor license agreements.  See the NOTICE file
+ *    distributed with this work for additional information
+ *    regarding copyright ownership.  The ASF licenses this file
+ *    to you under the Apache License, Version 2.0 (the
+ *    "License"); you may not use this file except in compliance
+ *    with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing,
+ *    software distributed under the License is distributed on an
+ *    "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *    KIND, either express or implied.  See the License for the
+ *    specific language governing permissions and limitations
+ *    under the License.
+ * ====================================================================
+ * @endcopyright
+ *
+ * @file write_queue.h
+ * @brief A bounded queue of output buffers drained by a dedicated
+ * writer thread, decoupling the producer of a dumpstream from its
+ * consumer.
+ */
+
+#ifndef WRITE_QUEUE_H_
+#define WRITE_QUEUE_H_
+
+/** The default size of each buffer in the queue: 256 KiB. */
+#define WRITE_QUEUE_DEFAULT_BUFFER_SIZE (256 * 1024)
+
+/**
+ * Counters describing how a write queue was used.  Stall times are
+ * in microseconds.
+ */
+struct write_queue_stats
+{
+  /* number of buffers in the queue, and the most ever filled at once */
+  apr_uint32_t depth;
+  apr_uint32_t high_water;
+
+  /* buffers and bytes handed to the writer thread */
+  apr_uint64_t buffers;
+  apr_uint64_t bytes;
+
+  /* time the producer spent waiting for a free buffer, i.e. for the
+     output, and time the writer spent waiting for a full one, i.e.
+     for the input */
+  apr_time_t producer_stall;
+  apr_time_t writer_stall;
+};
+
+/**
+ * An opaque write queue.
+ */
+struct write_queue;
+
+/**
+ * Create a write queue @a *queue of @a depth buffers of @a
+ * buffer_size bytes each, and start a writer thread that copies
+ * completed buffers to @a target.  @a target is only ever written to
+ * and closed from that thread.  Allocate the queue in @a pool.
+ *
+ * The queue is lock-free as long as neither side has to wait for the
+ * other.
+ */
+svn_error_t *
+write_queue_create(struct write_queue **queue,
+                   svn_stream_t *target,
+                   apr_size_t buffer_size,
+                   int depth,
+                   apr_pool_t *pool);
+
+/**
+ * Return a writable stream, allocated in @a pool, that fills buffers
+ * of @a queue.  Closing the stream is equivalent to calling
+ * write_queue_close().  The stream must only be used by one thread.
+ */
+svn_stream_t *
+write_queue_stream(struct write_queue *queue,
+                   apr_pool_t *pool);
+
+/**
+ * Hand the partly filled current buffer of @a queue, if any, to the
+ * writer thread without waiting for it to be written.
+ */
+svn_error_t *
+write_queue_flush(struct write_queue *queue);
+
+/**
+ * Flush @a queue, wait for the writer thread to write out everything
+ * and close the target stream.  Return the first error the writer
+ * thread encountered, if any.  Calling this more than once is
+ * harmless.
+ */
+svn_error_t *
+write_queue_close(struct write_queue *queue);
+
+/**
+ * Return the counters of @a queue.
+ */
+const struct write_queue_stats *
+write_queue_get_stats(const struct write_queue *queue);
+
+#endif